@@ -36,6 +36,7 @@
 #include <QtCore/QTimer>
 
 #include <Logging.h>
+#include <Metrics.h>
 #include <NodeList.h>
 #include <Node.h>
 #include <PacketHeaders.h>
@@ -351,7 +352,11 @@ void AudioMixer::run() {
     char* clientMixBuffer = new char[NETWORK_BUFFER_LENGTH_BYTES_STEREO
                                      + numBytesForPacketHeaderGivenPacketType(PacketTypeMixedAudio)];
 
+    static Metric mixTime(STAT_TYPE_TIMER, "audio-mixer-mix-usecs");
+    static Metric lateFrames(STAT_TYPE_COUNTER, "audio-mixer-late-frames");
+
     while (!_isFinished) {
+        quint64 mixStart = usecTimestampNow();
 
         foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
             if (node->getLinkedData()) {
@@ -377,6 +382,7 @@ void AudioMixer::run() {
                 ((AudioMixerClientData*) node->getLinkedData())->pushBuffersAfterFrameSend();
             }
         }
+        mixTime.update(usecTimestampNow() - mixStart);
         
         QCoreApplication::processEvents();
         
@@ -390,6 +396,7 @@ void AudioMixer::run() {
             usleep(usecToSleep);
         } else {
             qDebug() << "AudioMixer loop took" << -usecToSleep << "of extra time. Not sleeping.";
+            lateFrames.update(1.0f);
         }
 
     }
@@ -15,6 +15,7 @@
 #include <QtCore/QTimer>
 
 #include <Logging.h>
+#include <Metrics.h>
 #include <NodeList.h>
 #include <PacketHeaders.h>
 #include <SharedUtil.h>
@@ -263,6 +264,9 @@ void AvatarMixer::run() {
     QElapsedTimer billboardTimer;
     billboardTimer.start();
     
+    static Metric broadcastTime(STAT_TYPE_TIMER, "avatar-mixer-broadcast-usecs");
+    static Metric lateFrames(STAT_TYPE_COUNTER, "avatar-mixer-late-frames");
+    
     while (!_isFinished) {
         
         QCoreApplication::processEvents();
@@ -271,7 +275,9 @@ void AvatarMixer::run() {
             break;
         }
         
+        quint64 broadcastStart = usecTimestampNow();
         broadcastAvatarData();
+        broadcastTime.update(usecTimestampNow() - broadcastStart);
         
         if (identityTimer.elapsed() >= AVATAR_IDENTITY_KEYFRAME_MSECS) {
             // it's time to broadcast the keyframe identity packets
@@ -292,6 +298,7 @@ void AvatarMixer::run() {
             usleep(usecToSleep);
         } else {
             qDebug() << "AvatarMixer loop took too" << -usecToSleep << "of extra time. Won't sleep.";
+            lateFrames.update(1.0f);
         }
     }
 }
@@ -7,8 +7,12 @@
 //
 
 #include <QDateTime>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 
 #include <PacketHeaders.h>
+#include <SharedUtil.h>
 
 #include <MetavoxelMessages.h>
 #include <MetavoxelUtil.h>
@@ -17,15 +21,32 @@
 
 const int SEND_INTERVAL = 50;
 
+/// The interval at which paced datagrams are released, in milliseconds.
+const int PACING_INTERVAL = 5;
+
+const int FRAME_REPORT_INTERVAL = 10000;
+
 MetavoxelServer::MetavoxelServer(const QByteArray& packet) :
-    ThreadedAssignment(packet) {
+    ThreadedAssignment(packet),
+    _lastFrameReport(0),
+    _framesSinceReport(0),
+    _frameTimeSinceReport(0),
+    _maxFrameTimeSinceReport(0),
+    _deltasSinceReport(0),
+    _deltasDeferredSinceReport(0),
+    _deltaCopiesSinceReport(0),
+    _deltaTimeSavedSinceReport(0),
+    _editsSinceReport(0),
+    _editUpdatesSinceReport(0) {
     
     _sendTimer.setSingleShot(true);
     connect(&_sendTimer, SIGNAL(timeout()), SLOT(sendDeltas()));
+    
+    connect(&_pacingTimer, SIGNAL(timeout()), SLOT(sendPacedDatagrams()));
 }
 
 void MetavoxelServer::applyEdit(const MetavoxelEditMessage& edit) {
-    edit.apply(_data, SharedObject::getWeakHash());
+    _edits.append(edit);
 }
 
 const QString METAVOXEL_SERVER_LOGGING_NAME = "metavoxel-server";
@@ -38,8 +59,9 @@ void MetavoxelServer::run() {
     
     connect(nodeList, SIGNAL(nodeAdded(SharedNodePointer)), SLOT(maybeAttachSession(const SharedNodePointer&)));
     
-    _lastSend = QDateTime::currentMSecsSinceEpoch();
+    _lastSend = _lastFrameReport = QDateTime::currentMSecsSinceEpoch();
     _sendTimer.start(SEND_INTERVAL);
+    _pacingTimer.start(PACING_INTERVAL);
 }
 
 void MetavoxelServer::readPendingDatagrams() {
@@ -70,13 +92,90 @@ void MetavoxelServer::maybeAttachSession(const SharedNodePointer& node) {
     }
 }
 
+/// Sends one delta to the sessions that share it, on the global thread pool.
+class MetavoxelDeltaTask : public QRunnable {
+public:
+    
+    MetavoxelDeltaTask(MetavoxelDelta* delta, const QVector<MetavoxelSession*>& sessions, QSemaphore* finished) :
+        _delta(delta), _sessions(sessions), _finished(finished) { }
+    
+    virtual void run() {
+        foreach (MetavoxelSession* session, _sessions) {
+            session->sendDelta(*_delta);
+        }
+        _finished->release();
+    }
+
+private:
+    
+    MetavoxelDelta* _delta;
+    QVector<MetavoxelSession*> _sessions;
+    QSemaphore* _finished;
+};
+
 void MetavoxelServer::sendDeltas() {
-    // send deltas for all sessions
+    quint64 start = usecTimestampNow();
+    
+    // apply the edits received since the last send all at once, so that we create one new version of the data
+    if (!_edits.isEmpty()) {
+        _editsSinceReport += _edits.getEditCount();
+        _editUpdatesSinceReport += _edits.apply(_data, SharedObject::getWeakHash());
+    }
+    
+    // group the sessions by the delta they need from the current snapshot; those that last acknowledged the same state
+    // and are at the same LOD need the same one
+    MetavoxelData snapshot = _data;
+    QVector<MetavoxelDelta*> deltas;
+    QVector<QVector<MetavoxelSession*> > deltaSessions;
+    int sessionCount = 0;
     foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
-        if (node->getType() == NodeType::Agent) {
-            static_cast<MetavoxelSession*>(node->getLinkedData())->sendDelta();
+        if (node->getType() != NodeType::Agent || !node->getLinkedData()) {
+            continue;
+        }
+        MetavoxelSession* session = static_cast<MetavoxelSession*>(node->getLinkedData());
+        if (!session->getLOD().isValid()) {
+            continue; // wait until we have a valid lod
+        }
+        sessionCount++;
+        if (session->getSendBudget() <= 0) {
+            // the congestion window is full; the delta can wait for the next frame, when it'll be the more up-to-date
+            _deltasDeferredSinceReport++;
+            continue;
+        }
+        MetavoxelLOD lod = session->getSendLOD();
+        int i = 0;
+        while (i < deltas.size() && !deltas.at(i)->isFrom(session->getReferenceData(),
+                session->getReferenceLOD(), lod)) {
+            i++;
         }
+        if (i == deltas.size()) {
+            deltas.append(new MetavoxelDelta(snapshot, session->getReferenceData(),
+                session->getReferenceLOD(), lod));
+            deltaSessions.append(QVector<MetavoxelSession*>());
+        }
+        deltaSessions[i].append(session);
+    }
+    
+    // each delta gets its own task, so no session's sequencer is used by two threads at once
+    QSemaphore finished;
+    for (int i = 0; i < deltas.size(); i++) {
+        QThreadPool::globalInstance()->start(new MetavoxelDeltaTask(deltas.at(i), deltaSessions.at(i), &finished));
+    }
+    finished.acquire(deltas.size());
+    
+    // the socket belongs to this thread, so the datagrams go out from here as the pacer releases them
+    sendPacedDatagrams();
+    for (int i = 0; i < deltas.size(); i++) {
+        _deltasSinceReport += deltas.at(i)->getWrites();
+        _deltaCopiesSinceReport += deltas.at(i)->getCopies();
+        _deltaTimeSavedSinceReport += deltas.at(i)->getTimeSaved();
     }
+    qDeleteAll(deltas);
+    
+    quint64 frameTime = usecTimestampNow() - start;
+    _framesSinceReport++;
+    _frameTimeSinceReport += frameTime;
+    _maxFrameTimeSinceReport = qMax(_maxFrameTimeSinceReport, frameTime);
     
     // restart the send timer
     qint64 now = QDateTime::currentMSecsSinceEpoch();
@@ -84,6 +183,34 @@ void MetavoxelServer::sendDeltas() {
     _lastSend = now;
     
     _sendTimer.start(qMax(0, 2 * SEND_INTERVAL - elapsed));
+    
+    if (now - _lastFrameReport >= FRAME_REPORT_INTERVAL) {
+        qDebug() << "Sent deltas to" << sessionCount << "sessions in" << _frameTimeSinceReport / _framesSinceReport
+            << "usec per frame on average, at most" << _maxFrameTimeSinceReport << "usec";
+        qDebug() << "Copied" << _deltaCopiesSinceReport << "of" << _deltasSinceReport << "deltas from the delta cache ("
+            << (_deltasSinceReport ? 100 * _deltaCopiesSinceReport / _deltasSinceReport : 0)
+            << "percent), saving about" << _deltaTimeSavedSinceReport << "usec of encoding";
+        qDebug() << "Deferred" << _deltasDeferredSinceReport << "deltas for full congestion windows";
+        qDebug() << "Applied" << _editsSinceReport << "edits in" << _editUpdatesSinceReport << "updates";
+        _lastFrameReport = now;
+        _framesSinceReport = 0;
+        _frameTimeSinceReport = 0;
+        _maxFrameTimeSinceReport = 0;
+        _deltasSinceReport = 0;
+        _deltasDeferredSinceReport = 0;
+        _deltaCopiesSinceReport = 0;
+        _deltaTimeSavedSinceReport = 0;
+        _editsSinceReport = 0;
+        _editUpdatesSinceReport = 0;
+    }
+}
+
+void MetavoxelServer::sendPacedDatagrams() {
+    foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
+        if (node->getType() == NodeType::Agent && node->getLinkedData()) {
+            static_cast<MetavoxelSession*>(node->getLinkedData())->sendPacedDatagrams();
+        }
+    }
 }
 
 MetavoxelSession::MetavoxelSession(MetavoxelServer* server, const SharedNodePointer& node) :
@@ -91,7 +218,9 @@ MetavoxelSession::MetavoxelSession(MetavoxelServer* server, const SharedNodePoin
     _sequencer(byteArrayWithPopulatedHeader(PacketTypeMetavoxelData)),
     _node(node) {
     
-    connect(&_sequencer, SIGNAL(readyToWrite(const QByteArray&)), SLOT(sendData(const QByteArray&)));
+    // deltas are encoded on whichever thread, so their datagrams are held by the pacer for the main thread to release
+    _sequencer.setPacingEnabled(true);
+    connect(&_sequencer, SIGNAL(readyToWrite(const QByteArray&)), SLOT(sendDatagram(const QByteArray&)));
     connect(&_sequencer, SIGNAL(readyToRead(Bitstream&)), SLOT(readPacket(Bitstream&)));
     connect(&_sequencer, SIGNAL(sendAcknowledged(int)), SLOT(clearSendRecordsBefore(int)));
     connect(&_sequencer, SIGNAL(receivedHighPriorityMessage(const QVariant&)), SLOT(handleMessage(const QVariant&)));
@@ -110,22 +239,25 @@ int MetavoxelSession::parseData(const QByteArray& packet) {
     return packet.size();
 }
 
-void MetavoxelSession::sendDelta() {
-    // wait until we have a valid lod
-    if (!_lod.isValid()) {
-        return;
-    }
+void MetavoxelSession::sendDelta(MetavoxelDelta& delta) {
+    int budget = _sequencer.getSendBudget();
     Bitstream& out = _sequencer.startPacket();
     out << QVariant::fromValue(MetavoxelDeltaMessage());
-    _server->getData().writeDelta(_sendRecords.first().data, _sendRecords.first().lod, out, _lod);
+    int start = out.getBitsWritten();
+    delta.write(out);
+    _lodBudget.deltaSent((out.getBitsWritten() - start) / BITS_IN_BYTE, budget);
     _sequencer.endPacket();
     
     // record the send
-    SendRecord record = { _sequencer.getOutgoingPacketNumber(), _server->getData(), _lod };
+    SendRecord record = { _sequencer.getOutgoingPacketNumber(), delta.getData(), delta.getLOD() };
     _sendRecords.append(record);
 }
 
-void MetavoxelSession::sendData(const QByteArray& data) {
+void MetavoxelSession::sendPacedDatagrams() {
+    _sequencer.releasePacedDatagrams();
+}
+
+void MetavoxelSession::sendDatagram(const QByteArray& data) {
     NodeList::getInstance()->writeDatagram(data, _node);
 }
 
@@ -9,6 +9,7 @@
 #ifndef __hifi__MetavoxelServer__
 #define __hifi__MetavoxelServer__
 
+#include <QDataStream>
 #include <QList>
 #include <QTimer>
 
@@ -16,8 +17,9 @@
 
 #include <DatagramSequencer.h>
 #include <MetavoxelData.h>
+#include <MetavoxelDelta.h>
+#include <MetavoxelMessages.h>
 
-class MetavoxelEditMessage;
 class MetavoxelSession;
 
 /// Maintains a shared metavoxel system, accepting change requests and broadcasting updates.
@@ -28,6 +30,7 @@ public:
     
     MetavoxelServer(const QByteArray& packet);
 
+    /// Queues an edit to be applied, along with the rest received in the same interval, before the next deltas go out.
     void applyEdit(const MetavoxelEditMessage& edit);
 
     const MetavoxelData& getData() const { return _data; }
@@ -40,13 +43,28 @@ private slots:
 
     void maybeAttachSession(const SharedNodePointer& node);
     void sendDeltas();    
+    void sendPacedDatagrams();
     
 private:
     
     QTimer _sendTimer;
     qint64 _lastSend;
     
+    QTimer _pacingTimer;
+    
     MetavoxelData _data;
+    MetavoxelEditBatch _edits;
+    
+    qint64 _lastFrameReport;
+    int _framesSinceReport;
+    quint64 _frameTimeSinceReport;
+    quint64 _maxFrameTimeSinceReport;
+    int _deltasSinceReport;
+    int _deltasDeferredSinceReport;
+    int _deltaCopiesSinceReport;
+    quint64 _deltaTimeSavedSinceReport;
+    int _editsSinceReport;
+    int _editUpdatesSinceReport;
 };
 
 /// Contains the state of a single client session.
@@ -60,11 +78,30 @@ public:
 
     virtual int parseData(const QByteArray& packet);
 
-    void sendDelta();
+    const MetavoxelLOD& getLOD() const { return _lod; }
+    
+    /// Returns the LOD at which to send our next delta: our client's, coarsened as needed to fit our send budget.
+    MetavoxelLOD getSendLOD() const { return _lodBudget.getLOD(_lod); }
+    
+    /// Returns the last state that the client acknowledged, from which deltas are sent.
+    const MetavoxelData& getReferenceData() const { return _sendRecords.first().data; }
+    const MetavoxelLOD& getReferenceLOD() const { return _sendRecords.first().lod; }
+
+    /// Returns the number of bytes the congestion window allows us to send.  Deltas are held back while it's used up, and
+    /// sent at a coarser LOD while they overrun it.
+    int getSendBudget() const { return _sequencer.getSendBudget(); }
+    
+    /// Sends the supplied delta (which must be from our reference state to our send LOD), holding on to the resulting
+    /// datagrams until the pacer releases them in sendPacedDatagrams().  May be called off the main thread, but not for
+    /// two deltas at once.
+    void sendDelta(MetavoxelDelta& delta);
+
+    /// Sends as many of the datagrams held by the pacer as its rate allows.
+    void sendPacedDatagrams();
 
 private slots:
 
-    void sendData(const QByteArray& data);
+    void sendDatagram(const QByteArray& data);
 
     void readPacket(Bitstream& in);    
     
@@ -88,6 +125,7 @@ private:
     SharedNodePointer _node;
     
     MetavoxelLOD _lod;
+    MetavoxelLODBudget _lodBudget;
     
     QList<SendRecord> _sendRecords;
 };
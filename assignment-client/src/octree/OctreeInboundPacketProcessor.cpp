@@ -10,6 +10,7 @@
 
 #include <PacketHeaders.h>
 #include <PerfStat.h>
+#include <Tracing.h>
 
 #include "OctreeServer.h"
 #include "OctreeServerConsts.h"
@@ -40,6 +41,7 @@ void OctreeInboundPacketProcessor::resetStats() {
 
 
 void OctreeInboundPacketProcessor::processPacket(const SharedNodePointer& sendingNode, const QByteArray& packet) {
+    TRACE_SCOPE("processPacket");
 
     bool debugProcessPacket = _myServer->wantsVerboseDebug();
 
@@ -91,6 +93,8 @@ void OctreeInboundPacketProcessor::processPacket(const SharedNodePointer& sendin
                                                                                   editData, maxSize, sendingNode);
             _myServer->getOctree()->unlock();
             quint64 endProcess = usecTimestampNow();
+            TRACE_SPAN("lockForWrite", startLock, startProcess);
+            TRACE_SPAN("processEditPacketData", startProcess, endProcess);
 
             editsInPacket++;
             quint64 thisProcessTime = endProcess - startProcess;
@@ -30,6 +30,7 @@ OctreeQueryNode::OctreeQueryNode() :
     _viewFrustumJustStoppedChanging(true),
     _currentPacketIsColor(true),
     _currentPacketIsCompressed(false),
+    _currentPacketVersion(0),
     _octreeSendThread(NULL),
     _lastClientBoundaryLevelAdjust(0),
     _lastClientOctreeSizeScale(DEFAULT_OCTREE_SIZE_SCALE),
@@ -119,6 +120,7 @@ void OctreeQueryNode::resetOctreePacket(bool lastWasSurpressed) {
     // the clients requested color state.
     _currentPacketIsColor = getWantColor();
     _currentPacketIsCompressed = getWantCompression();
+    _currentPacketVersion = getMyPacketVersion();
     OCTREE_PACKET_FLAGS flags = 0;
     if (_currentPacketIsColor) {
         setAtBit(flags,PACKET_IS_COLOR_BIT);
@@ -129,6 +131,7 @@ void OctreeQueryNode::resetOctreePacket(bool lastWasSurpressed) {
 
     _octreePacketAvailableBytes = MAX_PACKET_SIZE;
     int numBytesPacketHeader = populatePacketHeader(reinterpret_cast<char*>(_octreePacket), getMyPacketType());
+    _octreePacket[numBytesArithmeticCodingFromBuffer(reinterpret_cast<char*>(_octreePacket))] = _currentPacketVersion;
     _octreePacketAt = _octreePacket + numBytesPacketHeader;
     _octreePacketAvailableBytes -= numBytesPacketHeader;
 
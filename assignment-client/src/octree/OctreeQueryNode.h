@@ -13,6 +13,7 @@
 #include <NodeData.h>
 #include <OctreePacketData.h>
 #include <OctreeQuery.h>
+#include <PacketHeaders.h>
 
 #include <CoverageMap.h>
 #include <OctreeConstants.h>
@@ -30,6 +31,9 @@ public:
     
     virtual PacketType getMyPacketType() const = 0;
 
+    /// Override for packet types whose older layouts are still sent, to clients that don't read the latest one.
+    virtual PacketVersion getMyPacketVersion() const { return versionForPacketType(getMyPacketType()); }
+
     void resetOctreePacket(bool lastWasSurpressed = false);  // resets octree packet to after "V" header
 
     void writeToPacket(const unsigned char* buffer, unsigned int bytes); // writes to end of packet
@@ -73,8 +77,10 @@ public:
 
     bool getCurrentPacketIsColor() const { return _currentPacketIsColor; }
     bool getCurrentPacketIsCompressed() const { return _currentPacketIsCompressed; }
+    PacketVersion getCurrentPacketVersion() const { return _currentPacketVersion; }
     bool getCurrentPacketFormatMatches() {
-        return (getCurrentPacketIsColor() == getWantColor() && getCurrentPacketIsCompressed() == getWantCompression());
+        return (getCurrentPacketIsColor() == getWantColor() && getCurrentPacketIsCompressed() == getWantCompression() &&
+                getCurrentPacketVersion() == getMyPacketVersion());
     }
 
     bool hasLodChanged() const { return _lodChanged; };
@@ -116,6 +122,7 @@ private:
     bool _viewFrustumJustStoppedChanging;
     bool _currentPacketIsColor;
     bool _currentPacketIsCompressed;
+    PacketVersion _currentPacketVersion;
 
     OctreeSendThread* _octreeSendThread;
 
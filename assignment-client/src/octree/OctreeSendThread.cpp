@@ -9,6 +9,7 @@
 #include <PacketHeaders.h>
 #include <PerfStat.h>
 #include <SharedUtil.h>
+#include <Tracing.h>
 
 #include "OctreeSendThread.h"
 #include "OctreeServer.h"
@@ -66,6 +67,7 @@ bool OctreeSendThread::process() {
 
             // Sometimes the node data has not yet been linked, in which case we can't really do anything
             if (nodeData) {
+                TRACE_SCOPE("packetDistributor");
                 bool viewFrustumChanged = nodeData->updateCurrentViewFrustum();
                 packetDistributor(node, nodeData, viewFrustumChanged);
             }
@@ -81,6 +83,7 @@ bool OctreeSendThread::process() {
         int usecToSleep =  OCTREE_SEND_INTERVAL_USECS - elapsed;
 
         if (usecToSleep > 0) {
+            TRACE_SCOPE("usleep");
             PerformanceWarning warn(false,"OctreeSendThread... usleep()",false,&_usleepTime,&_usleepCalls);
             usleep(usecToSleep);
         } else {
@@ -100,6 +103,7 @@ quint64 OctreeSendThread::_totalWastedBytes = 0;
 quint64 OctreeSendThread::_totalPackets = 0;
 
 int OctreeSendThread::handlePacketSend(const SharedNodePointer& node, OctreeQueryNode* nodeData, int& trueBytesSent, int& truePacketsSent) {
+    TRACE_SCOPE("handlePacketSend");
     bool debug = _myServer->wantsDebugSending();
     quint64 now = usecTimestampNow();
 
@@ -111,6 +115,7 @@ int OctreeSendThread::handlePacketSend(const SharedNodePointer& node, OctreeQuer
     quint64 lockWaitStart = usecTimestampNow();
     QMutexLocker locker(&node->getMutex());
     quint64 lockWaitEnd = usecTimestampNow();
+    TRACE_SPAN("node lock", lockWaitStart, lockWaitEnd);
     float lockWaitElapsedUsec = (float)(lockWaitEnd - lockWaitStart);
     OctreeServer::trackNodeWaitTime(lockWaitElapsedUsec);
     
@@ -163,10 +168,12 @@ int OctreeSendThread::handlePacketSend(const SharedNodePointer& node, OctreeQuer
             }
 
             // actually send it
+            TRACE_SCOPE("writeDatagram");
             NodeList::getInstance()->writeDatagram((char*) statsMessage, statsMessageLength, SharedNodePointer(node));
             packetSent = true;
         } else {
             // not enough room in the packet, send two packets
+            TRACE_SCOPE("writeDatagram");
             NodeList::getInstance()->writeDatagram((char*) statsMessage, statsMessageLength, SharedNodePointer(node));
 
             // since a stats message is only included on end of scene, don't consider any of these bytes "wasted", since
@@ -205,6 +212,7 @@ int OctreeSendThread::handlePacketSend(const SharedNodePointer& node, OctreeQuer
         // If there's actually a packet waiting, then send it.
         if (nodeData->isPacketWaiting()) {
             // just send the voxel packet
+            TRACE_SCOPE("writeDatagram");
             NodeList::getInstance()->writeDatagram((char*) nodeData->getPacket(), nodeData->getPacketLength(),
                                                    SharedNodePointer(node));
             packetSent = true;
@@ -274,6 +282,8 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
     if (viewFrustumChanged || nodeData->nodeBag.isEmpty()) {
 
         // if our view has changed, we need to reset these things...
+        TRACE_SCOPE("sceneStart");
+
         if (viewFrustumChanged) {
             if (nodeData->moveShouldDump() || nodeData->hasLodChanged()) {
                 nodeData->dumpOutOfView();
@@ -383,6 +393,11 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
                                              wantOcclusionCulling, coverageMap, boundaryLevelAdjust, voxelSizeScale,
                                              nodeData->getLastTimeBagEmpty(),
                                              isFullScene, &nodeData->stats, _myServer->getJurisdiction());
+                params.packetVersion = nodeData->getCurrentPacketVersion();
+
+                // the client had everything in view as of the last time the bag emptied, unless its view has since
+                // changed in a way we can't tell
+                params.sendElementDeltas = nodeData->getWantElementDeltas() && (!viewFrustumChanged || wantDelta);
 
                 // TODO: should this include the lock time or not? This stat is sent down to the client,
                 // it seems like it may be a good idea to include the lock time as part of the encode time
@@ -392,11 +407,13 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
                 quint64 lockWaitStart = usecTimestampNow();
                 _myServer->getOctree()->lockForRead();
                 quint64 lockWaitEnd = usecTimestampNow();
+                TRACE_SPAN("lockForRead", lockWaitStart, lockWaitEnd);
                 lockWaitElapsedUsec = (float)(lockWaitEnd - lockWaitStart);
 
                 quint64 encodeStart = usecTimestampNow();
                 bytesWritten = _myServer->getOctree()->encodeTreeBitstream(subTree, &_packetData, nodeData->nodeBag, params);
                 quint64 encodeEnd = usecTimestampNow();
+                TRACE_SPAN("encodeTreeBitstream", encodeStart, encodeEnd);
                 encodeElapsedUsec = (float)(encodeEnd - encodeStart);
                 
                 // If after calling encodeTreeBitstream() there are no nodes left to send, then we know we've
@@ -454,6 +471,7 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
                     nodeData->writeToPacket(_packetData.getFinalizedData(), _packetData.getFinalizedSize());
                     extraPackingAttempts = 0;
                     quint64 compressAndWriteEnd = usecTimestampNow();
+                    TRACE_SPAN("compressAndWrite", compressAndWriteStart, compressAndWriteEnd);
                     compressAndWriteElapsedUsec = (float)(compressAndWriteEnd - compressAndWriteStart);
                 }
 
@@ -495,6 +513,7 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
             OctreeServer::trackPacketSendingTime(packetSendingElapsedUsec);
             
             quint64 endInside = usecTimestampNow();
+            TRACE_SPAN("packet", startInside, endInside);
             quint64 elapsedInsideUsecs = endInside - startInside;
             OctreeServer::trackInsideTime((float)elapsedInsideUsecs);
         }
@@ -13,6 +13,7 @@
 #include <time.h>
 #include <HTTPConnection.h>
 #include <Logging.h>
+#include <Tracing.h>
 #include <UUID.h>
 
 #include "OctreeServer.h"
@@ -20,139 +21,156 @@
 
 OctreeServer* OctreeServer::_instance = NULL;
 int OctreeServer::_clientCount = 0;
-const int MOVING_AVERAGE_SAMPLE_COUNTS = 1000000;
+
+// the bands into which the stats page divides the times
+const int MAX_SHORT_TIME = 10;
+const int MAX_LONG_TIME = 100;
 
 float OctreeServer::SKIP_TIME = -1.0f; // use this for trackXXXTime() calls for non-times
 
-SimpleMovingAverage OctreeServer::_averageLoopTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageInsideTime(MOVING_AVERAGE_SAMPLE_COUNTS);
+QMutex OctreeServer::_timingsMutex;
+QList<OctreeServerTimings*> OctreeServer::_threadTimings;
+OctreeServerTimings OctreeServer::_retiredTimings;
+QThreadStorage<OctreeServerTimingsHolder*> OctreeServer::_threadTimingsHolders;
 
-SimpleMovingAverage OctreeServer::_averageEncodeTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageShortEncodeTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageLongEncodeTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageExtraLongEncodeTime(MOVING_AVERAGE_SAMPLE_COUNTS);
 int OctreeServer::_extraLongEncode = 0;
 int OctreeServer::_longEncode = 0;
 int OctreeServer::_shortEncode = 0;
 int OctreeServer::_noEncode = 0;
 
-SimpleMovingAverage OctreeServer::_averageTreeWaitTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageTreeShortWaitTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageTreeLongWaitTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageTreeExtraLongWaitTime(MOVING_AVERAGE_SAMPLE_COUNTS);
 int OctreeServer::_extraLongTreeWait = 0;
 int OctreeServer::_longTreeWait = 0;
 int OctreeServer::_shortTreeWait = 0;
 int OctreeServer::_noTreeWait = 0;
 
-SimpleMovingAverage OctreeServer::_averageNodeWaitTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-
-SimpleMovingAverage OctreeServer::_averageCompressAndWriteTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageShortCompressTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageLongCompressTime(MOVING_AVERAGE_SAMPLE_COUNTS);
-SimpleMovingAverage OctreeServer::_averageExtraLongCompressTime(MOVING_AVERAGE_SAMPLE_COUNTS);
 int OctreeServer::_extraLongCompress = 0;
 int OctreeServer::_longCompress = 0;
 int OctreeServer::_shortCompress = 0;
 int OctreeServer::_noCompress = 0;
 
-SimpleMovingAverage OctreeServer::_averagePacketSendingTime(MOVING_AVERAGE_SAMPLE_COUNTS);
 int OctreeServer::_noSend = 0;
 
+void OctreeServerTimings::merge(const OctreeServerTimings& other) {
+    loop.merge(other.loop);
+    inside.merge(other.inside);
+    encode.merge(other.encode);
+    treeWait.merge(other.treeWait);
+    nodeWait.merge(other.nodeWait);
+    compressAndWrite.merge(other.compressAndWrite);
+    packetSending.merge(other.packetSending);
+}
+
+void OctreeServerTimings::reset() {
+    loop.reset();
+    inside.reset();
+    encode.reset();
+    treeWait.reset();
+    nodeWait.reset();
+    compressAndWrite.reset();
+    packetSending.reset();
+}
 
-void OctreeServer::resetSendingStats() {
-    _averageLoopTime.reset();
+/// Owns a thread's timings, handing them over to the retired timings when the thread exits.
+class OctreeServerTimingsHolder {
+public:
+
+    OctreeServerTimingsHolder() {
+        QMutexLocker locker(&OctreeServer::_timingsMutex);
+        OctreeServer::_threadTimings.append(&timings);
+    }
+
+    ~OctreeServerTimingsHolder() {
+        QMutexLocker locker(&OctreeServer::_timingsMutex);
+        OctreeServer::_threadTimings.removeOne(&timings);
+        OctreeServer::_retiredTimings.merge(timings);
+    }
+
+    OctreeServerTimings timings;
+};
 
-    _averageEncodeTime.reset();
-    _averageShortEncodeTime.reset();
-    _averageLongEncodeTime.reset();
-    _averageExtraLongEncodeTime.reset();
+OctreeServerTimings& OctreeServer::getThreadTimings() {
+    if (!_threadTimingsHolders.hasLocalData()) {
+        _threadTimingsHolders.setLocalData(new OctreeServerTimingsHolder());
+    }
+    return _threadTimingsHolders.localData()->timings;
+}
+
+OctreeServerTimings OctreeServer::getTimings() {
+    QMutexLocker locker(&_timingsMutex);
+    OctreeServerTimings timings = _retiredTimings;
+    foreach (const OctreeServerTimings* threadTimings, _threadTimings) {
+        timings.merge(*threadTimings);
+    }
+    return timings;
+}
+
+void OctreeServer::resetSendingStats() {
+    {
+        // the threads may be recording as we reset, so a value or two may survive
+        QMutexLocker locker(&_timingsMutex);
+        _retiredTimings.reset();
+        foreach (OctreeServerTimings* threadTimings, _threadTimings) {
+            threadTimings->reset();
+        }
+    }
     _extraLongEncode = 0;
     _longEncode = 0;
     _shortEncode = 0;
     _noEncode = 0;
 
-    _averageInsideTime.reset();
-    _averageTreeWaitTime.reset();
-    _averageTreeShortWaitTime.reset();
-    _averageTreeLongWaitTime.reset();
-    _averageTreeExtraLongWaitTime.reset();
     _extraLongTreeWait = 0;
     _longTreeWait = 0;
     _shortTreeWait = 0;
     _noTreeWait = 0;
 
-    _averageNodeWaitTime.reset();
-
-    _averageCompressAndWriteTime.reset();
-    _averageShortCompressTime.reset();
-    _averageLongCompressTime.reset();
-    _averageExtraLongCompressTime.reset();
     _extraLongCompress = 0;
     _longCompress = 0;
     _shortCompress = 0;
     _noCompress = 0;
 
-    _averagePacketSendingTime.reset();
     _noSend = 0;
 }
 
 void OctreeServer::trackEncodeTime(float time) { 
-    const float MAX_SHORT_TIME = 10.0f;
-    const float MAX_LONG_TIME = 100.0f;
-
     if (time == SKIP_TIME) {
         _noEncode++;
         time = 0.0f;
     } else if (time <= MAX_SHORT_TIME) {
         _shortEncode++;
-        _averageShortEncodeTime.updateAverage(time);
     } else if (time <= MAX_LONG_TIME) {
         _longEncode++;
-        _averageLongEncodeTime.updateAverage(time);
     } else {
         _extraLongEncode++;
-        _averageExtraLongEncodeTime.updateAverage(time);
     }
-    _averageEncodeTime.updateAverage(time); 
+    getThreadTimings().encode.record(time);
 }
 
 void OctreeServer::trackTreeWaitTime(float time) { 
-    const float MAX_SHORT_TIME = 10.0f;
-    const float MAX_LONG_TIME = 100.0f;
     if (time == SKIP_TIME) {
         _noTreeWait++;
         time = 0.0f;
     } else if (time <= MAX_SHORT_TIME) {
         _shortTreeWait++;
-        _averageTreeShortWaitTime.updateAverage(time);
     } else if (time <= MAX_LONG_TIME) {
         _longTreeWait++;
-        _averageTreeLongWaitTime.updateAverage(time);
     } else {
         _extraLongTreeWait++;
-        _averageTreeExtraLongWaitTime.updateAverage(time);
     }
-    _averageTreeWaitTime.updateAverage(time);
+    getThreadTimings().treeWait.record(time);
 }
 
 void OctreeServer::trackCompressAndWriteTime(float time) { 
-    const float MAX_SHORT_TIME = 10.0f;
-    const float MAX_LONG_TIME = 100.0f;
     if (time == SKIP_TIME) {
         _noCompress++;
         time = 0.0f;
     } else if (time <= MAX_SHORT_TIME) {
         _shortCompress++;
-        _averageShortCompressTime.updateAverage(time);
     } else if (time <= MAX_LONG_TIME) {
         _longCompress++;
-        _averageLongCompressTime.updateAverage(time);
     } else {
         _extraLongCompress++;
-        _averageExtraLongCompressTime.updateAverage(time);
     }
-    _averageCompressAndWriteTime.updateAverage(time); 
+    getThreadTimings().compressAndWrite.record(time);
 }
 
 void OctreeServer::trackPacketSendingTime(float time) { 
@@ -160,7 +178,7 @@ void OctreeServer::trackPacketSendingTime(float time) {
         _noSend++;
         time = 0.0f;
     }
-    _averagePacketSendingTime.updateAverage(time); 
+    getThreadTimings().packetSending.record(time);
 }
 
 
@@ -194,7 +212,6 @@ OctreeServer::OctreeServer(const QByteArray& packet) :
     _startedUSecs(usecTimestampNow())
 {
     _instance = this;
-    _averageLoopTime.updateAverage(0);
     qDebug() << "Octree server starting... [" << this << "]";
 }
 
@@ -234,6 +251,79 @@ void OctreeServer::initHTTPManager(int port) {
 
     // setup an httpManager with us as the request handler and the parent
     _httpManager = new HTTPManager(port, documentRoot, this, this);
+    _httpManager->addStatsProvider(this);
+}
+
+/// Returns the mean of the times in one band of a histogram, leaving out the zeros recorded for skipped times.
+static float getBandMean(const LatencyHistogram& histogram, int minimum, int maximum, int skipped = 0) {
+    int count = histogram.getCount(minimum, maximum) - skipped;
+    return (count > 0) ? histogram.getSum(minimum, maximum) / count : 0.0f;
+}
+
+/// Formats a line of the stats page with the percentiles of a histogram, so that the tails show.
+static QString formatPercentiles(const LatencyHistogram& histogram, const char* units) {
+    return QString().sprintf("                 p50/p99/p99.9/max:    %9d / %d / %d / %d %s\r\n",
+        histogram.getPercentile(50.0f), histogram.getPercentile(99.0f), histogram.getPercentile(99.9f),
+        histogram.getMaximum(), units);
+}
+
+/// Writes a histogram of times as a summary: its percentiles, sum and count.
+static void writeTimingSummary(StatsWriter& writer, const char* name, const char* help, const LatencyHistogram& histogram) {
+    writer.writeFamily(name, "summary", help);
+    const float QUANTILES[] = { 0.5f, 0.9f, 0.99f, 0.999f, 1.0f };
+    const float PERCENT = 100.0f;
+    for (unsigned int i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); i++) {
+        writer.writeSample(name, (quint64)histogram.getPercentile(QUANTILES[i] * PERCENT), "quantile",
+            QString::number(QUANTILES[i]));
+    }
+    writer.writeSample(QByteArray(name).append("_sum").constData(), histogram.getSum());
+    writer.writeSample(QByteArray(name).append("_count").constData(), (quint64)histogram.getCount());
+}
+
+void OctreeServer::writeStats(StatsWriter& writer) {
+    writer.setPrefix(QByteArray(getMyLoggingServerTargetName()).replace('-', '_') + '_');
+
+    const double USECS_PER_SECOND = 1000000.0;
+    writer.writeGauge("uptime_seconds", (usecTimestampNow() - _startedUSecs) / USECS_PER_SECOND,
+        "Time since the server started.");
+    writer.writeGauge("initial_load_complete", isInitialLoadComplete() ? 1.0 : 0.0,
+        "Whether the persisted octree has finished loading.");
+    writer.writeGauge("load_seconds", getLoadElapsedTime() / USECS_PER_SECOND,
+        "Time taken to load the persisted octree.");
+    writer.writeGauge("clients", getCurrentClientCount(), "Clients connected.");
+
+    writer.writeGauge("elements", OctreeElement::getNodeCount(), "Elements in the octree.");
+    writer.writeGauge("leaf_elements", OctreeElement::getLeafNodeCount(), "Leaf elements in the octree.");
+    writer.writeGauge("element_memory_bytes", OctreeElement::getTotalMemoryUsage(), "Memory used by octree elements.");
+
+    writer.writeCounter("outbound_packets_total", OctreeSendThread::_totalPackets, "Packets sent to clients.");
+    writer.writeCounter("outbound_bytes_total", OctreeSendThread::_totalBytes, "Bytes sent to clients.");
+    writer.writeCounter("outbound_wasted_bytes_total", OctreeSendThread::_totalWastedBytes,
+        "Bytes of packets sent to clients left unfilled.");
+    writer.writeCounter("outbound_octal_code_bytes_total", OctreePacketData::getTotalBytesOfOctalCodes(),
+        "Bytes of octal codes sent to clients.");
+    writer.writeCounter("outbound_bitmask_bytes_total", OctreePacketData::getTotalBytesOfBitMasks(),
+        "Bytes of bitmasks sent to clients.");
+    writer.writeCounter("outbound_color_bytes_total", OctreePacketData::getTotalBytesOfColor(),
+        "Bytes of color sent to clients.");
+
+    if (_octreeInboundPacketProcessor) {
+        writer.writeCounter("inbound_packets_total", _octreeInboundPacketProcessor->getTotalPacketsProcessed(),
+            "Edit packets processed.");
+        writer.writeCounter("inbound_elements_total", _octreeInboundPacketProcessor->getTotalElementsProcessed(),
+            "Elements in the edit packets processed.");
+    }
+
+    // the merge reads the per-thread histograms without stopping the send threads
+    OctreeServerTimings timings = getTimings();
+    writeTimingSummary(writer, "send_loop_msecs", "Time of each send loop.", timings.loop);
+    writeTimingSummary(writer, "send_inside_usecs", "Time spent inside each send loop.", timings.inside);
+    writeTimingSummary(writer, "encode_usecs", "Time encoding each packet.", timings.encode);
+    writeTimingSummary(writer, "tree_wait_usecs", "Time waiting for the octree lock.", timings.treeWait);
+    writeTimingSummary(writer, "node_wait_usecs", "Time waiting for the node's lock.", timings.nodeWait);
+    writeTimingSummary(writer, "compress_and_write_usecs", "Time compressing and writing each packet.",
+        timings.compressAndWrite);
+    writeTimingSummary(writer, "packet_sending_usecs", "Time sending each packet.", timings.packetSending);
 }
 
 bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString& path) {
@@ -265,6 +355,13 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
             _octreeInboundPacketProcessor->resetStats();
             resetSendingStats();
             showStats = true;
+        } else if (path == "/startTracing" || path == "/stopTracing") {
+            Tracing::setEnabled(path == "/startTracing");
+            showStats = true;
+        } else if (path == "/trace.json") {
+            // open in chrome://tracing
+            connection->respond(HTTPConnection::StatusCode200, Tracing::getTrace(), "application/json");
+            return true;
         }
     }
 
@@ -273,6 +370,11 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         // return a 200
         QString statsString("<html><doc>\r\n<pre>\r\n");
         statsString += QString("<b>Your %1 Server is running... <a href='/'>[RELOAD]</a></b>\r\n").arg(getMyServerName());
+        if (Tracing::isEnabled()) {
+            statsString += "Tracing <a href='/trace.json'>[DUMP]</a> <a href='/stopTracing'>[STOP]</a>\r\n";
+        } else {
+            statsString += "Not tracing <a href='/startTracing'>[START]</a>\r\n";
+        }
 
         tm* localtm = localtime(&_started);
         const int MAX_TIME_LENGTH = 128;
@@ -416,18 +518,23 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         statsString += QString("          Total Clients Connected: %1 clients\r\n\r\n")
             .arg(locale.toString((uint)getCurrentClientCount()).rightJustified(COLUMN_WIDTH, ' '));
 
-        float averageLoopTime = getAverageLoopTime();
+        OctreeServerTimings timings = getTimings();
+
+        float averageLoopTime = timings.loop.getMean();
         statsString += QString().sprintf("           Average packetLoop() time:      %7.2f msecs\r\n", averageLoopTime);
+        statsString += formatPercentiles(timings.loop, "msecs");
 
-        float averageInsideTime = getAverageInsideTime();
-        statsString += QString().sprintf("               Average 'inside' time:    %9.2f usecs\r\n\r\n", averageInsideTime);
+        float averageInsideTime = timings.inside.getMean();
+        statsString += QString().sprintf("               Average 'inside' time:    %9.2f usecs\r\n", averageInsideTime);
+        statsString += formatPercentiles(timings.inside, "usecs") + "\r\n";
 
         int allWaitTimes = _extraLongTreeWait +_longTreeWait + _shortTreeWait + _noTreeWait;
 
-        float averageTreeWaitTime = getAverageTreeWaitTime();
+        float averageTreeWaitTime = timings.treeWait.getMean();
         statsString += QString().sprintf("         Average tree lock wait time:"
                                          "    %9.2f usecs                 samples: %12d \r\n",
                                          averageTreeWaitTime, allWaitTimes);
+        statsString += formatPercentiles(timings.treeWait, "usecs");
 
         float zeroVsTotal = (allWaitTimes > 0) ? ((float)_noTreeWait / (float)allWaitTimes) : 0.0f;
         statsString += QString().sprintf("                        No Lock Wait:"
@@ -437,23 +544,24 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         float shortVsTotal = (allWaitTimes > 0) ? ((float)_shortTreeWait / (float)allWaitTimes) : 0.0f;
         statsString += QString().sprintf("       Avg tree lock short wait time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n",
-                                         _averageTreeShortWaitTime.getAverage(), 
+                                         getBandMean(timings.treeWait, 0, MAX_SHORT_TIME, _noTreeWait),
                                          shortVsTotal * AS_PERCENT, _shortTreeWait);
 
         float longVsTotal = (allWaitTimes > 0) ? ((float)_longTreeWait / (float)allWaitTimes) : 0.0f;
         statsString += QString().sprintf("        Avg tree lock long wait time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n",
-                                         _averageTreeLongWaitTime.getAverage(), 
+                                         getBandMean(timings.treeWait, MAX_SHORT_TIME + 1, MAX_LONG_TIME),
                                          longVsTotal * AS_PERCENT, _longTreeWait);
 
         float extraLongVsTotal = (allWaitTimes > 0) ? ((float)_extraLongTreeWait / (float)allWaitTimes) : 0.0f;
         statsString += QString().sprintf("  Avg tree lock extra long wait time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n\r\n",
-                                         _averageTreeExtraLongWaitTime.getAverage(), 
+                                         getBandMean(timings.treeWait, MAX_LONG_TIME + 1, INT_MAX),
                                          extraLongVsTotal * AS_PERCENT, _extraLongTreeWait);
 
-        float averageEncodeTime = getAverageEncodeTime();
+        float averageEncodeTime = timings.encode.getMean();
         statsString += QString().sprintf("                 Average encode time:    %9.2f usecs\r\n", averageEncodeTime);
+        statsString += formatPercentiles(timings.encode, "usecs");
         
         int allEncodeTimes = _noEncode + _shortEncode + _longEncode + _extraLongEncode;
 
@@ -465,24 +573,25 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         float shortVsTotalEncode = (allEncodeTimes > 0) ? ((float)_shortEncode / (float)allEncodeTimes) : 0.0f;
         statsString += QString().sprintf("               Avg short encode time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n",
-                                         _averageShortEncodeTime.getAverage(), 
+                                         getBandMean(timings.encode, 0, MAX_SHORT_TIME, _noEncode),
                                          shortVsTotalEncode * AS_PERCENT, _shortEncode);
 
         float longVsTotalEncode = (allEncodeTimes > 0) ? ((float)_longEncode / (float)allEncodeTimes) : 0.0f;
         statsString += QString().sprintf("                Avg long encode time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n",
-                                         _averageLongEncodeTime.getAverage(), 
+                                         getBandMean(timings.encode, MAX_SHORT_TIME + 1, MAX_LONG_TIME),
                                          longVsTotalEncode * AS_PERCENT, _longEncode);
 
         float extraLongVsTotalEncode = (allEncodeTimes > 0) ? ((float)_extraLongEncode / (float)allEncodeTimes) : 0.0f;
         statsString += QString().sprintf("          Avg extra long encode time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n\r\n",
-                                         _averageExtraLongEncodeTime.getAverage(), 
+                                         getBandMean(timings.encode, MAX_LONG_TIME + 1, INT_MAX),
                                          extraLongVsTotalEncode * AS_PERCENT, _extraLongEncode);
 
 
-        float averageCompressAndWriteTime = getAverageCompressAndWriteTime();
+        float averageCompressAndWriteTime = timings.compressAndWrite.getMean();
         statsString += QString().sprintf("     Average compress and write time:    %9.2f usecs\r\n", averageCompressAndWriteTime);
+        statsString += formatPercentiles(timings.compressAndWrite, "usecs");
 
         int allCompressTimes = _noCompress + _shortCompress + _longCompress + _extraLongCompress;
 
@@ -494,33 +603,35 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         float shortVsTotalCompress = (allCompressTimes > 0) ? ((float)_shortCompress / (float)allCompressTimes) : 0.0f;
         statsString += QString().sprintf("             Avg short compress time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n",
-                                         _averageShortCompressTime.getAverage(), 
+                                         getBandMean(timings.compressAndWrite, 0, MAX_SHORT_TIME, _noCompress),
                                          shortVsTotalCompress * AS_PERCENT, _shortCompress);
 
         float longVsTotalCompress = (allCompressTimes > 0) ? ((float)_longCompress / (float)allCompressTimes) : 0.0f;
         statsString += QString().sprintf("              Avg long compress time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n",
-                                         _averageLongCompressTime.getAverage(), 
+                                         getBandMean(timings.compressAndWrite, MAX_SHORT_TIME + 1, MAX_LONG_TIME),
                                          longVsTotalCompress * AS_PERCENT, _longCompress);
 
         float extraLongVsTotalCompress = (allCompressTimes > 0) ? ((float)_extraLongCompress / (float)allCompressTimes) : 0.0f;
         statsString += QString().sprintf("        Avg extra long compress time:"
                                          "          %9.2f usecs (%6.2f%%) samples: %12d \r\n\r\n",
-                                         _averageExtraLongCompressTime.getAverage(), 
+                                         getBandMean(timings.compressAndWrite, MAX_LONG_TIME + 1, INT_MAX),
                                          extraLongVsTotalCompress * AS_PERCENT, _extraLongCompress);
 
-        float averagePacketSendingTime = getAveragePacketSendingTime();
+        float averagePacketSendingTime = timings.packetSending.getMean();
         statsString += QString().sprintf("         Average packet sending time:    %9.2f usecs (includes node lock)\r\n", 
                                         averagePacketSendingTime);
+        statsString += formatPercentiles(timings.packetSending, "usecs");
 
-        float noVsTotalSend = (_averagePacketSendingTime.getSampleCount() > 0) ? 
-                                        ((float)_noSend / (float)_averagePacketSendingTime.getSampleCount()) : 0.0f;
+        float noVsTotalSend = (timings.packetSending.getCount() > 0) ? 
+                                        ((float)_noSend / (float)timings.packetSending.getCount()) : 0.0f;
         statsString += QString().sprintf("                         Not sending:"
                                          "                          (%6.2f%%) samples: %12d \r\n",
                                          noVsTotalSend * AS_PERCENT, _noSend);
                                         
-        float averageNodeWaitTime = getAverageNodeWaitTime();
+        float averageNodeWaitTime = timings.nodeWait.getMean();
         statsString += QString().sprintf("         Average node lock wait time:    %9.2f usecs\r\n", averageNodeWaitTime);
+        statsString += formatPercentiles(timings.nodeWait, "usecs");
 
         statsString += QString().sprintf("--------------------------------------------------------------\r\n");
 
@@ -888,6 +999,13 @@ void OctreeServer::run() {
     _debugReceiving =  cmdOptionExists(_argc, _argv, DEBUG_RECEIVING);
     qDebug("debugReceiving=%s", debug::valueOf(_debugReceiving));
 
+    // tracing can also be started and stopped from the status page
+    const char* TRACE = "--trace";
+    if (cmdOptionExists(_argc, _argv, TRACE)) {
+        Tracing::setEnabled(true);
+    }
+    qDebug("trace=%s", debug::valueOf(Tracing::isEnabled()));
+
     // By default we will persist, if you want to disable this, then pass in this parameter
     const char* NO_PERSIST = "--NoPersist";
     if (cmdOptionExists(_argc, _argv, NO_PERSIST)) {
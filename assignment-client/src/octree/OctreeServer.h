@@ -13,8 +13,12 @@
 #include <QStringList>
 #include <QDateTime>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
 
 #include <HTTPManager.h>
+#include <LatencyHistogram.h>
+#include <StatsWriter.h>
 
 #include <ThreadedAssignment.h>
 #include <EnvironmentData.h>
@@ -26,8 +30,25 @@
 
 const int DEFAULT_PACKETS_PER_INTERVAL = 2000; // some 120,000 packets per second total
 
+class OctreeServerTimingsHolder;
+
+/// The timings recorded by the send threads: usecs, except for the loop, which is in msecs.
+class OctreeServerTimings {
+public:
+    LatencyHistogram loop;
+    LatencyHistogram inside;
+    LatencyHistogram encode;
+    LatencyHistogram treeWait;
+    LatencyHistogram nodeWait;
+    LatencyHistogram compressAndWrite;
+    LatencyHistogram packetSending;
+
+    void merge(const OctreeServerTimings& other);
+    void reset();
+};
+
 /// Handles assignments of type OctreeServer - sending octrees to various clients.
-class OctreeServer : public ThreadedAssignment, public HTTPRequestHandler {
+class OctreeServer : public ThreadedAssignment, public HTTPRequestHandler, public StatsProvider {
     Q_OBJECT
 public:
     OctreeServer(const QByteArray& packet);
@@ -76,29 +97,23 @@ public:
     
     static float SKIP_TIME; // use this for trackXXXTime() calls for non-times
 
-    static void trackLoopTime(float time) { _averageLoopTime.updateAverage(time); }
-    static float getAverageLoopTime() { return _averageLoopTime.getAverage(); }
-
+    // each thread records its timings in its own histograms, without locking
+    static void trackLoopTime(float time) { getThreadTimings().loop.record(time); }
     static void trackEncodeTime(float time);
-    static float getAverageEncodeTime() { return _averageEncodeTime.getAverage(); }
-
-    static void trackInsideTime(float time) { _averageInsideTime.updateAverage(time); }
-    static float getAverageInsideTime() { return _averageInsideTime.getAverage(); }
-
+    static void trackInsideTime(float time) { getThreadTimings().inside.record(time); }
     static void trackTreeWaitTime(float time);
-    static float getAverageTreeWaitTime() { return _averageTreeWaitTime.getAverage(); }
-
-    static void trackNodeWaitTime(float time) { _averageNodeWaitTime.updateAverage(time); }
-    static float getAverageNodeWaitTime() { return _averageNodeWaitTime.getAverage(); }
-
+    static void trackNodeWaitTime(float time) { getThreadTimings().nodeWait.record(time); }
     static void trackCompressAndWriteTime(float time);
-    static float getAverageCompressAndWriteTime() { return _averageCompressAndWriteTime.getAverage(); }
-
     static void trackPacketSendingTime(float time);
-    static float getAveragePacketSendingTime() { return _averagePacketSendingTime.getAverage(); }
+
+    /// Returns the timings of all the threads (past and present) merged together.
+    static OctreeServerTimings getTimings();
 
     bool handleHTTPRequest(HTTPConnection* connection, const QString& path);
 
+    /// Writes the counters and timings of the stats page for scraping, without touching the tree or the node list.
+    virtual void writeStats(StatsWriter& writer);
+
     virtual void aboutToFinish();
     
 public slots:
@@ -113,6 +128,8 @@ protected:
     void initHTTPManager(int port);
     void resetSendingStats();
 
+    static OctreeServerTimings& getThreadTimings();
+
     int _argc;
     const char** _argv;
     char** _parsedArgV;
@@ -139,39 +156,28 @@ protected:
     QString _safeServerName;
     
     static int _clientCount;
-    static SimpleMovingAverage _averageLoopTime;
 
-    static SimpleMovingAverage _averageEncodeTime;
-    static SimpleMovingAverage _averageShortEncodeTime;
-    static SimpleMovingAverage _averageLongEncodeTime;
-    static SimpleMovingAverage _averageExtraLongEncodeTime;
+    friend class OctreeServerTimingsHolder;
+    static QMutex _timingsMutex;
+    static QList<OctreeServerTimings*> _threadTimings;
+    static OctreeServerTimings _retiredTimings; ///< the timings of the threads that have exited
+    static QThreadStorage<OctreeServerTimingsHolder*> _threadTimingsHolders;
+
     static int _extraLongEncode;
     static int _longEncode;
     static int _shortEncode;
     static int _noEncode;
 
-    static SimpleMovingAverage _averageInsideTime;
-    static SimpleMovingAverage _averageTreeWaitTime;
-    static SimpleMovingAverage _averageTreeShortWaitTime;
-    static SimpleMovingAverage _averageTreeLongWaitTime;
-    static SimpleMovingAverage _averageTreeExtraLongWaitTime;
     static int _extraLongTreeWait;
     static int _longTreeWait;
     static int _shortTreeWait;
     static int _noTreeWait;
 
-    static SimpleMovingAverage _averageNodeWaitTime;
-
-    static SimpleMovingAverage _averageCompressAndWriteTime;
-    static SimpleMovingAverage _averageShortCompressTime;
-    static SimpleMovingAverage _averageLongCompressTime;
-    static SimpleMovingAverage _averageExtraLongCompressTime;
     static int _extraLongCompress;
     static int _longCompress;
     static int _shortCompress;
     static int _noCompress;
 
-    static SimpleMovingAverage _averagePacketSendingTime;
     static int _noSend;
 
 };
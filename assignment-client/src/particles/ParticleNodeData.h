@@ -11,6 +11,7 @@
 #define __hifi__ParticleNodeData__
 
 #include <PacketHeaders.h>
+#include <Particle.h>
 
 #include "../octree/OctreeQueryNode.h"
 
@@ -21,6 +22,9 @@ public:
         _lastDeletedParticlesSentAt(0) {  };
 
     virtual PacketType getMyPacketType() const { return PacketTypeParticleData; }
+    virtual PacketVersion getMyPacketVersion() const {
+        return getWantElementDeltas() ? versionForPacketType(PacketTypeParticleData) : FULL_PARTICLE_DATA_VERSION;
+    }
 
     quint64 getLastDeletedParticlesSentAt() const { return _lastDeletedParticlesSentAt; }
     void setLastDeletedParticlesSentAt(quint64 sentAt) { _lastDeletedParticlesSentAt = sentAt; }
@@ -41,6 +41,14 @@ void ParticleServer::beforeRun() {
     connect(pruneDeletedParticlesTimer, SIGNAL(timeout()), this, SLOT(pruneDeletedParticles()));
     const int PRUNE_DELETED_PARTICLES_INTERVAL_MSECS = 1 * 1000; // once every second
     pruneDeletedParticlesTimer->start(PRUNE_DELETED_PARTICLES_INTERVAL_MSECS);
+
+    // how far (in meters) particles may stray from where viewers extrapolate them to before they're sent again
+    const char* MOTION_TOLERANCE = "--motionTolerance";
+    const char* motionTolerance = getCmdOption(_argc, _argv, MOTION_TOLERANCE);
+    if (motionTolerance) {
+        static_cast<ParticleTree*>(_tree)->setMotionTolerance(atof(motionTolerance) / TREE_SCALE);
+    }
+    qDebug("motionTolerance=%f", static_cast<ParticleTree*>(_tree)->getMotionTolerance() * TREE_SCALE);
 }
 
 void ParticleServer::particleCreated(const Particle& newParticle, const SharedNodePointer& senderNode) {
@@ -95,14 +103,25 @@ int ParticleServer::sendSpecialPacket(const SharedNodePointer& node) {
         ParticleTree* tree = static_cast<ParticleTree*>(_tree);
         bool hasMoreToSend = true;
 
-        // TODO: is it possible to send too many of these packets? what if you deleted 1,000,000 particles?
-        while (hasMoreToSend) {
-            hasMoreToSend = tree->encodeParticlesDeletedSince(deletedParticlesSentAt,
-                                                outputBuffer, MAX_PACKET_SIZE, packetLength);
+        if (nodeData->getWantElementDeltas()) {
+            QVector<uint32_t> deletedParticleIDs;
+            tree->getParticlesDeletedSince(deletedParticlesSentAt, deletedParticleIDs);
+            int nextID = 0;
+            while (hasMoreToSend) {
+                hasMoreToSend = tree->encodeParticleIDRanges(deletedParticleIDs, nextID,
+                                                             outputBuffer, MAX_PACKET_SIZE, packetLength);
+                NodeList::getInstance()->writeDatagram((char*) outputBuffer, packetLength, SharedNodePointer(node));
+            }
+        } else {
+            // TODO: is it possible to send too many of these packets? what if you deleted 1,000,000 particles?
+            while (hasMoreToSend) {
+                hasMoreToSend = tree->encodeParticlesDeletedSince(deletedParticlesSentAt,
+                                                    outputBuffer, MAX_PACKET_SIZE, packetLength);
 
-            //qDebug() << "sending PacketType_PARTICLE_ERASE packetLength:" << packetLength;
+                //qDebug() << "sending PacketType_PARTICLE_ERASE packetLength:" << packetLength;
 
-            NodeList::getInstance()->writeDatagram((char*) outputBuffer, packetLength, SharedNodePointer(node));
+                NodeList::getInstance()->writeDatagram((char*) outputBuffer, packetLength, SharedNodePointer(node));
+            }
         }
 
         nodeData->setLastDeletedParticlesSentAt(deletePacketSentAt);
@@ -36,6 +36,8 @@ DomainServer::DomainServer(int argc, char* argv[]) :
     _nodeAuthenticationURL(),
     _redeemedTokenResponses()
 {
+    _HTTPManager.addStatsProvider(this);
+    
     setOrganizationName("High Fidelity");
     setOrganizationDomain("highfidelity.io");
     setApplicationName("domain-server");
@@ -816,13 +818,32 @@ void DomainServer::refreshStaticAssignmentAndAddToQueue(SharedAssignmentPointer&
     _staticAssignmentHash.remove(oldUUID);
 }
 
+void DomainServer::writeStats(StatsWriter& writer) {
+    writer.setPrefix("domain_server_");
+    
+    writer.writeFamily("nodes", "gauge", "Nodes in the domain, by type.");
+    for (QHash<NodeType_t, int>::const_iterator it = _nodeTypeCounts.constBegin(); it != _nodeTypeCounts.constEnd(); it++) {
+        writer.writeSample("nodes", (quint64)it.value(), "type", NodeType::getNodeTypeName(it.key()));
+    }
+    writer.writeGauge("static_assignments", _staticAssignmentHash.size(), "Static assignments configured.");
+    writer.writeGauge("queued_assignments", _assignmentQueue.size(), "Assignments waiting for an assignment client.");
+}
+
 void DomainServer::nodeAdded(SharedNodePointer node) {
     // we don't use updateNodeWithData, so add the DomainServerNodeData to the node here
     node->setLinkedData(new DomainServerNodeData());
+    
+    // keep count here, so that the stats needn't go through the node hash
+    _nodeTypeCounts[node->getType()]++;
 }
 
 void DomainServer::nodeKilled(SharedNodePointer node) {
     
+    QHash<NodeType_t, int>::iterator count = _nodeTypeCounts.find(node->getType());
+    if (count != _nodeTypeCounts.end() && --count.value() == 0) {
+        _nodeTypeCounts.erase(count);
+    }
+    
     DomainServerNodeData* nodeData = reinterpret_cast<DomainServerNodeData*>(node->getLinkedData());
     if (nodeData) {
         // if this node's UUID matches a static assignment we need to throw it back in the assignment queue
@@ -20,10 +20,11 @@
 #include <Assignment.h>
 #include <HTTPManager.h>
 #include <NodeList.h>
+#include <StatsWriter.h>
 
 typedef QSharedPointer<Assignment> SharedAssignmentPointer;
 
-class DomainServer : public QCoreApplication, public HTTPRequestHandler {
+class DomainServer : public QCoreApplication, public HTTPRequestHandler, public StatsProvider {
     Q_OBJECT
 public:
     DomainServer(int argc, char* argv[]);
@@ -32,6 +33,9 @@ public:
     
     bool handleHTTPRequest(HTTPConnection* connection, const QString& path);
     
+    /// Writes the node and assignment counts for scraping.
+    virtual void writeStats(StatsWriter& writer);
+    
     void exit(int retCode = 0);
     
 public slots:
@@ -73,6 +77,8 @@ private:
     QHash<QUuid, SharedAssignmentPointer> _staticAssignmentHash;
     QQueue<SharedAssignmentPointer> _assignmentQueue;
     
+    QHash<NodeType_t, int> _nodeTypeCounts;
+    
     QUrl _nodeAuthenticationURL;
     
     QStringList _argumentList;
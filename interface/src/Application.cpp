@@ -54,6 +54,7 @@
 #include <AccountManager.h>
 #include <AudioInjector.h>
 #include <Logging.h>
+#include <Metrics.h>
 #include <OctalCode.h>
 #include <PacketHeaders.h>
 #include <ParticlesScriptingInterface.h>
@@ -1182,7 +1183,8 @@ void Application::timer() {
     // ask the node list to check in with the domain server
     NodeList::getInstance()->sendDomainServerCheckIn();
     
-    
+    // send whatever metrics were stashed over the last second
+    MetricsRegistry::getInstance()->flush();
 }
 
 void Application::idle() {
@@ -1535,8 +1537,10 @@ void Application::init() {
 
     // Set up VoxelSystem after loading preferences so we can get the desired max voxel count
     _voxels.setMaxVoxels(Menu::getInstance()->getMaxVoxels());
+    _voxels.setUpdatesMenu(true);
     _voxels.setUseVoxelShader(false);
     _voxels.setVoxelsAsPoints(false);
+    _voxels.setUseMergedFaces(Menu::getInstance()->isOptionChecked(MenuOption::MergeVoxelFaces));
     _voxels.setDisableFastVoxelPipeline(false);
     _voxels.init();
 
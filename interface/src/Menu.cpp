@@ -270,6 +270,12 @@ Menu::Menu() :
     addActionToQMenuAndActionHash(voxelOptionsMenu, MenuOption::LodTools, Qt::SHIFT | Qt::Key_L, this, SLOT(lodTools()));
     addCheckableActionToQMenuAndActionHash(voxelOptionsMenu, MenuOption::DontFadeOnVoxelServerChanges);
     addCheckableActionToQMenuAndActionHash(voxelOptionsMenu, MenuOption::DisableAutoAdjustLOD);
+    addCheckableActionToQMenuAndActionHash(voxelOptionsMenu,
+                                           MenuOption::MergeVoxelFaces,
+                                           0,
+                                           false,
+                                           appInstance->getVoxels(),
+                                           SLOT(setUseMergedFaces(bool)));
 
     QMenu* avatarOptionsMenu = developerMenu->addMenu("Avatar Options");
 
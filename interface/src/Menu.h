@@ -263,6 +263,7 @@ namespace MenuOption {
     const QString Login = "Login";
     const QString Logout = "Logout";
     const QString LookAtVectors = "Look-at Vectors";
+    const QString MergeVoxelFaces = "Merge Voxel Faces";
     const QString MetavoxelEditor = "Metavoxel Editor...";
     const QString Chat = "Chat...";
     const QString Metavoxels = "Metavoxels";
@@ -147,12 +147,15 @@ void MetavoxelSystem::render() {
     
     _program.release();
     
+    // only render the spanners whose bounds are in view
+    _renderVisitor.setViewFrustum(Application::getInstance()->getViewFrustum());
     foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
         if (node->getType() == NodeType::MetavoxelServer) {
             QMutexLocker locker(&node->getMutex());
             MetavoxelClient* client = static_cast<MetavoxelClient*>(node->getLinkedData());
             if (client) {
-                client->guide(_renderVisitor);
+                client->getData().getSpannerIndex(AttributeRegistry::getInstance()->getSpannersAttribute()).walk(
+                    _renderVisitor);
             }
         }
     }
@@ -195,8 +198,9 @@ int MetavoxelSystem::SimulateVisitor::visit(MetavoxelInfo& info) {
     return STOP_RECURSION;
 }
 
-MetavoxelSystem::RenderVisitor::RenderVisitor() :
-    SpannerVisitor(QVector<AttributePointer>() << AttributeRegistry::getInstance()->getSpannersAttribute()) {
+bool MetavoxelSystem::RenderVisitor::intersects(const Box& bounds) {
+    glm::vec3 center = bounds.getCenter();
+    return _viewFrustum->sphereInFrustum(center, glm::distance(center, bounds.maximum)) != ViewFrustum::OUTSIDE;
 }
 
 bool MetavoxelSystem::RenderVisitor::visit(Spanner* spanner) {
@@ -231,7 +235,9 @@ MetavoxelClient::~MetavoxelClient() {
 
 static MetavoxelLOD getLOD() {
     const float FIXED_LOD_THRESHOLD = 0.01f;
-    return MetavoxelLOD(Application::getInstance()->getCamera()->getPosition(), FIXED_LOD_THRESHOLD);
+    const float LOD_POSITION_SPACING = 0.25f;
+    return MetavoxelLOD(Application::getInstance()->getCamera()->getPosition(),
+        FIXED_LOD_THRESHOLD).getSnapped(LOD_POSITION_SPACING);
 }
 
 void MetavoxelClient::guide(MetavoxelVisitor& visitor) {
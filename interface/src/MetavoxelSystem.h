@@ -24,6 +24,7 @@
 #include "renderer/ProgramObject.h"
 
 class Model;
+class ViewFrustum;
 
 /// Renders a metavoxel tree.
 class MetavoxelSystem : public QObject {
@@ -70,10 +71,14 @@ private:
         int _order;
     };
     
-    class RenderVisitor : public SpannerVisitor {
+    class RenderVisitor : public SpannerIndexVisitor {
     public:
-        RenderVisitor();
+        void setViewFrustum(const ViewFrustum* viewFrustum) { _viewFrustum = viewFrustum; }
+        virtual bool intersects(const Box& bounds);
         virtual bool visit(Spanner* spanner);
+    
+    private:
+        const ViewFrustum* _viewFrustum;
     };
     
     static ProgramObject _program;
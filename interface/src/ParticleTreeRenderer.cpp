@@ -27,6 +27,9 @@ ParticleTreeRenderer::~ParticleTreeRenderer() {
 
 void ParticleTreeRenderer::init() {
     OctreeRenderer::init();
+
+    // we move particles along the motion the server sends, and it only sends it again when they stray from there
+    getTree()->setExtrapolatingMotion(true);
 }
 
 
@@ -61,7 +64,7 @@ void ParticleTreeRenderer::renderElement(OctreeElement* element, RenderArgs* arg
     // we need to iterate the actual particles of the element
     ParticleTreeElement* particleTreeElement = (ParticleTreeElement*)element;
 
-    const QList<Particle>& particles = particleTreeElement->getParticles();
+    const QVector<Particle>& particles = particleTreeElement->getParticles();
 
     uint16_t numberOfParticles = particles.size();
 
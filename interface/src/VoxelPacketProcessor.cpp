@@ -33,6 +33,7 @@ void VoxelPacketProcessor::processPacket(const SharedNodePointer& sendingNode, c
 
     // check to see if the UI thread asked us to kill the voxel tree. since we're the only thread allowed to do that
     if (app->_wantToKillLocalVoxels) {
+        app->_voxels.applyDecodedPackets(true); // packets that arrived before the kill request are applied before it
         app->_voxels.killLocalVoxels();
         app->_wantToKillLocalVoxels = false;
     }
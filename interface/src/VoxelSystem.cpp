@@ -11,6 +11,10 @@
 #include <iostream> // to load voxels from file
 #include <fstream> // to load voxels from file
 
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
 #include <OctalCode.h>
 #include <PacketHeaders.h>
 #include <PerfStat.h>
@@ -22,6 +26,8 @@
 #include "Menu.h"
 #include "renderer/ProgramObject.h"
 #include "VoxelConstants.h"
+#include "VoxelMesher.h"
+#include "VoxelPacketDecoder.h"
 #include "VoxelSystem.h"
 
 const bool VoxelSystem::DONT_BAIL_EARLY = false;
@@ -53,6 +59,69 @@ GLubyte identityIndicesRight[]  = {  1, 2, 6,  1, 6, 5 };
 GLubyte identityIndicesFront[]  = {  0, 2, 1,  0, 3, 2 };
 GLubyte identityIndicesBack[]   = {  4, 5, 6,  4, 6, 7 };
 
+/// Decodes one voxel data packet on the global thread pool, outside of the tree lock.
+class VoxelPacketDecodeTask : public QRunnable {
+public:
+
+    VoxelPacketDecodeTask(VoxelSystem* voxelSystem, const QByteArray& packet, const QUuid& sourceUUID,
+        bool extraDebugging);
+
+    virtual void run();
+
+    bool isDecoded() const { return _decoded.available() > 0; }
+    void waitUntilDecoded() { _decoded.acquire(); _decoded.release(); }
+    void waitUntilFinished() { _finished.acquire(); _finished.release(); }
+
+    const DecodedVoxelPacket& getResult() const { return _result; }
+
+private:
+
+    VoxelSystem* _voxelSystem;
+    QByteArray _packet;
+    QUuid _sourceUUID;
+    bool _extraDebugging;
+    quint64 _arrivedAt;
+    DecodedVoxelPacket _result;
+    QSemaphore _decoded;
+    QSemaphore _finished; ///< released once we no longer touch the voxel system
+};
+
+VoxelPacketDecodeTask::VoxelPacketDecodeTask(VoxelSystem* voxelSystem, const QByteArray& packet,
+        const QUuid& sourceUUID, bool extraDebugging) :
+    _voxelSystem(voxelSystem),
+    _packet(packet),
+    _sourceUUID(sourceUUID),
+    _extraDebugging(extraDebugging),
+    _arrivedAt(usecTimestampNow()) {
+
+    // the owning VoxelSystem deletes us once our edits have been applied
+    setAutoDelete(false);
+}
+
+void VoxelPacketDecodeTask::run() {
+    quint64 start = usecTimestampNow();
+    VoxelPacketDecoder::decodePacket(_packet, _sourceUUID, _result);
+    if (_extraDebugging) {
+        int flightTime = _arrivedAt - _result.sentTime;
+        qDebug("VoxelPacketDecodeTask::run() ... Decoded Packet color:%s sequence: %u flight:%d usec sections:%d"
+               " size:%d compressed:%d uncompressed:%d edits:%d malformed:%s elapsed:%llu usec",
+               debug::valueOf(_result.isColored), _result.sequence, flightTime, _result.sections, _packet.size(),
+               _result.compressedBytes, _result.uncompressedBytes, _result.edits.size(),
+               debug::valueOf(_result.isMalformed), usecTimestampNow() - start);
+    }
+    _packet.clear(); // no need to hold on to the raw data while we wait to be applied
+    _decoded.release();
+
+    // have the voxel system apply us on its own thread, unless it's already been asked to
+    if (_voxelSystem->_applyDecodesScheduled.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(_voxelSystem, "applyReadyDecodedPackets", Qt::QueuedConnection);
+    }
+    _finished.release();
+}
+
+// past this many queued decodes, parseData() waits for them rather than letting the tree fall further behind
+const int MAX_PENDING_VOXEL_DECODES = 64;
+
 VoxelSystem::VoxelSystem(float treeScale, int maxVoxels, VoxelTree* tree)
     : NodeData(),
     _treeScale(treeScale),
@@ -63,7 +132,8 @@ VoxelSystem::VoxelSystem(float treeScale, int maxVoxels, VoxelTree* tree)
     _inOcclusions(false),
     _showCulledSharedFaces(false),
     _usePrimitiveRenderer(false),
-    _renderer(0) 
+    _renderer(0),
+    _updatesMenu(false)
 {
 
     _voxelsInReadArrays = _voxelsInWriteArrays = _voxelsUpdated = 0;
@@ -86,6 +156,10 @@ VoxelSystem::VoxelSystem(float treeScale, int maxVoxels, VoxelTree* tree)
     _voxelsAsPoints = false;
     _voxelShaderModeWhenVoxelsAsPointsEnabled = false;
 
+    _useMergedFaces = false;
+    _mergedFacesRequested = false;
+    _mergedFaceIndicesInVBO = 0;
+
     _writeVoxelShaderData = NULL;
     _readVoxelShaderData = NULL;
 
@@ -96,7 +170,7 @@ VoxelSystem::VoxelSystem(float treeScale, int maxVoxels, VoxelTree* tree)
     _writeVoxelDirtyArray = NULL;
     _readVoxelDirtyArray = NULL;
 
-    _inSetupNewVoxelsForDrawing = false;
+    _inSetupNewVoxelsForDrawing.store(0);
     _useFastVoxelPipeline = false;
 
     _culledOnce = false;
@@ -128,7 +202,7 @@ void VoxelSystem::elementUpdated(OctreeElement* element) {
     VoxelTreeElement* voxel = (VoxelTreeElement*)element;
 
     // If we're in SetupNewVoxelsForDrawing() or _writeRenderFullVBO then bail..
-    if (!_useFastVoxelPipeline || _inSetupNewVoxelsForDrawing || _writeRenderFullVBO) {
+    if (!_useFastVoxelPipeline || _inSetupNewVoxelsForDrawing.load() || _writeRenderFullVBO) {
         return;
     }
 
@@ -236,6 +310,14 @@ VoxelSystem::~VoxelSystem() {
     VoxelTreeElement::removeDeleteHook(this);
     VoxelTreeElement::removeUpdateHook(this);
 
+    // let any in flight decodes finish before we throw them away
+    QMutexLocker locker(&_pendingDecodesMutex);
+    foreach (VoxelPacketDecodeTask* task, _pendingDecodes) {
+        task->waitUntilFinished();
+    }
+    qDeleteAll(_pendingDecodes);
+    _pendingDecodes.clear();
+
     cleanupVoxelMemory();
     delete _tree;
 }
@@ -275,9 +357,15 @@ void VoxelSystem::setUseVoxelShader(bool useVoxelShader) {
     }
     _useVoxelShader = useVoxelShader;
     _usePrimitiveRenderer = false;
+
+    // merged faces give way to the voxel shader (see initVoxelMemory()), and come back afterwards if asked for
+    if (!useVoxelShader) {
+        _useMergedFaces = _mergedFacesRequested;
+    }
     if (wasInitialized) {
         initVoxelMemory();
     }
+    updateMenuForModes();
 
     if (wasInitialized) {
         forceRedrawEntireTree();
@@ -295,7 +383,9 @@ void VoxelSystem::setVoxelsAsPoints(bool voxelsAsPoints) {
     // Voxels as points uses the VoxelShader memory model, so if we're not in voxel shader mode,
     // then set it to voxel shader mode.
     if (voxelsAsPoints) {
-        Menu::getInstance()->getUseVoxelShader()->setEnabled(false);
+        if (_updatesMenu) {
+            Menu::getInstance()->getUseVoxelShader()->setEnabled(false);
+        }
 
         // If enabling this... then do it before checking voxel shader status, that way, if voxel
         // shader is already enabled, we just start drawing as points.
@@ -308,7 +398,9 @@ void VoxelSystem::setVoxelsAsPoints(bool voxelsAsPoints) {
             _voxelShaderModeWhenVoxelsAsPointsEnabled = true;
         }
     } else {
-        Menu::getInstance()->getUseVoxelShader()->setEnabled(true);
+        if (_updatesMenu) {
+            Menu::getInstance()->getUseVoxelShader()->setEnabled(true);
+        }
         // if we're turning OFF voxels as point mode, then we check what the state of voxel shader was when we enabled
         // voxels as points, if it was OFF, then we return it to that value.
         if (_voxelShaderModeWhenVoxelsAsPointsEnabled == false) {
@@ -325,6 +417,42 @@ void VoxelSystem::setVoxelsAsPoints(bool voxelsAsPoints) {
     }
 }
 
+// This is called by the main application thread when the merge voxel faces menu item is chosen
+void VoxelSystem::setUseMergedFaces(bool useMergedFaces) {
+    _mergedFacesRequested = useMergedFaces;
+    if (_useMergedFaces == useMergedFaces) {
+        return;
+    }
+
+    bool wasInitialized = _initialized;
+    if (wasInitialized) {
+        clearAllNodesBufferIndex();
+        cleanupVoxelMemory();
+    }
+    _useMergedFaces = useMergedFaces;
+    _usePrimitiveRenderer = false;
+    _writeRenderFullVBO = true;
+    if (wasInitialized) {
+        initVoxelMemory();
+    }
+    updateMenuForModes();
+
+    if (wasInitialized) {
+        forceRedrawEntireTree();
+    }
+}
+
+// Both the voxel shader and merged faces turn the primitive renderer off, and merged faces give way to the voxel
+// shader, so the menu items for them are brought in line with the modes actually in use
+void VoxelSystem::updateMenuForModes() {
+    if (!_updatesMenu) {
+        return;
+    }
+    Menu* menu = Menu::getInstance();
+    menu->getActionForOption(MenuOption::MergeVoxelFaces)->setEnabled(!_useVoxelShader);
+    menu->setIsOptionChecked(MenuOption::CullSharedFaces, _usePrimitiveRenderer);
+}
+
 void VoxelSystem::cleanupVoxelMemory() {
     if (_initialized) {
         _readArraysLock.lockForWrite();
@@ -339,6 +467,16 @@ void VoxelSystem::cleanupVoxelMemory() {
 
             _writeVoxelShaderData = _readVoxelShaderData = NULL;
 
+        } else if (_useMergedFaces) {
+            glDeleteBuffers(1, &_vboMergedFaceVerticesID);
+            glDeleteBuffers(1, &_vboMergedFaceColorsID);
+            glDeleteBuffers(1, &_vboMergedFaceNormalsID);
+            glDeleteBuffers(1, &_vboMergedFaceIndicesID);
+            _mergedFaceIndicesInVBO = 0;
+
+            _writeMergedFaces = VoxelMeshChunk();
+            _readMergedFaces = VoxelMeshChunk();
+
         } else {
             // Destroy  glBuffers
             glDeleteBuffers(1, &_vboVerticesID);
@@ -412,6 +550,12 @@ void VoxelSystem::initVoxelMemory() {
         _useVoxelShader = true;
     }
 
+    // merged faces are drawn as triangles, so the voxel shader takes priority over them
+    if (_useVoxelShader && _useMergedFaces) {
+        qDebug() << "Merged voxel faces are off while the voxel shader is in use.";
+        _useMergedFaces = false;
+    }
+
     if (_useVoxelShader) {
         GLuint* indicesArray = new GLuint[_maxVoxels];
 
@@ -450,6 +594,15 @@ void VoxelSystem::initVoxelMemory() {
 
         _readVoxelShaderData = new VoxelShaderVBOData[_maxVoxels];
         _memoryUsageRAM += (sizeof(VoxelShaderVBOData) * _maxVoxels);
+    } else if (_useMergedFaces) {
+
+        // Merged faces don't have a fixed number of vertices per voxel, so their VBOs are sized each time they're
+        // rewritten by updateMergedFaceVBOs(), and there are no per voxel slots or dirty arrays
+        glGenBuffers(1, &_vboMergedFaceVerticesID);
+        glGenBuffers(1, &_vboMergedFaceColorsID);
+        glGenBuffers(1, &_vboMergedFaceNormalsID);
+        glGenBuffers(1, &_vboMergedFaceIndicesID);
+        _mergedFaceIndicesInVBO = 0;
     } else {
 
         // Global Normals mode uses a technique of not including normals on any voxel vertices, and instead
@@ -493,27 +646,27 @@ void VoxelSystem::initVoxelMemory() {
         _memoryUsageRAM += (sizeof(GLubyte) * vertexPointsPerVoxel * _maxVoxels);
         _readColorsArray = new GLubyte[vertexPointsPerVoxel * _maxVoxels];
         _memoryUsageRAM += (sizeof(GLubyte) * vertexPointsPerVoxel * _maxVoxels);
+    }
 
-        // create our simple fragment shader if we're the first system to init
-        if (!_perlinModulateProgram.isLinked()) {
-            _perlinModulateProgram.addShaderFromSourceFile(QGLShader::Vertex, Application::resourcesPath()
-                                                           + "shaders/perlin_modulate.vert");
-            _perlinModulateProgram.addShaderFromSourceFile(QGLShader::Fragment, Application::resourcesPath()
-                                                           + "shaders/perlin_modulate.frag");
-            _perlinModulateProgram.link();
-
-            _perlinModulateProgram.bind();
-            _perlinModulateProgram.setUniformValue("permutationNormalTexture", 0);
-            _perlinModulateProgram.release();
-
-            _shadowMapProgram.addShaderFromSourceFile(QGLShader::Fragment, Application::resourcesPath()
-                                                      + "shaders/shadow_map.frag");
-            _shadowMapProgram.link();
-
-            _shadowMapProgram.bind();
-            _shadowMapProgram.setUniformValue("shadowMap", 0);
-            _shadowMapProgram.release();
-        }
+    // create our simple fragment shader if we're the first system to init
+    if (!_useVoxelShader && !_perlinModulateProgram.isLinked()) {
+        _perlinModulateProgram.addShaderFromSourceFile(QGLShader::Vertex, Application::resourcesPath()
+                                                       + "shaders/perlin_modulate.vert");
+        _perlinModulateProgram.addShaderFromSourceFile(QGLShader::Fragment, Application::resourcesPath()
+                                                       + "shaders/perlin_modulate.frag");
+        _perlinModulateProgram.link();
+
+        _perlinModulateProgram.bind();
+        _perlinModulateProgram.setUniformValue("permutationNormalTexture", 0);
+        _perlinModulateProgram.release();
+
+        _shadowMapProgram.addShaderFromSourceFile(QGLShader::Fragment, Application::resourcesPath()
+                                                  + "shaders/shadow_map.frag");
+        _shadowMapProgram.link();
+
+        _shadowMapProgram.bind();
+        _shadowMapProgram.setUniformValue("shadowMap", 0);
+        _shadowMapProgram.release();
     }
     _renderer = new PrimitiveRenderer(_maxVoxels);
 
@@ -527,82 +680,90 @@ int VoxelSystem::parseData(const QByteArray& packet) {
     bool showTimingDetails = Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings);
     PerformanceWarning warn(showTimingDetails, "VoxelSystem::parseData()",showTimingDetails);
 
-    PacketType command = packetTypeForPacket(packet);
-    int numBytesPacketHeader = numBytesForPacketHeader(packet);
-    switch(command) {
-        case PacketTypeVoxelData: {
-            PerformanceWarning warn(showTimingDetails, "VoxelSystem::parseData() PacketType_VOXEL_DATA part...",showTimingDetails);
-            
-            const unsigned char* dataAt = reinterpret_cast<const unsigned char*>(packet.data()) + numBytesPacketHeader;
-
-            OCTREE_PACKET_FLAGS flags = (*(OCTREE_PACKET_FLAGS*)(dataAt));
-            dataAt += sizeof(OCTREE_PACKET_FLAGS);
-            OCTREE_PACKET_SEQUENCE sequence = (*(OCTREE_PACKET_SEQUENCE*)dataAt);
-            dataAt += sizeof(OCTREE_PACKET_SEQUENCE);
-
-            OCTREE_PACKET_SENT_TIME sentAt = (*(OCTREE_PACKET_SENT_TIME*)dataAt);
-            dataAt += sizeof(OCTREE_PACKET_SENT_TIME);
-
-            bool packetIsColored = oneAtBit(flags, PACKET_IS_COLOR_BIT);
-            bool packetIsCompressed = oneAtBit(flags, PACKET_IS_COMPRESSED_BIT);
-
-            OCTREE_PACKET_SENT_TIME arrivedAt = usecTimestampNow();
-            int flightTime = arrivedAt - sentAt;
-
-            OCTREE_PACKET_INTERNAL_SECTION_SIZE sectionLength = 0;
-            unsigned int dataBytes = packet.size() - (numBytesPacketHeader + OCTREE_PACKET_EXTRA_HEADERS_SIZE);
-
-            int subsection = 1;
-            while (dataBytes > 0) {
-                if (packetIsCompressed) {
-                    if (dataBytes > sizeof(OCTREE_PACKET_INTERNAL_SECTION_SIZE)) {
-                        sectionLength = (*(OCTREE_PACKET_INTERNAL_SECTION_SIZE*)dataAt);
-                        dataAt += sizeof(OCTREE_PACKET_INTERNAL_SECTION_SIZE);
-                        dataBytes -= sizeof(OCTREE_PACKET_INTERNAL_SECTION_SIZE);
-                    } else {
-                        sectionLength = 0;
-                        dataBytes = 0; // stop looping something is wrong
-                    }
-                } else {
-                    sectionLength = dataBytes;
-                }
-
-                if (sectionLength) {
-                    PerformanceWarning warn(showTimingDetails, "VoxelSystem::parseData() section");
-                    // ask the VoxelTree to read the bitstream into the tree
-                    ReadBitstreamToTreeParams args(packetIsColored ? WANT_COLOR : NO_COLOR, WANT_EXISTS_BITS, NULL, getDataSourceUUID());
-                    _tree->lockForWrite();
-                    OctreePacketData packetData(packetIsCompressed);
-                    packetData.loadFinalizedContent(dataAt, sectionLength);
-                    if (Application::getInstance()->getLogger()->extraDebugging()) {
-                        qDebug("VoxelSystem::parseData() ... Got Packet Section"
-                               " color:%s compressed:%s sequence: %u flight:%d usec size:%d data:%u"
-                               " subsection:%d sectionLength:%d uncompressed:%d",
-                            debug::valueOf(packetIsColored), debug::valueOf(packetIsCompressed),
-                            sequence, flightTime, packet.size(), dataBytes, subsection, sectionLength,
-                               packetData.getUncompressedSize());
-                    }
-                    _tree->readBitstreamToTree(packetData.getUncompressedData(), packetData.getUncompressedSize(), args);
-                    _tree->unlock();
+    if (packetTypeForPacket(packet) == PacketTypeVoxelData) {
+        VoxelPacketDecodeTask* task = new VoxelPacketDecodeTask(this, packet, getDataSourceUUID(),
+            Application::getInstance()->getLogger()->extraDebugging());
+        _pendingDecodesMutex.lock();
+        _pendingDecodes.enqueue(task);
+        bool tooFarBehind = _pendingDecodes.size() > MAX_PENDING_VOXEL_DECODES;
+        _pendingDecodesMutex.unlock();
+        QThreadPool::globalInstance()->start(task);
+
+        if (tooFarBehind) {
+            applyDecodedPackets(true);
+        }
+    }
 
-                    dataBytes -= sectionLength;
-                    dataAt += sectionLength;
-                }
-            }
-            subsection++;
+    if (applyDecodedPackets() == 0) {
+        if (!_useFastVoxelPipeline || _writeRenderFullVBO) {
+            setupNewVoxelsForDrawing();
+        } else {
+            setupNewVoxelsForDrawingSingleNode(DONT_BAIL_EARLY);
         }
-        default:
+    }
+
+    Application::getInstance()->getBandwidthMeter()->inputStream(BandwidthMeter::VOXELS).updateValue(packet.size());
+
+    return packet.size();
+}
+
+int VoxelSystem::applyDecodedPackets(bool waitForDecodes) {
+    // if another thread is applying, it will take whatever is ready; only wait our turn if we have to wait anyway
+    if (waitForDecodes) {
+        _applyDecodesMutex.lock();
+    } else if (!_applyDecodesMutex.tryLock()) {
+        return 0;
+    }
+    bool showTimingDetails = Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings);
+
+    // packets must be applied in the order they arrived, so stop at the first one that isn't ready.  only the applier
+    // removes from the queue, so the head stays put while we wait for it without the lock
+    QList<VoxelPacketDecodeTask*> decoded;
+    _pendingDecodesMutex.lock();
+    while (!_pendingDecodes.isEmpty()) {
+        VoxelPacketDecodeTask* task = _pendingDecodes.head();
+        if (waitForDecodes) {
+            _pendingDecodesMutex.unlock();
+            task->waitUntilDecoded();
+            _pendingDecodesMutex.lock();
+
+        } else if (!task->isDecoded()) {
             break;
+        }
+        decoded.append(_pendingDecodes.dequeue());
+    }
+    _pendingDecodesMutex.unlock();
+    if (decoded.isEmpty()) {
+        _applyDecodesMutex.unlock();
+        return 0;
+    }
+
+    {
+        PerformanceWarning warn(showTimingDetails, "VoxelSystem::applyDecodedPackets() locked", showTimingDetails);
+        _tree->lockForWrite();
+        foreach (VoxelPacketDecodeTask* task, decoded) {
+            _tree->applyDecodedPacket(task->getResult());
+        }
+        _tree->unlock();
+    }
+    _applyDecodesMutex.unlock();
+    foreach (VoxelPacketDecodeTask* task, decoded) {
+        task->waitUntilFinished(); // it may still be scheduling our slot
     }
+    qDeleteAll(decoded);
+
     if (!_useFastVoxelPipeline || _writeRenderFullVBO) {
         setupNewVoxelsForDrawing();
     } else {
         setupNewVoxelsForDrawingSingleNode(DONT_BAIL_EARLY);
     }
+    return decoded.size();
+}
 
-    Application::getInstance()->getBandwidthMeter()->inputStream(BandwidthMeter::VOXELS).updateValue(packet.size());
-
-    return packet.size();
+void VoxelSystem::applyReadyDecodedPackets() {
+    // clear the flag first, so that decodes finishing while we apply schedule another pass
+    _applyDecodesScheduled.store(0);
+    applyDecodedPackets();
 }
 
 void VoxelSystem::setupNewVoxelsForDrawing() {
@@ -621,7 +782,7 @@ void VoxelSystem::setupNewVoxelsForDrawing() {
         return; // bail early, it hasn't been long enough since the last time we ran
     }
 
-    _inSetupNewVoxelsForDrawing = true;
+    _inSetupNewVoxelsForDrawing.store(1);
     
     bool didWriteFullVBO = _writeRenderFullVBO;
     if (_tree->isDirty()) {
@@ -646,7 +807,8 @@ void VoxelSystem::setupNewVoxelsForDrawing() {
             _abandonedVBOSlots = 0; // reset the count of our abandoned slots, why is this here and not earlier????
         }
 
-        _writeRenderFullVBO = false;
+        // merged faces span many voxels, so they're always rewritten in full
+        _writeRenderFullVBO = _useMergedFaces;
     } else {
         _voxelsUpdated = 0;
     }
@@ -673,7 +835,7 @@ void VoxelSystem::setupNewVoxelsForDrawing() {
     int elapsedmsec = (end - start) / 1000;
     _setupNewVoxelsForDrawingLastFinished = end;
     _setupNewVoxelsForDrawingLastElapsed = elapsedmsec;
-    _inSetupNewVoxelsForDrawing = false;
+    _inSetupNewVoxelsForDrawing.store(0);
 
     bool extraDebugging = Application::getInstance()->getLogger()->extraDebugging();
     if (extraDebugging) {
@@ -822,7 +984,13 @@ void VoxelSystem::checkForCulling() {
     _lastKnownVoxelSizeScale = Menu::getInstance()->getVoxelSizeScale();
     _lastKnownBoundaryLevelAdjust = Menu::getInstance()->getBoundaryLevelAdjust();
 
-    if (fullRedraw) {
+    if (_useMergedFaces) {
+        // merged faces span many voxels, so rather than hiding and showing voxels we mesh the tree again for the new view
+        if (fullRedraw || forceFullFrustum) {
+            _tree->setDirtyBit();
+            setupNewVoxelsForDrawing();
+        }
+    } else if (fullRedraw) {
         // this will remove all old geometry and recreate the correct geometry for all in view voxels
         recreateVoxelGeometryInView();
     } else {
@@ -867,6 +1035,15 @@ void VoxelSystem::cleanupRemovedVoxels() {
 }
 
 void VoxelSystem::copyWrittenDataToReadArraysFullVBOs() {
+    if (_useMergedFaces) {
+        _readMergedFaces = _writeMergedFaces; // implicitly shared, so this doesn't copy the faces
+        _voxelsInReadArrays = _voxelsInWriteArrays;
+        _memoryUsageRAM = _writeMergedFaces.faceVertices.size() * sizeof(GLfloat) +
+            (_writeMergedFaces.faceColors.size() + _writeMergedFaces.faceNormals.size()) * sizeof(GLubyte) +
+            _writeMergedFaces.faceIndices.size() * sizeof(GLuint);
+        _readRenderFullVBO = true;
+        return;
+    }
     copyWrittenDataSegmentToReadArrays(0, _voxelsInWriteArrays - 1);
     _voxelsInReadArrays = _voxelsInWriteArrays;
 
@@ -959,6 +1136,69 @@ void VoxelSystem::copyWrittenDataToReadArrays(bool fullVBOs) {
 }
 
 int VoxelSystem::newTreeToArrays(VoxelTreeElement* voxel) {
+    // the primitive renderer builds its geometry element by element, so it keeps the serial walk
+    if (_usePrimitiveRenderer) {
+        return newTreeToPrimitives(voxel);
+    }
+    bool showWarnings = Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings);
+
+    // generate the geometry for the whole tree in parallel chunks, then place it into our write arrays
+    VoxelMeshParams params(_viewFrustum, Menu::getInstance()->getVoxelSizeScale(),
+                           Menu::getInstance()->getBoundaryLevelAdjust());
+    params.forceDraw = _writeRenderFullVBO;
+    params.mergeFaces = _useMergedFaces;
+    QVector<VoxelMeshChunk> chunks;
+
+    // the mesher updates elements from the thread pool, so nobody else may touch the tree until we're done with them.
+    // the update hooks it fires bail on _inSetupNewVoxelsForDrawing, since the whole tree is being meshed anyway
+    _tree->lockForWrite();
+    {
+        PerformanceWarning warn(showWarnings, "newTreeToArrays() meshing");
+        VoxelMesher(params).meshTree(voxel, chunks);
+    }
+    if (_useMergedFaces) {
+        _tree->unlock(); // merged faces don't refer back to the elements
+        return updateMergedFacesInArrays(chunks);
+    }
+
+    // depending on our over all mode (fullVBO or not) we will reuse or not reuse the index
+    PerformanceWarning warn(showWarnings, "newTreeToArrays() copy to write arrays");
+    bool reuseIndex = !_writeRenderFullVBO;
+    int voxelsUpdated = 0;
+    foreach (const VoxelMeshChunk& chunk, chunks) {
+        foreach (const VoxelMeshEntry& entry, chunk.entries) {
+            voxelsUpdated += updateNodeInArraysFromMesh(chunk, entry, reuseIndex);
+        }
+    }
+    _tree->unlock();
+    return voxelsUpdated;
+}
+
+int VoxelSystem::updateMergedFacesInArrays(const QVector<VoxelMeshChunk>& chunks) {
+    PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings),
+                            "updateMergedFacesInArrays()");
+    _writeArraysLock.lockForWrite();
+    _writeMergedFaces = VoxelMeshChunk();
+    foreach (const VoxelMeshChunk& chunk, chunks) {
+        // the chunks' indices are relative to their own vertices
+        quint32 firstVertex = _writeMergedFaces.faceVertices.size() / 3;
+        _writeMergedFaces.faceVertices += chunk.faceVertices;
+        _writeMergedFaces.faceColors += chunk.faceColors;
+        _writeMergedFaces.faceNormals += chunk.faceNormals;
+        foreach (quint32 index, chunk.faceIndices) {
+            _writeMergedFaces.faceIndices.append(firstVertex + index);
+        }
+        _writeMergedFaces.cellsMerged += chunk.cellsMerged;
+        _writeMergedFaces.facesBeforeMerging += chunk.facesBeforeMerging;
+    }
+    _voxelsInWriteArrays = _writeMergedFaces.cellsMerged;
+    _writeArraysLock.unlock();
+
+    // the read arrays may need to be emptied, so report an update even if nothing is left to render
+    return std::max(_writeMergedFaces.cellsMerged, 1);
+}
+
+int VoxelSystem::newTreeToPrimitives(VoxelTreeElement* voxel) {
     int   voxelsUpdated   = 0;
     bool  shouldRender    = false; // assume we don't need to render it
     // if it's colored, we might need to render it!
@@ -978,7 +1218,7 @@ int VoxelSystem::newTreeToArrays(VoxelTreeElement* voxel) {
             VoxelTreeElement* childVoxel = voxel->getChildAtIndex(i);
             if (childVoxel) {
                 bool wasShouldRender = childVoxel->getShouldRender();
-                voxelsUpdated += newTreeToArrays(childVoxel);
+                voxelsUpdated += newTreeToPrimitives(childVoxel);
                 bool isShouldRender = childVoxel->getShouldRender();
                 if (wasShouldRender && !isShouldRender) {
                     childrenGotHiddenCount++;
@@ -1110,6 +1350,47 @@ int VoxelSystem::updateNodeInArrays(VoxelTreeElement* node, bool reuseIndex, boo
     return 0; // not-updated
 }
 
+int VoxelSystem::updateNodeInArraysFromMesh(const VoxelMeshChunk& chunk, const VoxelMeshEntry& entry, bool reuseIndex) {
+    // same bookkeeping as updateNodeInArrays(), with the geometry already generated by the VoxelMesher
+    if (_voxelsInWriteArrays >= _maxVoxels && (_freeIndexes.size() == 0)) {
+        if (Application::getInstance()->getLogger()->extraDebugging()) {
+            qDebug("OH NO! updateNodeInArraysFromMesh() BAILING (_voxelsInWriteArrays >= _maxVoxels)");
+        }
+        return 0;
+    }
+    if (!_initialized) {
+        return 0;
+    }
+
+    VoxelTreeElement* node = entry.element;
+    if (entry.vertexOffset == VoxelMeshEntry::NOT_RENDERED) {
+        // If we shouldn't render, and we're in reuseIndex mode, then free our index, this only operates
+        // on nodes with known index values, so it's safe to call for any node.
+        return reuseIndex ? forceRemoveNodeFromArrays(node) : 0;
+    }
+
+    glBufferIndex nodeIndex = GLBUFFER_INDEX_UNKNOWN;
+    if (reuseIndex && node->isKnownBufferIndex()) {
+        nodeIndex = node->getBufferIndex();
+    } else {
+        nodeIndex = getNextBufferIndex();
+        node->setBufferIndex(nodeIndex);
+        node->setVoxelSystem(this);
+    }
+    if (_useVoxelShader) {
+        updateArraysDetails(nodeIndex, node->getCorner(), node->getScale(), node->getColor());
+
+    } else if (nodeIndex <= _maxVoxels && _writeVerticesArray && _writeColorsArray) {
+        _writeVoxelDirtyArray[nodeIndex] = true;
+        int vertexPointsPerVoxel = GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL;
+        memcpy(_writeVerticesArray + (nodeIndex * vertexPointsPerVoxel), chunk.vertices.constData() + entry.vertexOffset,
+               vertexPointsPerVoxel * sizeof(GLfloat));
+        memcpy(_writeColorsArray + (nodeIndex * vertexPointsPerVoxel), chunk.colors.constData() + entry.vertexOffset,
+               vertexPointsPerVoxel * sizeof(GLubyte));
+    }
+    return 1; // updated!
+}
+
 void VoxelSystem::updateArraysDetails(glBufferIndex nodeIndex, const glm::vec3& startVertex,
                                      float voxelScale, const nodeColor& color) {
 
@@ -1187,6 +1468,11 @@ void VoxelSystem::updateFullVBOs() {
     bool outputWarning = Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings);
     PerformanceWarning warn(outputWarning, "updateFullVBOs()");
 
+    if (_useMergedFaces) {
+        updateMergedFaceVBOs();
+        return;
+    }
+
     {
         static char buffer[128] = { 0 };
         if (outputWarning) {
@@ -1204,6 +1490,35 @@ void VoxelSystem::updateFullVBOs() {
     }
 }
 
+// this should only be called on the main application thread during render
+void VoxelSystem::updateMergedFaceVBOs() {
+    PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings), "updateMergedFaceVBOs()");
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vboMergedFaceVerticesID);
+    glBufferData(GL_ARRAY_BUFFER, _readMergedFaces.faceVertices.size() * sizeof(GLfloat),
+                 _readMergedFaces.faceVertices.constData(), GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vboMergedFaceColorsID);
+    glBufferData(GL_ARRAY_BUFFER, _readMergedFaces.faceColors.size() * sizeof(GLubyte),
+                 _readMergedFaces.faceColors.constData(), GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vboMergedFaceNormalsID);
+    glBufferData(GL_ARRAY_BUFFER, _readMergedFaces.faceNormals.size() * sizeof(GLbyte),
+                 _readMergedFaces.faceNormals.constData(), GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vboMergedFaceIndicesID);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _readMergedFaces.faceIndices.size() * sizeof(GLuint),
+                 _readMergedFaces.faceIndices.constData(), GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    _mergedFaceIndicesInVBO = _readMergedFaces.faceIndices.size();
+    _memoryUsageVBO = _readMergedFaces.faceVertices.size() * sizeof(GLfloat) +
+        (_readMergedFaces.faceColors.size() + _readMergedFaces.faceNormals.size()) * sizeof(GLubyte) +
+        _readMergedFaces.faceIndices.size() * sizeof(GLuint);
+}
+
 void VoxelSystem::updatePartialVBOs() {
     glBufferIndex segmentStart = 0;
     bool inSegment = false;
@@ -1384,8 +1699,39 @@ void VoxelSystem::render() {
             glDisableVertexAttribArray(attributeLocation);
             glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
         }
-    } else 
-    if (!_usePrimitiveRenderer) {
+    } else if (_useMergedFaces && !_usePrimitiveRenderer) {
+        PerformanceWarning warn(showWarnings, "render().. merged faces...");
+
+        // merged faces face every which way, so unlike the six pass path below they carry their own normals
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+
+        glBindBuffer(GL_ARRAY_BUFFER, _vboMergedFaceVerticesID);
+        glVertexPointer(3, GL_FLOAT, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, _vboMergedFaceColorsID);
+        glColorPointer(3, GL_UNSIGNED_BYTE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, _vboMergedFaceNormalsID);
+        glNormalPointer(GL_BYTE, 0, 0);
+
+        applyScaleAndBindProgram(texture);
+        glEnable(GL_CULL_FACE);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vboMergedFaceIndicesID);
+        glDrawElements(GL_TRIANGLES, _mergedFaceIndicesInVBO, GL_UNSIGNED_INT, 0);
+
+        glDisable(GL_CULL_FACE);
+        removeScaleAndReleaseProgram(texture);
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    } else if (!_usePrimitiveRenderer) {
         PerformanceWarning warn(showWarnings, "render().. TRIANGLES...");
 
         {
@@ -1890,9 +2236,12 @@ void VoxelSystem::hideOutOfView(bool forceFullFrustum) {
 
     {
         PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings), 
-                            "VoxelSystem::... recurseTreeWithOperation(hideOutOfViewOperation)");
+                            "VoxelSystem::... hideOutOfViewRecursion()");
         _tree->lockForRead();
-        _tree->recurseTreeWithOperation(hideOutOfViewOperation,(void*)&args);
+        VoxelTreeElement* root = _tree->getRoot();
+        hideOutOfViewRecursion(root, root->inFrustum(args.thisViewFrustum),
+            (args.culledOnce && args.wantDeltaFrustums) ? root->inFrustum(args.lastViewFrustum) : ViewFrustum::OUTSIDE,
+            &args);
         _tree->unlock();
     }
     _lastCulledViewFrustum = args.thisViewFrustum; // save last stable
@@ -1983,26 +2332,38 @@ bool VoxelSystem::showAllSubTreeOperation(OctreeElement* element, void* extraDat
     return true; // keep recursing!
 }
 
-// "hide" voxels in the VBOs that are still in the tree that but not in view.
-// We don't remove them from the tree, we don't delete them, we do remove them
-// from the VBOs and mark them as such in the tree.
-bool VoxelSystem::hideOutOfViewOperation(OctreeElement* element, void* extraData) {
-    VoxelTreeElement* voxel = (VoxelTreeElement*)element;
-    hideOutOfViewArgs* args = (hideOutOfViewArgs*)extraData;
-    
-    // If we're still recursing the tree using this operator, then we don't know if we're inside or outside...
-    // so before we move forward we need to determine our frustum location
-    ViewFrustum::location inFrustum = voxel->inFrustum(args->thisViewFrustum);
-
-    // If we've culled at least once, then we will use the status of this voxel in the last culled frustum to determine
-    // how to proceed. If we've never culled, then we just consider all these voxels to be UNKNOWN so that we will not
-    // consider that case.
-    ViewFrustum::location inLastCulledFrustum = ViewFrustum::OUTSIDE; // assume outside, but should get reset to actual value
+// Recurses the tree for hideOutOfView(). Only elements that intersect the view are recursed, and the children of each
+// are tested against the current (and last culled) view all at once.
+void VoxelSystem::hideOutOfViewRecursion(VoxelTreeElement* voxel, ViewFrustum::location inFrustum,
+                                         ViewFrustum::location inLastCulledFrustum, hideOutOfViewArgs* args) {
+    if (!hideOutOfViewElement(voxel, inFrustum, inLastCulledFrustum, args)) {
+        return;
+    }
+    ViewFrustum::ChildLocations childLocations;
+    voxel->childrenInFrustum(args->thisViewFrustum, childLocations);
 
-    if (args->culledOnce && args->wantDeltaFrustums) {
-        inLastCulledFrustum = voxel->inFrustum(args->lastViewFrustum);
+    // If we've culled at least once, then we will use the status of the children in the last culled frustum to determine
+    // how to proceed. If we've never culled, then we just consider them all OUTSIDE so that we will not consider that case.
+    bool useLastCulledFrustum = args->culledOnce && args->wantDeltaFrustums;
+    ViewFrustum::ChildLocations lastChildLocations;
+    if (useLastCulledFrustum) {
+        voxel->childrenInFrustum(args->lastViewFrustum, lastChildLocations);
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        VoxelTreeElement* child = voxel->getChildAtIndex(i);
+        if (child) {
+            hideOutOfViewRecursion(child, childLocations.getLocation(i),
+                useLastCulledFrustum ? lastChildLocations.getLocation(i) : ViewFrustum::OUTSIDE, args);
+        }
     }
+}
 
+// "hide" voxels in the VBOs that are still in the tree that but not in view.
+// We don't remove them from the tree, we don't delete them, we do remove them
+// from the VBOs and mark them as such in the tree.
+// Returns true if the element's children need to be considered too.
+bool VoxelSystem::hideOutOfViewElement(VoxelTreeElement* voxel, ViewFrustum::location inFrustum,
+                                       ViewFrustum::location inLastCulledFrustum, hideOutOfViewArgs* args) {
     // ok, now do some processing for this node...
     switch (inFrustum) {
         case ViewFrustum::OUTSIDE: {
@@ -12,10 +12,15 @@
 #include "InterfaceConfig.h"
 #include <glm/glm.hpp>
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+
 #include <SharedUtil.h>
 
 #include <NodeData.h>
 #include <ViewFrustum.h>
+#include <VoxelMesher.h>
 #include <VoxelTree.h>
 #include <OctreePersistThread.h>
 
@@ -26,6 +31,8 @@
 #include "PrimitiveRenderer.h"
 
 class ProgramObject;
+class VoxelPacketDecodeTask;
+class hideOutOfViewArgs;
 
 const int NUM_CHILDREN = 8;
 
@@ -50,8 +57,15 @@ public:
     void setDataSourceUUID(const QUuid& dataSourceUUID) { _dataSourceUUID = dataSourceUUID; }
     const QUuid&  getDataSourceUUID() const { return _dataSourceUUID; }
 
+    /// Queues a voxel data packet to be decoded on the global thread pool. Decoded packets are applied to the tree, in
+    /// arrival order, by the next call to applyDecodedPackets(), here or on our own thread once their decodes finish.
     int parseData(const QByteArray& packet);
 
+    /// Applies decoded packets to the tree in one write locked batch. May be called from any thread.
+    /// \param waitForDecodes if true, waits for all queued packets to decode; otherwise applies only those ready in order
+    /// \return the number of packets applied
+    int applyDecodedPackets(bool waitForDecodes = false);
+
     bool isInitialized() { return _initialized; }
     virtual void init();
     void render();
@@ -90,6 +104,8 @@ public slots:
                         
 
     // Methods that recurse tree
+    /// Rebuilds the geometry for the whole tree.  Takes the tree's write lock, so mustn't be called with the tree
+    /// locked.
     void forceRedrawEntireTree();
     void clearAllNodesBufferIndex();
     void cullSharedFaces();
@@ -98,6 +114,16 @@ public slots:
     void setDisableFastVoxelPipeline(bool disableFastVoxelPipeline);
     void setUseVoxelShader(bool useVoxelShader);
     void setVoxelsAsPoints(bool voxelsAsPoints);
+    void setUseMergedFaces(bool useMergedFaces);
+
+    /// Sets whether this system keeps the voxel options in the menu in step with the modes it applies. Only the
+    /// application's own voxels do; overlays and the clipboard leave the menu alone.
+    void setUpdatesMenu(bool updatesMenu) { _updatesMenu = updatesMenu; }
+
+private slots:
+    /// Applies the packets whose decodes have finished; queued by the decode tasks, so that the last packets of a burst
+    /// don't wait for the next one to arrive.
+    void applyReadyDecodedPackets();
 
 protected:
     float _treeScale;
@@ -142,13 +168,18 @@ private:
     static bool clearAllNodesBufferIndexOperation(OctreeElement* element, void* extraData);
     static bool inspectForExteriorOcclusionsOperation(OctreeElement* element, void* extraData);
     static bool inspectForInteriorOcclusionsOperation(OctreeElement* element, void* extraData);
-    static bool hideOutOfViewOperation(OctreeElement* element, void* extraData);
+    static void hideOutOfViewRecursion(VoxelTreeElement* voxel, ViewFrustum::location inFrustum,
+                                       ViewFrustum::location inLastCulledFrustum, hideOutOfViewArgs* args);
+    static bool hideOutOfViewElement(VoxelTreeElement* voxel, ViewFrustum::location inFrustum,
+                                     ViewFrustum::location inLastCulledFrustum, hideOutOfViewArgs* args);
     static bool hideAllSubTreeOperation(OctreeElement* element, void* extraData);
     static bool showAllSubTreeOperation(OctreeElement* element, void* extraData);
     static bool getVoxelEnclosingOperation(OctreeElement* element, void* extraData);
     static bool recreateVoxelGeometryInViewOperation(OctreeElement* element, void* extraData);
 
     int updateNodeInArrays(VoxelTreeElement* node, bool reuseIndex, bool forceDraw);
+    int updateNodeInArraysFromMesh(const VoxelMeshChunk& chunk, const VoxelMeshEntry& entry, bool reuseIndex);
+    int updateMergedFacesInArrays(const QVector<VoxelMeshChunk>& chunks);
     int forceRemoveNodeFromArrays(VoxelTreeElement* node);
 
     void copyWrittenDataToReadArraysFullVBOs();
@@ -191,6 +222,7 @@ private:
 
     void initVoxelMemory();
     void cleanupVoxelMemory();
+    void updateMenuForModes();
 
     bool _useVoxelShader;
     bool _voxelsAsPoints;
@@ -211,6 +243,16 @@ private:
     GLuint _vboIndicesFront;
     GLuint _vboIndicesBack;
 
+    bool _useMergedFaces;
+    bool _mergedFacesRequested; ///< whether merged faces were asked for, though the voxel shader may override them
+    VoxelMeshChunk _writeMergedFaces; /// when merging faces, the whole tree's faces are kept in one chunk
+    VoxelMeshChunk _readMergedFaces;
+    GLuint _vboMergedFaceVerticesID;
+    GLuint _vboMergedFaceColorsID;
+    GLuint _vboMergedFaceNormalsID;
+    GLuint _vboMergedFaceIndicesID;
+    GLsizei _mergedFaceIndicesInVBO;
+
     ViewFrustum _lastKnownViewFrustum;
     ViewFrustum _lastStableViewFrustum;
     ViewFrustum* _viewFrustum;
@@ -221,12 +263,14 @@ private:
     void setupFaceIndices(GLuint& faceVBOID, GLubyte faceIdentityIndices[]);
 
     int newTreeToArrays(VoxelTreeElement* currentNode);
+    int newTreeToPrimitives(VoxelTreeElement* currentNode);
     void cleanupRemovedVoxels();
 
     void copyWrittenDataToReadArrays(bool fullVBOs);
 
     void updateFullVBOs(); // all voxels in the VBO
     void updatePartialVBOs(); // multiple segments, only dirty voxels
+    void updateMergedFaceVBOs(); // all merged faces, replacing the old ones
 
     bool _voxelsDirty;
 
@@ -244,13 +288,19 @@ private:
     bool _falseColorizeBySource;
     QUuid _dataSourceUUID;
 
+    friend class VoxelPacketDecodeTask;
+    QQueue<VoxelPacketDecodeTask*> _pendingDecodes;
+    QMutex _pendingDecodesMutex; ///< guards the queue itself
+    QMutex _applyDecodesMutex; ///< held by whichever thread is applying, so that packets are applied in order
+    QAtomicInt _applyDecodesScheduled;
+
     int _voxelServerCount;
     unsigned long _memoryUsageRAM;
     unsigned long _memoryUsageVBO;
     unsigned long _initialMemoryUsageGPU;
     bool _hasMemoryUsageGPU;
 
-    bool _inSetupNewVoxelsForDrawing;
+    QAtomicInt _inSetupNewVoxelsForDrawing; ///< read by elementUpdated(), which the mesher's pool threads trigger
     bool _useFastVoxelPipeline;
 
     bool _inhideOutOfView;
@@ -262,6 +312,7 @@ private:
     bool _showCulledSharedFaces;                ///< Flag visibility of culled faces
     bool _usePrimitiveRenderer;                 ///< Flag primitive renderer for use
     PrimitiveRenderer* _renderer;               ///< Voxel renderer
+    bool _updatesMenu;
 
     static const unsigned int _sNumOctantsPerHemiVoxel = 4;
     static int _sCorrectedChildIndex[8];
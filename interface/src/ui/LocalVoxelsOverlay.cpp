@@ -40,12 +40,10 @@ void LocalVoxelsOverlay::update(float deltatime) {
         _voxelSystem->init();
     }
     
-    _tree->lockForRead();
-    if (_visible && _voxelCount != _tree->getOctreeElementsCount()) {
-        _voxelCount = _tree->getOctreeElementsCount();
+    // the redraw takes the tree's write lock, so the count is checked without holding on to the lock
+    if (_visible && _tree->elementsCountChanged(_voxelCount)) {
         _voxelSystem->forceRedrawEntireTree();
     }
-    _tree->unlock();
 }
 
 void LocalVoxelsOverlay::render() {
@@ -14,8 +14,14 @@
 
 #include "HTTPConnection.h"
 #include "HTTPManager.h"
+#include "StatsWriter.h"
 
 bool HTTPManager::handleHTTPRequest(HTTPConnection* connection, const QString& path) {
+    if (path == STATS_PATH && !_statsProviders.isEmpty()) {
+        respondWithStats(connection);
+        return true;
+    }
+    
     if (_requestHandler && _requestHandler->handleHTTPRequest(connection, path)) {
         // this request was handled by our _requestHandler object
         // so we don't need to attempt to do so in the document root
@@ -124,7 +130,8 @@ bool HTTPManager::handleHTTPRequest(HTTPConnection* connection, const QString& p
 HTTPManager::HTTPManager(quint16 port, const QString& documentRoot, HTTPRequestHandler* requestHandler, QObject* parent) :
     QTcpServer(parent),
     _documentRoot(documentRoot),
-    _requestHandler(requestHandler)
+    _requestHandler(requestHandler),
+    _lastStatsSize(0)
 {
     // start listening on the passed port
     if (!listen(QHostAddress("0.0.0.0"), port)) {
@@ -142,3 +149,17 @@ void HTTPManager::acceptConnections() {
         new HTTPConnection(socket, this);
     }
 }
+
+void HTTPManager::respondWithStats(HTTPConnection* connection) {
+    // scrapers come back every few seconds for about as much as last time, so make room for that up front
+    QByteArray stats;
+    stats.reserve(_lastStatsSize);
+    StatsWriter writer(stats);
+    foreach (StatsProvider* provider, _statsProviders) {
+        writer.setPrefix(QByteArray());
+        provider->writeStats(writer);
+    }
+    _lastStatsSize = stats.size();
+    
+    connection->respond(HTTPConnection::StatusCode200, stats, "text/plain; version=0.0.4");
+}
@@ -13,9 +13,14 @@
 #ifndef __hifi__HTTPManager__
 #define __hifi__HTTPManager__
 
+#include <QtCore/QList>
 #include <QtNetwork/QTcpServer>
 
 class HTTPConnection;
+class StatsProvider;
+
+/// The path of the machine-readable stats, in the Prometheus text format.
+const QString STATS_PATH = "/metrics";
 
 class HTTPRequestHandler {
 public:
@@ -32,12 +37,21 @@ public:
     
     bool handleHTTPRequest(HTTPConnection* connection, const QString& path);
     
+    /// Adds a provider of the stats served on the stats path.
+    void addStatsProvider(StatsProvider* provider) { _statsProviders.append(provider); }
+    
 protected slots:
     /// Accepts all pending connections
     void acceptConnections();
 protected:
     QString _documentRoot;
     HTTPRequestHandler* _requestHandler;
+    
+private:
+    void respondWithStats(HTTPConnection* connection);
+    
+    QList<StatsProvider*> _statsProviders;
+    int _lastStatsSize;
 };
 
 #endif /* defined(__hifi__HTTPManager__) */
@@ -0,0 +1,60 @@
+//
+//  StatsWriter.cpp
+//  hifi
+//
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QtNumeric>
+
+#include "StatsWriter.h"
+
+StatsWriter::StatsWriter(QByteArray& output, const QByteArray& prefix) :
+    _output(output),
+    _prefix(prefix) {
+}
+
+void StatsWriter::writeFamily(const char* name, const char* type, const char* help) {
+    _output.append("# HELP ").append(_prefix).append(name).append(' ').append(help).append('\n');
+    _output.append("# TYPE ").append(_prefix).append(name).append(' ').append(type).append('\n');
+}
+
+void StatsWriter::writeSample(const char* name, double value, const char* labelName, const QString& labelValue) {
+    writeName(name, labelName, labelValue);
+    if (qIsNaN(value)) {
+        _output.append("NaN\n");
+        
+    } else if (qIsInf(value)) {
+        _output.append(value > 0.0 ? "+Inf\n" : "-Inf\n");
+        
+    } else {
+        const int SIGNIFICANT_DIGITS = 10;
+        _output.append(QByteArray::number(value, 'g', SIGNIFICANT_DIGITS)).append('\n');
+    }
+}
+
+void StatsWriter::writeSample(const char* name, quint64 value, const char* labelName, const QString& labelValue) {
+    writeName(name, labelName, labelValue);
+    _output.append(QByteArray::number(value)).append('\n');
+}
+
+void StatsWriter::writeCounter(const char* name, quint64 value, const char* help) {
+    writeFamily(name, "counter", help);
+    writeSample(name, value);
+}
+
+void StatsWriter::writeGauge(const char* name, double value, const char* help) {
+    writeFamily(name, "gauge", help);
+    writeSample(name, value);
+}
+
+void StatsWriter::writeName(const char* name, const char* labelName, const QString& labelValue) {
+    _output.append(_prefix).append(name);
+    if (labelName) {
+        // label values escape backslashes, quotes and newlines
+        QByteArray escaped = labelValue.toUtf8();
+        escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+        _output.append('{').append(labelName).append("=\"").append(escaped).append("\"}");
+    }
+    _output.append(' ');
+}
@@ -0,0 +1,54 @@
+//
+//  StatsWriter.h
+//  hifi
+//
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__StatsWriter__
+#define __hifi__StatsWriter__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+/// Writes stats in the Prometheus text exposition format: a HELP and a TYPE line for each family of stats, then a line
+/// per sample, "name{label="value"} number".
+class StatsWriter {
+public:
+
+    /// Initializes the writer to append to the given output, prefixing each stat name with the prefix.
+    StatsWriter(QByteArray& output, const QByteArray& prefix = QByteArray());
+
+    void setPrefix(const QByteArray& prefix) { _prefix = prefix; }
+    const QByteArray& getPrefix() const { return _prefix; }
+
+    /// Starts a family of samples.
+    /// \param type "counter", "gauge", "summary" or "untyped"
+    void writeFamily(const char* name, const char* type, const char* help);
+
+    /// Writes a sample, with an optional label (quantile="0.99", say).
+    void writeSample(const char* name, double value, const char* labelName = NULL, const QString& labelValue = QString());
+    void writeSample(const char* name, quint64 value, const char* labelName = NULL, const QString& labelValue = QString());
+
+    /// Writes a family with a single sample.
+    void writeCounter(const char* name, quint64 value, const char* help);
+    void writeGauge(const char* name, double value, const char* help);
+
+private:
+
+    void writeName(const char* name, const char* labelName, const QString& labelValue);
+
+    QByteArray& _output;
+    QByteArray _prefix;
+};
+
+/// Provides stats to an HTTPManager's stats page.
+class StatsProvider {
+public:
+    virtual ~StatsProvider() { }
+
+    /// Writes the current stats.  Called on the manager's thread for each request, so should read only live counters.
+    virtual void writeStats(StatsWriter& writer) = 0;
+};
+
+#endif /* defined(__hifi__StatsWriter__) */
@@ -13,6 +13,7 @@
 #include <QMetaType>
 #include <QUrl>
 #include <QtDebug>
+#include <QtEndian>
 
 #include <RegisteredMetaTypes.h>
 #include <SharedUtil.h>
@@ -93,8 +94,12 @@ QList<const QMetaObject*> Bitstream::getMetaObjectSubClasses(const QMetaObject*
 Bitstream::Bitstream(QDataStream& underlying, QObject* parent) :
     QObject(parent),
     _underlying(underlying),
-    _byte(0),
-    _position(0),
+    _writeWord(0),
+    _writtenBits(0),
+    _bufferedBytes(0),
+    _readWord(0),
+    _unreadBits(0),
+    _bytesPastEnd(0),
     _metaObjectStreamer(*this),
     _typeStreamerStreamer(*this),
     _attributeStreamer(*this),
@@ -103,19 +108,40 @@ Bitstream::Bitstream(QDataStream& underlying, QObject* parent) :
 }
 
 const int LAST_BIT_POSITION = BITS_IN_BYTE - 1;
+const int BITS_IN_WORD = 64;
+const int BYTES_IN_WORD = BITS_IN_WORD / BITS_IN_BYTE;
+
+// values pass through the word registers in chunks of at most this many bits, so that a chunk starting at any bit offset
+// within its first byte still fits in a single word
+const int MAX_CHUNK_BITS = BITS_IN_WORD - BITS_IN_BYTE;
+
+// values shorter than this take the chunked path even when aligned
+const int MIN_ALIGNED_BULK_BITS = BITS_IN_WORD;
+
+static inline quint64 getLowBitMask(int bits) {
+    return (Q_UINT64_C(1) << bits) - 1;
+}
+
+static inline int getBytesSpanned(int bits, int offset) {
+    return (offset + bits + LAST_BIT_POSITION) / BITS_IN_BYTE;
+}
 
 Bitstream& Bitstream::write(const void* data, int bits, int offset) {
     const quint8* source = (const quint8*)data;
+    if (offset == 0 && (_writtenBits & LAST_BIT_POSITION) == 0 && bits >= MIN_ALIGNED_BULK_BITS) {
+        int bytes = bits / BITS_IN_BYTE;
+        writeAlignedBytes(source, bytes);
+        source += bytes;
+        bits -= bytes * BITS_IN_BYTE;
+    }
     while (bits > 0) {
-        int bitsToWrite = qMin(BITS_IN_BYTE - _position, qMin(BITS_IN_BYTE - offset, bits));
-        _byte |= ((*source >> offset) & ((1 << bitsToWrite) - 1)) << _position;
-        if ((_position += bitsToWrite) == BITS_IN_BYTE) {
-            flush();
-        }
-        if ((offset += bitsToWrite) == BITS_IN_BYTE) {
-            source++;
-            offset = 0;
-        }
+        int bitsToWrite = qMin(bits, MAX_CHUNK_BITS);
+        quint64 word = 0;
+        memcpy(&word, source, getBytesSpanned(bitsToWrite, offset));
+        writeBits((qFromLittleEndian(word) >> offset) & getLowBitMask(bitsToWrite), bitsToWrite);
+        offset += bitsToWrite;
+        source += offset / BITS_IN_BYTE;
+        offset &= LAST_BIT_POSITION;
         bits -= bitsToWrite;
     }
     return *this;
@@ -123,33 +149,154 @@ Bitstream& Bitstream::write(const void* data, int bits, int offset) {
 
 Bitstream& Bitstream::read(void* data, int bits, int offset) {
     quint8* dest = (quint8*)data;
+    if (offset == 0 && (_unreadBits & LAST_BIT_POSITION) == 0 && bits >= MIN_ALIGNED_BULK_BITS) {
+        int bytes = bits / BITS_IN_BYTE;
+        readAlignedBytes(dest, bytes);
+        dest += bytes;
+        bits -= bytes * BITS_IN_BYTE;
+    }
     while (bits > 0) {
-        if (_position == 0) {
-            _underlying >> _byte;
-        }
-        int bitsToRead = qMin(BITS_IN_BYTE - _position, qMin(BITS_IN_BYTE - offset, bits));
-        int mask = ((1 << bitsToRead) - 1) << offset;
-        *dest = (*dest & ~mask) | (((_byte >> _position) << offset) & mask);
-        _position = (_position + bitsToRead) & LAST_BIT_POSITION;
-        if ((offset += bitsToRead) == BITS_IN_BYTE) {
-            dest++;
-            offset = 0;
-        }
+        // merge the chunk into the destination, leaving the bits around it as they were
+        int bitsToRead = qMin(bits, MAX_CHUNK_BITS);
+        int bytes = getBytesSpanned(bitsToRead, offset);
+        quint64 word = 0;
+        memcpy(&word, dest, bytes);
+        word = qFromLittleEndian(word);
+        word = (word & ~(getLowBitMask(bitsToRead) << offset)) | (readBits(bitsToRead) << offset);
+        word = qToLittleEndian(word);
+        memcpy(dest, &word, bytes);
+        offset += bitsToRead;
+        dest += offset / BITS_IN_BYTE;
+        offset &= LAST_BIT_POSITION;
         bits -= bitsToRead;
     }
     return *this;
 }
 
+int Bitstream::getBitsWritten() const {
+    return (_underlying.device()->pos() + _bufferedBytes) * BITS_IN_BYTE + _writtenBits;
+}
+
 void Bitstream::flush() {
-    if (_position != 0) {
-        _underlying << _byte;
-        reset();
+    int bytes = getBytesSpanned(_writtenBits, 0);
+    if (bytes > 0) {
+        quint64 word = qToLittleEndian(_writeWord);
+        bufferBytes(&word, bytes);
+        _writeWord = 0;
+        _writtenBits = 0;
     }
+    flushWriteBuffer();
 }
 
 void Bitstream::reset() {
-    _byte = 0;
-    _position = 0;
+    // any whole bytes written have always gone to the underlying stream; only a partial byte is dropped
+    int bytes = _writtenBits / BITS_IN_BYTE;
+    if (bytes > 0) {
+        quint64 word = qToLittleEndian(_writeWord);
+        bufferBytes(&word, bytes);
+    }
+    flushWriteBuffer();
+    _writeWord = 0;
+    _writtenBits = 0;
+    
+    // likewise, give back the whole bytes we read ahead (the partial byte counts as read)
+    int unreadBytes = _unreadBits / BITS_IN_BYTE - _bytesPastEnd;
+    if (unreadBytes > 0) {
+        QIODevice* device = _underlying.device();
+        device->seek(device->pos() - unreadBytes);
+    }
+    _readWord = 0;
+    _unreadBits = 0;
+    _bytesPastEnd = 0;
+}
+
+void Bitstream::writeBits(quint64 value, int bits) {
+    _writeWord |= value << _writtenBits;
+    if ((_writtenBits += bits) >= BITS_IN_WORD) {
+        quint64 word = qToLittleEndian(_writeWord);
+        bufferBytes(&word, BYTES_IN_WORD);
+        _writtenBits -= BITS_IN_WORD;
+        _writeWord = value >> (bits - _writtenBits);
+    }
+}
+
+void Bitstream::writeAlignedBytes(const quint8* data, int bytes) {
+    // the register holds whole bytes, so it can be emptied before the aligned data
+    if (_writtenBits > 0) {
+        quint64 word = qToLittleEndian(_writeWord);
+        bufferBytes(&word, _writtenBits / BITS_IN_BYTE);
+        _writeWord = 0;
+        _writtenBits = 0;
+    }
+    if (bytes > WRITE_BUFFER_SIZE - _bufferedBytes) {
+        flushWriteBuffer();
+        if (bytes > WRITE_BUFFER_SIZE) {
+            _underlying.writeRawData((const char*)data, bytes);
+            return;
+        }
+    }
+    memcpy(_writeBuffer + _bufferedBytes, data, bytes);
+    _bufferedBytes += bytes;
+}
+
+void Bitstream::bufferBytes(const void* data, int bytes) {
+    if (bytes > WRITE_BUFFER_SIZE - _bufferedBytes) {
+        flushWriteBuffer();
+    }
+    memcpy(_writeBuffer + _bufferedBytes, data, bytes);
+    _bufferedBytes += bytes;
+}
+
+void Bitstream::flushWriteBuffer() {
+    if (_bufferedBytes > 0) {
+        _underlying.writeRawData((const char*)_writeBuffer, _bufferedBytes);
+        _bufferedBytes = 0;
+    }
+}
+
+quint64 Bitstream::readBits(int bits) {
+    if (_unreadBits < bits) {
+        fillReadWord();
+    }
+    quint64 value = _readWord & getLowBitMask(bits);
+    _readWord >>= bits;
+    _unreadBits -= bits;
+    return value;
+}
+
+void Bitstream::readAlignedBytes(quint8* data, int bytes) {
+    // use up the whole bytes we read ahead, then read the rest directly
+    int bytesFromWord = qMin(bytes, _unreadBits / BITS_IN_BYTE);
+    for (int i = 0; i < bytesFromWord; i++) {
+        *data++ = (quint8)_readWord;
+        _readWord >>= BITS_IN_BYTE;
+    }
+    _unreadBits -= bytesFromWord * BITS_IN_BYTE;
+    bytes -= bytesFromWord;
+    if (bytes == 0) {
+        return;
+    }
+    int bytesRead = qMax(_underlying.readRawData((char*)data, bytes), 0);
+    if (bytesRead < bytes) {
+        // past the end, values read as zero
+        memset(data + bytesRead, 0, bytes - bytesRead);
+    }
+}
+
+void Bitstream::fillReadWord() {
+    // read as many whole bytes as will fit above the unread bits
+    int bytes = (BITS_IN_WORD - _unreadBits) / BITS_IN_BYTE;
+    quint64 word = 0;
+    int bytesRead = qMax(_underlying.readRawData((char*)&word, bytes), 0);
+    if (bytesRead < bytes) {
+        // the device may have scribbled past what it read; past the end, values read as zero
+        word = qFromLittleEndian(word) & getLowBitMask(bytesRead * BITS_IN_BYTE);
+        _bytesPastEnd += bytes - bytesRead;
+    } else {
+        word = qFromLittleEndian(word);
+    }
+    _readWord |= word << _unreadBits;
+    _unreadBits += bytes * BITS_IN_BYTE;
 }
 
 Bitstream::WriteMappings Bitstream::getAndResetWriteMappings() {
@@ -181,6 +328,22 @@ void Bitstream::persistAndResetWriteMappings() {
     persistWriteMappings(getAndResetWriteMappings());
 }
 
+bool Bitstream::hasSameWriteMappings(const Bitstream& other) const {
+    return _metaObjectStreamer.hasSameWriteState(other._metaObjectStreamer) &&
+        _typeStreamerStreamer.hasSameWriteState(other._typeStreamerStreamer) &&
+        _attributeStreamer.hasSameWriteState(other._attributeStreamer) &&
+        _scriptStringStreamer.hasSameWriteState(other._scriptStringStreamer) &&
+        _sharedObjectStreamer.hasSameWriteState(other._sharedObjectStreamer);
+}
+
+void Bitstream::copyWriteMappings(const Bitstream& other) {
+    _metaObjectStreamer.copyWriteState(other._metaObjectStreamer);
+    _typeStreamerStreamer.copyWriteState(other._typeStreamerStreamer);
+    _attributeStreamer.copyWriteState(other._attributeStreamer);
+    _scriptStringStreamer.copyWriteState(other._scriptStringStreamer);
+    _sharedObjectStreamer.copyWriteState(other._sharedObjectStreamer);
+}
+
 Bitstream::ReadMappings Bitstream::getAndResetReadMappings() {
     ReadMappings mappings = { _metaObjectStreamer.getAndResetTransientValues(),
         _typeStreamerStreamer.getAndResetTransientValues(),
@@ -210,21 +373,12 @@ void Bitstream::clearSharedObject(int id) {
 }
 
 Bitstream& Bitstream::operator<<(bool value) {
-    if (value) {
-        _byte |= (1 << _position);
-    }
-    if (++_position == BITS_IN_BYTE) {
-        flush();
-    }
+    writeBits(value ? 1 : 0, 1);
     return *this;
 }
 
 Bitstream& Bitstream::operator>>(bool& value) {
-    if (_position == 0) {
-        _underlying >> _byte;
-    }
-    value = _byte & (1 << _position);
-    _position = (_position + 1) & LAST_BIT_POSITION;
+    value = readBits(1);
     return *this;
 }
 
@@ -44,6 +44,9 @@ public:
     
     void setBitsFromValue(int value);
     
+    int getBits() const { return _bits; }
+    void setBits(int bits) { _bits = bits; }
+    
     IDStreamer& operator<<(int value);
     IDStreamer& operator>>(int& value);
     
@@ -73,6 +76,12 @@ public:
     
     T takePersistentValue(int id) { T value = _persistentValues.take(id); _persistentIDs.remove(value); return value; }
     
+    /// Checks whether this streamer would write any value exactly as the other one would.
+    bool hasSameWriteState(const RepeatedValueStreamer& other) const;
+    
+    /// Copies the state that determines how values are written from the other streamer.
+    void copyWriteState(const RepeatedValueStreamer& other);
+    
     RepeatedValueStreamer& operator<<(T value);
     RepeatedValueStreamer& operator>>(T& value);
     
@@ -130,6 +139,21 @@ template<class T, class P> inline void RepeatedValueStreamer<T, P>::persistTrans
     _idStreamer.setBitsFromValue(_lastPersistentID);
 }
 
+template<class T, class P> inline bool RepeatedValueStreamer<T, P>::hasSameWriteState(
+        const RepeatedValueStreamer& other) const {
+    return _idStreamer.getBits() == other._idStreamer.getBits() && _lastPersistentID == other._lastPersistentID &&
+        _lastTransientOffset == other._lastTransientOffset && _persistentIDs == other._persistentIDs &&
+        _transientOffsets == other._transientOffsets;
+}
+
+template<class T, class P> inline void RepeatedValueStreamer<T, P>::copyWriteState(const RepeatedValueStreamer& other) {
+    _idStreamer.setBits(other._idStreamer.getBits());
+    _lastPersistentID = other._lastPersistentID;
+    _lastTransientOffset = other._lastTransientOffset;
+    _persistentIDs = other._persistentIDs;
+    _transientOffsets = other._transientOffsets;
+}
+
 template<class T, class P> inline RepeatedValueStreamer<T, P>& RepeatedValueStreamer<T, P>::operator<<(T value) {
     int id = _persistentIDs.value(value);
     if (id == 0) {
@@ -205,7 +229,9 @@ public:
     /// Returns the list of registered subclasses for the supplied meta-object.
     static QList<const QMetaObject*> getMetaObjectSubClasses(const QMetaObject* metaObject);
 
-    /// Creates a new bitstream.  Note: the stream may be used for reading or writing, but not both.
+    /// Creates a new bitstream.  Note: the stream may be used for reading or writing, but not both.  Bits are gathered a
+    /// 64-bit word at a time: written words are buffered until flush(), and reads fetch up to a word ahead of the bits
+    /// consumed, so the underlying stream must only be touched directly after a flush() (writing) or reset() (reading).
     Bitstream(QDataStream& underlying, QObject* parent = NULL);
 
     /// Writes a set of bits to the underlying stream.
@@ -218,10 +244,15 @@ public:
     /// \param offset the offset of the first bit
     Bitstream& read(void* data, int bits, int offset = 0);    
 
+    /// Returns the number of bits written, counting from the start of the underlying device and including those not yet
+    /// flushed.
+    int getBitsWritten() const;
+
     /// Flushes any unwritten bits to the underlying stream.
     void flush();
 
-    /// Resets to the initial state.
+    /// Resets to the initial state.  When reading, returns any whole bytes read ahead to the underlying device, leaving
+    /// it positioned just past the last byte (partially) consumed.
     void reset();
 
     /// Returns the set of transient mappings gathered during writing and resets them.
@@ -233,6 +264,13 @@ public:
     /// Immediately persists and resets the write mappings.
     void persistAndResetWriteMappings();
 
+    /// Checks whether this stream would write every repeated value (meta-object, attribute, shared object, etc.) exactly
+    /// as the other would, so that bits written by one may be copied to the other.
+    bool hasSameWriteMappings(const Bitstream& other) const;
+
+    /// Copies the persistent and transient write mappings of the other stream, as when the bits it wrote are copied here.
+    void copyWriteMappings(const Bitstream& other);
+
     /// Returns the set of transient mappings gathered during reading and resets them.
     ReadMappings getAndResetReadMappings();
     
@@ -335,9 +373,27 @@ private:
     
     void readProperties(QObject* object);
    
+    void writeBits(quint64 value, int bits);
+    void writeAlignedBytes(const quint8* data, int bytes);
+    void bufferBytes(const void* data, int bytes);
+    void flushWriteBuffer();
+    
+    quint64 readBits(int bits);
+    void readAlignedBytes(quint8* data, int bytes);
+    void fillReadWord();
+    
+    static const int WRITE_BUFFER_SIZE = 1024;
+    
     QDataStream& _underlying;
-    quint8 _byte;
-    int _position;
+    
+    quint64 _writeWord; ///< bits not yet buffered, least significant first
+    int _writtenBits;
+    quint8 _writeBuffer[WRITE_BUFFER_SIZE];
+    int _bufferedBytes;
+    
+    quint64 _readWord; ///< bits read ahead but not yet consumed, least significant first
+    int _unreadBits;
+    int _bytesPastEnd; ///< zero bytes standing in for data beyond the end of the underlying stream
 
     RepeatedValueStreamer<const QMetaObject*> _metaObjectStreamer;
     RepeatedValueStreamer<const TypeStreamer*> _typeStreamerStreamer;
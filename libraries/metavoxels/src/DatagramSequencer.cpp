@@ -6,6 +6,8 @@
 //  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
 //
 
+#include <climits>
+#include <cmath>
 #include <cstring>
 
 #include <QtDebug>
@@ -20,6 +22,163 @@ const int MAX_DATAGRAM_SIZE = MAX_PACKET_SIZE;
 
 const int DEFAULT_MAX_PACKET_SIZE = 3000;
 
+// the congestion window is measured in bytes, but grows in terms of full datagrams
+const float MAX_SEGMENT_SIZE = MAX_DATAGRAM_SIZE;
+
+const float INITIAL_CONGESTION_WINDOW = 10.0f * MAX_SEGMENT_SIZE;
+const float MIN_CONGESTION_WINDOW = 2.0f * MAX_SEGMENT_SIZE;
+const float MAX_CONGESTION_WINDOW = 4.0f * 1024.0f * 1024.0f;
+
+/// The factor by which a loss shrinks the window.
+const float CUBIC_BETA = 0.7f;
+
+/// The scale of the cubic function, in segments per second cubed.
+const float CUBIC_C = 0.4f;
+
+/// The window growth per round trip (in segments) that makes Reno with our beta as aggressive as standard Reno.
+const float RENO_FRIENDLY_INCREASE = 3.0f * (1.0f - CUBIC_BETA) / (1.0f + CUBIC_BETA);
+
+const int INITIAL_TIMEOUT = 1000 * 1000;
+const int MIN_TIMEOUT = 200 * 1000;
+const int MAX_TIMEOUT_BACKOFF = 64;
+
+/// The round trip time assumed for pacing until we have a sample.
+const int INITIAL_PACING_ROUND_TRIP_TIME = 100 * 1000;
+
+/// The factors by which the pacing rate exceeds the window per round trip: enough to let the window grow.
+const float SLOW_START_PACING_GAIN = 2.0f;
+const float PACING_GAIN = 1.25f;
+
+/// The burst that the pacer may release at once after being idle.
+const float MAX_PACING_BURST = 2.0f * MAX_SEGMENT_SIZE;
+
+CongestionController::CongestionController() :
+    _window(INITIAL_CONGESTION_WINDOW),
+    _slowStartThreshold(MAX_CONGESTION_WINDOW),
+    _bytesInFlight(0),
+    _lastSentPacketNumber(0),
+    _recoveryPacketNumber(0),
+    _roundTripTime(0),
+    _roundTripTimeVariance(0),
+    _timeoutBackoff(1),
+    _windowBeforeTimeout(0.0f),
+    _slowStartThresholdBeforeTimeout(0.0f),
+    _epochStart(0),
+    _epochOriginWindow(0.0f),
+    _epochPlateauTime(0.0f),
+    _lastMaximumWindow(0.0f),
+    _renoWindow(0.0f) {
+}
+
+int CongestionController::getTimeout() const {
+    if (_roundTripTime == 0) {
+        return INITIAL_TIMEOUT * _timeoutBackoff;
+    }
+    const int VARIANCE_MULTIPLIER = 4;
+    return qMax(MIN_TIMEOUT, _roundTripTime + VARIANCE_MULTIPLIER * _roundTripTimeVariance) * _timeoutBackoff;
+}
+
+float CongestionController::getPacingRate() const {
+    int roundTripTime = (_roundTripTime == 0) ? INITIAL_PACING_ROUND_TRIP_TIME : qMax(_roundTripTime, 1);
+    float gain = (_window < _slowStartThreshold) ? SLOW_START_PACING_GAIN : PACING_GAIN;
+    return gain * _window * USECS_PER_SECOND / roundTripTime;
+}
+
+bool CongestionController::packetSent(int packetNumber, int bytes) {
+    _lastSentPacketNumber = packetNumber;
+    _bytesInFlight += bytes;
+    
+    // senders that don't fill even half the window can't tell us whether it's too small
+    return _bytesInFlight >= _window / 2.0f;
+}
+
+void CongestionController::packetAcknowledged(int bytes, bool windowLimited, quint64 sentTime, quint64 now) {
+    _bytesInFlight -= bytes;
+    _timeoutBackoff = 1;
+    _windowBeforeTimeout = 0.0f;
+    
+    // update the smoothed round trip time and its variance as TCP does (RFC 6298)
+    if (sentTime != 0) {
+        int sample = (now > sentTime) ? (int)qMin(now - sentTime, (quint64)INT_MAX) : 0;
+        if (_roundTripTime == 0) {
+            _roundTripTime = qMax(sample, 1);
+            _roundTripTimeVariance = sample / 2;
+        } else {
+            _roundTripTimeVariance += (qAbs(_roundTripTime - sample) - _roundTripTimeVariance) / 4;
+            _roundTripTime = qMax(_roundTripTime + (sample - _roundTripTime) / 8, 1);
+        }
+    }
+    
+    if (!windowLimited) {
+        return;
+    }
+    if (_window < _slowStartThreshold) {
+        _window = qMin(_window + bytes, MAX_CONGESTION_WINDOW);
+        return;
+    }
+    if (_epochStart == 0) {
+        // start a new epoch: the cubic function plateaus at the window where we last lost, if we're below it
+        _epochStart = now;
+        _renoWindow = _window;
+        if (_window < _lastMaximumWindow) {
+            _epochOriginWindow = _lastMaximumWindow;
+            _epochPlateauTime = powf((_lastMaximumWindow - _window) / MAX_SEGMENT_SIZE / CUBIC_C, 1.0f / 3.0f);
+        } else {
+            _epochOriginWindow = _window;
+            _epochPlateauTime = 0.0f;
+        }
+    }
+    // aim for where the cubic function will be a round trip from now, or Reno, whichever is larger
+    float time = (now + _roundTripTime - _epochStart) / (float)USECS_PER_SECOND - _epochPlateauTime;
+    float cubicWindow = _epochOriginWindow + CUBIC_C * time * time * time * MAX_SEGMENT_SIZE;
+    _renoWindow += RENO_FRIENDLY_INCREASE * MAX_SEGMENT_SIZE * bytes / _window;
+    float target = qMax(cubicWindow, _renoWindow);
+    if (target > _window) {
+        // grow no faster than slow start would
+        _window = qMin(_window + qMin(target - _window, (float)bytes), MAX_CONGESTION_WINDOW);
+    }
+}
+
+void CongestionController::timedOutPacketAcknowledged() {
+    // the bytes already left the window when the packet timed out
+    _timeoutBackoff = 1;
+    if (_windowBeforeTimeout == 0.0f) {
+        return;
+    }
+    _window = qMax(_window, _windowBeforeTimeout);
+    _slowStartThreshold = qMax(_slowStartThreshold, _slowStartThresholdBeforeTimeout);
+    _windowBeforeTimeout = 0.0f;
+}
+
+void CongestionController::packetLost(int packetNumber, int bytes) {
+    _bytesInFlight -= bytes;
+    _windowBeforeTimeout = 0.0f; // a real loss; there's no going back
+    if (packetNumber <= _recoveryPacketNumber) {
+        return; // we already shrank the window for this round trip
+    }
+    _recoveryPacketNumber = _lastSentPacketNumber;
+    
+    // if we didn't get back to the last maximum, something else is probably competing for the link, so leave it more
+    _lastMaximumWindow = (_window < _lastMaximumWindow) ? _window * (1.0f + CUBIC_BETA) / 2.0f : _window;
+    _window = qMax(_window * CUBIC_BETA, MIN_CONGESTION_WINDOW);
+    _slowStartThreshold = _window;
+    _epochStart = 0;
+}
+
+void CongestionController::timedOut(int bytes) {
+    _bytesInFlight -= bytes;
+    if (_windowBeforeTimeout == 0.0f) {
+        _windowBeforeTimeout = _window;
+        _slowStartThresholdBeforeTimeout = _slowStartThreshold;
+    }
+    _recoveryPacketNumber = _lastSentPacketNumber;
+    _lastMaximumWindow = _window;
+    _slowStartThreshold = qMax(_window * CUBIC_BETA, MIN_CONGESTION_WINDOW);
+    _window = MIN_CONGESTION_WINDOW;
+    _epochStart = 0;
+    _timeoutBackoff = qMin(_timeoutBackoff * 2, MAX_TIMEOUT_BACKOFF);
+}
+
 DatagramSequencer::DatagramSequencer(const QByteArray& datagramHeader, QObject* parent) :
     QObject(parent),
     _outgoingPacketStream(&_outgoingPacketData, QIODevice::WriteOnly),
@@ -34,7 +193,12 @@ DatagramSequencer::DatagramSequencer(const QByteArray& datagramHeader, QObject*
     _incomingPacketStream(&_incomingPacketData, QIODevice::ReadOnly),
     _inputStream(_incomingPacketStream),
     _receivedHighPriorityMessages(0),
-    _maxPacketSize(DEFAULT_MAX_PACKET_SIZE) {
+    _maxPacketSize(DEFAULT_MAX_PACKET_SIZE),
+    _clock(usecTimestampNow),
+    _pacingEnabled(false),
+    _pacedBytes(0),
+    _pacingCredit(0.0f),
+    _lastPacingTime(0) {
 
     _outgoingPacketStream.setByteOrder(QDataStream::LittleEndian);
     _incomingDatagramStream.setByteOrder(QDataStream::LittleEndian);
@@ -68,7 +232,37 @@ ReliableChannel* DatagramSequencer::getReliableInputChannel(int index) {
     return channel;
 }
 
+void DatagramSequencer::releasePacedDatagrams() {
+    quint64 now = _clock();
+    checkTimeout(now);
+    
+    // credit accumulates at the pacing rate; when there's nothing to send, only enough for a small burst is kept
+    if (_lastPacingTime != 0) {
+        _pacingCredit += (now - _lastPacingTime) * _congestionController.getPacingRate() / USECS_PER_SECOND;
+    }
+    _lastPacingTime = now;
+    while (!_pacedDatagrams.isEmpty() && _pacingCredit > 0.0f) {
+        PacedDatagram paced = _pacedDatagrams.takeFirst();
+        _pacedBytes -= paced.datagram.size();
+        _pacingCredit -= paced.datagram.size();
+        
+        // the packet is sent when its last datagram is
+        if (!_sendRecords.isEmpty()) {
+            int index = paced.packetNumber - _sendRecords.first().packetNumber;
+            if (index >= 0 && index < _sendRecords.size()) {
+                _sendRecords[index].sentTime = now;
+            }
+        }
+        emit readyToWrite(paced.datagram);
+    }
+    if (_pacedDatagrams.isEmpty()) {
+        _pacingCredit = qMin(_pacingCredit, MAX_PACING_BURST);
+    }
+}
+
 Bitstream& DatagramSequencer::startPacket() {
+    checkTimeout(_clock());
+    
     // start with the list of acknowledgements
     _outgoingPacketStream << (quint32)_receiveRecords.size();
     foreach (const ReceiveRecord& record, _receiveRecords) {
@@ -88,8 +282,13 @@ Bitstream& DatagramSequencer::startPacket() {
 void DatagramSequencer::endPacket() {
     _outputStream.flush();
     
-    // if we have space remaining, send some data from our reliable channels 
-    int remaining = _maxPacketSize - _outgoingPacketStream.device()->pos();
+    // if we have space remaining, send some data from our reliable channels.  only paced senders are held to the
+    // congestion window: the others send as the other party's packets arrive, so may go long stretches without
+    // acknowledgements, and would otherwise stall their reliable data on timeouts that don't reflect congestion
+    int remaining = _maxPacketSize - (int)_outgoingPacketStream.device()->pos();
+    if (_pacingEnabled) {
+        remaining = qMin(remaining, getSendBudget());
+    }
     const int MINIMUM_RELIABLE_SIZE = sizeof(quint32) * 5; // count, channel number, segment count, offset, size
     QVector<ChannelSpan> spans;
     if (remaining > MINIMUM_RELIABLE_SIZE) {
@@ -170,6 +369,23 @@ void DatagramSequencer::receivedDatagram(const QByteArray& datagram) {
             continue;
         }
         QList<SendRecord>::iterator it = _sendRecords.begin() + index;
+        
+        // the packets before this one won't be read if they haven't been already, so they count as lost
+        quint64 now = _clock();
+        for (QList<SendRecord>::iterator lost = _sendRecords.begin(); lost != it; lost++) {
+            if (lost->inFlight) {
+                _congestionController.packetLost(lost->packetNumber, lost->size);
+            }
+        }
+        if (it->inFlight) {
+            // the other party acknowledges everything it received since it last sent, so only the newest
+            // acknowledgement wasn't held back for long
+            bool newest = (i == acknowledgementCount - 1);
+            _congestionController.packetAcknowledged(it->size, it->windowLimited, newest ? it->sentTime : 0, now);
+            
+        } else if (it->sentTime != 0) {
+            _congestionController.timedOutPacketAcknowledged();
+        }
         sendRecordAcknowledged(*it);
         emit sendAcknowledged(index);
         _sendRecords.erase(_sendRecords.begin(), it + 1);
@@ -191,7 +407,8 @@ void DatagramSequencer::receivedDatagram(const QByteArray& datagram) {
     // alert external parties so that they can read the middle
     emit readyToRead(_inputStream);
     
-    // read the reliable data, if any
+    // read the reliable data, if any, from just past the bits read so far
+    _inputStream.reset();
     quint32 reliableChannels;
     _incomingPacketStream >> reliableChannels;
     for (quint32 i = 0; i < reliableChannels; i++) {
@@ -292,7 +509,7 @@ void DatagramSequencer::sendPacket(const QByteArray& packet, const QVector<Chann
     
     // record the send
     SendRecord record = { _outgoingPacketNumber, _receiveRecords.isEmpty() ? 0 : _receiveRecords.last().packetNumber,
-        _outputStream.getAndResetWriteMappings(), spans };
+        _outputStream.getAndResetWriteMappings(), spans, 0, 0, true, false };
     _sendRecords.append(record);
     
     // write the sequence number and size, which are the same between all fragments
@@ -303,6 +520,7 @@ void DatagramSequencer::sendPacket(const QByteArray& packet, const QVector<Chann
     
     // break the packet into MTU-sized datagrams
     int offset = 0;
+    int size = 0;
     do {
         _outgoingDatagramBuffer.seek(initialPosition);
         _outgoingDatagramStream << (quint32)offset;
@@ -310,11 +528,49 @@ void DatagramSequencer::sendPacket(const QByteArray& packet, const QVector<Chann
         int payloadSize = qMin((int)(_outgoingDatagram.size() - _outgoingDatagramBuffer.pos()), packet.size() - offset);
         memcpy(_outgoingDatagram.data() + _outgoingDatagramBuffer.pos(), packet.constData() + offset, payloadSize);
         
-        emit readyToWrite(QByteArray::fromRawData(_outgoingDatagram.constData(), _outgoingDatagramBuffer.pos() + payloadSize));
+        int datagramSize = _outgoingDatagramBuffer.pos() + payloadSize;
+        writeDatagram(QByteArray::fromRawData(_outgoingDatagram.constData(), datagramSize));
+        size += datagramSize;
         
         offset += payloadSize;
         
     } while(offset < packet.size());
+    
+    SendRecord& sent = _sendRecords.last();
+    sent.size = size;
+    sent.sentTime = _pacingEnabled ? 0 : _clock();
+    sent.windowLimited = _congestionController.packetSent(_outgoingPacketNumber, size);
+}
+
+void DatagramSequencer::writeDatagram(const QByteArray& datagram) {
+    if (!_pacingEnabled) {
+        emit readyToWrite(datagram);
+        return;
+    }
+    // have to copy the datagram; the one we're passed is a reference to our buffer
+    PacedDatagram paced = { _outgoingPacketNumber, QByteArray(datagram.constData(), datagram.size()) };
+    _pacedDatagrams.append(paced);
+    _pacedBytes += datagram.size();
+}
+
+void DatagramSequencer::checkTimeout(quint64 now) {
+    // look for the oldest packet in flight that's actually gone out
+    QList<SendRecord>::iterator it = _sendRecords.begin();
+    while (it != _sendRecords.end() && !(it->inFlight && it->sentTime != 0)) {
+        it++;
+    }
+    if (it == _sendRecords.end() || now < it->sentTime + _congestionController.getTimeout()) {
+        return;
+    }
+    // presume everything out there lost; anything still waiting for the pacer stays in flight
+    int bytes = 0;
+    for (; it != _sendRecords.end(); it++) {
+        if (it->inFlight && it->sentTime != 0) {
+            it->inFlight = false;
+            bytes += it->size;
+        }
+    }
+    _congestionController.timedOut(bytes);
 }
 
 const int INITIAL_CIRCULAR_BUFFER_CAPACITY = 16;
@@ -20,6 +20,74 @@
 
 class ReliableChannel;
 
+/// A CUBIC congestion controller (as in RFC 8312), counting bytes rather than segments.  After a loss, the window grows
+/// as a cubic function of the time since, slowing as it nears the size at which the loss happened and then probing
+/// beyond it, but never more slowly than Reno would grow it.  Each loss shrinks the window by 30%, at most once per
+/// round trip; a timeout collapses it to the minimum, until a packet presumed lost turns out not to have been.
+class CongestionController {
+public:
+
+    CongestionController();
+
+    /// Returns the size of the window: the number of bytes we may have in flight.
+    int getWindow() const { return (int)_window; }
+
+    int getBytesInFlight() const { return _bytesInFlight; }
+
+    /// Returns the number of bytes that may be sent before the window is full.
+    int getSendBudget() const { return qMax(0, (int)_window - _bytesInFlight); }
+
+    /// Returns the smoothed round trip time in usecs, or zero if we don't have a sample yet.
+    int getRoundTripTime() const { return _roundTripTime; }
+
+    /// Returns the time in usecs after which a packet not acknowledged is presumed lost.
+    int getTimeout() const;
+
+    /// Returns the rate at which to pace datagrams, in bytes per second.
+    float getPacingRate() const;
+
+    /// Notes that a packet was sent (or queued to be).
+    /// \return whether the window, rather than the sender, limited what was in flight (and so may grow)
+    bool packetSent(int packetNumber, int bytes);
+
+    /// Notes that a packet was acknowledged, growing the window if the packet was window-limited.
+    /// \param sentTime when the packet went out, or zero if its acknowledgement may have been held back and so shouldn't
+    /// be used to sample the round trip time
+    void packetAcknowledged(int bytes, bool windowLimited, quint64 sentTime, quint64 now);
+    
+    /// Notes that a packet presumed lost to a timeout was acknowledged after all.  The other party was slow to reply
+    /// (a server skipping deltas, say) rather than the link congested, so the window goes back to where it was.
+    void timedOutPacketAcknowledged();
+
+    /// Notes that a packet was lost, shrinking the window unless it already shrank for a loss in the same round trip.
+    void packetLost(int packetNumber, int bytes);
+
+    /// Notes that the given number of bytes in flight timed out, collapsing the window.
+    void timedOut(int bytes);
+
+private:
+
+    float _window;
+    float _slowStartThreshold;
+    int _bytesInFlight;
+
+    int _lastSentPacketNumber;
+    int _recoveryPacketNumber; ///< the last packet sent when the window last shrank; losses up to it don't count again
+
+    int _roundTripTime;
+    int _roundTripTimeVariance;
+    int _timeoutBackoff;
+    
+    float _windowBeforeTimeout; ///< the window before the first of a run of timeouts, or zero if it didn't time out
+    float _slowStartThresholdBeforeTimeout;
+
+    quint64 _epochStart; ///< the time at which the window started growing since the last loss, or zero if it hasn't
+    float _epochOriginWindow; ///< the window at which the cubic function plateaus
+    float _epochPlateauTime; ///< the time after the epoch start at which the cubic function plateaus, in seconds
+    float _lastMaximumWindow;
+    float _renoWindow; ///< the window as Reno would have grown it since the epoch start
+};
+
 /// Performs simple datagram sequencing, packet fragmentation and reassembly.
 class DatagramSequencer : public QObject {
     Q_OBJECT
@@ -58,6 +126,29 @@ public:
     
     int getMaxPacketSize() const { return _maxPacketSize; }
     
+    /// Sets the function that returns the current time in usecs (usecTimestampNow, by default), so that tests can
+    /// simulate it.
+    void setClock(quint64 (*clock)()) { _clock = clock; }
+    
+    const CongestionController& getCongestionController() const { return _congestionController; }
+    
+    /// Returns the number of bytes that may be sent before the congestion window fills.  Senders with data to spare
+    /// should hold back or send less when it runs out; if pacing is enabled, reliable data is limited to it
+    /// automatically.
+    int getSendBudget() const { return _congestionController.getSendBudget(); }
+    
+    /// Sets whether to pace the datagrams of each packet at the congestion controller's rate, rather than emitting
+    /// readyToWrite for them all as soon as the packet ends.  If enabled, releasePacedDatagrams must be called
+    /// regularly (every few milliseconds).
+    void setPacingEnabled(bool enabled) { _pacingEnabled = enabled; }
+    bool getPacingEnabled() const { return _pacingEnabled; }
+    
+    /// Returns the number of bytes of datagrams waiting for the pacer.
+    int getPacedBytes() const { return _pacedBytes; }
+    
+    /// Emits readyToWrite for as many paced datagrams as the pacing rate allows, and checks for packets that timed out.
+    void releasePacedDatagrams();
+    
     /// Returns the output channel at the specified index, creating it if necessary.
     ReliableChannel* getReliableOutputChannel(int index = 0);
     
@@ -116,6 +207,16 @@ private:
         int lastReceivedPacketNumber;
         Bitstream::WriteMappings mappings;
         QVector<ChannelSpan> spans; 
+        int size; ///< the total size of the packet's datagrams
+        quint64 sentTime; ///< when the last datagram went out, or zero if it's still waiting for the pacer
+        bool inFlight; ///< whether the packet counts against the congestion window
+        bool windowLimited;
+    };
+    
+    class PacedDatagram {
+    public:
+        int packetNumber;
+        QByteArray datagram;
     };
     
     class ReceiveRecord {
@@ -137,6 +238,12 @@ private:
     /// readyToWrite) as necessary.
     void sendPacket(const QByteArray& packet, const QVector<ChannelSpan>& spans);
     
+    /// Emits readyToWrite for a datagram, or queues it for the pacer.
+    void writeDatagram(const QByteArray& datagram);
+    
+    /// Presumes lost the packets sent longer ago than the congestion controller's timeout.
+    void checkTimeout(quint64 now);
+    
     QList<SendRecord> _sendRecords;
     QList<ReceiveRecord> _receiveRecords;
     
@@ -165,6 +272,15 @@ private:
     
     int _maxPacketSize;
     
+    quint64 (*_clock)();
+    CongestionController _congestionController;
+    
+    bool _pacingEnabled;
+    QList<PacedDatagram> _pacedDatagrams;
+    int _pacedBytes;
+    float _pacingCredit; ///< the number of bytes the pacer may release, accumulated at the pacing rate
+    quint64 _lastPacingTime;
+    
     QHash<int, ReliableChannel*> _reliableOutputChannels;
     QHash<int, ReliableChannel*> _reliableInputChannels;
 };
@@ -29,6 +29,10 @@ MetavoxelLOD::MetavoxelLOD(const glm::vec3& position, float threshold) :
     threshold(threshold) {
 }
 
+MetavoxelLOD MetavoxelLOD::getSnapped(float spacing) const {
+    return MetavoxelLOD(glm::floor(position / spacing + glm::vec3(0.5f, 0.5f, 0.5f)) * spacing, threshold);
+}
+
 bool MetavoxelLOD::shouldSubdivide(const glm::vec3& minimum, float size, float multiplier) const {
     return size >= glm::distance(position, minimum + glm::vec3(size, size, size) * 0.5f) * threshold * multiplier;
 }
@@ -50,12 +54,34 @@ bool MetavoxelLOD::becameSubdivided(const glm::vec3& minimum, float size,
         qMax(0.0f, glm::distance(reference.position, center) - radius) * reference.threshold;
 }
 
+/// The threshold scale at which new viewers start: four levels coarser than they ask for.
+const float INITIAL_LOD_SCALE = 16.0f;
+const float MAX_LOD_SCALE = 1024.0f;
+
+/// Each overrun drops a level of detail; refinement comes back more gradually, so as not to overrun again at once.
+const float LOD_COARSENING_FACTOR = 2.0f;
+const float LOD_REFINEMENT_FACTOR = 1.25f;
+
+MetavoxelLODBudget::MetavoxelLODBudget() :
+    _scale(INITIAL_LOD_SCALE) {
+}
+
+void MetavoxelLODBudget::deltaSent(int bytes, int budget) {
+    if (bytes > budget) {
+        _scale = qMin(_scale * LOD_COARSENING_FACTOR, MAX_LOD_SCALE);
+        
+    } else if (bytes < budget / 2) {
+        _scale = qMax(_scale / LOD_REFINEMENT_FACTOR, 1.0f);
+    }
+}
+
 MetavoxelData::MetavoxelData() : _size(1.0f) {
 }
 
 MetavoxelData::MetavoxelData(const MetavoxelData& other) :
     _size(other._size),
-    _roots(other._roots) {
+    _roots(other._roots),
+    _spannerIndices(other._spannerIndices) {
     
     incrementRootReferenceCounts();
 }
@@ -68,6 +94,7 @@ MetavoxelData& MetavoxelData::operator=(const MetavoxelData& other) {
     decrementRootReferenceCounts();
     _size = other._size;
     _roots = other._roots;
+    _spannerIndices = other._spannerIndices;
     incrementRootReferenceCounts();
     return *this;
 }
@@ -118,6 +145,9 @@ void MetavoxelData::guide(MetavoxelVisitor& visitor) {
             node->decrementReferenceCount(value.getAttribute());
             _roots.remove(value.getAttribute());
         }
+        
+        // we can't tell how the visitor changed any spanners, so the index must be rebuilt when next needed
+        _spannerIndices.remove(value.getAttribute());
     }
 }
 
@@ -186,8 +216,21 @@ void MetavoxelData::insert(const AttributePointer& attribute, const Box& bounds,
     while (!getBounds().contains(bounds)) {
         expand();
     }
+    QSharedDataPointer<SpannerIndex> index = _spannerIndices.take(attribute);
     SpannerUpdateVisitor<insertSpanner> visitor(attribute, bounds, granularity, object);
     guide(visitor);
+    
+    // whatever the region, the spanner is now present
+    if (index) {
+        index->insert(object);
+        _spannerIndices.insert(attribute, index);
+    }
+}
+
+/// Checks whether an update to the spanner over the specified region applies to all the cells that it occupies.
+static bool coversSpanner(const Box& bounds, float granularity, const SharedObjectPointer& object) {
+    Spanner* spanner = static_cast<Spanner*>(object.data());
+    return bounds == spanner->getBounds() && granularity == spanner->getGranularity();
 }
 
 void MetavoxelData::remove(const AttributePointer& attribute, const SharedObjectPointer& object) {
@@ -197,8 +240,15 @@ void MetavoxelData::remove(const AttributePointer& attribute, const SharedObject
 
 void MetavoxelData::remove(const AttributePointer& attribute, const Box& bounds,
         float granularity, const SharedObjectPointer& object) {
+    QSharedDataPointer<SpannerIndex> index = _spannerIndices.take(attribute);
     SpannerUpdateVisitor<removeSpanner> visitor(attribute, bounds, granularity, object);
     guide(visitor);
+    
+    // removing the spanner from part of its cells may leave it in others, in which case we let the index go
+    if (index && coversSpanner(bounds, granularity, object)) {
+        index->remove(object);
+        _spannerIndices.insert(attribute, index);
+    }
 }
 
 void MetavoxelData::toggle(const AttributePointer& attribute, const SharedObjectPointer& object) {
@@ -208,8 +258,14 @@ void MetavoxelData::toggle(const AttributePointer& attribute, const SharedObject
 
 void MetavoxelData::toggle(const AttributePointer& attribute, const Box& bounds,
         float granularity, const SharedObjectPointer& object) {
+    QSharedDataPointer<SpannerIndex> index = _spannerIndices.take(attribute);
     SpannerUpdateVisitor<toggleSpanner> visitor(attribute, bounds, granularity, object);
     guide(visitor);
+    
+    if (index && coversSpanner(bounds, granularity, object)) {
+        index->toggle(object);
+        _spannerIndices.insert(attribute, index);
+    }
 }
 
 void MetavoxelData::clear(const AttributePointer& attribute) {
@@ -217,6 +273,7 @@ void MetavoxelData::clear(const AttributePointer& attribute) {
     if (node) {
         node->decrementReferenceCount(attribute);
     }
+    _spannerIndices.remove(attribute);
 }
 
 class FirstRaySpannerIntersectionVisitor : public RaySpannerIntersectionVisitor {
@@ -252,6 +309,9 @@ bool FirstRaySpannerIntersectionVisitor::visitSpanner(Spanner* spanner, float di
 SharedObjectPointer MetavoxelData::findFirstRaySpannerIntersection(
         const glm::vec3& origin, const glm::vec3& direction, const AttributePointer& attribute,
             float& distance, const MetavoxelLOD& lod) {
+    if (!lod.isValid()) {
+        return SharedObjectPointer(getSpannerIndex(attribute).findFirstRayIntersection(origin, direction, distance));
+    }
     FirstRaySpannerIntersectionVisitor visitor(origin, direction, attribute, lod);
     guide(visitor);
     if (!visitor.getSpanner()) {
@@ -261,6 +321,46 @@ SharedObjectPointer MetavoxelData::findFirstRaySpannerIntersection(
     return SharedObjectPointer(visitor.getSpanner());
 }
 
+void MetavoxelData::findIntersectingSpanners(const AttributePointer& attribute,
+        const Box& bounds, QVector<Spanner*>& results) {
+    getSpannerIndex(attribute).findIntersecting(bounds, results);
+}
+
+/// Gathers up all of the spanners in an attribute.
+class SpannerCollector : public SpannerVisitor {
+public:
+    
+    SpannerCollector(const AttributePointer& attribute);
+    
+    const QVector<SharedObjectPointer>& getSpanners() const { return _spanners; }
+    
+    virtual bool visit(Spanner* spanner);
+
+private:
+    
+    QVector<SharedObjectPointer> _spanners;
+};
+
+SpannerCollector::SpannerCollector(const AttributePointer& attribute) :
+    SpannerVisitor(QVector<AttributePointer>() << attribute) {
+}
+
+bool SpannerCollector::visit(Spanner* spanner) {
+    _spanners.append(SharedObjectPointer(spanner));
+    return true;
+}
+
+const SpannerIndex& MetavoxelData::getSpannerIndex(const AttributePointer& attribute) {
+    QSharedDataPointer<SpannerIndex>& index = _spannerIndices[attribute];
+    if (!index) {
+        SpannerCollector collector(attribute);
+        guide(collector);
+        index = new SpannerIndex();
+        index->build(collector.getSpanners());
+    }
+    return *index.constData();
+}
+
 const int X_MAXIMUM_FLAG = 1;
 const int Y_MAXIMUM_FLAG = 2;
 const int Z_MAXIMUM_FLAG = 4;
@@ -301,6 +401,7 @@ void MetavoxelData::read(Bitstream& in, const MetavoxelLOD& lod) {
     // clear out any existing roots
     decrementRootReferenceCounts();
     _roots.clear();
+    _spannerIndices.clear();
 
     in >> _size;
     
@@ -377,6 +478,7 @@ void MetavoxelData::readDelta(const MetavoxelData& reference, const MetavoxelLOD
             break;
         }
         _roots.take(attribute)->decrementReferenceCount(attribute);
+        _spannerIndices.remove(attribute);
     }
 }
 
@@ -443,6 +545,7 @@ void MetavoxelData::writeDelta(const MetavoxelData& reference, const MetavoxelLO
 }
 
 MetavoxelNode* MetavoxelData::createRoot(const AttributePointer& attribute) {
+    _spannerIndices.remove(attribute);
     MetavoxelNode*& root = _roots[attribute];
     if (root) {
         root->decrementReferenceCount(attribute);
@@ -485,7 +588,10 @@ void MetavoxelStreamState::setMinimum(const glm::vec3& lastMinimum, int index) {
     minimum = getNextMinimum(lastMinimum, size, index);
 }
 
+QAtomicInt MetavoxelNode::_createdCount;
+
 MetavoxelNode::MetavoxelNode(const AttributeValue& attributeValue) : _referenceCount(1) {
+    _createdCount.ref();
     _attributeValue = attributeValue.copy();
     for (int i = 0; i < CHILD_COUNT; i++) {
         _children[i] = NULL;
@@ -493,6 +599,7 @@ MetavoxelNode::MetavoxelNode(const AttributeValue& attributeValue) : _referenceC
 }
 
 MetavoxelNode::MetavoxelNode(const AttributePointer& attribute, const MetavoxelNode* copy) : _referenceCount(1) {
+    _createdCount.ref();
     _attributeValue = attribute->create(copy->_attributeValue);
     for (int i = 0; i < CHILD_COUNT; i++) {
         if ((_children[i] = copy->_children[i])) {
@@ -784,7 +891,7 @@ void MetavoxelNode::writeSpannerSubdivision(MetavoxelStreamState& state) const {
 }
 
 void MetavoxelNode::decrementReferenceCount(const AttributePointer& attribute) {
-    if (--_referenceCount == 0) {
+    if (!_referenceCount.deref()) {
         destroy(attribute);
         delete this;
     }
@@ -1122,9 +1229,76 @@ QScriptValue ScriptedMetavoxelGuide::visit(QScriptContext* context, QScriptEngin
     return result;
 }
 
+QScriptValue ScriptedMetavoxelGuide::visitBlock(QScriptContext* context, QScriptEngine* engine) {
+    ScriptedMetavoxelGuide* guide = static_cast<ScriptedMetavoxelGuide*>(context->callee().data().toVariant().value<void*>());
+    
+    // convert each of the numeric arrays in one go, rather than an element at a time
+    QScriptValue blockValue = context->argument(0);
+    QVariantList minimums = blockValue.property(guide->_minimumsHandle).toVariant().toList();
+    QVariantList sizes = blockValue.property(guide->_sizesHandle).toVariant().toList();
+    QVariantList leaves = blockValue.property(guide->_isLeafHandle).toVariant().toList();
+    
+    // the input values have to be created from script values, so we only fetch the arrays provided
+    const QVector<AttributePointer>& inputs = guide->_visitation->visitor.getInputs();
+    QScriptValue inputValues = blockValue.property(guide->_inputValuesHandle);
+    QVector<QScriptValue> inputArrays(inputs.size());
+    for (int i = 0; i < inputs.size(); i++) {
+        inputArrays[i] = inputValues.property(i);
+    }
+    
+    const MetavoxelInfo& parentInfo = guide->_visitation->info;
+    MetavoxelInfo info = { glm::vec3(), 0.0f, parentInfo.inputValues, parentInfo.outputValues, false };
+    QVector<bool> created(inputs.size());
+    int count = qMin(sizes.size(), minimums.size() / 3);
+    QVariantList results;
+    results.reserve(count);
+    for (int i = 0; i < count; i++) {
+        info.minimum = glm::vec3(minimums.at(i * 3).toFloat(), minimums.at(i * 3 + 1).toFloat(),
+            minimums.at(i * 3 + 2).toFloat());
+        info.size = sizes.at(i).toFloat();
+        info.isLeaf = leaves.value(i).toBool();
+        for (int j = 0; j < inputs.size(); j++) {
+            if (!inputArrays.at(j).isValid()) {
+                continue;
+            }
+            QScriptValue attributeValue = inputArrays.at(j).property(i);
+            if ((created[j] = attributeValue.isValid())) {
+                info.inputValues[j] = AttributeValue(inputs.at(j),
+                    inputs.at(j)->createFromScript(attributeValue, engine));
+            }
+        }
+        
+        results.append(guide->_visitation->visitor.visit(info));
+        
+        // destroy any created values, reverting to the inherited ones
+        for (int j = 0; j < inputs.size(); j++) {
+            if (created.at(j)) {
+                info.inputValues[j].getAttribute()->destroy(info.inputValues[j].getValue());
+                info.inputValues[j] = parentInfo.inputValues.at(j);
+                created[j] = false;
+            }
+        }
+    }
+    return engine->toScriptValue(results);
+}
+
+/// A guide function supplied directly rather than loaded.
+class LocalGuideFunction : public NetworkValue {
+public:
+    
+    LocalGuideFunction(const QScriptValue& function) { _value = function; }
+    
+    virtual QScriptValue& getValue() { return _value; }
+};
+
 ScriptedMetavoxelGuide::ScriptedMetavoxelGuide() {
 }
 
+void ScriptedMetavoxelGuide::setGuideFunction(const QScriptValue& function) {
+    _guideFunction = QSharedPointer<NetworkValue>(new LocalGuideFunction(function));
+    _minimumHandle = QScriptString();
+}
+
 bool ScriptedMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
     QScriptValue guideFunction;
     if (_guideFunction) {
@@ -1145,25 +1319,33 @@ bool ScriptedMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
         _inputValuesHandle = engine->toStringHandle("inputValues");
         _outputValuesHandle = engine->toStringHandle("outputValues");
         _isLeafHandle = engine->toStringHandle("isLeaf");
+        _minimumsHandle = engine->toStringHandle("minimums");
+        _sizesHandle = engine->toStringHandle("sizes");
         _getInputsFunction = engine->newFunction(getInputs, 0);
         _getOutputsFunction = engine->newFunction(getOutputs, 0);
         _visitFunction = engine->newFunction(visit, 1);
+        _visitBlockFunction = engine->newFunction(visitBlock, 1);
         _info = engine->newObject();
         _minimum = engine->newArray(3);
         
+        // the functions are ours alone, so they can hold on to the same pointer back to us
+        QScriptValue data = engine->newVariant(QVariant::fromValue<void*>(this));
+        _getInputsFunction.setData(data);
+        _getOutputsFunction.setData(data);
+        _visitFunction.setData(data);
+        _visitBlockFunction.setData(data);
+        
         _arguments.clear();
         _arguments.append(engine->newObject());
         QScriptValue visitor = engine->newObject();
         visitor.setProperty("getInputs", _getInputsFunction);
         visitor.setProperty("getOutputs", _getOutputsFunction);
         visitor.setProperty("visit", _visitFunction);
+        visitor.setProperty("visitBlock", _visitBlockFunction);
         _arguments[0].setProperty("visitor", visitor);
         _arguments[0].setProperty("info", _info);
         _info.setProperty(_minimumHandle, _minimum);
     }
-    QScriptValue data = engine->newVariant(QVariant::fromValue<void*>(this));
-    _getInputsFunction.setData(data);
-    _visitFunction.setData(data);
     _minimum.setProperty(0, visitation.info.minimum.x);
     _minimum.setProperty(1, visitation.info.minimum.y);
     _minimum.setProperty(2, visitation.info.minimum.z);
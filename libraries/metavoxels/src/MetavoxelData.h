@@ -9,6 +9,7 @@
 #ifndef __interface__MetavoxelData__
 #define __interface__MetavoxelData__
 
+#include <QAtomicInt>
 #include <QBitArray>
 #include <QHash>
 #include <QSharedData>
@@ -21,6 +22,7 @@
 
 #include "AttributeRegistry.h"
 #include "MetavoxelUtil.h"
+#include "SpannerIndex.h"
 
 class QScriptContext;
 
@@ -43,6 +45,10 @@ public:
     
     bool isValid() const { return threshold > 0.0f; }
     
+    /// Returns a copy of this LOD with its position snapped to a grid of the given spacing.  Viewers that snap their LODs
+    /// alike share them with their neighbors, letting the server encode one delta for all of them.
+    MetavoxelLOD getSnapped(float spacing) const;
+    
     bool shouldSubdivide(const glm::vec3& minimum, float size, float multiplier = 1.0f) const;
     
     /// Checks whether the node or any of the nodes underneath it have had subdivision enabled as compared to the reference.
@@ -51,6 +57,28 @@ public:
 
 DECLARE_STREAMABLE_METATYPE(MetavoxelLOD)
 
+/// Scales the threshold of the LOD at which deltas are sent so that they fit a budget, such as a congestion window.  A
+/// delta that overruns the budget makes the next one coarser, and one that leaves room to spare lets the next be finer,
+/// so that a first join or a large edit arrives over several deltas, each refining the last.
+class MetavoxelLODBudget {
+public:
+    
+    /// Viewers start coarse, since their first delta holds everything in view.
+    MetavoxelLODBudget();
+    
+    float getScale() const { return _scale; }
+    
+    /// Returns the LOD at which to send, given the one the viewer asked for.
+    MetavoxelLOD getLOD(const MetavoxelLOD& lod) const { return MetavoxelLOD(lod.position, lod.threshold * _scale); }
+    
+    /// Notes the size of a delta sent at getLOD() and the budget that was available for it.
+    void deltaSent(int bytes, int budget);
+
+private:
+    
+    float _scale;
+};
+
 /// The base metavoxel representation shared between server and client.
 class MetavoxelData {
 public:
@@ -61,6 +89,10 @@ public:
 
     MetavoxelData& operator=(const MetavoxelData& other);
 
+    /// Checks whether this data has the same size and shares all of its roots with the other (and is thus identical to it).
+    bool operator==(const MetavoxelData& other) const { return _size == other._size && _roots == other._roots; }
+    bool operator!=(const MetavoxelData& other) const { return !(*this == other); }
+
     float getSize() const { return _size; }
 
     glm::vec3 getMinimum() const { return glm::vec3(_size, _size, _size) * -0.5f; }
@@ -81,10 +113,18 @@ public:
 
     void clear(const AttributePointer& attribute);
 
-    /// Convenience function that finds the first spanner intersecting the provided ray.    
+    /// Convenience function that finds the first spanner intersecting the provided ray.  At full resolution (that is,
+    /// with the default LOD), this casts the ray through the spanner index rather than touring the cells.
     SharedObjectPointer findFirstRaySpannerIntersection(const glm::vec3& origin, const glm::vec3& direction,
         const AttributePointer& attribute, float& distance, const MetavoxelLOD& lod = MetavoxelLOD());
 
+    /// Appends to the results every spanner of the specified attribute whose bounds intersect the provided ones.
+    void findIntersectingSpanners(const AttributePointer& attribute, const Box& bounds, QVector<Spanner*>& results);
+
+    /// Returns the index over the bounds of the spanners in the specified attribute, building it if we haven't yet.
+    /// Once built, the index is kept up to date by insert, remove and toggle; other changes to the attribute discard it.
+    const SpannerIndex& getSpannerIndex(const AttributePointer& attribute);
+
     /// Expands the tree, increasing its capacity in all dimensions.
     void expand();
 
@@ -107,6 +147,7 @@ private:
     
     float _size;
     QHash<AttributePointer, MetavoxelNode*> _roots;
+    QHash<AttributePointer, QSharedDataPointer<SpannerIndex> > _spannerIndices; ///< shared between copies until changed
 };
 
 /// Holds the state used in streaming metavoxel data.
@@ -132,6 +173,9 @@ public:
 
     static const int CHILD_COUNT = 8;
 
+    /// Returns the number of nodes created so far, by which tests measure the cost of edits.
+    static int getCreatedCount() { return _createdCount.load(); }
+
     MetavoxelNode(const AttributeValue& attributeValue);
     MetavoxelNode(const AttributePointer& attribute, const MetavoxelNode* copy);
     
@@ -161,7 +205,7 @@ public:
     void writeSpannerSubdivision(MetavoxelStreamState& state) const;
 
     /// Increments the node's reference count.
-    void incrementReferenceCount() { _referenceCount++; }
+    void incrementReferenceCount() { _referenceCount.ref(); }
 
     /// Decrements the node's reference count.  If the resulting reference count is zero, destroys the node
     /// and calls delete this.
@@ -176,9 +220,11 @@ private:
     
     void clearChildren(const AttributePointer& attribute);
     
-    int _referenceCount;
+    QAtomicInt _referenceCount; ///< nodes are shared between snapshots encoded on different threads
     void* _attributeValue;
     MetavoxelNode* _children[CHILD_COUNT];
+    
+    static QAtomicInt _createdCount;
 };
 
 /// Contains information about a metavoxel (explicit or procedural).
@@ -350,7 +396,11 @@ private:
     float _rate;
 };
 
-/// Represents a guide implemented in Javascript.
+/// Represents a guide implemented in Javascript.  The guide function receives the visitor, whose visit function takes
+/// one metavoxel's info ({ minimum, size, isLeaf, inputValues }), and whose visitBlock function takes any number of them
+/// as parallel arrays ({ minimums: [x0, y0, z0, x1, ...], sizes, isLeaf, inputValues: [[values of input 0], ...] }) and
+/// returns an array of the visit results.  Converting a whole block at once saves most of the cost of crossing into and
+/// out of the script engine for each metavoxel.
 class ScriptedMetavoxelGuide : public DefaultMetavoxelGuide {
     Q_OBJECT
     Q_PROPERTY(ParameterizedURL url MEMBER _url WRITE setURL)
@@ -359,6 +409,9 @@ public:
 
     Q_INVOKABLE ScriptedMetavoxelGuide();
 
+    /// Uses the supplied function rather than one loaded from the URL.
+    void setGuideFunction(const QScriptValue& function);
+
     virtual bool guide(MetavoxelVisitation& visitation);
 
 public slots:
@@ -370,6 +423,7 @@ private:
     static QScriptValue getInputs(QScriptContext* context, QScriptEngine* engine);
     static QScriptValue getOutputs(QScriptContext* context, QScriptEngine* engine);
     static QScriptValue visit(QScriptContext* context, QScriptEngine* engine);
+    static QScriptValue visitBlock(QScriptContext* context, QScriptEngine* engine);
 
     ParameterizedURL _url;
 
@@ -380,10 +434,13 @@ private:
     QScriptString _inputValuesHandle;
     QScriptString _outputValuesHandle;
     QScriptString _isLeafHandle;
+    QScriptString _minimumsHandle;
+    QScriptString _sizesHandle;
     QScriptValueList _arguments;
     QScriptValue _getInputsFunction;
     QScriptValue _getOutputsFunction;
     QScriptValue _visitFunction;
+    QScriptValue _visitBlockFunction;
     QScriptValue _info;
     QScriptValue _minimum;
     
@@ -0,0 +1,55 @@
+//
+//  MetavoxelDelta.cpp
+//  metavoxels
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <SharedUtil.h>
+
+#include "MetavoxelDelta.h"
+
+MetavoxelDelta::MetavoxelDelta(const MetavoxelData& data, const MetavoxelData& reference,
+        const MetavoxelLOD& referenceLOD, const MetavoxelLOD& lod) :
+    _data(data),
+    _reference(reference),
+    _referenceLOD(referenceLOD),
+    _lod(lod),
+    _stream(&_bytes, QIODevice::WriteOnly),
+    _initialMappings(_stream),
+    _encoder(_stream),
+    _bits(0),
+    _copies(0),
+    _encodings(0),
+    _encodingTime(0) {
+}
+
+bool MetavoxelDelta::isFrom(const MetavoxelData& reference, const MetavoxelLOD& referenceLOD,
+        const MetavoxelLOD& lod) const {
+    return _reference == reference && _referenceLOD == referenceLOD && _lod == lod;
+}
+
+void MetavoxelDelta::write(Bitstream& out) {
+    if (_encodings > 0 && out.hasSameWriteMappings(_initialMappings)) {
+        out.write(_bytes.constData(), _bits);
+        out.copyWriteMappings(_encoder);
+        _copies++;
+        return;
+    }
+    if (_encodings++ > 0) {
+        // the mappings differ, so this one has to be encoded on its own
+        _data.writeDelta(_reference, _referenceLOD, out, _lod);
+        return;
+    }
+    // encode into our own stream, starting from the session's mappings, then copy from there like the rest
+    quint64 start = usecTimestampNow();
+    _initialMappings.copyWriteMappings(out);
+    _encoder.copyWriteMappings(out);
+    _data.writeDelta(_reference, _referenceLOD, _encoder, _lod);
+    _bits = _encoder.getBitsWritten();
+    _encoder.flush();
+    _encodingTime = usecTimestampNow() - start;
+    
+    out.write(_bytes.constData(), _bits);
+    out.copyWriteMappings(_encoder);
+}
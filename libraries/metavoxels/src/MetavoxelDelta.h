@@ -0,0 +1,60 @@
+//
+//  MetavoxelDelta.h
+//  metavoxels
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __interface__MetavoxelDelta__
+#define __interface__MetavoxelDelta__
+
+#include <QByteArray>
+#include <QDataStream>
+
+#include "Bitstream.h"
+#include "MetavoxelData.h"
+
+/// A delta from one state of the data (at one LOD) to another, sent by any number of sessions in the same frame.  The delta
+/// is encoded once, for the first session, and the bits copied to the streams of the rest, provided their write mappings
+/// match the first's.
+class MetavoxelDelta {
+public:
+    
+    MetavoxelDelta(const MetavoxelData& data, const MetavoxelData& reference,
+        const MetavoxelLOD& referenceLOD, const MetavoxelLOD& lod);
+    
+    const MetavoxelData& getData() const { return _data; }
+    const MetavoxelLOD& getLOD() const { return _lod; }
+    
+    /// Checks whether this is the delta from the specified reference state to the specified LOD.
+    bool isFrom(const MetavoxelData& reference, const MetavoxelLOD& referenceLOD, const MetavoxelLOD& lod) const;
+    
+    /// Writes the delta to the supplied stream, copying it if possible and encoding it if not.
+    void write(Bitstream& out);
+
+    int getWrites() const { return _copies + _encodings; }
+    int getCopies() const { return _copies; }
+    
+    /// Returns the time spent encoding the delta once, times the number of copies made instead.
+    quint64 getTimeSaved() const { return _copies * _encodingTime; }
+    
+private:
+    Q_DISABLE_COPY(MetavoxelDelta)
+    
+    const MetavoxelData& _data;
+    MetavoxelData _reference;
+    MetavoxelLOD _referenceLOD;
+    MetavoxelLOD _lod;
+    
+    QByteArray _bytes;
+    QDataStream _stream;
+    Bitstream _initialMappings; ///< holds the write mappings that the encoding started with
+    Bitstream _encoder;
+    int _bits;
+    
+    int _copies;
+    int _encodings;
+    quint64 _encodingTime;
+};
+
+#endif /* defined(__interface__MetavoxelDelta__) */
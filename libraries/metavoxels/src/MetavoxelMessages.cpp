@@ -6,6 +6,10 @@
 //  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
 //
 
+#include <QPair>
+#include <QSet>
+#include <QVarLengthArray>
+
 #include "MetavoxelMessages.h"
 
 void MetavoxelEditMessage::apply(MetavoxelData& data, const WeakSharedObjectHash& objects) const {
@@ -36,26 +40,40 @@ BoxSetEditVisitor::BoxSetEditVisitor(const BoxSetEdit& edit) :
     _edit(edit) {
 }
 
-int BoxSetEditVisitor::visit(MetavoxelInfo& info) {
+enum BoxSetResult { SETS_NONE, SETS_ALL, SETS_PART };
+
+/// Determines what the edit does to the described voxel: leaves it alone, sets all of it, or sets part of it (in which
+/// case we subdivide).
+static BoxSetResult getBoxSetResult(const BoxSetEdit& edit, const MetavoxelInfo& info) {
     // find the intersection between volume and voxel
-    glm::vec3 minimum = glm::max(info.minimum, _edit.region.minimum);
-    glm::vec3 maximum = glm::min(info.minimum + glm::vec3(info.size, info.size, info.size), _edit.region.maximum);
+    glm::vec3 minimum = glm::max(info.minimum, edit.region.minimum);
+    glm::vec3 maximum = glm::min(info.minimum + glm::vec3(info.size, info.size, info.size), edit.region.maximum);
     glm::vec3 size = maximum - minimum;
     if (size.x <= 0.0f || size.y <= 0.0f || size.z <= 0.0f) {
-        return STOP_RECURSION; // disjoint
+        return SETS_NONE; // disjoint
     }
     float volume = (size.x * size.y * size.z) / (info.size * info.size * info.size);
     if (volume >= 1.0f) {
-        info.outputValues[0] = _edit.value;
-        return STOP_RECURSION; // entirely contained
+        return SETS_ALL; // entirely contained
+    }
+    if (info.size <= edit.granularity) {
+        return (volume >= 0.5f) ? SETS_ALL : SETS_NONE; // reached granularity limit; take best guess
     }
-    if (info.size <= _edit.granularity) {
-        if (volume >= 0.5f) {
+    return SETS_PART;
+}
+
+int BoxSetEditVisitor::visit(MetavoxelInfo& info) {
+    switch (getBoxSetResult(_edit, info)) {
+        case SETS_ALL:
             info.outputValues[0] = _edit.value;
-        }
-        return STOP_RECURSION; // reached granularity limit; take best guess
+            return STOP_RECURSION;
+        
+        case SETS_PART:
+            return DEFAULT_ORDER; // subdivide
+            
+        default:
+            return STOP_RECURSION;
     }
-    return DEFAULT_ORDER; // subdivide
 }
 
 void BoxSetEdit::apply(MetavoxelData& data, const WeakSharedObjectHash& objects) const {
@@ -68,6 +86,211 @@ void BoxSetEdit::apply(MetavoxelData& data, const WeakSharedObjectHash& objects)
     data.guide(visitor);
 }
 
+static QVector<AttributePointer> getBoxSetAttributes(const QVector<const BoxSetEdit*>& edits) {
+    QVector<AttributePointer> attributes;
+    foreach (const BoxSetEdit* edit, edits) {
+        if (!attributes.contains(edit->value.getAttribute())) {
+            attributes.append(edit->value.getAttribute());
+        }
+    }
+    return attributes;
+}
+
+/// Applies a run of box sets in one traversal.
+class BoxSetBatchVisitor : public MetavoxelVisitor {
+public:
+    
+    BoxSetBatchVisitor(const QVector<const BoxSetEdit*>& edits);
+    
+    virtual void prepare();
+    virtual int visit(MetavoxelInfo& info);
+
+private:
+    
+    /// The edits that set part of a voxel (and thus must be applied to its children).
+    class PartialEdits {
+    public:
+        float size;
+        QVector<int> edits;
+    };
+    
+    const QVector<const BoxSetEdit*>& _edits;
+    QVector<int> _outputIndices;
+    PartialEdits _allEdits;
+    QVector<PartialEdits> _partialEdits;
+};
+
+BoxSetBatchVisitor::BoxSetBatchVisitor(const QVector<const BoxSetEdit*>& edits) :
+    MetavoxelVisitor(QVector<AttributePointer>(), getBoxSetAttributes(edits)),
+    _edits(edits) {
+    
+    for (int i = 0; i < edits.size(); i++) {
+        _outputIndices.append(_outputs.indexOf(edits.at(i)->value.getAttribute()));
+        _allEdits.edits.append(i);
+    }
+}
+
+void BoxSetBatchVisitor::prepare() {
+    MetavoxelVisitor::prepare();
+    _partialEdits.clear();
+}
+
+int BoxSetBatchVisitor::visit(MetavoxelInfo& info) {
+    // we visit depth first, so the partial edits of the parent are the last ones from a larger voxel
+    while (!_partialEdits.isEmpty() && _partialEdits.last().size <= info.size) {
+        _partialEdits.removeLast();
+    }
+    const PartialEdits& parentEdits = _partialEdits.isEmpty() ? _allEdits : _partialEdits.last();
+    
+    // apply the edits in order: one that sets the whole voxel overrides those before it on the same attribute
+    PartialEdits partialEdits = { info.size };
+    QVarLengthArray<int, 4> lastEdits(_outputs.size());
+    for (int i = 0; i < lastEdits.size(); i++) {
+        lastEdits[i] = -1;
+    }
+    foreach (int index, parentEdits.edits) {
+        switch (getBoxSetResult(*_edits.at(index), info)) {
+            case SETS_ALL: {
+                int outputIndex = _outputIndices.at(index);
+                lastEdits[outputIndex] = index;
+                for (int i = partialEdits.edits.size() - 1; i >= 0; i--) {
+                    if (_outputIndices.at(partialEdits.edits.at(i)) == outputIndex) {
+                        partialEdits.edits.remove(i);
+                    }
+                }
+                break;
+            }
+            case SETS_PART:
+                partialEdits.edits.append(index);
+                break;
+                
+            default:
+                break;
+        }
+    }
+    for (int i = 0; i < lastEdits.size(); i++) {
+        if (lastEdits.at(i) != -1) {
+            info.outputValues[i] = _edits.at(lastEdits.at(i))->value;
+        }
+    }
+    if (partialEdits.edits.isEmpty()) {
+        return STOP_RECURSION;
+    }
+    _partialEdits.append(partialEdits);
+    return DEFAULT_ORDER;
+}
+
+static void applyBoxSets(const QVector<const BoxSetEdit*>& edits, MetavoxelData& data) {
+    if (edits.size() == 1) {
+        BoxSetEditVisitor visitor(*edits.at(0));
+        data.guide(visitor);
+        
+    } else {
+        BoxSetBatchVisitor visitor(edits);
+        data.guide(visitor);
+    }
+}
+
+/// Returns the attribute and spanner of a spanner insertion or removal, or a null attribute if the edit is neither.
+static QPair<AttributePointer, SharedObject*> getSpannerKey(const QVariant& edit, const WeakSharedObjectHash& objects) {
+    if (edit.userType() == InsertSpannerEdit::Type) {
+        const InsertSpannerEdit* insert = static_cast<const InsertSpannerEdit*>(edit.constData());
+        return qMakePair(insert->attribute, insert->spanner.data());
+    }
+    if (edit.userType() == RemoveSpannerEdit::Type) {
+        const RemoveSpannerEdit* remove = static_cast<const RemoveSpannerEdit*>(edit.constData());
+        SharedObject* object = objects.value(remove->id);
+        if (object) {
+            return qMakePair(remove->attribute, object);
+        }
+    }
+    return QPair<AttributePointer, SharedObject*>();
+}
+
+int MetavoxelEditBatch::apply(MetavoxelData& data, const WeakSharedObjectHash& objects) {
+    // working backwards, drop the edits whose effects later ones undo: anything on an attribute that is later set or
+    // cleared globally, and spanner insertions and removals followed by another for the same spanner
+    QVector<bool> moot(_edits.size());
+    QSet<AttributePointer> overwritten;
+    QSet<QPair<AttributePointer, SharedObject*> > laterSpanners;
+    for (int i = _edits.size() - 1; i >= 0; i--) {
+        const QVariant& edit = _edits.at(i).edit;
+        int userType = edit.userType();
+        QPair<AttributePointer, SharedObject*> key = getSpannerKey(edit, objects);
+        if (key.first) {
+            if (overwritten.contains(key.first) || laterSpanners.contains(key)) {
+                moot[i] = true;
+            } else {
+                laterSpanners.insert(key);
+            }
+        } else if (userType == GlobalSetEdit::Type || userType == ClearSpannersEdit::Type) {
+            AttributePointer attribute = (userType == GlobalSetEdit::Type) ?
+                static_cast<const GlobalSetEdit*>(edit.constData())->value.getAttribute() :
+                static_cast<const ClearSpannersEdit*>(edit.constData())->attribute;
+            if (overwritten.contains(attribute)) {
+                moot[i] = true;
+            } else {
+                overwritten.insert(attribute);
+            }
+        } else if (userType == BoxSetEdit::Type) {
+            AttributePointer attribute = static_cast<const BoxSetEdit*>(edit.constData())->value.getAttribute();
+            if (overwritten.contains(attribute)) {
+                moot[i] = true;
+            } else {
+                // a box set on a spanner attribute doesn't commute with the spanner edits before it
+                for (QSet<QPair<AttributePointer, SharedObject*> >::iterator it = laterSpanners.begin();
+                        it != laterSpanners.end(); ) {
+                    if (it->first == attribute) {
+                        it = laterSpanners.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+            }
+        }
+    }
+    
+    // apply the rest in order, gathering runs of box sets that fit within the data as it stands at their start
+    int updates = 0;
+    QVector<const BoxSetEdit*> boxSets;
+    for (int i = 0; i < _edits.size(); i++) {
+        if (moot.at(i)) {
+            continue;
+        }
+        const QVariant& edit = _edits.at(i).edit;
+        if (edit.userType() == BoxSetEdit::Type) {
+            const BoxSetEdit* boxSet = static_cast<const BoxSetEdit*>(edit.constData());
+            if (!boxSets.isEmpty() && data.getBounds().contains(boxSet->region)) {
+                boxSets.append(boxSet);
+                continue;
+            }
+            if (!boxSets.isEmpty()) {
+                applyBoxSets(boxSets, data);
+                boxSets.clear();
+                updates++;
+            }
+            while (!data.getBounds().contains(boxSet->region)) {
+                data.expand();
+            }
+            boxSets.append(boxSet);
+            continue;
+        }
+        if (!boxSets.isEmpty()) {
+            applyBoxSets(boxSets, data);
+            boxSets.clear();
+            updates++;
+        }
+        _edits.at(i).apply(data, objects);
+        updates++;
+    }
+    if (!boxSets.isEmpty()) {
+        applyBoxSets(boxSets, data);
+        updates++;
+    }
+    _edits.clear();
+    return updates;
+}
+
 GlobalSetEdit::GlobalSetEdit(const OwnedAttributeValue& value) :
     value(value) {
 }
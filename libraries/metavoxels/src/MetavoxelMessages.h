@@ -71,6 +71,28 @@ public:
 
 DECLARE_STREAMABLE_METATYPE(MetavoxelEditMessage)
 
+/// Collects edits so that they can be applied together.  Box sets that follow one another are merged into a single
+/// traversal, with later boxes overriding earlier ones where they overlap, and spanner insertions and removals made moot
+/// by later edits (a later insertion or removal of the same spanner, or a clear of the attribute) are dropped.  The
+/// values that result are the same as if the edits had been applied one at a time, though the data may not need to
+/// expand as far.
+class MetavoxelEditBatch {
+public:
+    
+    void append(const MetavoxelEditMessage& edit) { _edits.append(edit); }
+    
+    bool isEmpty() const { return _edits.isEmpty(); }
+    int getEditCount() const { return _edits.size(); }
+    
+    /// Applies the queued edits and clears the queue.
+    /// \return the number of traversals (or other individual updates) the edits took
+    int apply(MetavoxelData& data, const WeakSharedObjectHash& objects);
+
+private:
+    
+    QVector<MetavoxelEditMessage> _edits;
+};
+
 /// Abstract base class for edits.
 class MetavoxelEdit {
 public:
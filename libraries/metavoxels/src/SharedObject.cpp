@@ -18,21 +18,30 @@
 
 REGISTER_META_OBJECT(SharedObject)
 
+WeakSharedObjectHash SharedObject::getWeakHash() {
+    QMutexLocker locker(&_weakHashMutex);
+    return _weakHash;
+}
+
 SharedObject::SharedObject() :
-    _id(++_lastID),
     _remoteID(0),
     _referenceCount(0) {
     
+    QMutexLocker locker(&_weakHashMutex);
+    _id = ++_lastID;
     _weakHash.insert(_id, this);
 }
 
 void SharedObject::incrementReferenceCount() {
-    _referenceCount++;
+    _referenceCount.ref();
 }
 
 void SharedObject::decrementReferenceCount() {
-    if (--_referenceCount == 0) {
+    if (!_referenceCount.deref()) {
+        // the last reference may be dropped on one of the server's encoding threads
+        _weakHashMutex.lock();
         _weakHash.remove(_id);
+        _weakHashMutex.unlock();
         delete this;
     }
 }
@@ -93,6 +102,7 @@ void SharedObject::dump(QDebug debug) const {
 
 int SharedObject::_lastID = 0;
 WeakSharedObjectHash SharedObject::_weakHash;
+QMutex SharedObject::_weakHashMutex;
 
 void pruneWeakSharedObjectHash(WeakSharedObjectHash& hash) {
     for (WeakSharedObjectHash::iterator it = hash.begin(); it != hash.end(); ) {
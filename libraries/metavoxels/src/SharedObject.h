@@ -9,8 +9,10 @@
 #ifndef __interface__SharedObject__
 #define __interface__SharedObject__
 
+#include <QAtomicInt>
 #include <QHash>
 #include <QMetaType>
+#include <QMutex>
 #include <QObject>
 #include <QPointer>
 #include <QSet>
@@ -29,8 +31,9 @@ class SharedObject : public QObject {
     
 public:
 
-    /// Returns the weak hash under which all local shared objects are registered.
-    static const WeakSharedObjectHash& getWeakHash() { return _weakHash; }
+    /// Returns a copy of the weak hash under which all local shared objects are registered.  Objects register and
+    /// unregister themselves on whichever thread creates them or drops their last reference, so this takes a lock.
+    static WeakSharedObjectHash getWeakHash();
 
     Q_INVOKABLE SharedObject();
 
@@ -42,7 +45,7 @@ public:
     
     void setRemoteID(int remoteID) { _remoteID = remoteID; }
 
-    int getReferenceCount() const { return _referenceCount; }
+    int getReferenceCount() const { return _referenceCount.load(); }
     void incrementReferenceCount();
     void decrementReferenceCount();
 
@@ -59,10 +62,11 @@ private:
     
     int _id;
     int _remoteID;
-    int _referenceCount;
+    QAtomicInt _referenceCount; ///< pointers may be copied on several threads at once
     
     static int _lastID;
     static WeakSharedObjectHash _weakHash;
+    static QMutex _weakHashMutex; ///< guards _lastID and _weakHash
 };
 
 /// Removes the null references from the supplied hash.
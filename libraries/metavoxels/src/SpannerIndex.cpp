@@ -0,0 +1,356 @@
+//
+//  SpannerIndex.cpp
+//  metavoxels
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cfloat>
+
+#include <QPair>
+#include <QVarLengthArray>
+
+#include "MetavoxelData.h"
+#include "SpannerIndex.h"
+
+// enough for the walk of any tree we're likely to see without going to the heap; the stack holds at most one more entry
+// than the height of the tree
+const int WALK_STACK_RESERVE = 64;
+
+SpannerIndexVisitor::~SpannerIndexVisitor() {
+}
+
+static Box getUnion(const Box& first, const Box& second) {
+    return Box(glm::min(first.minimum, second.minimum), glm::max(first.maximum, second.maximum));
+}
+
+static float getSurfaceArea(const Box& box) {
+    glm::vec3 extent = box.maximum - box.minimum;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+SpannerIndex::SpannerIndex() :
+    _root(NULL_NODE),
+    _freeNodes(NULL_NODE) {
+}
+
+void SpannerIndex::insert(const SharedObjectPointer& object) {
+    if (_leaves.contains(object)) {
+        return;
+    }
+    int leaf = allocateNode();
+    Node& node = _nodes[leaf];
+    node.spanner = static_cast<Spanner*>(object.data());
+    node.bounds = node.spanner->getBounds();
+    _leaves.insert(object, leaf);
+    insertLeaf(leaf);
+}
+
+bool SpannerIndex::remove(const SharedObjectPointer& object) {
+    QHash<SharedObjectPointer, int>::iterator it = _leaves.find(object);
+    if (it == _leaves.end()) {
+        return false;
+    }
+    int leaf = it.value();
+    _leaves.erase(it);
+    removeLeaf(leaf);
+    freeNode(leaf);
+    return true;
+}
+
+void SpannerIndex::toggle(const SharedObjectPointer& object) {
+    if (!remove(object)) {
+        insert(object);
+    }
+}
+
+void SpannerIndex::clear() {
+    _nodes.clear();
+    _root = NULL_NODE;
+    _freeNodes = NULL_NODE;
+    _leaves.clear();
+}
+
+void SpannerIndex::build(const QVector<SharedObjectPointer>& objects) {
+    clear();
+    QVector<int> leaves;
+    leaves.reserve(objects.size());
+    foreach (const SharedObjectPointer& object, objects) {
+        if (_leaves.contains(object)) {
+            continue;
+        }
+        int leaf = allocateNode();
+        Node& node = _nodes[leaf];
+        node.spanner = static_cast<Spanner*>(object.data());
+        node.bounds = node.spanner->getBounds();
+        _leaves.insert(object, leaf);
+        leaves.append(leaf);
+    }
+    if (!leaves.isEmpty()) {
+        _root = buildRange(leaves, 0, leaves.size());
+        _nodes[_root].parent = NULL_NODE;
+    }
+}
+
+Spanner* SpannerIndex::findFirstRayIntersection(const glm::vec3& origin,
+        const glm::vec3& direction, float& distance) const {
+    Spanner* closestSpanner = NULL;
+    float closestDistance = FLT_MAX;
+    QVarLengthArray<int, WALK_STACK_RESERVE> stack;
+    if (_root != NULL_NODE) {
+        stack.append(_root);
+    }
+    while (!stack.isEmpty()) {
+        const Node& node = _nodes.at(stack.last());
+        stack.removeLast();
+
+        // nothing within the bounds can be closer than where the ray enters them
+        float nodeDistance;
+        if (!node.bounds.findRayIntersection(origin, direction, nodeDistance) || nodeDistance >= closestDistance) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            float spannerDistance;
+            if (node.spanner->findRayIntersection(origin, direction, spannerDistance) &&
+                    spannerDistance < closestDistance) {
+                closestSpanner = node.spanner;
+                closestDistance = spannerDistance;
+            }
+            continue;
+        }
+        // push the farther child first, so that we pop the nearer and (likely) tighten the distance sooner
+        const Node& first = _nodes.at(node.children[0]);
+        const Node& second = _nodes.at(node.children[1]);
+        int nearer = (glm::dot(first.bounds.getCenter() - origin, direction) <=
+            glm::dot(second.bounds.getCenter() - origin, direction)) ? 0 : 1;
+        stack.append(node.children[1 - nearer]);
+        stack.append(node.children[nearer]);
+    }
+    if (closestSpanner) {
+        distance = closestDistance;
+    }
+    return closestSpanner;
+}
+
+void SpannerIndex::findIntersecting(const Box& bounds, QVector<Spanner*>& results) const {
+    QVarLengthArray<int, WALK_STACK_RESERVE> stack;
+    if (_root != NULL_NODE) {
+        stack.append(_root);
+    }
+    while (!stack.isEmpty()) {
+        const Node& node = _nodes.at(stack.last());
+        stack.removeLast();
+        if (!node.bounds.intersects(bounds)) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            results.append(node.spanner);
+        } else {
+            stack.append(node.children[1]);
+            stack.append(node.children[0]);
+        }
+    }
+}
+
+void SpannerIndex::walk(SpannerIndexVisitor& visitor) const {
+    QVarLengthArray<int, WALK_STACK_RESERVE> stack;
+    if (_root != NULL_NODE) {
+        stack.append(_root);
+    }
+    while (!stack.isEmpty()) {
+        const Node& node = _nodes.at(stack.last());
+        stack.removeLast();
+        if (!visitor.intersects(node.bounds)) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            if (!visitor.visit(node.spanner)) {
+                return;
+            }
+        } else {
+            stack.append(node.children[1]);
+            stack.append(node.children[0]);
+        }
+    }
+}
+
+int SpannerIndex::allocateNode() {
+    Node node = { Box(), NULL_NODE, { NULL_NODE, NULL_NODE }, 1, NULL };
+    if (_freeNodes == NULL_NODE) {
+        _nodes.append(node);
+        return _nodes.size() - 1;
+    }
+    int index = _freeNodes;
+    _freeNodes = _nodes.at(index).parent;
+    _nodes[index] = node;
+    return index;
+}
+
+void SpannerIndex::freeNode(int index) {
+    Node& node = _nodes[index];
+    node.parent = _freeNodes;
+    node.spanner = NULL;
+    _freeNodes = index;
+}
+
+void SpannerIndex::insertLeaf(int leaf) {
+    if (_root == NULL_NODE) {
+        _root = leaf;
+        _nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // descend toward the sibling that adds the least surface area to the tree, stopping when pairing the leaf with the
+    // current node costs less than pushing it further down
+    Box leafBounds = _nodes.at(leaf).bounds;
+    int sibling = _root;
+    while (!_nodes.at(sibling).isLeaf()) {
+        const Node& node = _nodes.at(sibling);
+        float area = getSurfaceArea(node.bounds);
+        float combinedArea = getSurfaceArea(getUnion(node.bounds, leafBounds));
+        float cost = 2.0f * combinedArea;
+        float inheritanceCost = 2.0f * (combinedArea - area);
+        float childCosts[2];
+        for (int i = 0; i < 2; i++) {
+            const Node& child = _nodes.at(node.children[i]);
+            float childCombinedArea = getSurfaceArea(getUnion(child.bounds, leafBounds));
+            childCosts[i] = inheritanceCost + (child.isLeaf() ? childCombinedArea :
+                childCombinedArea - getSurfaceArea(child.bounds));
+        }
+        if (cost < childCosts[0] && cost < childCosts[1]) {
+            break;
+        }
+        sibling = node.children[childCosts[0] <= childCosts[1] ? 0 : 1];
+    }
+
+    // give the sibling and the leaf a new parent in the sibling's place
+    int oldParent = _nodes.at(sibling).parent;
+    int newParent = allocateNode();
+    Node& parentNode = _nodes[newParent];
+    parentNode.parent = oldParent;
+    parentNode.children[0] = sibling;
+    parentNode.children[1] = leaf;
+    _nodes[sibling].parent = newParent;
+    _nodes[leaf].parent = newParent;
+    if (oldParent == NULL_NODE) {
+        _root = newParent;
+    } else {
+        Node& oldParentNode = _nodes[oldParent];
+        oldParentNode.children[oldParentNode.children[0] == sibling ? 0 : 1] = newParent;
+    }
+    refit(newParent);
+}
+
+void SpannerIndex::removeLeaf(int leaf) {
+    if (leaf == _root) {
+        _root = NULL_NODE;
+        return;
+    }
+
+    // replace the leaf's parent with its sibling
+    int parent = _nodes.at(leaf).parent;
+    int sibling = _nodes.at(parent).children[_nodes.at(parent).children[0] == leaf ? 1 : 0];
+    int grandparent = _nodes.at(parent).parent;
+    freeNode(parent);
+    _nodes[sibling].parent = grandparent;
+    if (grandparent == NULL_NODE) {
+        _root = sibling;
+        return;
+    }
+    Node& grandparentNode = _nodes[grandparent];
+    grandparentNode.children[grandparentNode.children[0] == parent ? 0 : 1] = sibling;
+    refit(grandparent);
+}
+
+void SpannerIndex::refit(int index) {
+    while (index != NULL_NODE) {
+        updateNode(index);
+        index = rebalance(index);
+        index = _nodes.at(index).parent;
+    }
+}
+
+int SpannerIndex::rebalance(int index) {
+    Node& node = _nodes[index];
+    const int MIN_UNBALANCED_HEIGHT = 3;
+    if (node.isLeaf() || node.height < MIN_UNBALANCED_HEIGHT) {
+        return index;
+    }
+    int balance = _nodes.at(node.children[1]).height - _nodes.at(node.children[0]).height;
+    if (balance >= -1 && balance <= 1) {
+        return index;
+    }
+
+    // rotate the taller child up into the node's place; the node keeps its shorter child and takes the shorter of the
+    // taller child's children, while the taller child keeps its taller one
+    int tallerSide = (balance > 0) ? 1 : 0;
+    int promoted = node.children[tallerSide];
+    Node& promotedNode = _nodes[promoted];
+    int grandchild = promotedNode.children[0];
+    int otherGrandchild = promotedNode.children[1];
+    if (_nodes.at(grandchild).height > _nodes.at(otherGrandchild).height) {
+        qSwap(grandchild, otherGrandchild);
+    }
+    promotedNode.parent = node.parent;
+    promotedNode.children[0] = index;
+    promotedNode.children[1] = otherGrandchild;
+    node.parent = promoted;
+    node.children[tallerSide] = grandchild;
+    _nodes[grandchild].parent = index;
+    if (promotedNode.parent == NULL_NODE) {
+        _root = promoted;
+    } else {
+        Node& parentNode = _nodes[promotedNode.parent];
+        parentNode.children[parentNode.children[0] == index ? 0 : 1] = promoted;
+    }
+    updateNode(index);
+    updateNode(promoted);
+    return promoted;
+}
+
+void SpannerIndex::updateNode(int index) {
+    Node& node = _nodes[index];
+    const Node& first = _nodes.at(node.children[0]);
+    const Node& second = _nodes.at(node.children[1]);
+    node.bounds = getUnion(first.bounds, second.bounds);
+    node.height = qMax(first.height, second.height) + 1;
+}
+
+int SpannerIndex::buildRange(QVector<int>& leaves, int begin, int end) {
+    if (end - begin == 1) {
+        return leaves.at(begin);
+    }
+
+    // split at the median center along the axis on which the centers spread the furthest
+    glm::vec3 minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+    glm::vec3 maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (int i = begin; i < end; i++) {
+        glm::vec3 center = _nodes.at(leaves.at(i)).bounds.getCenter();
+        minimum = glm::min(minimum, center);
+        maximum = glm::max(maximum, center);
+    }
+    glm::vec3 extent = maximum - minimum;
+    int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+    QVector<QPair<float, int> > centers;
+    centers.reserve(end - begin);
+    for (int i = begin; i < end; i++) {
+        centers.append(qMakePair(_nodes.at(leaves.at(i)).bounds.getCenter()[axis], leaves.at(i)));
+    }
+    int middle = (end - begin) / 2;
+    std::nth_element(centers.begin(), centers.begin() + middle, centers.end());
+    for (int i = 0; i < centers.size(); i++) {
+        leaves[begin + i] = centers.at(i).second;
+    }
+    int first = buildRange(leaves, begin, begin + middle);
+    int second = buildRange(leaves, begin + middle, end);
+
+    int parent = allocateNode();
+    Node& parentNode = _nodes[parent];
+    parentNode.children[0] = first;
+    parentNode.children[1] = second;
+    _nodes[first].parent = parent;
+    _nodes[second].parent = parent;
+    updateNode(parent);
+    return parent;
+}
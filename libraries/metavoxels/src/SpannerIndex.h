@@ -0,0 +1,109 @@
+//
+//  SpannerIndex.h
+//  metavoxels
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __interface__SpannerIndex__
+#define __interface__SpannerIndex__
+
+#include <QHash>
+#include <QSharedData>
+#include <QVector>
+
+#include <glm/glm.hpp>
+
+#include "MetavoxelUtil.h"
+#include "SharedObject.h"
+
+class Spanner;
+
+/// Base class for walks over a spanner index.
+class SpannerIndexVisitor {
+public:
+
+    virtual ~SpannerIndexVisitor();
+
+    /// Checks whether to descend into a part of the index with the given bounds (or, for a single spanner, whether to
+    /// visit it).
+    virtual bool intersects(const Box& bounds) = 0;
+
+    /// Visits a spanner whose bounds passed the intersection test.
+    /// \return true to continue, false to stop the walk
+    virtual bool visit(Spanner* spanner) = 0;
+};
+
+/// A bounding volume hierarchy over the bounds of a set of spanners.  Spanners are added to and removed from the tree
+/// as they come and go, rebalancing it with rotations on the way back up, so that ray casts and region queries only
+/// test the spanners near them rather than touring every cell the spanners occupy.
+class SpannerIndex : public QSharedData {
+public:
+
+    SpannerIndex();
+
+    int getSpannerCount() const { return _leaves.size(); }
+
+    bool contains(const SharedObjectPointer& object) const { return _leaves.contains(object); }
+
+    /// Returns the height of the tree (zero if empty, one if holding a single spanner).
+    int getHeight() const { return _root == NULL_NODE ? 0 : _nodes.at(_root).height; }
+
+    /// Adds a spanner, if it isn't already present.
+    void insert(const SharedObjectPointer& object);
+
+    /// Removes a spanner.
+    /// \return whether the spanner was present
+    bool remove(const SharedObjectPointer& object);
+
+    /// Adds the spanner if absent, removes it if present.
+    void toggle(const SharedObjectPointer& object);
+
+    void clear();
+
+    /// Replaces the contents of the index with the given spanners, building a balanced tree from the top down.
+    void build(const QVector<SharedObjectPointer>& objects);
+
+    /// Finds the closest spanner intersecting the described ray.
+    /// \param distance[out] the distance to the intersection, if any
+    Spanner* findFirstRayIntersection(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+    /// Appends every spanner whose bounds intersect the given ones to the results.
+    void findIntersecting(const Box& bounds, QVector<Spanner*>& results) const;
+
+    /// Walks the tree, descending only into the parts that the visitor finds intersecting.
+    void walk(SpannerIndexVisitor& visitor) const;
+
+private:
+
+    static const int NULL_NODE = -1;
+
+    class Node {
+    public:
+        Box bounds;
+        int parent; ///< the parent for nodes in the tree, the next free node for those on the free list
+        int children[2];
+        int height;
+        Spanner* spanner; ///< for leaves; kept alive by the reference in _leaves
+
+        bool isLeaf() const { return children[0] == NULL_NODE; }
+    };
+
+    int allocateNode();
+    void freeNode(int index);
+
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int index);
+    int rebalance(int index);
+    void updateNode(int index);
+
+    int buildRange(QVector<int>& leaves, int begin, int end);
+
+    QVector<Node> _nodes;
+    int _root;
+    int _freeNodes;
+    QHash<SharedObjectPointer, int> _leaves;
+};
+
+#endif /* defined(__interface__SpannerIndex__) */
@@ -108,7 +108,7 @@ bool AABox::contains(const glm::vec3& point) const {
 }
 
 bool AABox::contains(const AABox& otherBox) const {
-    for (int v = BOTTOM_LEFT_NEAR; v < TOP_LEFT_FAR; v++) {
+    for (int v = BOTTOM_LEFT_NEAR; v <= TOP_LEFT_FAR; v++) {
         glm::vec3 vertex = otherBox.getVertex((BoxVertex)v);
         if (!contains(vertex)) {
             return false;
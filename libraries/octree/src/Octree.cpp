@@ -552,32 +552,128 @@ public:
     float& distance;
     BoxFace& face;
     bool found;
+    glm::vec3 inverseDirection; // with zero components made tiny, so that the plane crossings stay finite
+    int mirrorMask;             // child index bits of the axes along which the ray travels backwards
 };
 
-bool findRayIntersectionOp(OctreeElement* node, void* extraData) {
-    RayArgs* args = static_cast<RayArgs*>(extraData);
-    AABox box = node->getAABox();
-    float distance;
-    BoxFace face;
-    if (!box.findRayIntersection(args->origin, args->direction, distance, face)) {
-        return false;
+// children are laid out as in octal codes
+const int CHILD_X_BIT = 4;
+const int CHILD_Y_BIT = 2;
+const int CHILD_Z_BIT = 1;
+const int NO_MORE_CHILDREN = NUMBER_OF_CHILDREN;
+
+// the (mirrored) index of the first child crossed by a ray that enters a node at the largest of t0, given the ray's
+// crossings of the node's middle planes
+static int firstChildCrossed(const glm::vec3& t0, const glm::vec3& tm) {
+    int child = 0;
+    if (t0.x > t0.y && t0.x > t0.z) {
+        // entered through an x face
+        child |= (tm.y < t0.x) ? CHILD_Y_BIT : 0;
+        child |= (tm.z < t0.x) ? CHILD_Z_BIT : 0;
+    } else if (t0.y > t0.z) {
+        // entered through a y face
+        child |= (tm.x < t0.y) ? CHILD_X_BIT : 0;
+        child |= (tm.z < t0.y) ? CHILD_Z_BIT : 0;
+    } else {
+        // entered through a z face
+        child |= (tm.x < t0.z) ? CHILD_X_BIT : 0;
+        child |= (tm.y < t0.z) ? CHILD_Y_BIT : 0;
     }
-    if (!node->isLeaf()) {
-        return true; // recurse on children
+    return child;
+}
+
+// the (mirrored) index of the child the ray crosses into on leaving child through the nearest of its exit planes
+static int nextChildCrossed(int child, const glm::vec3& t1) {
+    int exitBit;
+    if (t1.x <= t1.y && t1.x <= t1.z) {
+        exitBit = CHILD_X_BIT;
+    } else if (t1.y <= t1.z) {
+        exitBit = CHILD_Y_BIT;
+    } else {
+        exitBit = CHILD_Z_BIT;
+    }
+    // leaving through the far half of the node along the exit axis means leaving the node
+    return (child & exitBit) ? NO_MORE_CHILDREN : (child | exitBit);
+}
+
+// where the ray crosses the slabs of a (mirrored) child, given where it crosses its parent's
+static void getChildCrossings(int child, const glm::vec3& t0, const glm::vec3& tm, const glm::vec3& t1,
+                              glm::vec3& childT0, glm::vec3& childT1) {
+    childT0 = glm::vec3((child & CHILD_X_BIT) ? tm.x : t0.x, (child & CHILD_Y_BIT) ? tm.y : t0.y,
+        (child & CHILD_Z_BIT) ? tm.z : t0.z);
+    childT1 = glm::vec3((child & CHILD_X_BIT) ? t1.x : tm.x, (child & CHILD_Y_BIT) ? t1.y : tm.y,
+        (child & CHILD_Z_BIT) ? t1.z : tm.z);
+}
+
+// mirrors the axes along which the ray travels backwards, so that it always crosses a node's low planes first; returns
+// the child index bits of those axes
+static int mirrorRay(const glm::vec3& direction, glm::vec3& inverseDirection) {
+    const float MINIMUM_DIRECTION = 1.0e-10f;
+    int mirrorMask = 0;
+    const int AXIS_BITS[] = { CHILD_X_BIT, CHILD_Y_BIT, CHILD_Z_BIT };
+    for (int axis = 0; axis < 3; axis++) {
+        float mirroredDirection = direction[axis];
+        if (direction[axis] < 0.0f) {
+            mirrorMask |= AXIS_BITS[axis];
+            mirroredDirection = -direction[axis];
+        }
+        mirroredDirection = glm::max(mirroredDirection, MINIMUM_DIRECTION);
+        inverseDirection[axis] = ((direction[axis] < 0.0f) ? -1.0f : 1.0f) / mirroredDirection;
     }
-    distance *= TREE_SCALE;
-    if (node->hasContent() && (!args->found || distance < args->distance)) {
-        args->node = node;
-        args->distance = distance;
-        args->face = face;
-        args->found = true;
+    return mirrorMask;
+}
+
+// where the ray crosses the root's slabs, or false if it misses the root; in mirrored space the ray enters the slabs at
+// their low planes, and the plane crossings are the same either way
+static bool findRootCrossings(const AABox& rootBox, const glm::vec3& origin, const glm::vec3& inverseDirection,
+                              glm::vec3& t0, glm::vec3& t1) {
+    glm::vec3 low = (rootBox.getCorner() - origin) * inverseDirection;
+    glm::vec3 high = (rootBox.getCorner() + glm::vec3(rootBox.getScale()) - origin) * inverseDirection;
+    t0 = glm::min(low, high);
+    t1 = glm::max(low, high);
+    return glm::max(t0.x, glm::max(t0.y, t0.z)) < glm::min(t1.x, glm::min(t1.y, t1.z));
+}
+
+// Visits the leaves crossed by the ray in the order it crosses them, stopping at the first one with content, following
+// Revelles et al., "An Efficient Parametric Algorithm for Octree Traversal". t0 and t1 are where the ray enters and leaves
+// the node's slab along each axis, in the ray's mirrored space where every component of the direction is positive.
+static bool findOrderedRayIntersection(OctreeElement* node, const glm::vec3& t0, const glm::vec3& t1, RayArgs& args) {
+    if (t1.x < 0.0f || t1.y < 0.0f || t1.z < 0.0f) {
+        return false; // the node is entirely behind the origin
+    }
+    if (node->isLeaf()) {
+        if (!node->hasContent()) {
+            return false;
+        }
+        // as in the exhaustive search this replaces, the hit is that of the ray against the leaf's box
+        float distance;
+        BoxFace face;
+        if (!node->getAABox().findRayIntersection(args.origin, args.direction, distance, face)) {
+            return false;
+        }
+        args.node = node;
+        args.distance = distance * TREE_SCALE;
+        args.face = face;
+        args.found = true;
+        return true;
+    }
+    glm::vec3 tm = (node->getAABox().calcCenter() - args.origin) * args.inverseDirection;
+    for (int child = firstChildCrossed(t0, tm); child != NO_MORE_CHILDREN; ) {
+        glm::vec3 childT0, childT1;
+        getChildCrossings(child, t0, tm, t1, childT0, childT1);
+        OctreeElement* childNode = node->getChildAtIndex(child ^ args.mirrorMask);
+        if (childNode && findOrderedRayIntersection(childNode, childT0, childT1, args)) {
+            return true; // every child after this one is further along the ray
+        }
+        child = nextChildCrossed(child, childT1);
     }
     return false;
 }
 
 bool Octree::findRayIntersection(const glm::vec3& origin, const glm::vec3& direction,
                                     OctreeElement*& node, float& distance, BoxFace& face, Octree::lockType lockType) {
-    RayArgs args = { origin / (float)(TREE_SCALE), direction, node, distance, face };
+    RayArgs args = { origin / (float)(TREE_SCALE), direction, node, distance, face, false };
+    args.mirrorMask = mirrorRay(direction, args.inverseDirection);
 
     bool gotLock = false;
     if (lockType == Octree::Lock) {
@@ -590,7 +686,10 @@ bool Octree::findRayIntersection(const glm::vec3& origin, const glm::vec3& direc
         }
     }
 
-    recurseTreeWithOperation(findRayIntersectionOp, &args);
+    glm::vec3 t0, t1;
+    if (findRootCrossings(getRoot()->getAABox(), args.origin, args.inverseDirection, t0, t1)) {
+        findOrderedRayIntersection(getRoot(), t0, t1, args);
+    }
 
     if (gotLock) {
         unlock();
@@ -599,6 +698,161 @@ bool Octree::findRayIntersection(const glm::vec3& origin, const glm::vec3& direc
     return args.found;
 }
 
+// the order in which findOrderedRayIntersection() visits a node for a ray: two bits per level for its place in its
+// parent's crossing order, from the top bits down, so that a node's descendants sort between it and its next sibling
+typedef quint64 RayVisitOrder;
+const int RAY_VISIT_ORDER_LEVELS = 32;
+
+static RayVisitOrder getChildVisitOrder(RayVisitOrder parentOrder, int level, int place) {
+    // beyond the levels that fit, children keep their parent's order and ties go to the first found
+    if (level >= RAY_VISIT_ORDER_LEVELS) {
+        return parentOrder;
+    }
+    return parentOrder | ((RayVisitOrder)place << (2 * (RAY_VISIT_ORDER_LEVELS - 1 - level)));
+}
+
+// a ray that reaches a node in findRayIntersections(), with where it crosses the node's slabs
+class ActiveRay {
+public:
+    int index;
+    glm::vec3 t0;
+    glm::vec3 t1;
+    RayVisitOrder order;
+    int child;
+};
+
+// the rays still being cast by findRayIntersections(), as ranges of active
+class BatchedRayArgs {
+public:
+    QVector<OctreeRayIntersection>& rays;
+    QVector<glm::vec3> origins;          // in voxel scale
+    QVector<glm::vec3> inverseDirections;
+    QVector<int> mirrorMasks;
+    QVector<RayVisitOrder> hitOrders;    // the visit order of each ray's hit so far
+    QVector<ActiveRay> active;
+};
+
+// Visits each node once for all the rays that reach it.  Each ray only enters the children it would in
+// findOrderedRayIntersection(), and keeps the hit that the ordered cast would have visited first, rather than the nearest,
+// so that rays that graze a shared edge or start on a shared face get the same leaf either way.
+static void findBatchedRayIntersections(OctreeElement* node, int level, int firstActive, int activeCount,
+                                        BatchedRayArgs& args) {
+    if (node->isLeaf()) {
+        if (!node->hasContent()) {
+            return;
+        }
+        for (int i = firstActive; i < firstActive + activeCount; i++) {
+            const ActiveRay& active = args.active.at(i);
+            OctreeRayIntersection& ray = args.rays[active.index];
+            float distance;
+            BoxFace face;
+            if ((!ray.intersects || active.order < args.hitOrders.at(active.index)) &&
+                    node->getAABox().findRayIntersection(args.origins.at(active.index), ray.direction, distance, face)) {
+                ray.element = node;
+                ray.distance = distance * TREE_SCALE;
+                ray.face = face;
+                ray.intersects = true;
+                args.hitOrders[active.index] = active.order;
+            }
+        }
+        return;
+    }
+
+    // find the children each ray crosses, in the order it crosses them
+    int firstCrossing = args.active.size();
+    glm::vec3 center = node->getAABox().calcCenter();
+    for (int i = firstActive; i < firstActive + activeCount; i++) {
+        ActiveRay active = args.active.at(i);
+        glm::vec3 tm = (center - args.origins.at(active.index)) * args.inverseDirections.at(active.index);
+        int place = 0;
+        for (int child = firstChildCrossed(active.t0, tm); child != NO_MORE_CHILDREN; place++) {
+            ActiveRay crossing;
+            crossing.index = active.index;
+            getChildCrossings(child, active.t0, tm, active.t1, crossing.t0, crossing.t1);
+            crossing.order = getChildVisitOrder(active.order, level, place);
+            crossing.child = child ^ args.mirrorMasks.at(active.index);
+            if (node->getChildAtIndex(crossing.child) &&
+                    !(crossing.t1.x < 0.0f || crossing.t1.y < 0.0f || crossing.t1.z < 0.0f)) {
+                args.active.append(crossing);
+            }
+            child = nextChildCrossed(child, crossing.t1);
+        }
+    }
+    int crossingCount = args.active.size() - firstCrossing;
+
+    // visit the children front to back for the first ray, so that coherent rays find their first hits early and skip
+    // the children they would visit after them
+    int mirrorMask = args.mirrorMasks.at(args.active.at(firstActive).index);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        int child = i ^ mirrorMask;
+        int firstChildActive = args.active.size();
+        for (int j = firstCrossing; j < firstCrossing + crossingCount; j++) {
+            ActiveRay crossing = args.active.at(j);
+            if (crossing.child == child && (!args.rays.at(crossing.index).intersects ||
+                    crossing.order < args.hitOrders.at(crossing.index))) {
+                args.active.append(crossing);
+            }
+        }
+        int childActiveCount = args.active.size() - firstChildActive;
+        if (childActiveCount > 0) {
+            findBatchedRayIntersections(node->getChildAtIndex(child), level + 1, firstChildActive, childActiveCount,
+                args);
+        }
+        args.active.resize(firstChildActive);
+    }
+    args.active.resize(firstCrossing);
+}
+
+int Octree::findRayIntersections(QVector<OctreeRayIntersection>& rays, Octree::lockType lockType) {
+    BatchedRayArgs args = { rays };
+    for (int i = 0; i < rays.size(); i++) {
+        rays[i].intersects = false;
+    }
+
+    bool gotLock = false;
+    if (lockType == Octree::Lock) {
+        lockForRead();
+        gotLock = true;
+    } else if (lockType == Octree::TryLock) {
+        gotLock = tryLockForRead();
+        if (!gotLock) {
+            return 0; // if we wanted to tryLock, and we couldn't then just bail...
+        }
+    }
+
+    args.origins.resize(rays.size());
+    args.inverseDirections.resize(rays.size());
+    args.mirrorMasks.resize(rays.size());
+    args.hitOrders.resize(rays.size());
+    for (int i = 0; i < rays.size(); i++) {
+        args.origins[i] = rays.at(i).origin / (float)TREE_SCALE;
+        args.mirrorMasks[i] = mirrorRay(rays.at(i).direction, args.inverseDirections[i]);
+        ActiveRay active;
+        active.index = i;
+        active.order = 0;
+        active.child = 0;
+        if (findRootCrossings(getRoot()->getAABox(), args.origins.at(i), args.inverseDirections.at(i), active.t0,
+                active.t1) && !(active.t1.x < 0.0f || active.t1.y < 0.0f || active.t1.z < 0.0f)) {
+            args.active.append(active);
+        }
+    }
+    if (!args.active.isEmpty()) {
+        findBatchedRayIntersections(getRoot(), 0, 0, args.active.size(), args);
+    }
+
+    if (gotLock) {
+        unlock();
+    }
+
+    int intersections = 0;
+    for (int i = 0; i < rays.size(); i++) {
+        if (rays.at(i).intersects) {
+            intersections++;
+        }
+    }
+    return intersections;
+}
+
 class SphereArgs {
 public:
     glm::vec3 center;
@@ -1020,6 +1274,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     unsigned char childrenExistInTreeBits = 0;
     unsigned char childrenExistInPacketBits = 0;
     unsigned char childrenColoredBits = 0;
+    unsigned char childrenWereInViewBits = 0; // colored children the recipient already had, sent because they changed
 
     // Make our local buffer large enough to handle writing at this level in case we need to.
     LevelDetails thisLevelKey = packetData->startLevel();
@@ -1033,6 +1288,14 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     int indexOfChildren[NUMBER_OF_CHILDREN] = { 0, 0, 0, 0, 0, 0, 0, 0 };
     int currentCount = 0;
 
+    // test all of our children against the view (and last view, if we need it) at once
+    ViewFrustum::ChildLocations childLocations;
+    if (params.viewFrustum) {
+        node->childrenInFrustum(*params.viewFrustum, childLocations);
+    }
+    ViewFrustum::ChildLocations lastChildLocations;
+    bool haveLastChildLocations = false;
+
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
         OctreeElement* childNode = node->getChildAtIndex(i);
 
@@ -1052,7 +1315,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
         if (params.wantOcclusionCulling) {
             if (childNode) {
-                float distance = params.viewFrustum ? childNode->distanceToCamera(*params.viewFrustum) : 0;
+                float distance = params.viewFrustum ? childLocations.distances[i] : 0;
 
                 currentCount = insertIntoSortedArrays((void*)childNode, distance, i,
                                                       (void**)&sortedChildren, (float*)&distancesToChildren,
@@ -1081,7 +1344,8 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         bool childIsInView  = (childNode && 
                 ( !params.viewFrustum || // no view frustum was given, everything is assumed in view
                   (nodeLocationThisView == ViewFrustum::INSIDE) || // the parent was fully in view, we can assume ALL children are
-                  (nodeLocationThisView == ViewFrustum::INTERSECT && childNode->isInView(*params.viewFrustum)) // the parent intersects and the child is in view
+                  (nodeLocationThisView == ViewFrustum::INTERSECT &&
+                    childLocations.getLocation(originalIndex) != ViewFrustum::OUTSIDE) // the parent intersects and the child is in view
                 ));
 
         if (!childIsInView) {
@@ -1147,7 +1411,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
                 bool shouldRender = !params.viewFrustum
                                     ? true
-                                    : childNode->calculateShouldRender(params.viewFrustum,
+                                    : childNode->shouldRenderAtDistance(childLocations.furthestDistances[originalIndex],
                                                     params.octreeElementSizeScale, params.boundaryLevelAdjust);
 
                 // track some stats
@@ -1167,7 +1431,11 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                     bool childWasInView = false;
 
                     if (childNode && params.deltaViewFrustum && params.lastViewFrustum) {
-                        ViewFrustum::location location = childNode->inFrustum(*params.lastViewFrustum);
+                        if (!haveLastChildLocations) {
+                            node->childrenInFrustum(*params.lastViewFrustum, lastChildLocations);
+                            haveLastChildLocations = true;
+                        }
+                        ViewFrustum::location location = lastChildLocations.getLocation(originalIndex);
 
                         // If we're a leaf, then either intersect or inside is considered "formerly in view"
                         if (childNode->isLeaf()) {
@@ -1186,6 +1454,9 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
                         childrenColoredBits += (1 << (7 - originalIndex));
                         inViewWithColorCount++;
+                        if (childWasInView) {
+                            childrenWereInViewBits += (1 << (7 - originalIndex));
+                        }
                     } else {
                         // otherwise just track stats of the items we discarded
                         // don't need to check childNode here, because we can't get here with no childNode
@@ -1212,14 +1483,22 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         }
     }
 
+    // children the recipient is known to have had when last sent the scene only need what changed since: if the view
+    // hasn't changed that's all of them, if it has, those that were in the last view
+    bool recipientHasChildren = params.sendElementDeltas && !params.forceSendScene &&
+        params.lastViewFrustumSent > CHANGE_FUDGE;
+
     // write the color data...
     if (continueThisLevel && params.includeColor) {
         for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
             if (oneAtBit(childrenColoredBits, i)) {
                 OctreeElement* childNode = node->getChildAtIndex(i);
                 if (childNode) {
+                    quint64 sinceTime = (recipientHasChildren &&
+                        (!params.deltaViewFrustum || oneAtBit(childrenWereInViewBits, i))) ?
+                            params.lastViewFrustumSent - CHANGE_FUDGE : 0;
                     int bytesBeforeChild = packetData->getUncompressedSize();
-                    continueThisLevel = childNode->appendElementData(packetData);
+                    continueThisLevel = childNode->appendElementDelta(packetData, sinceTime, params.packetVersion);
                     int bytesAfterChild = packetData->getUncompressedSize();
 
                     if (!continueThisLevel) {
@@ -1429,6 +1708,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
 bool Octree::readFromSVOFile(const char* fileName) {
     bool fileOk = false;
+    int fileVersion = LATEST_PACKET_VERSION;
     std::ifstream file(fileName, std::ios::in|std::ios::binary|std::ios::ate);
     if(file.is_open()) {
         emit importSize(1.0f, 1.0f, 1.0f);
@@ -1461,9 +1741,10 @@ bool Octree::readFromSVOFile(const char* fileName) {
                 dataLength -= sizeof(expectedType);
                 PacketVersion expectedVersion = versionForPacketType(expectedType);
                 PacketVersion gotVersion = *dataAt;
-                if (gotVersion == expectedVersion) {
+                if (gotVersion >= minimumVersionForPacketType(expectedType) && gotVersion <= expectedVersion) {
                     dataAt += sizeof(expectedVersion);
                     dataLength -= sizeof(expectedVersion);
+                    fileVersion = gotVersion;
                     fileOk = true;
                 } else {
                     qDebug("SVO file version mismatch. Expected: %d Got: %d", expectedVersion, gotVersion);
@@ -1475,7 +1756,8 @@ bool Octree::readFromSVOFile(const char* fileName) {
             fileOk = true; // assume the file is ok
         }
         if (fileOk) {
-            ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS, NULL, 0, SharedNodePointer(), wantImportProgress);
+            ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS, NULL, 0, SharedNodePointer(), wantImportProgress,
+                                           fileVersion);
             readBitstreamToTree(dataAt, dataLength, args);
         }
         delete[] entireFile;
@@ -1550,6 +1832,17 @@ unsigned long Octree::getOctreeElementsCount() {
     return nodeCount;
 }
 
+bool Octree::elementsCountChanged(unsigned long& count) {
+    lockForRead();
+    unsigned long newCount = getOctreeElementsCount();
+    unlock();
+    if (newCount == count) {
+        return false;
+    }
+    count = newCount;
+    return true;
+}
+
 bool Octree::countOctreeElementsOperation(OctreeElement* node, void* extraData) {
     (*(unsigned long*)extraData)++;
     return true; // keep going
@@ -29,6 +29,7 @@ class OctreePacketData;
 
 #include <QObject>
 #include <QReadWriteLock>
+#include <QVector>
 
 // Callback function, for recuseTreeWithOperation
 typedef bool (*RecurseOctreeOperation)(OctreeElement* node, void* extraData);
@@ -71,6 +72,8 @@ public:
     OctreeSceneStats* stats;
     CoverageMap* map;
     JurisdictionMap* jurisdictionMap;
+    int packetVersion;       ///< data packet version the elements are laid out for, or LATEST_PACKET_VERSION
+    bool sendElementDeltas;  ///< elements the recipient had as of lastViewFrustumSent may be sent as what changed since
 
     // output hints from the encode process
     typedef enum {
@@ -119,6 +122,8 @@ public:
             stats(stats),
             map(map),
             jurisdictionMap(jurisdictionMap),
+            packetVersion(LATEST_PACKET_VERSION),
+            sendElementDeltas(false),
             stopReason(UNKNOWN)
     {}
 
@@ -157,6 +162,7 @@ public:
     QUuid sourceUUID;
     SharedNodePointer sourceNode;
     bool wantImportProgress;
+    int packetVersion; ///< version of the packet or file the data came in, or LATEST_PACKET_VERSION
 
     ReadBitstreamToTreeParams(
         bool includeColor = WANT_COLOR,
@@ -164,16 +170,32 @@ public:
         OctreeElement* destinationNode = NULL,
         QUuid sourceUUID = QUuid(),
         SharedNodePointer sourceNode = SharedNodePointer(),
-        bool wantImportProgress = false) :
+        bool wantImportProgress = false,
+        int packetVersion = LATEST_PACKET_VERSION) :
             includeColor(includeColor),
             includeExistsBits(includeExistsBits),
             destinationNode(destinationNode),
             sourceUUID(sourceUUID),
             sourceNode(sourceNode),
-            wantImportProgress(wantImportProgress)
+            wantImportProgress(wantImportProgress),
+            packetVersion(packetVersion)
     {}
 };
 
+/// A ray cast with Octree::findRayIntersections(), and what it hit, if anything.
+class OctreeRayIntersection {
+public:
+    OctreeRayIntersection(const glm::vec3& origin = glm::vec3(), const glm::vec3& direction = glm::vec3()) :
+        origin(origin), direction(direction), element(NULL), distance(0.0f), face(MIN_X_FACE), intersects(false) { }
+
+    glm::vec3 origin;
+    glm::vec3 direction;
+    OctreeElement* element;
+    float distance;
+    BoxFace face;
+    bool intersects;
+};
+
 class Octree : public QObject {
     Q_OBJECT
 public:
@@ -237,6 +259,10 @@ public:
     bool findRayIntersection(const glm::vec3& origin, const glm::vec3& direction,
                              OctreeElement*& node, float& distance, BoxFace& face, Octree::lockType lockType = Octree::TryLock);
 
+    /// Casts many rays in a single pass over the tree, with the same results as calling findRayIntersection() on each.
+    /// \return the number of rays that intersected the tree
+    int findRayIntersections(QVector<OctreeRayIntersection>& rays, Octree::lockType lockType = Octree::TryLock);
+
     bool findSpherePenetration(const glm::vec3& center, float radius, glm::vec3& penetration,
                                     void** penetratedObject = NULL, Octree::lockType lockType = Octree::TryLock);
 
@@ -255,6 +281,10 @@ public:
 
     unsigned long getOctreeElementsCount();
 
+    /// Counts the elements under the read lock, storing the count and returning whether it differs from the one passed
+    /// in.  The lock is released before returning, so the caller may go on to redraw, which locks the tree itself.
+    bool elementsCountChanged(unsigned long& count);
+
     void copySubTreeIntoNewTree(OctreeElement* startNode, Octree* destinationTree, bool rebaseToRoot);
     void copyFromTreeIntoSubTree(Octree* sourceTree, OctreeElement* destinationNode);
 
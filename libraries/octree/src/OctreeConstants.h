@@ -26,6 +26,8 @@ const glm::vec3 IDENTITY_FRONT = glm::vec3( 0.0f, 0.0f,-1.0f);
 
 const quint64 CHANGE_FUDGE = 1000 * 200; // useconds of fudge in determining if we want to resend changed voxels
 
+const int LATEST_PACKET_VERSION = -1; // element data laid out for a reader of this build's data packet version
+
 const int   TREE_SCALE = 16384; // ~10 miles.. This is the number of meters of the 0.0 to 1.0 voxel universe
 
 // This controls the LOD. Larger number will make smaller voxels visible at greater distance.
@@ -1199,9 +1199,12 @@ ViewFrustum::location OctreeElement::inFrustum(const ViewFrustum& viewFrustum) c
 //    corner. We can use we can use this corner as our "voxel position" to do our distance calculations off of.
 //    By doing this, we don't need to test each child voxel's position vs the LOD boundary
 bool OctreeElement::calculateShouldRender(const ViewFrustum* viewFrustum, float voxelScaleSize, int boundaryLevelAdjust) const {
+    return hasContent() && shouldRenderAtDistance(furthestDistanceToCamera(*viewFrustum), voxelScaleSize, boundaryLevelAdjust);
+}
+
+bool OctreeElement::shouldRenderAtDistance(float furthestDistance, float voxelScaleSize, int boundaryLevelAdjust) const {
     bool shouldRender = false;
     if (hasContent()) {
-        float furthestDistance = furthestDistanceToCamera(*viewFrustum);
         float childBoundary = boundaryDistanceForRenderLevel(getLevel() + 1 + boundaryLevelAdjust, voxelScaleSize);
         bool inChildBoundary = (furthestDistance <= childBoundary);
         if (isLeaf() && inChildBoundary) {
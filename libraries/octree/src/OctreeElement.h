@@ -78,6 +78,12 @@ public:
 
     /// Override to serialize the state of this element. This is used for persistance and for transmission across the network.
     virtual bool appendElementData(OctreePacketData* packetData) const { return true; }
+
+    /// Override to serialize only what changed since sinceTime, for a recipient known to have had this element's state as
+    /// of then, or everything if sinceTime is 0, laid out for a reader of the given data packet version. By default the
+    /// whole state is serialized with appendElementData().
+    virtual bool appendElementDelta(OctreePacketData* packetData, quint64 sinceTime, int packetVersion) const
+                    { return appendElementData(packetData); }
     
     /// Override to deserialize the state of this element. This is used for loading from a persisted file or from reading
     /// from the network.
@@ -114,11 +120,17 @@ public:
     float getEnclosingRadius() const;
     bool isInView(const ViewFrustum& viewFrustum) const { return inFrustum(viewFrustum) != ViewFrustum::OUTSIDE; }
     ViewFrustum::location inFrustum(const ViewFrustum& viewFrustum) const;
+    void childrenInFrustum(const ViewFrustum& viewFrustum, ViewFrustum::ChildLocations& locations) const
+        { viewFrustum.childrenInFrustum(_box, locations); }
     float distanceToCamera(const ViewFrustum& viewFrustum) const; 
     float furthestDistanceToCamera(const ViewFrustum& viewFrustum) const;
 
     bool calculateShouldRender(const ViewFrustum* viewFrustum, 
                 float voxelSizeScale = DEFAULT_OCTREE_SIZE_SCALE, int boundaryLevelAdjust = 0) const;
+
+    /// As calculateShouldRender(), given the distance to the element's furthest point from the camera
+    bool shouldRenderAtDistance(float furthestDistance,
+                float voxelSizeScale = DEFAULT_OCTREE_SIZE_SCALE, int boundaryLevelAdjust = 0) const;
     
     // points are assumed to be in Voxel Coordinates (not TREE_SCALE'd)
     float distanceSquareToPoint(const glm::vec3& point) const; // when you don't need the actual distance, use this.
@@ -11,6 +11,7 @@
 #include <QDebug>
 #include <PerfStat.h>
 #include <SharedUtil.h>
+#include <Tracing.h>
 
 #include "OctreePersistThread.h"
 
@@ -33,6 +34,7 @@ bool OctreePersistThread::process() {
 
         _tree->lockForWrite();
         {
+            TRACE_SCOPE("readFromSVOFile");
             PerformanceWarning warn(true, "Loading Octree File", true);
             persistantFileRead = _tree->readFromSVOFile(_filename.toLocal8Bit().constData());
         }
@@ -69,7 +71,10 @@ bool OctreePersistThread::process() {
         usleep(USECS_TO_SLEEP);
 
         // do our updates then check to save...
-        _tree->update();
+        {
+            TRACE_SCOPE("update");
+            _tree->update();
+        }
 
         quint64 now = usecTimestampNow();
         quint64 sinceLastSave = now - _lastCheck;
@@ -80,6 +85,7 @@ bool OctreePersistThread::process() {
             _lastCheck = usecTimestampNow();
             if (_tree->isDirty()) {
                 qDebug() << "saving Octrees to file " << _filename << "...";
+                TRACE_SCOPE("writeToSVOFile");
                 _tree->writeToSVOFile(_filename.toLocal8Bit().constData());
                 _tree->clearDirtyBit(); // tree is clean after saving
                 qDebug("DONE saving Octrees to file...");
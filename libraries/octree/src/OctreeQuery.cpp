@@ -24,6 +24,7 @@ OctreeQuery::OctreeQuery() :
     _wantLowResMoving(true),
     _wantOcclusionCulling(false), // disabled by default
     _wantCompression(false), // disabled by default
+    _wantElementDeltas(true),
     _maxOctreePPS(DEFAULT_MAX_OCTREE_PPS),
     _octreeElementSizeScale(DEFAULT_OCTREE_SIZE_SCALE)
 {
@@ -59,6 +60,7 @@ int OctreeQuery::getBroadcastData(unsigned char* destinationBuffer) {
     if (_wantDelta)            { setAtBit(bitItems, WANT_DELTA_AT_BIT); }
     if (_wantOcclusionCulling) { setAtBit(bitItems, WANT_OCCLUSION_CULLING_BIT); }
     if (_wantCompression)      { setAtBit(bitItems, WANT_COMPRESSION); }
+    if (_wantElementDeltas)    { setAtBit(bitItems, WANT_ELEMENT_DELTAS_BIT); }
 
     *destinationBuffer++ = bitItems;
 
@@ -105,6 +107,7 @@ int OctreeQuery::parseData(const QByteArray& packet) {
     _wantDelta = oneAtBit(bitItems, WANT_DELTA_AT_BIT);
     _wantOcclusionCulling = oneAtBit(bitItems, WANT_OCCLUSION_CULLING_BIT);
     _wantCompression = oneAtBit(bitItems, WANT_COMPRESSION);
+    _wantElementDeltas = oneAtBit(bitItems, WANT_ELEMENT_DELTAS_BIT); // never set by clients that predate them
 
     // desired Max Octree PPS
     memcpy(&_maxOctreePPS, sourceBuffer, sizeof(_maxOctreePPS));
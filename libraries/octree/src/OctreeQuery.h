@@ -36,6 +36,7 @@ const int WANT_COLOR_AT_BIT = 1;
 const int WANT_DELTA_AT_BIT = 2;
 const int WANT_OCCLUSION_CULLING_BIT = 3;
 const int WANT_COMPRESSION = 4; // 5th bit
+const int WANT_ELEMENT_DELTAS_BIT = 5; // elements the client has are sent as what changed, if the data packet layout allows
 
 class OctreeQuery : public NodeData {
     Q_OBJECT
@@ -73,6 +74,7 @@ public:
     bool getWantLowResMoving() const { return _wantLowResMoving; }
     bool getWantOcclusionCulling() const { return _wantOcclusionCulling; }
     bool getWantCompression() const { return _wantCompression; }
+    bool getWantElementDeltas() const { return _wantElementDeltas; }
     int getMaxOctreePacketsPerSecond() const { return _maxOctreePPS; }
     float getOctreeSizeScale() const { return _octreeElementSizeScale; }
     int getBoundaryLevelAdjust() const { return _boundaryLevelAdjust; }
@@ -83,6 +85,7 @@ public slots:
     void setWantDelta(bool wantDelta) { _wantDelta = wantDelta; }
     void setWantOcclusionCulling(bool wantOcclusionCulling) { _wantOcclusionCulling = wantOcclusionCulling; }
     void setWantCompression(bool wantCompression) { _wantCompression = wantCompression; }
+    void setWantElementDeltas(bool wantElementDeltas) { _wantElementDeltas = wantElementDeltas; }
     void setMaxOctreePacketsPerSecond(int maxOctreePPS) { _maxOctreePPS = maxOctreePPS; }
     void setOctreeSizeScale(float octreeSizeScale) { _octreeElementSizeScale = octreeSizeScale; }
     void setBoundaryLevelAdjust(int boundaryLevelAdjust) { _boundaryLevelAdjust = boundaryLevelAdjust; }
@@ -103,6 +106,7 @@ protected:
     bool _wantLowResMoving;
     bool _wantOcclusionCulling;
     bool _wantCompression;
+    bool _wantElementDeltas;
     int _maxOctreePPS;
     float _octreeElementSizeScale; /// used for LOD calculations
     int _boundaryLevelAdjust; /// used for LOD calculations
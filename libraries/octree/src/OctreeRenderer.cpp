@@ -113,7 +113,7 @@ void OctreeRenderer::processDatagram(const QByteArray& dataByteArray, const Shar
             if (sectionLength) {
                 // ask the VoxelTree to read the bitstream into the tree
                 ReadBitstreamToTreeParams args(packetIsColored ? WANT_COLOR : NO_COLOR, WANT_EXISTS_BITS, NULL, 
-                                                sourceUUID, sourceNode);
+                                                sourceUUID, sourceNode, false, versionForPacket(dataByteArray));
                 _tree->lockForWrite();
                 OctreePacketData packetData(packetIsCompressed);
                 packetData.loadFinalizedContent(dataAt, sectionLength);
@@ -149,11 +149,42 @@ bool OctreeRenderer::renderOperation(OctreeElement* element, void* extraData) {
     return false;
 }
 
+void OctreeRenderer::renderSubtree(OctreeElement* element, ViewFrustum::location location, RenderArgs* args,
+                                   int recursionCount) {
+    if (recursionCount > DANGEROUSLY_DEEP_RECURSION) {
+        qDebug() << "OctreeRenderer::renderSubtree() reached DANGEROUSLY_DEEP_RECURSION, bailing!";
+        return;
+    }
+    if (element->hasContent()) {
+        renderElement(element, args);
+    }
+
+    // if we're fully in view then so are all of our children, otherwise check them all at once
+    ViewFrustum::ChildLocations childLocations;
+    if (location != ViewFrustum::INSIDE) {
+        element->childrenInFrustum(*args->_viewFrustum, childLocations);
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            ViewFrustum::location childLocation = (location == ViewFrustum::INSIDE) ?
+                ViewFrustum::INSIDE : childLocations.getLocation(i);
+            if (childLocation != ViewFrustum::OUTSIDE) {
+                renderSubtree(child, childLocation, args, recursionCount + 1);
+            }
+        }
+    }
+}
+
 void OctreeRenderer::render() {
     RenderArgs args = { 0, this, _viewFrustum };
     if (_tree) {
         _tree->lockForRead();
-        _tree->recurseTreeWithOperation(renderOperation, &args);
+        OctreeElement* root = _tree->getRoot();
+        ViewFrustum::location rootLocation = root->inFrustum(*_viewFrustum);
+        if (rootLocation != ViewFrustum::OUTSIDE) {
+            renderSubtree(root, rootLocation, &args);
+        }
         _tree->unlock();
     }
 }
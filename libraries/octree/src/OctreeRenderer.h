@@ -64,6 +64,9 @@ public:
     /// clears the tree
     void clear();
 protected:
+    /// renders the element and its children in view, testing all the children of an intersecting element at once
+    void renderSubtree(OctreeElement* element, ViewFrustum::location location, RenderArgs* args, int recursionCount = 0);
+
     Octree* _tree;
     bool _managedTree;
     ViewFrustum* _viewFrustum;
@@ -43,7 +43,8 @@ ViewFrustum::ViewFrustum() :
     _nearTopLeft(0,0,0),
     _nearTopRight(0,0,0),
     _nearBottomLeft(0,0,0),
-    _nearBottomRight(0,0,0)
+    _nearBottomRight(0,0,0),
+    _batchChildTests(true)
 {
 }
 
@@ -197,9 +198,9 @@ ViewFrustum::location ViewFrustum::boxInKeyhole(const AABox& box) const {
     if (intersects) {
         result = INTERSECT;
 
-        // test all the corners, if they are all inside the sphere, the entire box is in the sphere
+        // test all eight corners; if they are all inside the sphere, the entire box is in the sphere
         bool allPointsInside = true; // assume the best
-        for (int v = BOTTOM_LEFT_NEAR; v < TOP_LEFT_FAR; v++) {
+        for (int v = BOTTOM_LEFT_NEAR; v <= TOP_LEFT_FAR; v++) {
             glm::vec3 vertex = box.getVertex((BoxVertex)v);
             if (!pointInKeyhole(vertex)) {
                 allPointsInside = false;
@@ -300,6 +301,147 @@ ViewFrustum::location ViewFrustum::boxInFrustum(const AABox& box) const {
     return regularResult;
 }
 
+ViewFrustum::location ViewFrustum::ChildLocations::getLocation(int childIndex) const {
+    if (insideMask & (1 << childIndex)) {
+        return INSIDE;
+    }
+    return (intersectMask & (1 << childIndex)) ? INTERSECT : OUTSIDE;
+}
+
+// Each test below runs over all eight children with the children's coordinates held one array per axis, so the loops
+// have no branches or dependencies between children and the compiler is free to vectorize them.
+void ViewFrustum::childrenInFrustum(const AABox& box, ChildLocations& locations) const {
+    if (!_batchChildTests) {
+        childrenInFrustumOneByOne(box, locations);
+        return;
+    }
+    const float treeScale = (float)TREE_SCALE;
+    const glm::vec3& parentCorner = box.getCorner();
+    float childScale = box.getScale() * 0.5f;
+    float scaledChildScale = childScale * treeScale;
+
+    // the children's corners: voxel scale for the LOD distances, and TREE_SCALE like the frustum
+    float minX[NUMBER_OF_CHILDREN], minY[NUMBER_OF_CHILDREN], minZ[NUMBER_OF_CHILDREN];
+    float scaledMinX[NUMBER_OF_CHILDREN], scaledMinY[NUMBER_OF_CHILDREN], scaledMinZ[NUMBER_OF_CHILDREN];
+    float scaledMaxX[NUMBER_OF_CHILDREN], scaledMaxY[NUMBER_OF_CHILDREN], scaledMaxZ[NUMBER_OF_CHILDREN];
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        minX[i] = parentCorner.x + ((i >> 2) & 1) * childScale;
+        minY[i] = parentCorner.y + ((i >> 1) & 1) * childScale;
+        minZ[i] = parentCorner.z + (i & 1) * childScale;
+        scaledMinX[i] = minX[i] * treeScale;
+        scaledMinY[i] = minY[i] * treeScale;
+        scaledMinZ[i] = minZ[i] * treeScale;
+        scaledMaxX[i] = scaledMinX[i] + scaledChildScale;
+        scaledMaxY[i] = scaledMinY[i] + scaledChildScale;
+        scaledMaxZ[i] = scaledMinZ[i] + scaledChildScale;
+    }
+
+    // distances, computed as OctreeElement::distanceToCamera() and furthestDistanceToCamera() do
+    float halfChildScale = childScale * 0.5f;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        float centerX = (minX[i] + halfChildScale) * treeScale - _position.x;
+        float centerY = (minY[i] + halfChildScale) * treeScale - _position.y;
+        float centerZ = (minZ[i] + halfChildScale) * treeScale - _position.z;
+        locations.distances[i] = sqrtf(centerX * centerX + centerY * centerY + centerZ * centerZ);
+
+        float furthestX = _positionVoxelScale.x - ((_positionVoxelScale.x < minX[i] + halfChildScale) ?
+            minX[i] + childScale : minX[i]);
+        float furthestY = _positionVoxelScale.y - ((_positionVoxelScale.y < minY[i] + halfChildScale) ?
+            minY[i] + childScale : minY[i]);
+        float furthestZ = _positionVoxelScale.z - ((_positionVoxelScale.z < minZ[i] + halfChildScale) ?
+            minZ[i] + childScale : minZ[i]);
+        locations.furthestDistances[i] = sqrtf(furthestX * furthestX + furthestY * furthestY + furthestZ * furthestZ) *
+            treeScale;
+    }
+
+    // the regular frustum, using the same P and N vertices as boxInFrustum()
+    bool outsideFrustum[NUMBER_OF_CHILDREN] = { false, false, false, false, false, false, false, false };
+    bool intersectsFrustum[NUMBER_OF_CHILDREN] = { false, false, false, false, false, false, false, false };
+    for (int p = 0; p < 6; p++) {
+        const glm::vec3& normal = _planes[p].getNormal();
+        float d = _planes[p].getDCoefficient();
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            float pX = (normal.x > 0) ? scaledMaxX[i] : scaledMinX[i];
+            float pY = (normal.y > 0) ? scaledMaxY[i] : scaledMinY[i];
+            float pZ = (normal.z > 0) ? scaledMaxZ[i] : scaledMinZ[i];
+            float nX = (normal.x < 0) ? scaledMaxX[i] : scaledMinX[i];
+            float nY = (normal.y < 0) ? scaledMaxY[i] : scaledMinY[i];
+            float nZ = (normal.z < 0) ? scaledMaxZ[i] : scaledMinZ[i];
+            outsideFrustum[i] |= (d + (normal.x * pX + normal.y * pY + normal.z * pZ)) < 0;
+            intersectsFrustum[i] |= (d + (normal.x * nX + normal.y * nY + normal.z * nZ)) < 0;
+        }
+    }
+
+    // the keyhole, as in boxInKeyhole(): boxes that don't fit in the keyhole's bounding box are outside it, boxes whose
+    // closest point is within the radius intersect it, and boxes whose furthest corner is within the radius are inside
+    bool insideKeyhole[NUMBER_OF_CHILDREN] = { false, false, false, false, false, false, false, false };
+    bool intersectsKeyhole[NUMBER_OF_CHILDREN] = { false, false, false, false, false, false, false, false };
+    if (_keyholeRadius >= 0.0f) {
+        const glm::vec3& keyholeMin = _keyholeBoundingBox.getCorner();
+        float keyholeSize = _keyholeBoundingBox.getScale();
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            bool inKeyholeBox =
+                scaledMinX[i] >= keyholeMin.x && scaledMaxX[i] <= keyholeMin.x + keyholeSize &&
+                scaledMinY[i] >= keyholeMin.y && scaledMaxY[i] <= keyholeMin.y + keyholeSize &&
+                scaledMinZ[i] >= keyholeMin.z && scaledMaxZ[i] <= keyholeMin.z + keyholeSize;
+
+            float closestX = glm::clamp(_position.x, scaledMinX[i], scaledMaxX[i]) - _position.x;
+            float closestY = glm::clamp(_position.y, scaledMinY[i], scaledMaxY[i]) - _position.y;
+            float closestZ = glm::clamp(_position.z, scaledMinZ[i], scaledMaxZ[i]) - _position.z;
+            float closestDistance = sqrtf(closestX * closestX + closestY * closestY + closestZ * closestZ);
+
+            float farX = std::max(fabsf(scaledMinX[i] - _position.x), fabsf(scaledMaxX[i] - _position.x));
+            float farY = std::max(fabsf(scaledMinY[i] - _position.y), fabsf(scaledMaxY[i] - _position.y));
+            float farZ = std::max(fabsf(scaledMinZ[i] - _position.z), fabsf(scaledMaxZ[i] - _position.z));
+            float furthestCornerDistance = sqrtf(farX * farX + farY * farY + farZ * farZ);
+
+            intersectsKeyhole[i] = inKeyholeBox && (closestDistance < _keyholeRadius || closestDistance < EPSILON);
+            insideKeyhole[i] = intersectsKeyhole[i] && furthestCornerDistance <= _keyholeRadius;
+        }
+    }
+
+    // combined as boxInFrustum() does: inside the keyhole wins, then outside the frustum falls back to the keyhole
+    locations.insideMask = 0;
+    locations.intersectMask = 0;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        unsigned char bit = (1 << i);
+        if (insideKeyhole[i]) {
+            locations.insideMask |= bit;
+        } else if (outsideFrustum[i]) {
+            if (intersectsKeyhole[i]) {
+                locations.intersectMask |= bit;
+            }
+        } else if (intersectsFrustum[i]) {
+            locations.intersectMask |= bit;
+        } else {
+            locations.insideMask |= bit;
+        }
+    }
+}
+
+void ViewFrustum::childrenInFrustumOneByOne(const AABox& box, ChildLocations& locations) const {
+    float childScale = box.getScale() * 0.5f;
+    locations.insideMask = 0;
+    locations.intersectMask = 0;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        AABox childBox(box.getCorner() + glm::vec3(((i >> 2) & 1) * childScale, ((i >> 1) & 1) * childScale,
+            (i & 1) * childScale), childScale);
+        locations.distances[i] = glm::distance(_position, childBox.calcCenter() * (float)TREE_SCALE);
+
+        glm::vec3 furthestPoint;
+        getFurthestPointFromCameraVoxelScale(childBox, furthestPoint);
+        locations.furthestDistances[i] = glm::distance(_positionVoxelScale, furthestPoint) * (float)TREE_SCALE;
+
+        childBox.scale(TREE_SCALE);
+        ViewFrustum::location location = boxInFrustum(childBox);
+        if (location == INSIDE) {
+            locations.insideMask |= (1 << i);
+        } else if (location == INTERSECT) {
+            locations.intersectMask |= (1 << i);
+        }
+    }
+}
+
 bool testMatches(glm::quat lhs, glm::quat rhs, float epsilon = EPSILON) {
     return (fabs(lhs.x - rhs.x) <= epsilon && fabs(lhs.y - rhs.y) <= epsilon && fabs(lhs.z - rhs.z) <= epsilon
             && fabs(lhs.w - rhs.w) <= epsilon);
@@ -87,6 +87,28 @@ public:
     ViewFrustum::location sphereInFrustum(const glm::vec3& center, float radius) const;
     ViewFrustum::location boxInFrustum(const AABox& box) const;
 
+    /// The locations of an element's eight children, and their distances from the camera, as found by
+    /// childrenInFrustum(). Child bits are (1 << childIndex); children in neither mask are OUTSIDE.
+    class ChildLocations {
+    public:
+        unsigned char insideMask;
+        unsigned char intersectMask;
+        float distances[NUMBER_OF_CHILDREN];         ///< camera to each child's center, as OctreeElement::distanceToCamera()
+        float furthestDistances[NUMBER_OF_CHILDREN]; ///< to each child's furthest corner, as furthestDistanceToCamera()
+
+        ViewFrustum::location getLocation(int childIndex) const;
+    };
+
+    /// Tests the eight children of a box against the frustum and keyhole in one pass, with the same results as calling
+    /// boxInFrustum() on each child in turn. The children are laid out as in octal codes, and the box is in voxel scale
+    /// like OctreeElement::getAABox().
+    void childrenInFrustum(const AABox& box, ChildLocations& locations) const;
+
+    /// Whether childrenInFrustum() tests the children in one pass (the default) or one at a time with boxInFrustum(), as
+    /// encoding did before; the benchmarks use the latter as their baseline.
+    void setBatchChildTests(bool batchChildTests) { _batchChildTests = batchChildTests; }
+    bool getBatchChildTests() const { return _batchChildTests; }
+
     // some frustum comparisons
     bool matches(const ViewFrustum& compareTo, bool debug = false) const;
     bool matches(const ViewFrustum* compareTo, bool debug = false) const { return matches(*compareTo, debug); }
@@ -113,6 +135,7 @@ private:
     ViewFrustum::location pointInKeyhole(const glm::vec3& point) const;
     ViewFrustum::location sphereInKeyhole(const glm::vec3& center, float radius) const;
     ViewFrustum::location boxInKeyhole(const AABox& box) const;
+    void childrenInFrustumOneByOne(const AABox& box, ChildLocations& locations) const;
 
     // camera location/orientation attributes
     glm::vec3   _position; // the position in TREE_SCALE
@@ -158,6 +181,8 @@ private:
 
     // Used to project points
     glm::mat4 _ourModelViewProjectionMatrix;
+
+    bool _batchChildTests;
 };
 
 
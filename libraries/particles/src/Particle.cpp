@@ -7,8 +7,13 @@
 //
 //
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QThreadStorage>
 
+#include <AABox.h>
 #include <Octree.h>
 #include <RegisteredMetaTypes.h>
 #include <SharedUtil.h> // usecTimestampNow()
@@ -96,8 +101,12 @@ Particle::Particle(const ParticleID& particleID, const ParticleProperties& prope
     _modelTranslation = DEFAULT_MODEL_TRANSLATION;
     _modelRotation = DEFAULT_MODEL_ROTATION;
     _modelScale = DEFAULT_MODEL_SCALE;
-    
+    _sleeping = false;
+    _stillSince = now;
+    stampAllChanged(now);
+
     setProperties(properties);
+    resetReckoning(now);
 }
 
 
@@ -116,8 +125,12 @@ void Particle::init(glm::vec3 position, float radius, rgbColor color, glm::vec3
     _lastEdited = now;
     _lastUpdated = now;
     _created = now; // will get updated as appropriate in setAge()
+    _sleeping = false;
+    _stillSince = now;
+    stampAllChanged(now);
 
     _position = position;
+    _stillPosition = position;
     _radius = radius;
     _mass = 1.0f;
     memcpy(_color, color, sizeof(_color));
@@ -132,6 +145,7 @@ void Particle::init(glm::vec3 position, float radius, rgbColor color, glm::vec3
     _modelTranslation = DEFAULT_MODEL_TRANSLATION;
     _modelRotation = DEFAULT_MODEL_ROTATION;
     _modelScale = DEFAULT_MODEL_SCALE;
+    resetReckoning(now);
 }
 
 void Particle::setMass(float value) {
@@ -343,11 +357,227 @@ int Particle::readParticleDataFromBuffer(const unsigned char* data, int bytesLef
         dataAt += bytes;
         bytesRead += bytes;
 
+        // the server's particle is where we extrapolate ours from, until it sends another
+        resetReckoning(_lastUpdated);
+
         //printf("Particle::readParticleDataFromBuffer()... "); debugDump();
     }
     return bytesRead;
 }
 
+// how often a particle is sent whole to viewers, even if they've heard about every change to it; particles are spread
+// out over the period by ID, so that they don't all come due at once
+const quint64 PARTICLE_REFRESH_USECS = 5 * USECS_PER_SECOND;
+const quint64 PARTICLE_REFRESH_SLOTS = 1024;
+
+uint8_t Particle::getDeltaSince(quint64 sinceTime, quint64 now) const {
+    quint64 offset = (_id % PARTICLE_REFRESH_SLOTS) * (PARTICLE_REFRESH_USECS / PARTICLE_REFRESH_SLOTS);
+    bool dueRefresh = (sinceTime + offset) / PARTICLE_REFRESH_USECS != (now + offset) / PARTICLE_REFRESH_USECS;
+
+    // every group changes at once when the particle is created, or comes into its element
+    bool allChanged = _motionChanged > sinceTime && _physicsChanged > sinceTime &&
+        _appearanceChanged > sinceTime && _scriptChanged > sinceTime;
+    if (sinceTime == 0 || dueRefresh || allChanged) {
+        return PARTICLE_DELTA_ALL;
+    }
+    uint8_t delta = 0;
+    if (_motionChanged > sinceTime) {
+        delta |= PARTICLE_DELTA_MOTION;
+    }
+    if (_physicsChanged > sinceTime) {
+        delta |= PARTICLE_DELTA_PHYSICS;
+    }
+    if (_appearanceChanged > sinceTime) {
+        delta |= PARTICLE_DELTA_APPEARANCE;
+    }
+    if (_scriptChanged > sinceTime) {
+        delta |= PARTICLE_DELTA_SCRIPT;
+    }
+    return delta;
+}
+
+// positions are sent as 16 bit fractions of their element's box, when that's within this of the actual position
+const float PARTICLE_POSITION_TOLERANCE = 0.001f / TREE_SCALE;
+const float POSITION_STEPS = 65535.0f;
+
+// velocities are sent as signed 16 bit multiples of this fraction of their element's box per second, when that's within
+// this of the actual velocity
+const float PARTICLE_VELOCITY_TOLERANCE = 0.01f / TREE_SCALE;
+const float VELOCITY_STEPS_PER_SCALE = 1024.0f;
+const float MAX_VELOCITY_STEPS = 32767.0f;
+
+static bool needsWidePosition(const glm::vec3& position, const AABox& box) {
+    return 0.5f * box.getScale() / POSITION_STEPS > PARTICLE_POSITION_TOLERANCE || !box.contains(position);
+}
+
+static bool needsWideVelocity(const glm::vec3& velocity, const AABox& box) {
+    float step = box.getScale() / VELOCITY_STEPS_PER_SCALE;
+    float maxComponent = glm::max(glm::max(fabsf(velocity.x), fabsf(velocity.y)), fabsf(velocity.z));
+    return 0.5f * step > PARTICLE_VELOCITY_TOLERANCE || maxComponent / step > MAX_VELOCITY_STEPS;
+}
+
+static bool appendString(OctreePacketData* packetData, const QString& string) {
+    QByteArray utf8 = string.toUtf8();
+    uint16_t length = utf8.size() + 1; // include NULL
+    return packetData->appendValue(length) &&
+        packetData->appendRawData((const unsigned char*)utf8.constData(), length);
+}
+
+bool Particle::appendParticleDelta(OctreePacketData* packetData, uint8_t delta, const AABox& box) const {
+    bool widePosition = false;
+    bool wideVelocity = false;
+    if (delta & PARTICLE_DELTA_MOTION) {
+        widePosition = needsWidePosition(_reckoningPosition, box);
+        wideVelocity = needsWideVelocity(_reckoningVelocity, box);
+        if (widePosition) {
+            delta |= PARTICLE_DELTA_WIDE_POSITION;
+        }
+        if (wideVelocity) {
+            delta |= PARTICLE_DELTA_WIDE_VELOCITY;
+        }
+    }
+    bool success = packetData->appendValue(getID()) && packetData->appendValue(delta);
+
+    if (success && (delta & PARTICLE_DELTA_AGE)) {
+        success = packetData->appendValue(getAge());
+    }
+    // viewers are sent the motion they extrapolate from, rather than where the particle is now
+    if (success && (delta & PARTICLE_DELTA_MOTION)) {
+        success = packetData->appendValue(_reckoningSince);
+        if (success && widePosition) {
+            success = packetData->appendPosition(_reckoningPosition);
+
+        } else if (success) {
+            glm::vec3 fraction = (_reckoningPosition - box.getCorner()) / box.getScale();
+            for (int i = 0; i < 3 && success; i++) {
+                success = packetData->appendValue((uint16_t)glm::round(glm::clamp(fraction[i], 0.0f, 1.0f) * POSITION_STEPS));
+            }
+        }
+        if (success && wideVelocity) {
+            success = packetData->appendValue(_reckoningVelocity);
+
+        } else if (success) {
+            glm::vec3 steps = _reckoningVelocity * (VELOCITY_STEPS_PER_SCALE / box.getScale());
+            for (int i = 0; i < 3 && success; i++) {
+                success = packetData->appendValue((uint16_t)(int16_t)glm::round(steps[i]));
+            }
+        }
+    }
+    if (success && (delta & PARTICLE_DELTA_EDITED)) {
+        success = packetData->appendValue(getLastEdited());
+    }
+    if (success && (delta & PARTICLE_DELTA_PHYSICS)) {
+        success = packetData->appendValue(getRadius()) && packetData->appendValue(getGravity()) &&
+            packetData->appendValue(getDamping()) && packetData->appendValue(getLifetime()) &&
+            packetData->appendValue(getInHand()) && packetData->appendValue(getShouldDie());
+    }
+    if (success && (delta & PARTICLE_DELTA_APPEARANCE)) {
+        success = packetData->appendColor(getColor()) && appendString(packetData, _modelURL) &&
+            packetData->appendValue(getModelScale()) && packetData->appendValue(getModelTranslation()) &&
+            packetData->appendValue(getModelRotation());
+    }
+    if (success && (delta & PARTICLE_DELTA_SCRIPT)) {
+        success = appendString(packetData, _script);
+    }
+    return success;
+}
+
+template<typename T> static bool readDeltaValue(const unsigned char*& dataAt, const unsigned char* dataEnd, T& value) {
+    if (dataEnd - dataAt < (int)sizeof(T)) {
+        return false;
+    }
+    memcpy(&value, dataAt, sizeof(T));
+    dataAt += sizeof(T);
+    return true;
+}
+
+static bool readDeltaString(const unsigned char*& dataAt, const unsigned char* dataEnd, QString& string) {
+    uint16_t length;
+    if (!readDeltaValue(dataAt, dataEnd, length) || length == 0 || dataEnd - dataAt < length) {
+        return false;
+    }
+    string = QString::fromUtf8((const char*)dataAt, length - 1);
+    dataAt += length;
+    return true;
+}
+
+int Particle::readParticleDeltaFromBuffer(const unsigned char* data, int bytesLeftToRead, const AABox& box,
+                                          ReadBitstreamToTreeParams& args) {
+    int clockSkew = args.sourceNode ? args.sourceNode->getClockSkewUsec() : 0;
+    const unsigned char* dataAt = data;
+    const unsigned char* dataEnd = data + bytesLeftToRead;
+
+    uint8_t delta;
+    if (!(readDeltaValue(dataAt, dataEnd, _id) && readDeltaValue(dataAt, dataEnd, delta))) {
+        return 0;
+    }
+    if (delta & PARTICLE_DELTA_AGE) {
+        float age;
+        if (!readDeltaValue(dataAt, dataEnd, age)) {
+            return 0;
+        }
+        setAge(age);
+    }
+    if (delta & PARTICLE_DELTA_MOTION) {
+        if (!readDeltaValue(dataAt, dataEnd, _lastUpdated)) {
+            return 0;
+        }
+        _lastUpdated -= clockSkew;
+
+        if (delta & PARTICLE_DELTA_WIDE_POSITION) {
+            if (!readDeltaValue(dataAt, dataEnd, _position)) {
+                return 0;
+            }
+        } else {
+            uint16_t steps[3];
+            if (!readDeltaValue(dataAt, dataEnd, steps)) {
+                return 0;
+            }
+            _position = box.getCorner() + glm::vec3(steps[0], steps[1], steps[2]) * (box.getScale() / POSITION_STEPS);
+        }
+        if (delta & PARTICLE_DELTA_WIDE_VELOCITY) {
+            if (!readDeltaValue(dataAt, dataEnd, _velocity)) {
+                return 0;
+            }
+        } else {
+            int16_t steps[3];
+            if (!readDeltaValue(dataAt, dataEnd, steps)) {
+                return 0;
+            }
+            _velocity = glm::vec3(steps[0], steps[1], steps[2]) * (box.getScale() / VELOCITY_STEPS_PER_SCALE);
+        }
+        resetReckoning(_lastUpdated);
+    }
+    if (delta & PARTICLE_DELTA_EDITED) {
+        if (!readDeltaValue(dataAt, dataEnd, _lastEdited)) {
+            return 0;
+        }
+        _lastEdited -= clockSkew;
+    }
+    if (delta & PARTICLE_DELTA_PHYSICS) {
+        if (!(readDeltaValue(dataAt, dataEnd, _radius) && readDeltaValue(dataAt, dataEnd, _gravity) &&
+                readDeltaValue(dataAt, dataEnd, _damping) && readDeltaValue(dataAt, dataEnd, _lifetime) &&
+                readDeltaValue(dataAt, dataEnd, _inHand) && readDeltaValue(dataAt, dataEnd, _shouldDie))) {
+            return 0;
+        }
+    }
+    if (delta & PARTICLE_DELTA_APPEARANCE) {
+        const int PACKED_QUAT_SIZE = 4 * sizeof(uint16_t);
+        if (!(readDeltaValue(dataAt, dataEnd, _color) && readDeltaString(dataAt, dataEnd, _modelURL) &&
+                readDeltaValue(dataAt, dataEnd, _modelScale) && readDeltaValue(dataAt, dataEnd, _modelTranslation) &&
+                dataEnd - dataAt >= PACKED_QUAT_SIZE)) {
+            return 0;
+        }
+        dataAt += unpackOrientationQuatFromBytes(dataAt, _modelRotation);
+    }
+    if (delta & PARTICLE_DELTA_SCRIPT) {
+        if (!readDeltaString(dataAt, dataEnd, _script)) {
+            return 0;
+        }
+    }
+    return dataAt - data;
+}
+
 Particle Particle::fromEditPacket(const unsigned char* data, int length, int& processedBytes, ParticleTree* tree, bool& valid) {
 
     Particle newParticle; // id and _lastUpdated will get set here...
@@ -535,6 +765,10 @@ Particle Particle::fromEditPacket(const unsigned char* data, int length, int& pr
         newParticle.debugDump();
     }
 
+    // edits to existing particles are extrapolated from once they're stored, see stampChanges()
+    if (isNewParticle) {
+        newParticle.resetReckoning(newParticle._lastUpdated);
+    }
     return newParticle;
 }
 
@@ -815,90 +1049,348 @@ void Particle::applyHardCollision(const CollisionInfo& collisionInfo) {
     setVelocity(velocity);
 }
 
-void Particle::update(const quint64& now) {
+// a particle that moves less than this for SLEEP_DELAY_USECS goes to sleep
+const float SLEEP_DISTANCE = 0.001f / TREE_SCALE;
+const quint64 SLEEP_DELAY_USECS = USECS_PER_SECOND / 2;
+
+// moves a particle under its velocity, gravity and damping, bouncing it off the ground
+static void integrateMotion(glm::vec3& position, glm::vec3& velocity, const glm::vec3& gravity, float damping,
+                            float timeElapsed) {
+    position += velocity * timeElapsed;
+
+    // handle bounces off the ground...
+    if (position.y <= 0) {
+        velocity = velocity * glm::vec3(1,-1,1);
+        position.y = 0;
+    }
+
+    // handle gravity....
+    velocity += gravity * timeElapsed;
+
+    // handle damping
+    glm::vec3 dampingResistance = velocity * damping;
+    velocity -= dampingResistance * timeElapsed;
+}
+
+bool Particle::update(const quint64& now, bool extrapolating, float motionTolerance) {
+    quint64 lastUpdated = _lastUpdated;
     float timeElapsed = (float)(now - _lastUpdated) / (float)(USECS_PER_SECOND);
     _lastUpdated = now;
 
     // calculate our default shouldDie state... then allow script to change it if it wants...
+    bool wasDying = getShouldDie();
     bool isInHand = getInHand();
     bool shouldDie = (getAge() > getLifetime()) || getShouldDie();
     setShouldDie(shouldDie);
+    if (shouldDie != wasDying) {
+        _physicsChanged = now;
+    }
 
-    executeUpdateScripts(); // allow the javascript to alter our state
+    // sleeping particles don't simulate until something (an edit, a collision) gives them a velocity
+    if (_sleeping) {
+        if (_velocity == glm::vec3(0.0f, 0.0f, 0.0f)) {
+            return shouldDie != wasDying;
+        }
+        wakeUp();
+    }
+
+    // scripts can change anything about us, so scripted particles are compared against a copy
+    uint8_t scriptDifferences = 0;
+    if (!_script.isEmpty()) {
+        Particle beforeScript(*this);
+        executeUpdateScripts(); // allow the javascript to alter our state
+        scriptDifferences = differencesFrom(beforeScript);
+    }
+    glm::vec3 oldPosition = _position;
+    glm::vec3 oldVelocity = _velocity;
 
     // If the ball is in hand, it doesn't move or have gravity effect it
     if (!isInHand) {
-        _position += _velocity * timeElapsed;
+        if (extrapolating) {
+            // if something here (a collision, a script) moved us since we were last extrapolated, carry on from there
+            // until the server says otherwise
+            glm::vec3 reckonedPosition;
+            glm::vec3 reckonedVelocity;
+            reckon(lastUpdated, reckonedPosition, reckonedVelocity);
+            if (reckonedPosition != _position || reckonedVelocity != _velocity) {
+                resetReckoning(lastUpdated);
+            }
+            reckon(now, _position, _velocity);
+        } else {
+            integrateMotion(_position, _velocity, _gravity, _damping, timeElapsed);
+        }
+        updateSleeping(now);
+    }
+
+    // viewers are only sent our motion again once we've strayed from where they extrapolate us to
+    if (!extrapolating && (_position != oldPosition || _velocity != oldVelocity) && hasStrayed(now, motionTolerance)) {
+        scriptDifferences |= PARTICLE_DELTA_MOTION;
+    }
+    return stampDifferences(scriptDifferences, now) || shouldDie != wasDying;
+}
 
-        // handle bounces off the ground...
-        if (_position.y <= 0) {
-            _velocity = _velocity * glm::vec3(1,-1,1);
-            _position.y = 0;
+// extrapolated motion is integrated in steps of this, and restarted from the particle's actual motion at least this often
+const quint64 RECKONING_STEP_USECS = USECS_PER_SECOND / 60;
+const quint64 MAX_RECKONING_USECS = 2 * USECS_PER_SECOND;
+
+void Particle::reckon(const quint64& time, glm::vec3& position, glm::vec3& velocity) {
+    // particles sent at rest stay put, as they do on the server while they're asleep
+    if (_inHand || _reckoningVelocity == glm::vec3(0.0f, 0.0f, 0.0f)) {
+        position = _reckoningPosition;
+        velocity = _reckoningVelocity;
+        return;
+    }
+    const float STEP_SECONDS = (float)RECKONING_STEP_USECS / (float)USECS_PER_SECOND;
+    while (time >= _reckonedUntil + RECKONING_STEP_USECS) {
+        integrateMotion(_reckonedPosition, _reckonedVelocity, _gravity, _damping, STEP_SECONDS);
+        _reckonedUntil += RECKONING_STEP_USECS;
+    }
+    position = _reckonedPosition;
+    velocity = _reckonedVelocity;
+    if (time > _reckonedUntil) {
+        integrateMotion(position, velocity, _gravity, _damping, (float)(time - _reckonedUntil) / (float)USECS_PER_SECOND);
+    }
+}
+
+void Particle::resetReckoning(const quint64& since) {
+    _reckoningPosition = _reckonedPosition = _position;
+    _reckoningVelocity = _reckonedVelocity = _velocity;
+    _reckoningSince = _reckonedUntil = since;
+}
+
+bool Particle::hasStrayed(const quint64& now, float motionTolerance) {
+    // old motion is resent anyway, since viewers extrapolate from a quantized copy of it
+    if (now - _reckoningSince > MAX_RECKONING_USECS) {
+        return true;
+    }
+    glm::vec3 reckonedPosition;
+    glm::vec3 reckonedVelocity;
+    reckon(now, reckonedPosition, reckonedVelocity);
+
+    // a velocity off by motionTolerance per second takes the particle that far off course within a second
+    return glm::distance(reckonedPosition, _position) > motionTolerance ||
+        glm::distance(reckonedVelocity, _velocity) > motionTolerance;
+}
+
+void Particle::updateSleeping(const quint64& now) {
+    if (!_script.isEmpty() || glm::distance(_position, _stillPosition) > SLEEP_DISTANCE) {
+        _stillPosition = _position;
+        _stillSince = now;
+
+    } else if (now - _stillSince > SLEEP_DELAY_USECS) {
+        // settle where we are; a particle resting on the ground under gravity never quite stops bouncing
+        _sleeping = true;
+        _velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+    }
+}
+
+void Particle::wakeUp() {
+    _sleeping = false;
+    _stillSince = _lastUpdated;
+    _stillPosition = _position;
+}
+
+uint8_t Particle::differencesFrom(const Particle& other) const {
+    uint8_t differences = 0;
+    if (_position != other._position || _velocity != other._velocity) {
+        differences |= PARTICLE_DELTA_MOTION;
+    }
+    if (_radius != other._radius || _gravity != other._gravity || _damping != other._damping ||
+            _lifetime != other._lifetime || _inHand != other._inHand || _shouldDie != other._shouldDie) {
+        differences |= PARTICLE_DELTA_PHYSICS;
+    }
+    if (memcmp(_color, other._color, sizeof(_color)) != 0 || _modelURL != other._modelURL ||
+            _modelScale != other._modelScale || _modelTranslation != other._modelTranslation ||
+            _modelRotation != other._modelRotation) {
+        differences |= PARTICLE_DELTA_APPEARANCE;
+    }
+    if (_script != other._script) {
+        differences |= PARTICLE_DELTA_SCRIPT;
+    }
+    return differences;
+}
+
+bool Particle::stampChanges(const Particle& before, const quint64& now) {
+    return stampDifferences(differencesFrom(before), now);
+}
+
+bool Particle::stampDifferences(uint8_t differences, const quint64& now) {
+    // viewers can't extrapolate through an edit, so they're sent the motion to extrapolate from after it
+    if (differences & (PARTICLE_DELTA_MOTION | PARTICLE_DELTA_PHYSICS)) {
+        _motionChanged = now;
+        resetReckoning(_lastUpdated);
+    }
+    if (differences & PARTICLE_DELTA_PHYSICS) {
+        _physicsChanged = now;
+    }
+    if (differences & PARTICLE_DELTA_APPEARANCE) {
+        _appearanceChanged = now;
+    }
+    if (differences & PARTICLE_DELTA_SCRIPT) {
+        _scriptChanged = now;
+    }
+    return differences != 0;
+}
+
+void Particle::stampAllChanged(const quint64& now) {
+    _motionChanged = now;
+    _physicsChanged = now;
+    _appearanceChanged = now;
+    _scriptChanged = now;
+}
+
+/// A script engine that has evaluated a particle script once, and that every particle running the same script then reuses
+/// for its update and collision events, so that the script isn't compiled for each event. Particles sharing a script
+/// also share its global state.
+class ParticleScriptContext {
+public:
+    ParticleScriptContext(const QString& script) : particleScriptable(NULL), engine(script) { }
+
+    ParticleScriptObject particleScriptable; ///< the "Particle" global, set only while a particle runs
+    ScriptEngine engine;
+};
+
+static QMutex scriptUsersMutex;
+static QHash<QString, int> scriptUsers; // the particles with a claim on each script's contexts, across all threads
+static QAtomicInt scriptsReleased; // bumped whenever a script loses its last user
+
+/// The script contexts created on one thread, by script text. Script engines can't be shared between threads.
+class ParticleScriptContextPool {
+public:
+    ParticleScriptContextPool() : releasesSeen(scriptsReleased.load()) { }
+    ~ParticleScriptContextPool() { qDeleteAll(contexts); }
+
+    void releaseUnusedContexts();
+
+    QHash<QString, ParticleScriptContext*> contexts;
+    int releasesSeen;
+};
+
+void ParticleScriptContextPool::releaseUnusedContexts() {
+    releasesSeen = scriptsReleased.load();
+    QMutexLocker locker(&scriptUsersMutex);
+    QHash<QString, ParticleScriptContext*>::iterator it = contexts.begin();
+    while (it != contexts.end()) {
+        if (!scriptUsers.contains(it.key())) {
+            delete it.value();
+            it = contexts.erase(it);
+        } else {
+            ++it;
         }
+    }
+}
 
-        // handle gravity....
-        _velocity += _gravity * timeElapsed;
+static QThreadStorage<ParticleScriptContextPool*> scriptContextPools;
 
-        // handle damping
-        glm::vec3 dampingResistance = _velocity * _damping;
-        _velocity -= dampingResistance * timeElapsed;
-        //printf("applying damping to Particle timeElapsed=%f\n",timeElapsed);
+static ParticleScriptContextPool& getScriptContextPool() {
+    if (!scriptContextPools.hasLocalData()) {
+        scriptContextPools.setLocalData(new ParticleScriptContextPool());
     }
+    return *scriptContextPools.localData();
 }
 
-void Particle::startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
-    if (_voxelEditSender) {
-        engine.getVoxelsScriptingInterface()->setPacketSender(_voxelEditSender);
+void ParticleScriptUse::use(const QString& script) {
+    if (script == _script) {
+        return;
     }
-    if (_particleEditSender) {
-        engine.getParticlesScriptingInterface()->setPacketSender(_particleEditSender);
+    release();
+    QMutexLocker locker(&scriptUsersMutex);
+    scriptUsers[script]++;
+    _script = script;
+}
+
+void ParticleScriptUse::release() {
+    if (_script.isEmpty()) {
+        return;
+    }
+    bool lastUser = false;
+    {
+        QMutexLocker locker(&scriptUsersMutex);
+        QHash<QString, int>::iterator it = scriptUsers.find(_script);
+        if (--it.value() == 0) {
+            scriptUsers.erase(it);
+            lastUser = true;
+        }
     }
+    if (lastUser) {
+        scriptsReleased.ref();
+        if (scriptContextPools.hasLocalData()) {
+            delete scriptContextPools.localData()->contexts.take(_script);
+        }
+    }
+    _script.clear();
+}
 
-    // Add the "this" Particle object
-    engine.registerGlobalObject("Particle", &particleScriptable);
-    engine.evaluate();
+int Particle::getScriptContextCount() {
+    return scriptContextPools.hasLocalData() ? scriptContextPools.localData()->contexts.size() : 0;
 }
 
-void Particle::endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
+ParticleScriptObject& Particle::startParticleScriptContext() {
+    if (_voxelEditSender) {
+        ScriptEngine::getVoxelsScriptingInterface()->setPacketSender(_voxelEditSender);
+    }
+    if (_particleEditSender) {
+        ScriptEngine::getParticlesScriptingInterface()->setPacketSender(_particleEditSender);
+    }
+
+    // claim the script before sweeping, so that its context here survives the sweep; scripts also run on threads that
+    // never update a tree (collisions, for one), so every thread tears down the contexts other threads' particles
+    // stopped using as it runs scripts
+    _scriptUse.use(_script);
+    ParticleScriptContextPool& pool = getScriptContextPool();
+    if (pool.releasesSeen != scriptsReleased.load()) {
+        pool.releaseUnusedContexts();
+    }
+    ParticleScriptContext* context = pool.contexts.value(_script);
+    if (!context) {
+        // Add the "this" Particle object, and run the script once to connect its handlers
+        context = new ParticleScriptContext(_script);
+        pool.contexts.insert(_script, context);
+        context->particleScriptable.setParticle(this);
+        context->engine.registerGlobalObject("Particle", &context->particleScriptable);
+        context->engine.evaluate();
+    }
+    context->particleScriptable.setParticle(this);
+    return context->particleScriptable;
+}
+
+void Particle::endParticleScriptContext(ParticleScriptObject& particleScriptable) {
     if (_voxelEditSender) {
         _voxelEditSender->releaseQueuedMessages();
     }
     if (_particleEditSender) {
         _particleEditSender->releaseQueuedMessages();
     }
+
+    // the particle may die before the script runs again, so don't leave the "Particle" global pointing at it
+    particleScriptable.setParticle(NULL);
 }
 
 void Particle::executeUpdateScripts() {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
+        ParticleScriptObject& particleScriptable = startParticleScriptContext();
         particleScriptable.emitUpdate();
-        endParticleScriptContext(engine, particleScriptable);
+        endParticleScriptContext(particleScriptable);
     }
 }
 
 void Particle::collisionWithParticle(Particle* other, const glm::vec3& penetration) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
+        ParticleScriptObject& particleScriptable = startParticleScriptContext();
         ParticleScriptObject otherParticleScriptable(other);
         particleScriptable.emitCollisionWithParticle(&otherParticleScriptable, penetration);
-        endParticleScriptContext(engine, particleScriptable);
+        endParticleScriptContext(particleScriptable);
     }
 }
 
 void Particle::collisionWithVoxel(VoxelDetail* voxelDetails, const glm::vec3& penetration) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
+        ParticleScriptObject& particleScriptable = startParticleScriptContext();
         particleScriptable.emitCollisionWithVoxel(*voxelDetails, penetration);
-        endParticleScriptContext(engine, particleScriptable);
+        endParticleScriptContext(particleScriptable);
     }
 }
 
@@ -921,6 +1413,7 @@ ParticleProperties Particle::getProperties() const {
 
 void Particle::setProperties(const ParticleProperties& properties) {
     properties.copyToParticle(*this);
+    wakeUp();
 }
 
 ParticleProperties::ParticleProperties() :
@@ -19,7 +19,9 @@
 #include <CollisionInfo.h>
 #include <SharedUtil.h>
 #include <OctreePacketData.h>
+#include <PacketHeaders.h>
 
+class AABox;
 class Particle;
 class ParticleEditPacketSender;
 class ParticleProperties;
@@ -50,11 +52,27 @@ const uint16_t CONTAINS_MODEL_TRANSLATION = 1024;
 const uint16_t CONTAINS_MODEL_ROTATION = 2048;
 const uint16_t CONTAINS_MODEL_SCALE = 4096;
 
+// the groups of properties sent to viewers in a particle delta, see Particle::appendParticleDelta()
+const uint8_t PARTICLE_DELTA_AGE = 1;           // the whole particle is sent, starting with its age
+const uint8_t PARTICLE_DELTA_MOTION = 2;        // the motion viewers extrapolate from: when, position and velocity
+const uint8_t PARTICLE_DELTA_WIDE_POSITION = 4; // the position is sent as floats, its element is too big to quantize it in
+const uint8_t PARTICLE_DELTA_WIDE_VELOCITY = 8; // the velocity is sent as floats, it's too fast to quantize in its element
+const uint8_t PARTICLE_DELTA_PHYSICS = 16;      // radius, gravity, damping, lifetime, in hand and should die
+const uint8_t PARTICLE_DELTA_APPEARANCE = 32;   // color and model
+const uint8_t PARTICLE_DELTA_SCRIPT = 64;
+const uint8_t PARTICLE_DELTA_EDITED = PARTICLE_DELTA_PHYSICS | PARTICLE_DELTA_APPEARANCE | PARTICLE_DELTA_SCRIPT;
+const uint8_t PARTICLE_DELTA_ALL = PARTICLE_DELTA_AGE | PARTICLE_DELTA_MOTION | PARTICLE_DELTA_EDITED;
+
+/// The PacketTypeParticleData and PacketTypeParticleErase version that sent whole particles and lists of deleted IDs,
+/// still sent to clients that don't ask for deltas
+const PacketVersion FULL_PARTICLE_DATA_VERSION = 1;
+
 const float DEFAULT_LIFETIME = 10.0f; // particles live for 10 seconds by default
 const float DEFAULT_DAMPING = 0.99f;
 const float DEFAULT_RADIUS = 0.1f / TREE_SCALE;
 const float MINIMUM_PARTICLE_ELEMENT_SIZE = (1.0f / 100000.0f) / TREE_SCALE; // smallest size container
 const glm::vec3 DEFAULT_GRAVITY(0, (-9.8f / TREE_SCALE), 0);
+const float DEFAULT_MOTION_TOLERANCE = 0.05f / TREE_SCALE; // how far particles stray before viewers are sent their motion
 const QString DEFAULT_SCRIPT("");
 const QString DEFAULT_MODEL_URL("");
 const glm::vec3 DEFAULT_MODEL_TRANSLATION(0, 0, 0);
@@ -187,6 +205,26 @@ QScriptValue ParticleIDtoScriptValue(QScriptEngine* engine, const ParticleID& pr
 void ParticleIDfromScriptValue(const QScriptValue &object, ParticleID& properties);
 
 
+/// A particle's claim on the script contexts for its script, released when the particle dies or its script changes.
+/// Copies start out with no claim, and make their own when they first run the script.
+class ParticleScriptUse {
+public:
+    ParticleScriptUse() { }
+    ParticleScriptUse(const ParticleScriptUse& other) { }
+    ~ParticleScriptUse() { release(); }
+
+    ParticleScriptUse& operator=(const ParticleScriptUse& other) { return *this; }
+
+    /// Claims the contexts for script, releasing the claim on any other script.
+    void use(const QString& script);
+
+    /// Releases the claim, tearing down this thread's context for the script if that was its last user. Other threads
+    /// tear down theirs the next time they run a script.
+    void release();
+
+private:
+    QString _script;
+};
 
 /// Particle class - this is the actual particle class.
 class Particle  {
@@ -248,6 +286,7 @@ public:
     void setID(uint32_t id) { _id = id; }
     bool getShouldDie() const { return _shouldDie; }
     QString getScript() const { return _script; }
+    bool hasScript() const { return !_script.isEmpty(); }
     uint32_t getCreatorTokenID() const { return _creatorTokenID; }
     bool isNewlyCreated() const { return _newlyCreated; }
 
@@ -287,6 +326,28 @@ public:
     int readParticleDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args);
     static int expectedBytes();
 
+    /// The groups of properties (PARTICLE_DELTA_AGE and the others that aren't WIDE) a viewer that last heard about the
+    /// particle at sinceTime needs. That's all of them if sinceTime is 0, if the particle has come into its element since,
+    /// or if the particle is due its periodic refresh, which makes up for lost packets.
+    uint8_t getDeltaSince(quint64 sinceTime, quint64 now) const;
+
+    /// Appends the particle's ID and the groups of properties in delta, with the position and velocity quantized to box,
+    /// the bounds of the particle's element.
+    bool appendParticleDelta(OctreePacketData* packetData, uint8_t delta, const AABox& box) const;
+
+    /// Reads what appendParticleDelta() wrote over the particle's properties.
+    /// \return the number of bytes read, or 0 if the delta was cut short
+    int readParticleDeltaFromBuffer(const unsigned char* data, int bytesLeftToRead, const AABox& box,
+                                    ReadBitstreamToTreeParams& args);
+    static int minimumDeltaBytes() { return sizeof(uint32_t) + sizeof(uint8_t); }
+
+    /// Notes that the groups of properties that differ from before changed at now.
+    /// \return true if any of them did
+    bool stampChanges(const Particle& before, const quint64& now);
+
+    /// Notes that every property changed at now, e.g. when the particle comes into an element.
+    void stampAllChanged(const quint64& now);
+
     static bool encodeParticleEditMessageDetails(PacketType command, ParticleID id, const ParticleProperties& details,
                         unsigned char* bufferOut, int sizeIn, int& sizeOut);
 
@@ -294,7 +355,24 @@ public:
     
     void applyHardCollision(const CollisionInfo& collisionInfo);
 
-    void update(const quint64& now);
+    /// Simulates the particle up to now and runs its update script. Viewers extrapolating their particles (rather than
+    /// simulating them) move them along the motion they were last sent, see reckon(), and so are only sent the particle's
+    /// motion again when it strays more than motionTolerance from there.
+    /// \return true if the particle's state changed in a way worth sending to viewers
+    bool update(const quint64& now, bool extrapolating = false, float motionTolerance = DEFAULT_MOTION_TOLERANCE);
+
+    /// Extrapolates the motion viewers were last sent to time, with the equations update() simulates. The motion is
+    /// integrated in fixed steps, so that the server and every viewer land in the same place however often they ask.
+    void reckon(const quint64& time, glm::vec3& position, glm::vec3& velocity);
+
+    /// When the motion that reckon() extrapolates starts.
+    const quint64& getReckoningSince() const { return _reckoningSince; }
+
+    /// Unscripted particles that have stayed put for a while go to sleep: they stop simulating, and so stop changing,
+    /// until something gives them a velocity or edits them.
+    bool isSleeping() const { return _sleeping; }
+    void wakeUp();
+
     void collisionWithParticle(Particle* other, const glm::vec3& penetration);
     void collisionWithVoxel(VoxelDetail* voxel, const glm::vec3& penetration);
 
@@ -318,29 +396,60 @@ public:
     static uint32_t getNextCreatorTokenID();
     static void handleAddParticleResponse(const QByteArray& packet);
 
+    /// Returns the number of script contexts on this thread. Particle scripts are evaluated once per thread and their
+    /// contexts reused, until the last particle running them dies.
+    static int getScriptContextCount();
+
 protected:
     static VoxelEditPacketSender* _voxelEditSender;
     static ParticleEditPacketSender* _particleEditSender;
 
-    void startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
-    void endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
+    ParticleScriptObject& startParticleScriptContext();
+    void endParticleScriptContext(ParticleScriptObject& particleScriptable);
     void executeUpdateScripts();
 
     void setAge(float age);
+    uint8_t differencesFrom(const Particle& other) const;
+    bool stampDifferences(uint8_t differences, const quint64& now);
+    void updateSleeping(const quint64& now);
+
+    /// Starts extrapolating from the particle's motion at since.
+    void resetReckoning(const quint64& since);
+    bool hasStrayed(const quint64& now, float motionTolerance);
 
+    // the state that simulation and collisions touch comes first, to share as few cache lines as it can
     glm::vec3 _position;
-    rgbColor _color;
-    float _radius;
-    float _mass;
     glm::vec3 _velocity;
-    uint32_t _id;
-    static uint32_t _nextID;
-    bool _shouldDie;
     glm::vec3 _gravity;
+    float _radius;
+    float _mass;
     float _damping;
     float _lifetime;
-    QString _script;
+    uint32_t _id;
+    bool _shouldDie;
     bool _inHand;
+    quint64 _lastUpdated;
+
+    // this doesn't go on the wire, we send it as lifetime
+    quint64 _created;
+
+    // neither do these, the server decides when its particles sleep
+    bool _sleeping;
+    quint64 _stillSince;
+    glm::vec3 _stillPosition;
+
+    // the motion viewers were last sent, and how far reckon() has extrapolated it in whole steps
+    glm::vec3 _reckoningPosition;
+    glm::vec3 _reckoningVelocity;
+    quint64 _reckoningSince;
+    glm::vec3 _reckonedPosition;
+    glm::vec3 _reckonedVelocity;
+    quint64 _reckonedUntil;
+
+    // the rest is only needed for rendering, scripting and editing
+    rgbColor _color;
+    QString _script;
+    ParticleScriptUse _scriptUse;
 
     // model related items
     QString _modelURL;
@@ -350,12 +459,15 @@ protected:
 
     uint32_t _creatorTokenID;
     bool _newlyCreated;
-
-    quint64 _lastUpdated;
     quint64 _lastEdited;
 
-    // this doesn't go on the wire, we send it as lifetime
-    quint64 _created;
+    // when each group of properties sent in deltas last changed, on the server
+    quint64 _motionChanged;
+    quint64 _physicsChanged;
+    quint64 _appearanceChanged;
+    quint64 _scriptChanged;
+
+    static uint32_t _nextID;
 
     // used by the static interfaces for creator token ids
     static uint32_t _nextCreatorTokenID;
@@ -368,6 +480,7 @@ class ParticleScriptObject  : public QObject {
     Q_OBJECT
 public:
     ParticleScriptObject(Particle* particle) { _particle = particle; }
+    void setParticle(Particle* particle) { _particle = particle; }
     //~ParticleScriptObject() { qDebug() << "~ParticleScriptObject() this=" << this; }
 
     void emitUpdate() { emit update(); }
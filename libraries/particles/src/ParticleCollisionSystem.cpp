@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <AbstractAudioInterface.h>
+#include <GeometryUtil.h>
 #include <VoxelTree.h>
 #include <AvatarData.h>
 #include <HeadData.h>
@@ -45,11 +46,12 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
 
     // iterate the particles...
-    QList<Particle>& particles = particleTreeElement->getParticles();
+    QVector<Particle>& particles = particleTreeElement->getParticles();
     uint16_t numberOfParticles = particles.size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle* particle = &particles[i];
         system->checkParticle(particle);
+        system->_allParticles.append(particle);
     }
 
     return true;
@@ -59,7 +61,10 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
 void ParticleCollisionSystem::update() {
     // update all particles
     if (_particles->tryLockForRead()) {
+        _allParticles.clear();
         _particles->recurseTreeWithOperation(updateOperation, this);
+        updateCollisionsBetweenParticles(_allParticles);
+        releaseParticlePropertiesUpdates();
         _particles->unlock();
     }
 }
@@ -67,7 +72,6 @@ void ParticleCollisionSystem::update() {
 
 void ParticleCollisionSystem::checkParticle(Particle* particle) {
     updateCollisionWithVoxels(particle);
-    updateCollisionWithParticles(particle);
     updateCollisionWithAvatars(particle);
 }
 
@@ -112,15 +116,43 @@ void ParticleCollisionSystem::updateCollisionWithVoxels(Particle* particle) {
     }
 }
 
-void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA) {
+// cells are about twice the size of the average particle, but never so small that one particle spans more than this many
+const float MAX_CELLS_PER_PARTICLE_DIAMETER = 8.0f;
+
+void ParticleCollisionSystem::updateCollisionsBetweenParticles(const QVector<Particle*>& particles) {
+    if (particles.size() < 2) {
+        return;
+    }
+    float totalRadius = 0.0f;
+    float maxRadius = 0.0f;
+    foreach (Particle* particle, particles) {
+        totalRadius += particle->getRadius();
+        maxRadius = std::max(maxRadius, particle->getRadius());
+    }
+    float cellSize = std::max(2.0f * totalRadius / particles.size(), 2.0f * maxRadius / MAX_CELLS_PER_PARTICLE_DIAMETER);
+    if (cellSize <= 0.0f) {
+        return; // no particle has any size to collide with
+    }
+    _spatialHash.clear();
+    _spatialHash.setCellSize(cellSize);
+    foreach (Particle* particle, particles) {
+        _spatialHash.addSphere(particle->getPosition(), particle->getRadius());
+    }
+    _spatialHash.findPairs(_pairs);
+    foreach (const SpatialHashPair& pair, _pairs) {
+        updateCollisionBetweenParticles(particles.at(pair.first), particles.at(pair.second));
+    }
+}
+
+void ParticleCollisionSystem::updateCollisionBetweenParticles(Particle* particleA, Particle* particleB) {
     glm::vec3 center = particleA->getPosition() * (float)(TREE_SCALE);
     float radius = particleA->getRadius() * (float)(TREE_SCALE);
     //const float ELASTICITY = 0.4f;
     //const float DAMPING = 0.0f;
     const float COLLISION_FREQUENCY = 0.5f;
     glm::vec3 penetration;
-    Particle* particleB;
-    if (_particles->findSpherePenetration(center, radius, penetration, (void**)&particleB, Octree::NoLock)) {
+    if (findSphereSpherePenetration(center, radius, particleB->getPosition() * (float)(TREE_SCALE),
+            particleB->getRadius() * (float)(TREE_SCALE), penetration)) {
         // NOTE: 'penetration' is the depth that 'particleA' overlaps 'particleB'.
         // That is, it points from A into B.
 
@@ -142,27 +174,18 @@ void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA)
             float massB = (particleB->getInHand()) ? MAX_MASS : particleB->getMass();
             float totalMass = massA + massB;
 
+            // separate the particles, in domain units
+            glm::vec3 separation = (0.5f / (float)TREE_SCALE) * penetration;
+
             // handle A particle
             particleA->setVelocity(particleA->getVelocity() - axialVelocity * (2.0f * massB / totalMass));
-            particleA->setPosition(particleA->getPosition() - 0.5f * penetration);
-            ParticleProperties propertiesA;
-            ParticleID particleAid(particleA->getID());
-            propertiesA.copyFromParticle(*particleA);
-            propertiesA.setVelocity(particleA->getVelocity() * (float)TREE_SCALE);
-            propertiesA.setPosition(particleA->getPosition() * (float)TREE_SCALE);
-            _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleAid, propertiesA);
+            particleA->setPosition(particleA->getPosition() - separation);
+            queueParticlePropertiesUpdate(particleA);
 
             // handle B particle
             particleB->setVelocity(particleB->getVelocity() + axialVelocity * (2.0f * massA / totalMass));
-            particleA->setPosition(particleB->getPosition() + 0.5f * penetration);
-            ParticleProperties propertiesB;
-            ParticleID particleBid(particleB->getID());
-            propertiesB.copyFromParticle(*particleB);
-            propertiesB.setVelocity(particleB->getVelocity() * (float)TREE_SCALE);
-            propertiesB.setPosition(particleB->getPosition() * (float)TREE_SCALE);
-            _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleBid, propertiesB);
-
-            _packetSender->releaseQueuedMessages();
+            particleB->setPosition(particleB->getPosition() + separation);
+            queueParticlePropertiesUpdate(particleB);
 
             updateCollisionSound(particleA, penetration, COLLISION_FREQUENCY);
         }
@@ -240,14 +263,26 @@ void ParticleCollisionSystem::updateCollisionWithAvatars(Particle* particle) {
 }
 
 void ParticleCollisionSystem::queueParticlePropertiesUpdate(Particle* particle) {
-    // queue the result for sending to the particle server
-    ParticleProperties properties;
-    ParticleID particleID(particle->getID());
-    properties.copyFromParticle(*particle);
-
-    properties.setPosition(particle->getPosition() * (float)TREE_SCALE);
-    properties.setVelocity(particle->getVelocity() * (float)TREE_SCALE);
-    _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleID, properties);
+    // a particle can collide with several things in one update, but the server only needs to hear about where it ended up
+    _updatedParticles.insert(particle);
+}
+
+void ParticleCollisionSystem::releaseParticlePropertiesUpdates() {
+    if (_updatedParticles.isEmpty()) {
+        return;
+    }
+    // queue the results for sending to the particle server, all in as few packets as will hold them
+    foreach (Particle* particle, _updatedParticles) {
+        ParticleProperties properties;
+        ParticleID particleID(particle->getID());
+        properties.copyFromParticle(*particle);
+
+        properties.setPosition(particle->getPosition() * (float)TREE_SCALE);
+        properties.setVelocity(particle->getVelocity() * (float)TREE_SCALE);
+        _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleID, properties);
+    }
+    _updatedParticles.clear();
+    _packetSender->releaseQueuedMessages();
 }
 
 
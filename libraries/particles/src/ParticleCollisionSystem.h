@@ -15,11 +15,13 @@
 
 #include <QtScript/QScriptEngine>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 
 #include <AvatarHashMap.h>
 #include <CollisionInfo.h>
 #include <SharedUtil.h>
 #include <OctreePacketData.h>
+#include <SpatialHash.h>
 
 #include "Particle.h"
 
@@ -43,13 +45,21 @@ public:
                                 
     ~ParticleCollisionSystem();
 
+    /// Collides every particle with the voxels, the avatars and each other, and sends the server one edit per particle
+    /// that a collision changed.
     void update();
 
     void checkParticle(Particle* particle);
     void updateCollisionWithVoxels(Particle* particle);
-    void updateCollisionWithParticles(Particle* particle);
     void updateCollisionWithAvatars(Particle* particle);
+
+    /// Finds the pairs of particles that touch with a spatial hash, and resolves each pair once.
+    void updateCollisionsBetweenParticles(const QVector<Particle*>& particles);
+    void updateCollisionBetweenParticles(Particle* particleA, Particle* particleB);
+
+    /// Queues an edit for a particle that a collision changed; edits are sent by releaseParticlePropertiesUpdates().
     void queueParticlePropertiesUpdate(Particle* particle);
+    void releaseParticlePropertiesUpdates();
     void updateCollisionSound(Particle* particle, const glm::vec3 &penetration, float frequency);
 
 signals:
@@ -67,6 +77,12 @@ private:
     AbstractAudioInterface* _audio;
     AvatarHashMap* _avatars;
     CollisionList _collisions;
+
+    // reused from one update to the next
+    QVector<Particle*> _allParticles;
+    SpatialHash _spatialHash;
+    QVector<SpatialHashPair> _pairs;
+    QSet<Particle*> _updatedParticles;
 };
 
 #endif /* defined(__hifi__ParticleCollisionSystem__) */
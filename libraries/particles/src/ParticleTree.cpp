@@ -6,12 +6,32 @@
 //  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+#include <climits>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
 #include "ParticleTree.h"
 
-ParticleTree::ParticleTree(bool shouldReaverage) : Octree(shouldReaverage) {
+// the depth below the root at which update() splits the tree into subtrees simulated in parallel, up to 64 of them
+const int UPDATE_SUBTREE_LEVEL = 2;
+
+ParticleTree::ParticleTree(bool shouldReaverage) :
+    Octree(shouldReaverage),
+    _deterministicUpdates(false),
+    _extrapolatingMotion(false),
+    _motionTolerance(DEFAULT_MOTION_TOLERANCE) {
     _rootNode = createNewElement();
 }
 
+ParticleTree::~ParticleTree() {
+    // delete our elements while the particle indexes they remove themselves from still exist
+    delete _rootNode;
+    _rootNode = NULL;
+}
+
 ParticleTreeElement* ParticleTree::createNewElement(unsigned char * octalCode) {
     ParticleTreeElement* newElement = new ParticleTreeElement(octalCode);
     newElement->setTree(this);
@@ -29,113 +49,31 @@ bool ParticleTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
-class FindAndDeleteParticlesArgs {
-public:
-    QList<uint32_t> _idsToDelete;
-};
-
-bool ParticleTree::findAndDeleteOperation(OctreeElement* element, void* extraData) {
-    //qDebug() << "findAndDeleteOperation()";
-
-    FindAndDeleteParticlesArgs* args = static_cast< FindAndDeleteParticlesArgs*>(extraData);
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    //qDebug() << "findAndDeleteOperation() args->_idsToDelete.size():" << args->_idsToDelete.size();
-
-    for (QList<uint32_t>::iterator it = args->_idsToDelete.begin(); it != args->_idsToDelete.end(); it++) {
-        uint32_t particleID = *it;
-        //qDebug() << "findAndDeleteOperation() particleID:" << particleID;
-
-        if (particleTreeElement->removeParticleWithID(particleID)) {
-            // if the particle was in this element, then remove it from our search list.
-            //qDebug() << "findAndDeleteOperation() it = args->_idsToDelete.erase(it)";
-            it = args->_idsToDelete.erase(it);
-        }
-
-        if (it == args->_idsToDelete.end()) {
-            //qDebug() << "findAndDeleteOperation() breaking";
-            break;
-        }
-    }
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-    return true;
-}
-
-
-class FindAndUpdateParticleArgs {
-public:
-    const Particle& searchParticle;
-    bool found;
-};
-
-bool ParticleTree::findAndUpdateOperation(OctreeElement* element, void* extraData) {
-    FindAndUpdateParticleArgs* args = static_cast<FindAndUpdateParticleArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    // Note: updateParticle() will only operate on correctly found particles
-    if (particleTreeElement->updateParticle(args->searchParticle)) {
-        args->found = true;
-        return false; // stop searching
-    }
-    return true;
-}
-
 void ParticleTree::storeParticle(const Particle& particle, const SharedNodePointer& senderNode) {
     // First, look for the existing particle in the tree..
-    FindAndUpdateParticleArgs args = { particle, false };
-    recurseTreeWithOperation(findAndUpdateOperation, &args);
+    ParticleTreeElement* element = getElementWithParticleID(particle.getID());
 
     // if we didn't find it in the tree, then store it...
-    if (!args.found) {
+    // Note: updateParticle() will only operate on correctly found particles
+    if (!element || !element->updateParticle(particle)) {
         glm::vec3 position = particle.getPosition();
         float size = std::max(MINIMUM_PARTICLE_ELEMENT_SIZE, particle.getRadius());
 
-        ParticleTreeElement* element = (ParticleTreeElement*)getOrCreateChildElementAt(position.x, position.y, position.z, size);
+        element = (ParticleTreeElement*)getOrCreateChildElementAt(position.x, position.y, position.z, size);
         element->storeParticle(particle);
     }
     // what else do we need to do here to get reaveraging to work
     _isDirty = true;
 }
 
-class FindAndUpdateParticleWithIDandPropertiesArgs {
-public:
-    const ParticleID& particleID;
-    const ParticleProperties& properties;
-    bool found;
-};
-
-bool ParticleTree::findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData) {
-    FindAndUpdateParticleWithIDandPropertiesArgs* args = static_cast<FindAndUpdateParticleWithIDandPropertiesArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    // Note: updateParticle() will only operate on correctly found particles
-    if (particleTreeElement->updateParticle(args->particleID, args->properties)) {
-        args->found = true;
-        return false; // stop searching
-    }
-
-    // if we've found our particle stop searching
-    if (args->found) {
-        return false;
-    }
-
-    return true;
-}
-
 void ParticleTree::updateParticle(const ParticleID& particleID, const ParticleProperties& properties) {
     // First, look for the existing particle in the tree..
-    FindAndUpdateParticleWithIDandPropertiesArgs args = { particleID, properties, false };
-    recurseTreeWithOperation(findAndUpdateWithIDandPropertiesOperation, &args);
+    ParticleTreeElement* element = particleID.isKnownID ? getElementWithParticleID(particleID.id) :
+        _pendingParticleElements.value(particleID.creatorTokenID);
+
+    // Note: updateParticle() will only operate on correctly found particles
     // if we found it in the tree, then mark the tree as dirty
-    if (args.found) {
+    if (element && element->updateParticle(particleID, properties)) {
         _isDirty = true;
     }
 }
@@ -157,32 +95,36 @@ void ParticleTree::addParticle(const ParticleID& particleID, const ParticlePrope
 
 void ParticleTree::deleteParticle(const ParticleID& particleID) {
     if (particleID.isKnownID) {
-        FindAndDeleteParticlesArgs args;
-        args._idsToDelete.push_back(particleID.id);
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        ParticleTreeElement* element = getElementWithParticleID(particleID.id);
+        if (element) {
+            element->removeParticleWithID(particleID.id);
+        }
     }
 }
 
-// scans the tree and handles mapping locally created particles to know IDs.
-// in the event that this tree is also viewing the scene, then we need to also
-// search the tree to make sure we don't have a duplicate particle from the viewing
-// operation.
-bool ParticleTree::findAndUpdateParticleIDOperation(OctreeElement* element, void* extraData) {
-    bool keepSearching = true;
-
-    FindAndUpdateParticleIDArgs* args = static_cast<FindAndUpdateParticleIDArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
+ParticleTreeElement* ParticleTree::getElementWithParticleID(uint32_t id) const {
+    return (id == UNKNOWN_PARTICLE_ID) ? NULL : _particleElements.value(id);
+}
 
-    // Note: updateParticleID() will only operate on correctly found particles
-    particleTreeElement->updateParticleID(args);
+void ParticleTree::indexParticle(const Particle& particle, ParticleTreeElement* element) {
+    if (particle.getID() != UNKNOWN_PARTICLE_ID) {
+        _particleElements.insert(particle.getID(), element);
+    } else if (particle.getCreatorTokenID() != UNKNOWN_TOKEN) {
+        _pendingParticleElements.insert(particle.getCreatorTokenID(), element);
+    }
+}
 
-    // if we've found and replaced both the creatorTokenID and the viewedParticle, then we
-    // can stop looking, otherwise we will keep looking    
-    if (args->creatorTokenFound && args->viewedParticleFound) {
-        keepSearching = false;
+void ParticleTree::unindexParticle(const Particle& particle, ParticleTreeElement* element) {
+    // the particle may already have been stored in another element
+    if (particle.getID() != UNKNOWN_PARTICLE_ID) {
+        if (!element || _particleElements.value(particle.getID()) == element) {
+            _particleElements.remove(particle.getID());
+        }
+    } else if (particle.getCreatorTokenID() != UNKNOWN_TOKEN) {
+        if (!element || _pendingParticleElements.value(particle.getCreatorTokenID()) == element) {
+            _pendingParticleElements.remove(particle.getCreatorTokenID());
+        }
     }
-    
-    return keepSearching;
 }
 
 void ParticleTree::handleAddParticleResponse(const QByteArray& packet) {
@@ -198,23 +140,26 @@ void ParticleTree::handleAddParticleResponse(const QByteArray& packet) {
     memcpy(&particleID, dataAt, sizeof(particleID));
     dataAt += sizeof(particleID);
 
-    // update particles in our tree
-    bool assumeParticleFound = !getIsViewing(); // if we're not a viewing tree, then we don't have to find the actual particle
-    FindAndUpdateParticleIDArgs args = { 
-        particleID, 
-        creatorTokenID, 
-        false, 
-        assumeParticleFound,
-        getIsViewing() 
-    };
-    
     const bool wantDebug = false;
     if (wantDebug) {
         qDebug() << "looking for creatorTokenID=" << creatorTokenID << " particleID=" << particleID 
                 << " getIsViewing()=" << getIsViewing();
     }
     lockForWrite();
-    recurseTreeWithOperation(findAndUpdateParticleIDOperation, &args);
+
+    // if we're in an isViewing tree, we may already have the server's copy of the particle, which ours replaces
+    if (getIsViewing()) {
+        ParticleTreeElement* viewedElement = getElementWithParticleID(particleID);
+        if (viewedElement) {
+            viewedElement->removeViewedParticleWithID(particleID);
+        }
+    }
+
+    // then fix our locally created particle to know its actual ID
+    ParticleTreeElement* element = _pendingParticleElements.value(creatorTokenID);
+    if (element) {
+        element->updateParticleID(creatorTokenID, particleID);
+    }
     unlock();
 }
 
@@ -337,49 +282,16 @@ void ParticleTree::findParticlesForUpdate(const AABox& box, QVector<Particle*> f
     foundParticles.swap(args._foundParticles);
 }
 
-class FindByIDArgs {
-public:
-    uint32_t id;
-    bool found;
-    const Particle* foundParticle;
-};
-
-
-bool ParticleTree::findByIDOperation(OctreeElement* element, void* extraData) {
-//qDebug() << "ParticleTree::findByIDOperation()....";
-
-    FindByIDArgs* args = static_cast<FindByIDArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    // if already found, stop looking
-    if (args->found) {
-        return false;
-    }
-
-    // as the tree element if it has this particle
-    const Particle* foundParticle = particleTreeElement->getParticleWithID(args->id);
-    if (foundParticle) {
-        args->foundParticle = foundParticle;
-        args->found = true;
-        return false;
-    }
-
-    // keep looking
-    return true;
-}
-
-
 const Particle* ParticleTree::findParticleByID(uint32_t id, bool alreadyLocked) {
-    FindByIDArgs args = { id, false, NULL };
-
     if (!alreadyLocked) {
         lockForRead();
     }
-    recurseTreeWithOperation(findByIDOperation, &args);
+    ParticleTreeElement* element = getElementWithParticleID(id);
+    const Particle* foundParticle = element ? element->getParticleWithID(id) : NULL;
     if (!alreadyLocked) {
         unlock();
     }
-    return args.foundParticle;
+    return foundParticle;
 }
 
 
@@ -446,29 +358,140 @@ bool ParticleTree::updateOperation(OctreeElement* element, void* extraData) {
     return true;
 }
 
+bool ParticleTree::updateChangedTimeOperation(OctreeElement* element, void* extraData) {
+    ParticleTreeUpdateArgs* args = static_cast<ParticleTreeUpdateArgs*>(extraData);
+    static_cast<ParticleTreeElement*>(element)->updateChangedTime(args->_now);
+    return true;
+}
+
+static void updateSubtree(ParticleTreeElement* element, ParticleTreeUpdateArgs& args) {
+    element->updateParticles(args, UNSCRIPTED_PARTICLES);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        ParticleTreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            updateSubtree(child, args);
+        }
+    }
+}
+
+/// Simulates the unscripted particles of one subtree on the global thread pool.
+class ParticleUpdateTask : public QRunnable {
+public:
+
+    ParticleUpdateTask(ParticleTreeElement* root, ParticleTreeUpdateArgs* args, QSemaphore* finished) :
+        _root(root), _args(args), _finished(finished) { }
+
+    virtual void run() {
+        updateSubtree(_root, *_args);
+        _finished->release();
+    }
+
+private:
+
+    ParticleTreeElement* _root;
+    ParticleTreeUpdateArgs* _args;
+    QSemaphore* _finished;
+};
+
+void ParticleTree::updateInParallel(ParticleTreeUpdateArgs& args) {
+    QVector<ParticleTreeElement*> subtreeRoots;
+    collectUpdateSubtrees(getRoot(), 0, subtreeRoots);
+
+    QVector<ParticleTreeUpdateArgs> subtreeArgs(subtreeRoots.size());
+    QSemaphore finished;
+    for (int i = 0; i < subtreeRoots.size(); i++) {
+        subtreeArgs[i]._now = args._now;
+        subtreeArgs[i]._extrapolating = args._extrapolating;
+        subtreeArgs[i]._motionTolerance = args._motionTolerance;
+        QThreadPool::globalInstance()->start(new ParticleUpdateTask(subtreeRoots.at(i), &subtreeArgs[i], &finished));
+    }
+
+    // the elements above the subtrees are ours while the tasks run
+    updateSpine(getRoot(), 0, args);
+    finished.acquire(subtreeRoots.size());
+
+    // merge in tree order, so that the results don't depend on which task finished first
+    for (int i = 0; i < subtreeArgs.size(); i++) {
+        args._movingParticles += subtreeArgs.at(i)._movingParticles;
+        args._scriptedElements += subtreeArgs.at(i)._scriptedElements;
+    }
+
+    // scripts aren't thread safe, so particles with scripts are simulated here, after the rest
+    for (int i = 0; i < args._scriptedElements.size(); i++) {
+        args._scriptedElements.at(i)->updateParticles(args, SCRIPTED_PARTICLES);
+    }
+
+    // children first, so that elements know whether any of their children changed
+    recurseTreeWithPostOperation(updateChangedTimeOperation, &args);
+}
+
+void ParticleTree::collectUpdateSubtrees(ParticleTreeElement* element, int depth,
+        QVector<ParticleTreeElement*>& subtreeRoots) {
+    if (depth == UPDATE_SUBTREE_LEVEL) {
+        subtreeRoots.append(element);
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        ParticleTreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            collectUpdateSubtrees(child, depth + 1, subtreeRoots);
+        }
+    }
+}
+
+void ParticleTree::updateSpine(ParticleTreeElement* element, int depth, ParticleTreeUpdateArgs& args) {
+    if (depth == UPDATE_SUBTREE_LEVEL) {
+        return;
+    }
+    element->updateParticles(args, UNSCRIPTED_PARTICLES);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        ParticleTreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            updateSpine(child, depth + 1, args);
+        }
+    }
+}
+
 bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
         ParticleTreeElement* childAt = particleTreeElement->getChildAtIndex(i);
         if (childAt && childAt->isLeaf() && !childAt->hasParticles()) {
             particleTreeElement->deleteChildAtIndex(i);
+            particleTreeElement->markParticlesChanged();
         }
     }
     return true;
 }
 
 void ParticleTree::update() {
+    // the whole update is under the write lock, not only the re-storing and deleting below: particles are simulated in
+    // place, which readers (the encoder, collision checks) mustn't see half done, and simulating copies under the read
+    // lock would mean reconciling them with edits that land before the write lock could be taken
     lockForWrite();
-    _isDirty = true;
 
-    ParticleTreeUpdateArgs args = { };
-    recurseTreeWithOperation(updateOperation, &args);
+    ParticleTreeUpdateArgs args;
+    args._now = usecTimestampNow();
+    args._extrapolating = _extrapolatingMotion;
+    args._motionTolerance = _motionTolerance;
+    if (_deterministicUpdates) {
+        // children first, so that elements know whether any of their children changed
+        recurseTreeWithPostOperation(updateOperation, &args);
+    } else {
+        updateInParallel(args);
+    }
+    if (getRoot()->getLastChanged() >= args._now) {
+        _isDirty = true;
+    }
 
     // now add back any of the particles that moved elements....
     int movingParticles = args._movingParticles.size();
     for (int i = 0; i < movingParticles; i++) {
         bool shouldDie = args._movingParticles[i].getShouldDie();
 
+        // the elements leave the index alone, since they may have been simulated on other threads
+        unindexParticle(args._movingParticles[i], NULL);
+
         // if the particle is still inside our total bounds, then re-add it
         AABox treeBounds = getRoot()->getAABox();
 
@@ -515,6 +538,9 @@ bool ParticleTree::encodeParticlesDeletedSince(quint64& sinceTime, unsigned char
 
     unsigned char* copyAt = outputBuffer;
     size_t numBytesPacketHeader = populatePacketHeader(reinterpret_cast<char*>(outputBuffer), PacketTypeParticleErase);
+
+    // lists of IDs are what clients that don't ask for deltas read
+    outputBuffer[numBytesArithmeticCodingFromBuffer(reinterpret_cast<char*>(outputBuffer))] = FULL_PARTICLE_DATA_VERSION;
     copyAt += numBytesPacketHeader;
     outputLength = numBytesPacketHeader;
 
@@ -569,6 +595,108 @@ bool ParticleTree::encodeParticlesDeletedSince(quint64& sinceTime, unsigned char
     return hasMoreToSend;
 }
 
+void ParticleTree::getParticlesDeletedSince(quint64 sinceTime, QVector<uint32_t>& ids) {
+    _recentlyDeletedParticlesLock.lockForRead();
+    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedParticleIDs.upperBound(sinceTime);
+    while (iterator != _recentlyDeletedParticleIDs.constEnd()) {
+        ids.append(iterator.value());
+        ++iterator;
+    }
+    _recentlyDeletedParticlesLock.unlock();
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+bool ParticleTree::encodeParticleIDRanges(const QVector<uint32_t>& ids, int& nextID, unsigned char* outputBuffer,
+                                          size_t maxLength, size_t& outputLength) {
+    size_t numBytesPacketHeader = populatePacketHeader(reinterpret_cast<char*>(outputBuffer), PacketTypeParticleErase);
+    outputLength = numBytesPacketHeader + packParticleIDRanges(ids, nextID, outputBuffer + numBytesPacketHeader,
+                                                               maxLength - numBytesPacketHeader);
+    return nextID < ids.size();
+}
+
+// unsigned integers are packed seven bits to a byte, low bits first, with the high bit set on all but the last byte
+const int MAX_VARIABLE_LENGTH_BYTES = 5;
+
+static int packVariableLength(uint32_t value, unsigned char* buffer) {
+    int length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buffer[length++] = value;
+    return length;
+}
+
+static int unpackVariableLength(const unsigned char* buffer, int length, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < length && i < MAX_VARIABLE_LENGTH_BYTES; i++) {
+        value |= (uint32_t)(buffer[i] & 0x7f) << (7 * i);
+        if (!(buffer[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+int ParticleTree::packParticleIDRanges(const QVector<uint32_t>& ids, int& nextID, unsigned char* buffer, int maxLength) {
+    uint16_t numberOfRanges = 0;
+    if (maxLength < (int)sizeof(numberOfRanges)) {
+        return 0;
+    }
+    int length = sizeof(numberOfRanges);
+    uint32_t lastEnd = 0; // one past the last ID of the previous range
+    unsigned char range[2 * MAX_VARIABLE_LENGTH_BYTES];
+    while (nextID < ids.size() && numberOfRanges < USHRT_MAX) {
+        uint32_t first = ids.at(nextID);
+        int count = 1;
+        while (nextID + count < ids.size() && ids.at(nextID + count) == first + count) {
+            count++;
+        }
+        int rangeLength = packVariableLength(first - lastEnd, range);
+        rangeLength += packVariableLength(count - 1, range + rangeLength);
+        if (length + rangeLength > maxLength) {
+            break;
+        }
+        memcpy(buffer + length, range, rangeLength);
+        length += rangeLength;
+        numberOfRanges++;
+        lastEnd = first + count;
+        nextID += count;
+    }
+    memcpy(buffer, &numberOfRanges, sizeof(numberOfRanges));
+    return length;
+}
+
+int ParticleTree::unpackParticleIDRanges(const unsigned char* buffer, int length, QVector<uint32_t>& ids) {
+    uint16_t numberOfRanges;
+    if (length < (int)sizeof(numberOfRanges)) {
+        return 0;
+    }
+    memcpy(&numberOfRanges, buffer, sizeof(numberOfRanges));
+    int bytesRead = sizeof(numberOfRanges);
+    uint32_t lastEnd = 0;
+    for (uint16_t i = 0; i < numberOfRanges; i++) {
+        uint32_t gap;
+        uint32_t extraIDs;
+        int gapBytes = unpackVariableLength(buffer + bytesRead, length - bytesRead, gap);
+        int extraBytes = gapBytes ? unpackVariableLength(buffer + bytesRead + gapBytes, length - bytesRead - gapBytes,
+                                                         extraIDs) : 0;
+        if (extraBytes == 0 || (quint64)lastEnd + gap + extraIDs > UINT_MAX) {
+            return 0; // cut short, or running past the last ID
+        }
+        bytesRead += gapBytes + extraBytes;
+        uint32_t first = lastEnd + gap;
+        for (uint32_t id = first; id != first + extraIDs; id++) {
+            ids.append(id);
+        }
+        ids.append(first + extraIDs);
+        lastEnd = first + extraIDs + 1;
+    }
+    return bytesRead;
+}
+
 // called by the server when it knows all nodes have been sent deleted packets
 
 void ParticleTree::forgetParticlesDeletedBefore(quint64 sinceTime) {
@@ -606,14 +734,30 @@ void ParticleTree::processEraseMessage(const QByteArray& dataByteArray, const Sh
     size_t processedBytes = numBytesPacketHeader;
     dataAt += numBytesPacketHeader;
 
+    // clients that ask for deltas are sent runs of IDs
+    if (versionForPacket(dataByteArray) != FULL_PARTICLE_DATA_VERSION) {
+        QVector<uint32_t> particleIDs;
+        unpackParticleIDRanges(dataAt, packetLength - processedBytes, particleIDs);
+        if (!particleIDs.isEmpty()) {
+            lockForWrite();
+            foreach (uint32_t particleID, particleIDs) {
+                ParticleTreeElement* element = getElementWithParticleID(particleID);
+                if (element) {
+                    element->removeParticleWithID(particleID);
+                }
+            }
+            unlock();
+        }
+        return;
+    }
+
     uint16_t numberOfIds = 0; // placeholder for now
     memcpy(&numberOfIds, dataAt, sizeof(numberOfIds));
     dataAt += sizeof(numberOfIds);
     processedBytes += sizeof(numberOfIds);
 
     if (numberOfIds > 0) {
-        FindAndDeleteParticlesArgs args;
-
+        lockForWrite();
         for (size_t i = 0; i < numberOfIds; i++) {
             if (processedBytes + sizeof(uint32_t) > packetLength) {
                 break; // bail to prevent buffer overflow
@@ -624,10 +768,11 @@ void ParticleTree::processEraseMessage(const QByteArray& dataByteArray, const Sh
             dataAt += sizeof(particleID);
             processedBytes += sizeof(particleID);
 
-            args._idsToDelete.push_back(particleID);
+            ParticleTreeElement* element = getElementWithParticleID(particleID);
+            if (element) {
+                element->removeParticleWithID(particleID);
+            }
         }
-
-        // calling recurse to actually delete the particles
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        unlock();
     }
 }
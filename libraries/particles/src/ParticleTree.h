@@ -9,6 +9,8 @@
 #ifndef __hifi__ParticleTree__
 #define __hifi__ParticleTree__
 
+#include <QHash>
+
 #include <Octree.h>
 #include "ParticleTreeElement.h"
 
@@ -21,6 +23,7 @@ class ParticleTree : public Octree {
     Q_OBJECT
 public:
     ParticleTree(bool shouldReaverage = false);
+    virtual ~ParticleTree();
 
     /// Implements our type specific root element factory
     virtual ParticleTreeElement* createNewElement(unsigned char * octalCode = NULL);
@@ -37,8 +40,26 @@ public:
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, const SharedNodePointer& senderNode);
 
+    /// Simulates the particles: those in different subtrees in parallel on the global thread pool, and those with scripts
+    /// on this thread, unless deterministic updates are on.  Holds the write lock throughout, not just while moving and
+    /// deleting particles: they're simulated in place.
     virtual void update();
 
+    /// When set, update() simulates every particle on the calling thread in tree order, so that runs are reproducible.
+    /// Particles sharing a script share its state, which otherwise depends on which thread ran them.
+    void setDeterministicUpdates(bool deterministicUpdates) { _deterministicUpdates = deterministicUpdates; }
+    bool getDeterministicUpdates() const { return _deterministicUpdates; }
+
+    /// When set, update() moves particles along the motion the server last sent for them, rather than simulating them, so
+    /// that viewers agree with the server about where its particles are without being sent them every time they move.
+    void setExtrapolatingMotion(bool extrapolatingMotion) { _extrapolatingMotion = extrapolatingMotion; }
+    bool getExtrapolatingMotion() const { return _extrapolatingMotion; }
+
+    /// How far (in domain units) a simulated particle may stray from where extrapolating viewers have it before they're
+    /// sent its motion again.
+    void setMotionTolerance(float motionTolerance) { _motionTolerance = motionTolerance; }
+    float getMotionTolerance() const { return _motionTolerance; }
+
     void storeParticle(const Particle& particle, const SharedNodePointer& senderNode = SharedNodePointer());
     void updateParticle(const ParticleID& particleID, const ParticleProperties& properties);
     void addParticle(const ParticleID& particleID, const ParticleProperties& properties);
@@ -67,20 +88,45 @@ public:
     bool encodeParticlesDeletedSince(quint64& sinceTime, unsigned char* packetData, size_t maxLength, size_t& outputLength);
     void forgetParticlesDeletedBefore(quint64 sinceTime);
 
+    /// Collects the IDs of the particles deleted since sinceTime, in ascending order.
+    void getParticlesDeletedSince(quint64 sinceTime, QVector<uint32_t>& ids);
+
+    /// Encodes a PacketTypeParticleErase for clients past FULL_PARTICLE_DATA_VERSION, with as many of the sorted IDs from
+    /// ids[nextID] on as fit, which are then skipped over.
+    /// \return true if there are IDs left to send
+    bool encodeParticleIDRanges(const QVector<uint32_t>& ids, int& nextID, unsigned char* outputBuffer, size_t maxLength,
+                                size_t& outputLength);
+
+    /// Packs sorted IDs from ids[nextID] on as runs of consecutive IDs, each the gap since the last run and its length
+    /// as variable length integers, until the buffer is full.
+    /// \return the number of bytes packed
+    static int packParticleIDRanges(const QVector<uint32_t>& ids, int& nextID, unsigned char* buffer, int maxLength);
+
+    /// Appends the IDs packed by packParticleIDRanges() to ids.
+    /// \return the number of bytes read, or 0 if the ranges were cut short
+    static int unpackParticleIDRanges(const unsigned char* buffer, int length, QVector<uint32_t>& ids);
+
     void processEraseMessage(const QByteArray& dataByteArray, const SharedNodePointer& sourceNode);
     void handleAddParticleResponse(const QByteArray& packet);
 
 private:
+    friend class ParticleTreeElement; // to keep the particle indexes current
 
     static bool updateOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData);
+    static bool updateChangedTimeOperation(OctreeElement* element, void* extraData);
     static bool findNearPointOperation(OctreeElement* element, void* extraData);
     static bool findInSphereOperation(OctreeElement* element, void* extraData);
     static bool pruneOperation(OctreeElement* element, void* extraData);
-    static bool findByIDOperation(OctreeElement* element, void* extraData);
-    static bool findAndDeleteOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateParticleIDOperation(OctreeElement* element, void* extraData);
+
+    ParticleTreeElement* getElementWithParticleID(uint32_t id) const;
+    void indexParticle(const Particle& particle, ParticleTreeElement* element);
+
+    /// Removes the particle from the index if it's indexed as being in element, or wherever it is if element is NULL.
+    void unindexParticle(const Particle& particle, ParticleTreeElement* element);
+
+    void updateInParallel(ParticleTreeUpdateArgs& args);
+    void collectUpdateSubtrees(ParticleTreeElement* element, int depth, QVector<ParticleTreeElement*>& subtreeRoots);
+    void updateSpine(ParticleTreeElement* element, int depth, ParticleTreeUpdateArgs& args);
 
     void notifyNewlyCreatedParticle(const Particle& newParticle, const SharedNodePointer& senderNode);
 
@@ -90,6 +136,14 @@ private:
 
     QReadWriteLock _recentlyDeletedParticlesLock;
     QMultiMap<quint64, uint32_t> _recentlyDeletedParticleIDs;
+
+    // the elements containing each particle, kept current by the elements as they store and remove particles
+    QHash<uint32_t, ParticleTreeElement*> _particleElements;        ///< by particle ID
+    QHash<uint32_t, ParticleTreeElement*> _pendingParticleElements; ///< by creator token, for particles without an ID yet
+
+    bool _deterministicUpdates;
+    bool _extrapolatingMotion;
+    float _motionTolerance;
 };
 
 #endif /* defined(__hifi__ParticleTree__) */
@@ -6,16 +6,29 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+
+#include <QVarLengthArray>
+
 #include <GeometryUtil.h>
 
 #include "ParticleTree.h"
 #include "ParticleTreeElement.h"
 
-ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _particles(NULL) {
+// elements keep this much room for particles however many they've held
+const int MIN_PARTICLE_CAPACITY = 16;
+
+ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _myTree(NULL), _particles(NULL),
+        _particlesChanged(false) {
     init(octalCode);
 };
 
 ParticleTreeElement::~ParticleTreeElement() {
+    if (_myTree) {
+        foreach (const Particle& particle, *_particles) {
+            _myTree->unindexParticle(particle, this);
+        }
+    }
     _voxelMemoryUsage -= sizeof(ParticleTreeElement);
     delete _particles;
     _particles = NULL;
@@ -33,7 +46,7 @@ OctreeElement* ParticleTreeElement::createNewElement(unsigned char* octalCode) {
 
 void ParticleTreeElement::init(unsigned char* octalCode) {
     OctreeElement::init(octalCode);
-    _particles = new QList<Particle>;
+    _particles = new QVector<Particle>;
     _voxelMemoryUsage += sizeof(ParticleTreeElement);
 }
 
@@ -45,55 +58,114 @@ ParticleTreeElement* ParticleTreeElement::addChildAtIndex(int index) {
 
 
 bool ParticleTreeElement::appendElementData(OctreePacketData* packetData) const {
-    bool success = true; // assume the best...
+    return appendElementDelta(packetData, 0, LATEST_PACKET_VERSION);
+}
 
-    // write our particles out...
+bool ParticleTreeElement::appendElementDelta(OctreePacketData* packetData, quint64 sinceTime, int packetVersion) const {
+    bool success = true; // assume the best...
     uint16_t numberOfParticles = _particles->size();
-    success = packetData->appendValue(numberOfParticles);
-
-    if (success) {
-        for (uint16_t i = 0; i < numberOfParticles; i++) {
-            const Particle& particle = (*_particles)[i];
-            success = particle.appendParticleData(packetData);
-            if (!success) {
-                break;
+
+    if (packetVersion == FULL_PARTICLE_DATA_VERSION) {
+        // write our particles out...
+        success = packetData->appendValue(numberOfParticles);
+
+        if (success) {
+            for (uint16_t i = 0; i < numberOfParticles; i++) {
+                const Particle& particle = (*_particles)[i];
+                success = particle.appendParticleData(packetData);
+                if (!success) {
+                    break;
+                }
             }
         }
+        return success;
+    }
+
+    // work out what the recipient is missing first, so that we can say how many particles follow
+    quint64 now = usecTimestampNow();
+    QVarLengthArray<uint8_t, MIN_PARTICLE_CAPACITY> deltas(numberOfParticles);
+    uint16_t numberOfDeltas = 0;
+    for (uint16_t i = 0; i < numberOfParticles; i++) {
+        deltas[i] = (*_particles)[i].getDeltaSince(sinceTime, now);
+        if (deltas[i]) {
+            numberOfDeltas++;
+        }
+    }
+    success = packetData->appendValue(numberOfDeltas);
+    for (uint16_t i = 0; i < numberOfParticles && success; i++) {
+        if (deltas[i]) {
+            success = (*_particles)[i].appendParticleDelta(packetData, deltas[i], _box);
+        }
     }
     return success;
 }
 
 void ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
-    markWithChangedTime();
-    // TODO: early exit when _particles is empty
+    updateParticles(args);
+    updateChangedTime(args._now);
+}
 
-    // update our contained particles
-    QList<Particle>::iterator particleItr = _particles->begin();
-    while(particleItr != _particles->end()) {
-        Particle& particle = (*particleItr);
-        particle.update(_lastChanged);
+void ParticleTreeElement::updateParticles(ParticleTreeUpdateArgs& args, ParticleUpdateFilter filter) {
+    bool skippedScriptedParticles = false;
 
-        // If the particle wants to die, or if it's left our bounding box, then move it
-        // into the arguments moving particles. These will be added back or deleted completely
-        if (particle.getShouldDie() || !_box.contains(particle.getPosition())) {
-            args._movingParticles.push_back(particle);
+    // update our contained particles, packing the ones that stay to the front as we go
+    int numberOfParticles = _particles->size();
+    int kept = 0;
+    for (int i = 0; i < numberOfParticles; i++) {
+        Particle& particle = (*_particles)[i];
+        bool scripted = particle.hasScript();
+        bool skipped = (filter == UNSCRIPTED_PARTICLES && scripted) || (filter == SCRIPTED_PARTICLES && !scripted);
+        if (skipped) {
+            skippedScriptedParticles = skippedScriptedParticles || scripted;
 
-            // erase this particle
-            particleItr = _particles->erase(particleItr);
         } else {
-            ++particleItr;
+            if (particle.update(args._now, args._extrapolating, args._motionTolerance)) {
+                _particlesChanged = true;
+            }
+
+            // If the particle wants to die, or if it's left our bounding box, then move it
+            // into the arguments moving particles. These will be added back or deleted completely;
+            // the tree removes them from its index along with the other moving particles
+            if (particle.getShouldDie() || !_box.contains(particle.getPosition())) {
+                args._movingParticles.push_back(particle);
+                _particlesChanged = true;
+                continue;
+            }
         }
+        if (kept != i) {
+            (*_particles)[kept] = particle;
+        }
+        kept++;
+    }
+    _particles->resize(kept);
+
+    // don't hang on to the room left by a pile of particles that has moved on
+    if (_particles->capacity() > 4 * std::max(kept, MIN_PARTICLE_CAPACITY)) {
+        _particles->squeeze();
+    }
+
+    if (skippedScriptedParticles) {
+        args._scriptedElements.append(this);
+    }
+}
+
+void ParticleTreeElement::updateChangedTime(quint64 now) {
+    // only stamp ourselves if there's something new to send: the encoder skips unchanged elements, and their subtrees
+    bool changed = _particlesChanged;
+    for (int i = 0; i < NUMBER_OF_CHILDREN && !changed; i++) {
+        OctreeElement* child = getChildAtIndex(i);
+        changed = child && child->getLastChanged() >= now;
+    }
+    if (changed) {
+        markWithChangedTime();
+        _particlesChanged = false;
     }
-    // TODO: if _particles is empty after while loop consider freeing memory in _particles if
-    // internal array is too big (QList internal array does not decrease size except in dtor and
-    // assignment operator).  Otherwise _particles could become a "resource leak" for large
-    // roaming piles of particles.
 }
 
 bool ParticleTreeElement::findSpherePenetration(const glm::vec3& center, float radius,
                                     glm::vec3& penetration, void** penetratedObject) const {
-    QList<Particle>::iterator particleItr = _particles->begin();
-    QList<Particle>::const_iterator particleEnd = _particles->end();
+    QVector<Particle>::iterator particleItr = _particles->begin();
+    QVector<Particle>::const_iterator particleEnd = _particles->end();
     while(particleItr != particleEnd) {
         Particle& particle = (*particleItr);
         glm::vec3 particleCenter = particle.getPosition();
@@ -137,14 +209,18 @@ bool ParticleTreeElement::updateParticle(const Particle& particle) {
             int difference = thisParticle.getLastUpdated() - particle.getLastUpdated();
             bool changedOnServer = thisParticle.getLastEdited() < particle.getLastEdited();
             bool localOlder = thisParticle.getLastUpdated() < particle.getLastUpdated();
-            if (changedOnServer || localOlder) {
+            bool corrected = thisParticle.getReckoningSince() < particle.getReckoningSince();
+            if (changedOnServer || localOlder || corrected) {
                 if (wantDebug) {
                     printf("local particle [id:%d] %s and %s than server particle by %d, particle.isNewlyCreated()=%s\n",
                             particle.getID(), (changedOnServer ? "CHANGED" : "same"),
                             (localOlder ? "OLDER" : "NEWER"),
                             difference, debug::valueOf(particle.isNewlyCreated()) );
                 }
+                Particle before = thisParticle;
                 thisParticle.copyChangedProperties(particle);
+                thisParticle.stampChanges(before, usecTimestampNow());
+                markParticlesChanged();
             } else {
                 if (wantDebug) {
                     printf(">>> IGNORING SERVER!!! Would've caused jutter! <<<  "
@@ -174,7 +250,10 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
             found = thisParticle.getCreatorTokenID() == particleID.creatorTokenID;
         }
         if (found) {
+            Particle before = thisParticle;
             thisParticle.setProperties(properties);
+            thisParticle.stampChanges(before, usecTimestampNow());
+            markParticlesChanged();
 
             const bool wantDebug = false;
             if (wantDebug) {
@@ -190,32 +269,35 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
     return false;
 }
 
-void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
+bool ParticleTreeElement::updateParticleID(uint32_t creatorTokenID, uint32_t particleID) {
+    // we're looking for a matching creatorTokenID, if we find that, then we fix it to know the actual ID
     uint16_t numberOfParticles = _particles->size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle& thisParticle = (*_particles)[i];
-        
-        if (!args->creatorTokenFound) {
-            // first, we're looking for matching creatorTokenIDs, if we find that, then we fix it to know the actual ID
-            if (thisParticle.getCreatorTokenID() == args->creatorTokenID) {
-                thisParticle.setID(args->particleID);
-                args->creatorTokenFound = true;
-            }
-        }
-        
-        // if we're in an isViewing tree, we also need to look for an kill any viewed particles
-        if (!args->viewedParticleFound && args->isViewing) {
-            if (thisParticle.getCreatorTokenID() == UNKNOWN_TOKEN && thisParticle.getID() == args->particleID) {
-                _particles->removeAt(i); // remove the particle at this index
-                numberOfParticles--; // this means we have 1 fewer particle in this list
-                i--; // and we actually want to back up i as well.
-                args->viewedParticleFound = true;
-            }
+        if (thisParticle.getCreatorTokenID() == creatorTokenID) {
+            _myTree->unindexParticle(thisParticle, this);
+            thisParticle.setID(particleID);
+            markParticlesChanged();
+            _myTree->indexParticle(thisParticle, this);
+            return true;
         }
     }
+    return false;
 }
 
-
+bool ParticleTreeElement::removeViewedParticleWithID(uint32_t id) {
+    uint16_t numberOfParticles = _particles->size();
+    for (uint16_t i = 0; i < numberOfParticles; i++) {
+        const Particle& thisParticle = (*_particles)[i];
+        if (thisParticle.getCreatorTokenID() == UNKNOWN_TOKEN && thisParticle.getID() == id) {
+            _myTree->unindexParticle(thisParticle, this);
+            _particles->remove(i); // remove the particle at this index
+            markParticlesChanged();
+            return true;
+        }
+    }
+    return false;
+}
 
 const Particle* ParticleTreeElement::getClosestParticle(glm::vec3 position) const {
     const Particle* closestParticle = NULL;
@@ -242,8 +324,8 @@ void ParticleTreeElement::getParticles(const glm::vec3& searchPosition, float se
 }
 
 void ParticleTreeElement::getParticlesForUpdate(const AABox& box, QVector<Particle*>& foundParticles) {
-    QList<Particle>::iterator particleItr = _particles->begin();
-    QList<Particle>::iterator particleEnd = _particles->end();
+    QVector<Particle>::iterator particleItr = _particles->begin();
+    QVector<Particle>::iterator particleEnd = _particles->end();
     AABox particleBox;
     while(particleItr != particleEnd) {
         Particle* particle = &(*particleItr);
@@ -278,7 +360,9 @@ bool ParticleTreeElement::removeParticleWithID(uint32_t id) {
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         if ((*_particles)[i].getID() == id) {
             foundParticle = true;
-            _particles->removeAt(i);
+            _myTree->unindexParticle((*_particles)[i], this);
+            _particles->remove(i);
+            markParticlesChanged();
             break;
         }
     }
@@ -291,7 +375,8 @@ int ParticleTreeElement::readElementDataFromBuffer(const unsigned char* data, in
     const unsigned char* dataAt = data;
     int bytesRead = 0;
     uint16_t numberOfParticles = 0;
-    int expectedBytesPerParticle = Particle::expectedBytes();
+    bool fullParticles = (args.packetVersion == FULL_PARTICLE_DATA_VERSION);
+    int expectedBytesPerParticle = fullParticles ? Particle::expectedBytes() : Particle::minimumDeltaBytes();
 
     if (bytesLeftToRead >= (int)sizeof(numberOfParticles)) {
         // read our particles in....
@@ -302,9 +387,31 @@ int ParticleTreeElement::readElementDataFromBuffer(const unsigned char* data, in
 
         if (bytesLeftToRead >= (int)(numberOfParticles * expectedBytesPerParticle)) {
             for (uint16_t i = 0; i < numberOfParticles; i++) {
-                Particle tempParticle;
-                int bytesForThisParticle = tempParticle.readParticleDataFromBuffer(dataAt, bytesLeftToRead, args);
-                _myTree->storeParticle(tempParticle);
+                if (fullParticles) {
+                    Particle tempParticle;
+                    int bytesForThisParticle = tempParticle.readParticleDataFromBuffer(dataAt, bytesLeftToRead, args);
+                    _myTree->storeParticle(tempParticle);
+                    dataAt += bytesForThisParticle;
+                    bytesLeftToRead -= bytesForThisParticle;
+                    bytesRead += bytesForThisParticle;
+                    continue;
+                }
+
+                // deltas apply over what we have of the particle, if anything
+                uint32_t particleID;
+                memcpy(&particleID, dataAt, sizeof(particleID));
+                uint8_t delta = dataAt[sizeof(particleID)];
+                const Particle* existingParticle = _myTree->findParticleByID(particleID, true);
+                Particle tempParticle = existingParticle ? *existingParticle : Particle();
+                int bytesForThisParticle = tempParticle.readParticleDeltaFromBuffer(dataAt, bytesLeftToRead, _box, args);
+                if (bytesForThisParticle == 0) {
+                    break; // the rest of the data can't be trusted
+                }
+
+                // a particle we've missed can't be pieced together from part of it, it'll be sent whole again
+                if (existingParticle || (delta & PARTICLE_DELTA_AGE)) {
+                    _myTree->storeParticle(tempParticle);
+                }
                 dataAt += bytesForThisParticle;
                 bytesLeftToRead -= bytesForThisParticle;
                 bytesRead += bytesForThisParticle;
@@ -332,6 +439,10 @@ bool ParticleTreeElement::collapseChildren() {
 
 void ParticleTreeElement::storeParticle(const Particle& particle) {
     _particles->push_back(particle);
-    markWithChangedTime();
+
+    // viewers that have this element may never have heard of the particle
+    _particles->last().stampAllChanged(usecTimestampNow());
+    _myTree->indexParticle(particle, this);
+    markParticlesChanged();
 }
 
@@ -13,7 +13,7 @@
 //#include <vector>
 
 #include <OctreeElement.h>
-#include <QList>
+#include <QVector>
 
 #include "Particle.h"
 #include "ParticleTree.h"
@@ -23,17 +23,15 @@ class ParticleTreeElement;
 
 class ParticleTreeUpdateArgs {
 public:
-    QList<Particle> _movingParticles;
+    quint64 _now;
+    bool _extrapolating;                                ///< see ParticleTree::setExtrapolatingMotion()
+    float _motionTolerance;                             ///< see ParticleTree::setMotionTolerance()
+    QVector<Particle> _movingParticles;                 ///< left their elements; still in the index until re-stored
+    QVector<ParticleTreeElement*> _scriptedElements;    ///< elements whose scripted particles were skipped
 };
 
-class FindAndUpdateParticleIDArgs {
-public:
-    uint32_t particleID;
-    uint32_t creatorTokenID;
-    bool creatorTokenFound;
-    bool viewedParticleFound;
-    bool isViewing;
-};
+/// Which of an element's particles to simulate. Particle scripts can only run on the thread that owns the tree.
+enum ParticleUpdateFilter { ALL_PARTICLES, UNSCRIPTED_PARTICLES, SCRIPTED_PARTICLES };
 
 
 
@@ -76,6 +74,10 @@ public:
     /// Override to serialize the state of this element. This is used for persistance and for transmission across the network.
     virtual bool appendElementData(OctreePacketData* packetData) const;
 
+    /// Clients that read FULL_PARTICLE_DATA_VERSION are sent every particle whole. Later clients are sent only the particles
+    /// that changed since sinceTime, and only the properties of theirs that did, see Particle::getDeltaSince().
+    virtual bool appendElementDelta(OctreePacketData* packetData, quint64 sinceTime, int packetVersion) const;
+
     /// Override to deserialize the state of this element. This is used for loading from a persisted file or from reading
     /// from the network.
     virtual int readElementDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args);
@@ -90,16 +92,28 @@ public:
     virtual bool findSpherePenetration(const glm::vec3& center, float radius,
                         glm::vec3& penetration, void** penetratedObject) const;
 
-    const QList<Particle>& getParticles() const { return *_particles; }
-    QList<Particle>& getParticles() { return *_particles; }
+    const QVector<Particle>& getParticles() const { return *_particles; }
+    QVector<Particle>& getParticles() { return *_particles; }
     bool hasParticles() const { return _particles->size() > 0; }
 
+    /// Simulates our particles, and stamps us with a changed time if they or our children changed. Children must be
+    /// updated before their parents.
     void update(ParticleTreeUpdateArgs& args);
+
+    /// Simulates our particles, moving those that die or leave our bounds to the args' moving particles. Touches nothing
+    /// outside of this element and args, so different elements can be simulated on different threads.
+    void updateParticles(ParticleTreeUpdateArgs& args, ParticleUpdateFilter filter = ALL_PARTICLES);
+
+    /// Stamps us with a changed time if our particles changed since the last stamp, or if a child was stamped since now.
+    void updateChangedTime(quint64 now);
     void setTree(ParticleTree* tree) { _myTree = tree; }
 
+    /// Notes that our particles changed outside of update(), so that we and our ancestors are stamped on the next one.
+    void markParticlesChanged() { _particlesChanged = true; }
+
     bool updateParticle(const Particle& particle);
     bool updateParticle(const ParticleID& particleID, const ParticleProperties& properties);
-    void updateParticleID(FindAndUpdateParticleIDArgs* args);
+    bool updateParticleID(uint32_t creatorTokenID, uint32_t particleID);
 
     const Particle* getClosestParticle(glm::vec3 position) const;
 
@@ -118,13 +132,17 @@ public:
 
     bool removeParticleWithID(uint32_t id);
 
+    /// Removes a particle that came from the server in a viewing tree, as opposed to one created locally.
+    bool removeViewedParticleWithID(uint32_t id);
+
 protected:
     virtual void init(unsigned char * octalCode);
 
     void storeParticle(const Particle& particle);
 
     ParticleTree* _myTree;
-    QList<Particle>* _particles;
+    QVector<Particle>* _particles; ///< stored contiguously, since simulating, colliding and encoding all walk them in order
+    bool _particlesChanged;
 };
 
 #endif /* defined(__hifi__ParticleTreeElement__) */
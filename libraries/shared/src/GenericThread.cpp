@@ -31,6 +31,9 @@ void GenericThread::initialize(bool isThreaded) {
     if (_isThreaded) {
         _thread = new QThread(this);
 
+        // name the thread after the class, for traces and debuggers
+        _thread->setObjectName(metaObject()->className());
+
         // when the worker thread is started, call our engine's run..
         connect(_thread, SIGNAL(started()), this, SLOT(threadRoutine()));
 
@@ -0,0 +1,149 @@
+//
+//  LatencyHistogram.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cmath>
+
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram() :
+    _count(0),
+    _minimum(INT_MAX),
+    _maximum(0) {
+}
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram& other) :
+    _count(other._count.load()),
+    _minimum(other._minimum.load()),
+    _maximum(other._maximum.load()) {
+
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        _buckets[i].store(other._buckets[i].load());
+    }
+}
+
+LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other) {
+    _count.store(other._count.load());
+    _minimum.store(other._minimum.load());
+    _maximum.store(other._maximum.load());
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        _buckets[i].store(other._buckets[i].load());
+    }
+    return *this;
+}
+
+void LatencyHistogram::record(qint64 value) {
+    int clampedValue = (value < 0) ? 0 : (value > INT_MAX ? INT_MAX : (int)value);
+
+    // there's only one writer, so there's no need for read-modify-write
+    QAtomicInt& bucket = _buckets[getBucketIndex(clampedValue)];
+    bucket.store(bucket.load() + 1);
+    if (clampedValue < _minimum.load()) {
+        _minimum.store(clampedValue);
+    }
+    if (clampedValue > _maximum.load()) {
+        _maximum.store(clampedValue);
+    }
+    _count.store(_count.load() + 1);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        int count = other._buckets[i].load();
+        if (count != 0) {
+            _buckets[i].store(_buckets[i].load() + count);
+        }
+    }
+    _minimum.store(qMin(_minimum.load(), other._minimum.load()));
+    _maximum.store(qMax(_maximum.load(), other._maximum.load()));
+    _count.store(_count.load() + other._count.load());
+}
+
+void LatencyHistogram::reset() {
+    _count.store(0);
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        _buckets[i].store(0);
+    }
+    _minimum.store(INT_MAX);
+    _maximum.store(0);
+}
+
+int LatencyHistogram::getCount(int minimum, int maximum) const {
+    int count = 0;
+    for (int i = getBucketIndex(qMax(minimum, 0)), last = getBucketIndex(qMax(maximum, 0)); i <= last; i++) {
+        if (getBucketLowest(i) >= minimum) {
+            count += _buckets[i].load();
+        }
+    }
+    return count;
+}
+
+double LatencyHistogram::getSum(int minimum, int maximum) const {
+    double sum = 0.0;
+    for (int i = getBucketIndex(qMax(minimum, 0)), last = getBucketIndex(qMax(maximum, 0)); i <= last; i++) {
+        int count = _buckets[i].load();
+        if (count != 0 && getBucketLowest(i) >= minimum) {
+            // take the middle of each bucket
+            sum += count * (((double)getBucketLowest(i) + getBucketHighest(i)) / 2.0);
+        }
+    }
+    return sum;
+}
+
+float LatencyHistogram::getMean() const {
+    int count = getCount(0, INT_MAX);
+    return (count == 0) ? 0.0f : getSum() / count;
+}
+
+int LatencyHistogram::getPercentile(float percentile) const {
+    // count from the buckets themselves, in case the total is a record behind
+    int count = getCount(0, INT_MAX);
+    if (count == 0) {
+        return 0;
+    }
+    const float PERCENT = 100.0f;
+    int rank = qMax(1, (int)ceil(qMin(percentile, PERCENT) * count / PERCENT));
+    int maximum = getMaximum();
+    int seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        seen += _buckets[i].load();
+        if (seen >= rank) {
+            return qMin(getBucketHighest(i), maximum);
+        }
+    }
+    return maximum;
+}
+
+int LatencyHistogram::getBucketIndex(int value) {
+    if (value < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return value;
+    }
+    // find the highest bit, then shift the value down to the top half of the sub-buckets
+    int highestBit = 0;
+    for (int bits = 16; bits > 0; bits >>= 1) {
+        if (value >> (highestBit + bits)) {
+            highestBit += bits;
+        }
+    }
+    int shift = highestBit - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+    return shift * HISTOGRAM_HALF_SUB_BUCKET_COUNT + (value >> shift);
+}
+
+int LatencyHistogram::getBucketLowest(int index) {
+    if (index < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return index;
+    }
+    int shift = index / HISTOGRAM_HALF_SUB_BUCKET_COUNT - 1;
+    return (index - shift * HISTOGRAM_HALF_SUB_BUCKET_COUNT) << shift;
+}
+
+int LatencyHistogram::getBucketHighest(int index) {
+    if (index < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return index;
+    }
+    int shift = index / HISTOGRAM_HALF_SUB_BUCKET_COUNT - 1;
+    return getBucketLowest(index) + ((1 << shift) - 1);
+}
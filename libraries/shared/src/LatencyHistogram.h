@@ -0,0 +1,77 @@
+//
+//  LatencyHistogram.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__LatencyHistogram__
+#define __hifi__LatencyHistogram__
+
+#include <climits>
+
+#include <QtCore/QAtomicInt>
+
+/// The number of bits of each value that the histogram distinguishes: values below 2^bits are counted exactly, and
+/// larger ones to within 1/2^(bits - 1).
+const int HISTOGRAM_SUB_BUCKET_BITS = 7;
+const int HISTOGRAM_SUB_BUCKET_COUNT = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+const int HISTOGRAM_HALF_SUB_BUCKET_COUNT = HISTOGRAM_SUB_BUCKET_COUNT / 2;
+
+/// Enough buckets for values up to INT_MAX.
+const int HISTOGRAM_BUCKET_COUNT = (32 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_HALF_SUB_BUCKET_COUNT;
+
+/// A histogram of non-negative values (latencies in microseconds, say) in log-linear buckets: one per value below 128,
+/// then 64 to each power of two, so that any value is known to within 1/64 (1.6%).  It takes the same 6.5KB however
+/// many values it holds and however widely they range, and histograms combine by adding their buckets.
+///
+/// One thread records while any others read or merge the histogram, without locks: the counts are atomic, though a
+/// reader may see a value counted in its bucket but not yet in the total count, say.
+class LatencyHistogram {
+public:
+
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram& other);
+
+    LatencyHistogram& operator=(const LatencyHistogram& other);
+
+    /// Records a value, on the one thread that records.  Negative values count as zero; those beyond INT_MAX as INT_MAX.
+    void record(qint64 value);
+
+    /// Adds the values of another histogram to this one, which mustn't be recorded into at the same time.
+    void merge(const LatencyHistogram& other);
+
+    /// Clears the histogram.  A value recorded at the same time may or may not survive.
+    void reset();
+
+    int getCount() const { return _count.load(); }
+    int getMinimum() const { return getCount() == 0 ? 0 : _minimum.load(); }
+    int getMaximum() const { return _maximum.load(); }
+
+    /// Returns the number of values in the buckets whose lowest values lie in the given range.
+    int getCount(int minimum, int maximum) const;
+
+    /// Returns the sum of the values in the buckets whose lowest values lie in the given range, estimated from the
+    /// buckets (exactly, below 128).
+    double getSum(int minimum = 0, int maximum = INT_MAX) const;
+
+    /// Returns the mean of the values, estimated from the buckets.
+    float getMean() const;
+
+    /// Returns the value that the given percentage of the values are less than or equal to, to within the precision of
+    /// the buckets (reporting the highest value of the bucket that holds it, but no more than the maximum).
+    int getPercentile(float percentile) const;
+
+private:
+
+    static int getBucketIndex(int value);
+    static int getBucketLowest(int index);
+    static int getBucketHighest(int index);
+
+    QAtomicInt _count;
+    QAtomicInt _minimum;
+    QAtomicInt _maximum;
+    QAtomicInt _buckets[HISTOGRAM_BUCKET_COUNT];
+};
+
+#endif /* defined(__hifi__LatencyHistogram__) */
@@ -0,0 +1,46 @@
+//
+//  LogRing.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cstring>
+
+#include "LogRing.h"
+
+/// The most records a single message may take; anything beyond is cut off, so that even the longest message fits.
+const int MAX_RECORDS_PER_MESSAGE = LOG_RING_RECORDS / 4;
+
+LogRing::LogRing() :
+    _head(0),
+    _tail(0),
+    _dropped(0),
+    _closed(0) {
+}
+
+bool LogRing::push(int sequence, time_t time, QtMsgType type, const QString& message) {
+    int length = qMin(message.size(), MAX_RECORDS_PER_MESSAGE * LOG_RECORD_CHARACTERS);
+    int recordCount = qMax(1, (length + LOG_RECORD_CHARACTERS - 1) / LOG_RECORD_CHARACTERS);
+    unsigned int tail = _tail.load();
+    if (recordCount > LOG_RING_RECORDS - (int)(tail - (unsigned int)_head.loadAcquire())) {
+        _dropped.ref();
+        return false;
+    }
+    const QChar* characters = message.constData();
+    for (int i = 0; i < recordCount; i++) {
+        LogRecord& record = _records[(tail + i) & (LOG_RING_RECORDS - 1)];
+        record.sequence = sequence;
+        record.time = time;
+        record.type = type;
+        record.length = qMin(length, LOG_RECORD_CHARACTERS);
+        record.continued = (i < recordCount - 1);
+        memcpy(record.characters, characters, record.length * sizeof(QChar));
+        characters += record.length;
+        length -= record.length;
+    }
+
+    // publish the records only once they're complete
+    _tail.storeRelease((int)(tail + recordCount));
+    return true;
+}
@@ -0,0 +1,70 @@
+//
+//  LogRing.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__LogRing__
+#define __hifi__LogRing__
+
+#include <ctime>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QString>
+
+/// The number of characters of a message that fit in one record; longer messages continue in the records that follow.
+const int LOG_RECORD_CHARACTERS = 240;
+
+/// The number of records in each thread's ring (a power of two).
+const int LOG_RING_RECORDS = 128;
+
+/// A message (or a piece of one) waiting to be written.
+class LogRecord {
+public:
+    int sequence; ///< the order in which the message was queued, across all threads
+    time_t time;
+    QtMsgType type;
+    int length; ///< the number of characters in this record
+    bool continued; ///< whether the message continues in the next record
+    QChar characters[LOG_RECORD_CHARACTERS];
+};
+
+/// A fixed-size ring of log records, filled by the thread that owns it and emptied by the log writer.  Each index is
+/// only ever written by one side, so neither needs a lock; when the ring is full, messages are counted and dropped.
+class LogRing {
+public:
+
+    LogRing();
+
+    /// Copies a message into the ring (on the owning thread).
+    /// \return false if there wasn't room for it, in which case it's counted as dropped
+    bool push(int sequence, time_t time, QtMsgType type, const QString& message);
+
+    /// Returns the number of records waiting to be read.
+    int getUsed() const { return (int)((unsigned int)_tail.loadAcquire() - (unsigned int)_head.load()); }
+
+    /// Returns the record at the given offset from the front (on the writer).  The caller must check getUsed() first.
+    const LogRecord& peek(int offset = 0) const {
+        return _records[((unsigned int)_head.load() + offset) & (LOG_RING_RECORDS - 1)]; }
+
+    /// Releases records from the front of the ring (on the writer).
+    void pop(int count) { _head.storeRelease((int)((unsigned int)_head.load() + count)); }
+
+    /// Returns the number of messages dropped since the last call, and resets the count.
+    int takeDropped() { return _dropped.fetchAndStoreRelaxed(0); }
+
+    /// Notes that the owning thread is gone, so that the writer can delete the ring once it's empty.
+    void close() { _closed.storeRelease(1); }
+    bool isClosed() const { return _closed.loadAcquire() != 0; }
+
+private:
+
+    QAtomicInt _head; ///< the index of the next record to read, advanced by the writer
+    QAtomicInt _tail; ///< the index of the next record to fill, advanced by the owner
+    QAtomicInt _dropped;
+    QAtomicInt _closed;
+    LogRecord _records[LOG_RING_RECORDS];
+};
+
+#endif /* defined(__hifi__LogRing__) */
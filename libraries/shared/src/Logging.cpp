@@ -19,11 +19,21 @@
 #define pid_t int // hack to build
 #endif
 
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QWaitCondition>
 #include <QtNetwork/QHostInfo>
 
 #include "HifiSockAddr.h"
+#include "LogRing.h"
+#include "Metrics.h"
 #include "SharedUtil.h"
-#include "NodeList.h"
 
 #include "Logging.h"
 
@@ -56,18 +66,8 @@ bool Logging::shouldSendStats() {
 }
 
 void Logging::stashValue(char statType, const char* key, float value) {
-    static char logstashPacket[MAX_PACKET_SIZE];
-
-    // load up the logstash packet with the key and the passed float value
-    // send it to 4 decimal places
-    int numPacketBytes = sprintf(logstashPacket, "%c %s %.4f", statType, key, value);
-
-    NodeList *nodeList = NodeList::getInstance();
-
-    if (nodeList) {
-        nodeList->getNodeSocket().writeDatagram(logstashPacket, numPacketBytes,
-                                                _logstashSocket.getAddress(), _logstashSocket.getPort());
-    }
+    MetricsRegistry* registry = MetricsRegistry::getInstance();
+    registry->update(registry->getMetricID(statType, key), value);
 }
 
 const char* stringForLogType(QtMsgType msgType) {
@@ -88,36 +88,380 @@ const char* stringForLogType(QtMsgType msgType) {
 // the following will produce 2000-10-02 13:55:36 -0700
 const char DATE_STRING_FORMAT[] = "%F %H:%M:%S %z";
 
-void Logging::verboseMessageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
-    if (message.isEmpty()) {
-        return;
-    }
-    // log prefix is in the following format
-    // [DEBUG] [TIMESTAMP] [PID:PARENT_PID] [TARGET] logged string
-
-    QString prefixString = QString("[%1]").arg(stringForLogType(type));
-
-    time_t rawTime;
-    time(&rawTime);
+/// Formats the part of the log prefix that follows the message type: [TIMESTAMP] [PID:PARENT_PID] [TARGET]
+static QByteArray formatStamp(time_t rawTime) {
     struct tm* localTime = localtime(&rawTime);
 
     char dateString[100];
     strftime(dateString, sizeof(dateString), DATE_STRING_FORMAT, localTime);
 
-    prefixString.append(QString(" [%1]").arg(dateString));
+    QString stampString = QString("[%1]").arg(dateString);
 
-    prefixString.append(QString(" [%1").arg(getpid()));
+    stampString.append(QString(" [%1").arg(getpid()));
 
     pid_t parentProcessID = getppid();
     if (parentProcessID != 0) {
-        prefixString.append(QString(":%1]").arg(parentProcessID));
+        stampString.append(QString(":%1]").arg(parentProcessID));
+    } else {
+        stampString.append("]");
+    }
+
+    if (!Logging::getTargetName().isEmpty()) {
+        stampString.append(QString(" [%1]").arg(Logging::getTargetName()));
+    }
+    return stampString.toLocal8Bit();
+}
+
+/// The file to write to, or NULL for stdout.
+static FILE* logOutput = NULL;
+
+static FILE* getLogOutput() {
+    return logOutput ? logOutput : stdout;
+}
+
+/// The longest the writer leaves queued messages unwritten, if no thread wakes it sooner.  When nothing is queued, it
+/// sleeps until the next message.
+const unsigned long LOG_WRITE_INTERVAL_MSECS = 10;
+
+/// Threads wake the writer when their rings get this full.
+const int LOG_WAKE_RECORDS = LOG_RING_RECORDS / 2;
+
+/// How long the crash handler waits for the writer to finish what it's doing before writing anyway.
+const int CRASH_LOCK_MSECS = 100;
+
+/// Closes a thread's ring when the thread exits.
+class LogRingHolder {
+public:
+
+    LogRingHolder(LogRing* ring) : ring(ring) { }
+    ~LogRingHolder() { ring->close(); }
+
+    LogRing* ring;
+};
+
+/// Drains the rings of the threads that log, merging their messages in the order they were queued, and writes them.
+class LogWriter : public QThread {
+public:
+
+    LogWriter();
+    virtual ~LogWriter();
+
+    /// Queues a message on the calling thread's ring.  Returns false, without queuing it, once the writer is stopping; the
+    /// caller should then write the message itself.
+    bool queue(QtMsgType type, const QString& message);
+
+    /// Writes out everything queued so far.
+    void flush();
+
+    /// Writes out what's queued from a signal handler.  This is best effort: it won't wait long for locks that the
+    /// crashed thread may hold, and formatting isn't strictly safe to do in a signal handler.
+    void flushOnCrash();
+
+    void setOutput(FILE* output);
+
+protected:
+
+    virtual void run();
+
+private:
+
+    LogRing* getRing();
+    bool hasQueuedMessages();
+    void wake();
+    void drain(bool crashing = false);
+    void appendMessage(QByteArray& buffer, QtMsgType type, time_t time, const QString& message);
+
+    QThreadStorage<LogRingHolder*> _ringHolders;
+    QMutex _ringsMutex;
+    QList<LogRing*> _rings;
+
+    QMutex _drainMutex;
+    QAtomicInt _sequence;
+
+    QMutex _wakeMutex;
+    QWaitCondition _wakeCondition;
+    bool _wakeRequested;
+    QAtomicInt _idle;       ///< set while the writer sleeps with nothing queued, so that the next message wakes it
+    QAtomicInt _stopping;
+    QAtomicInt _queuing;    ///< the number of threads partway through queue()
+
+    time_t _stampTime;
+    QByteArray _stamp;
+};
+
+Q_GLOBAL_STATIC(LogWriter, logWriter)
+
+#ifndef _WIN32
+static const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static const int CRASH_SIGNAL_COUNT = sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]);
+static struct sigaction previousCrashActions[CRASH_SIGNAL_COUNT];
+
+static void handleCrash(int signal) {
+    if (LogWriter* writer = logWriter()) {
+        writer->flushOnCrash();
+    }
+    // hand the signal on to whoever had it before
+    for (int i = 0; i < CRASH_SIGNAL_COUNT; i++) {
+        if (CRASH_SIGNALS[i] == signal) {
+            sigaction(signal, &previousCrashActions[i], NULL);
+            break;
+        }
+    }
+    raise(signal);
+}
+#endif
+
+LogWriter::LogWriter() :
+    _sequence(0),
+    _wakeRequested(false),
+    _idle(0),
+    _stopping(0),
+    _queuing(0),
+    _stampTime(0) {
+
+#ifndef _WIN32
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleCrash;
+    sigemptyset(&action.sa_mask);
+    for (int i = 0; i < CRASH_SIGNAL_COUNT; i++) {
+        sigaction(CRASH_SIGNALS[i], &action, &previousCrashActions[i]);
+    }
+#endif
+    start();
+}
+
+LogWriter::~LogWriter() {
+    // turn away new messages, and let those already being queued finish, so that nothing pushes to the rings from here
+    _stopping.fetchAndStoreOrdered(1);
+    while (_queuing.load() > 0) {
+        QThread::yieldCurrentThread();
+    }
+    wake();
+    wait();
+    flush();
+
+    // the rings of threads that are still running are left to them, since their holders close them on exit
+    QMutexLocker locker(&_ringsMutex);
+    foreach (LogRing* ring, _rings) {
+        if (ring->isClosed()) {
+            delete ring;
+        }
+    }
+    _rings.clear();
+}
+
+bool LogWriter::queue(QtMsgType type, const QString& message) {
+    _queuing.ref();
+    if (_stopping.loadAcquire()) {
+        _queuing.deref();
+        return false;
+    }
+    LogRing* ring = getRing();
+    bool shouldWake = !ring->push(_sequence.fetchAndAddRelaxed(1), time(NULL), type, message) ||
+        ring->getUsed() >= LOG_WAKE_RECORDS;
+    if (_idle.testAndSetOrdered(1, 0) || shouldWake) {
+        wake();
+    }
+    _queuing.deref();
+    return true;
+}
+
+void LogWriter::flush() {
+    QMutexLocker locker(&_drainMutex);
+    drain();
+}
+
+void LogWriter::flushOnCrash() {
+    bool locked = _drainMutex.tryLock(CRASH_LOCK_MSECS);
+    drain(true);
+    if (locked) {
+        _drainMutex.unlock();
+    }
+}
+
+void LogWriter::setOutput(FILE* output) {
+    QMutexLocker locker(&_drainMutex);
+    drain();
+    logOutput = output;
+}
+
+void LogWriter::run() {
+    while (!_stopping.loadAcquire()) {
+        _wakeMutex.lock();
+        if (!_wakeRequested) {
+            // mark ourselves idle before looking at the rings, so that a message queued after we look wakes us
+            _idle.fetchAndStoreOrdered(1);
+            if (hasQueuedMessages()) {
+                _idle.fetchAndStoreOrdered(0);
+                _wakeCondition.wait(&_wakeMutex, LOG_WRITE_INTERVAL_MSECS);
+            } else {
+                _wakeCondition.wait(&_wakeMutex);
+                _idle.fetchAndStoreOrdered(0);
+            }
+        }
+        _wakeRequested = false;
+        _wakeMutex.unlock();
+
+        flush();
+    }
+}
+
+LogRing* LogWriter::getRing() {
+    if (!_ringHolders.hasLocalData()) {
+        LogRing* ring = new LogRing();
+        QMutexLocker locker(&_ringsMutex);
+        _rings.append(ring);
+        _ringHolders.setLocalData(new LogRingHolder(ring));
+    }
+    return _ringHolders.localData()->ring;
+}
+
+bool LogWriter::hasQueuedMessages() {
+    QMutexLocker locker(&_ringsMutex);
+    foreach (LogRing* ring, _rings) {
+        if (ring->getUsed() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LogWriter::wake() {
+    QMutexLocker locker(&_wakeMutex);
+    _wakeRequested = true;
+    _wakeCondition.wakeOne();
+}
+
+void LogWriter::drain(bool crashing) {
+    QList<LogRing*> rings;
+    if (crashing) {
+        if (!_ringsMutex.tryLock(CRASH_LOCK_MSECS)) {
+            return;
+        }
+        rings = _rings;
+        _ringsMutex.unlock();
+
+    } else {
+        QMutexLocker locker(&_ringsMutex);
+        rings = _rings;
+    }
+
+    // write the messages in the order they were queued, whichever thread queued them
+    QByteArray buffer;
+    forever {
+        LogRing* first = NULL;
+        foreach (LogRing* ring, rings) {
+            if (ring->getUsed() > 0 && (!first || ring->peek().sequence - first->peek().sequence < 0)) {
+                first = ring;
+            }
+        }
+        if (!first) {
+            break;
+        }
+        const LogRecord& firstRecord = first->peek();
+        QString message;
+        int recordCount = 0;
+        for (bool continued = true; continued; recordCount++) {
+            const LogRecord& record = first->peek(recordCount);
+            message.append(record.characters, record.length);
+            continued = record.continued;
+        }
+        appendMessage(buffer, firstRecord.type, firstRecord.time, message);
+        first->pop(recordCount);
+    }
+
+    int dropped = 0;
+    foreach (LogRing* ring, rings) {
+        dropped += ring->takeDropped();
+    }
+    if (dropped > 0) {
+        appendMessage(buffer, QtWarningMsg, time(NULL), QString("%1 log messages dropped").arg(dropped));
+    }
+
+    if (!buffer.isEmpty()) {
+        FILE* output = getLogOutput();
+        fwrite(buffer.constData(), 1, buffer.size(), output);
+        fflush(output);
+    }
+
+    if (crashing) {
+        return;
+    }
+    // forget the rings whose threads are gone (checking that they're closed first, so that nothing can follow), as long
+    // as we've counted their drops
+    QMutexLocker locker(&_ringsMutex);
+    for (QList<LogRing*>::iterator it = _rings.begin(); it != _rings.end(); ) {
+        LogRing* ring = *it;
+        if (ring->isClosed() && ring->getUsed() == 0 && rings.contains(ring)) {
+            delete ring;
+            it = _rings.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void LogWriter::appendMessage(QByteArray& buffer, QtMsgType type, time_t time, const QString& message) {
+    // the stamp only changes once a second
+    if (time != _stampTime || _stamp.isEmpty()) {
+        _stampTime = time;
+        _stamp = formatStamp(time);
+    }
+    buffer.append('[');
+    buffer.append(stringForLogType(type));
+    buffer.append("] ");
+    buffer.append(_stamp);
+    buffer.append(' ');
+    buffer.append(message.toLocal8Bit());
+    buffer.append('\n');
+}
+
+void Logging::setOutput(FILE* output) {
+    if (LogWriter* writer = logWriter()) {
+        writer->setOutput(output);
     } else {
-        prefixString.append("]");
+        logOutput = output;
+    }
+}
+
+void Logging::verboseMessageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
+    if (message.isEmpty()) {
+        return;
+    }
+    LogWriter* writer = logWriter();
+    if (!writer || type == QtFatalMsg) {
+        // once the writer is gone (or the process is about to be), write directly after anything queued
+        if (writer) {
+            writer->flush();
+        }
+        synchronousMessageHandler(type, context, message);
+        return;
+    }
+    if (!writer->queue(type, message)) {
+        // the writer is shutting down
+        synchronousMessageHandler(type, context, message);
     }
+}
+
+void Logging::synchronousMessageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
+    if (message.isEmpty()) {
+        return;
+    }
+    // log prefix is in the following format
+    // [DEBUG] [TIMESTAMP] [PID:PARENT_PID] [TARGET] logged string
+
+    time_t rawTime;
+    time(&rawTime);
+
+    FILE* output = getLogOutput();
+    fprintf(output, "[%s] %s %s\n", stringForLogType(type), formatStamp(rawTime).constData(),
+        message.toLocal8Bit().constData());
+    fflush(output);
+}
 
-    if (!_targetName.isEmpty()) {
-        prefixString.append(QString(" [%1]").arg(_targetName));
+void Logging::flush() {
+    if (LogWriter* writer = logWriter()) {
+        writer->flush();
     }
-    
-    fprintf(stdout, "%s %s\n", prefixString.toLocal8Bit().constData(), message.toLocal8Bit().constData());
 }
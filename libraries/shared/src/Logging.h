@@ -15,6 +15,8 @@
 #include <netinet/in.h>
 #endif
 
+#include <cstdio>
+
 #include <QtCore/QString>
 
 const int LOGSTASH_UDP_PORT = 9500;
@@ -36,7 +38,8 @@ public:
     /// \return true if the caller should send stats to logstash
     static bool shouldSendStats();
 
-    /// stashes a float value to Logstash instance
+    /// stashes a float value to Logstash instance, via the metrics registry, which sends it with the other metrics
+    /// updated over the interval
     /// \param statType a stat type from the constants in this file
     /// \param key the key at which to store the stat
     /// \param value the value to store
@@ -45,10 +48,22 @@ public:
     /// sets the target name to output via the verboseMessageHandler, called once before logging begins
     /// \param targetName the desired target name to output in logs
     static void setTargetName(const QString& targetName) { _targetName = targetName; }
+    static const QString& getTargetName() { return _targetName; }
+
+    /// sets the file that logged messages are written to (stdout by default), after writing out those already queued
+    static void setOutput(FILE* output);
 
     /// a qtMessageHandler that can be hooked up to a target that links to Qt
     /// prints various process, message type, and time information
+    /// messages are copied to a ring belonging to the calling thread and written out by a background thread, so that
+    /// logging doesn't stall the caller; if the ring is full, the message is dropped and the drop is logged later
     static void verboseMessageHandler(QtMsgType type, const QMessageLogContext& context, const QString &message);
+
+    /// a qtMessageHandler that formats and writes each message on the calling thread, as verboseMessageHandler once did
+    static void synchronousMessageHandler(QtMsgType type, const QMessageLogContext& context, const QString &message);
+
+    /// writes out all messages queued by verboseMessageHandler so far, returning when they've been written
+    static void flush();
 private:
     static HifiSockAddr _logstashSocket;
     static QString _targetName;
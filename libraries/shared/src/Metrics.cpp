@@ -0,0 +1,271 @@
+//
+//  Metrics.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cfloat>
+#include <climits>
+
+#include <QtCore/QDataStream>
+#include <QtNetwork/QUdpSocket>
+
+#include "HifiSockAddr.h"
+#include "Logging.h"
+#include "NodeList.h"
+#include "SharedUtil.h"
+
+#include "Metrics.h"
+
+/// One thread's updates to one metric over the current interval.
+class MetricAccumulator {
+public:
+    char type;
+    quint32 count;
+    float total;
+    float minimum;
+    float maximum;
+    float latest;
+    int latestSequence; ///< for gauges, orders the latest values of different threads
+
+    MetricAccumulator() : type(STAT_TYPE_COUNTER), count(0), total(0.0f), minimum(FLT_MAX), maximum(-FLT_MAX),
+        latest(0.0f), latestSequence(0) { }
+};
+
+/// The accumulators of one thread.  The mutex is only ever contended by the flush, once an interval.
+class MetricsShard {
+public:
+    QMutex mutex;
+    QVector<MetricAccumulator> accumulators;
+    bool closed;
+
+    MetricsShard() : closed(false) { }
+};
+
+/// Closes a thread's shard when the thread exits, leaving its last updates for the next flush.
+class MetricsShardHolder {
+public:
+
+    MetricsShardHolder(MetricsShard* shard) : shard(shard) { }
+    ~MetricsShardHolder() {
+        QMutexLocker locker(&shard->mutex);
+        shard->closed = true;
+    }
+
+    MetricsShard* shard;
+};
+
+MetricsRegistry* MetricsRegistry::getInstance() {
+    static MetricsRegistry* instance = new MetricsRegistry();
+    return instance;
+}
+
+MetricsRegistry::MetricsRegistry() :
+    _gaugeSequence(0) {
+}
+
+int MetricsRegistry::getMetricID(char type, const QByteArray& key) {
+    QMutexLocker locker(&_definitionsMutex);
+    QHash<QByteArray, int>::const_iterator it = _ids.constFind(key);
+    if (it != _ids.constEnd()) {
+        return it.value();
+    }
+    Definition definition = { type, key };
+    _definitions.append(definition);
+    _ids.insert(key, _definitions.size() - 1);
+    return _definitions.size() - 1;
+}
+
+void MetricsRegistry::update(int id, float value) {
+    MetricsShard* shard = getShard();
+    QMutexLocker locker(&shard->mutex);
+    if (id >= shard->accumulators.size()) {
+        // the accumulators start out empty each interval; make room for all the metrics so far
+        QMutexLocker definitionsLocker(&_definitionsMutex);
+        int oldSize = shard->accumulators.size();
+        shard->accumulators.resize(_definitions.size());
+        for (int i = oldSize; i < _definitions.size(); i++) {
+            shard->accumulators[i].type = _definitions.at(i).type;
+        }
+    }
+    MetricAccumulator& accumulator = shard->accumulators[id];
+    accumulator.count++;
+    accumulator.total += value;
+    accumulator.minimum = qMin(accumulator.minimum, value);
+    accumulator.maximum = qMax(accumulator.maximum, value);
+    accumulator.latest = value;
+    if (accumulator.type == STAT_TYPE_GAUGE) {
+        accumulator.latestSequence = _gaugeSequence.fetchAndAddRelaxed(1);
+    }
+}
+
+QList<MetricSample> MetricsRegistry::takeSamples() {
+    // swap out each shard's accumulators and merge them, dropping the shards of threads that have exited
+    QVector<MetricAccumulator> merged;
+    {
+        QMutexLocker locker(&_shardsMutex);
+        for (QList<MetricsShard*>::iterator it = _shards.begin(); it != _shards.end(); ) {
+            MetricsShard* shard = *it;
+            QVector<MetricAccumulator> accumulators;
+            shard->mutex.lock();
+            accumulators.swap(shard->accumulators);
+            bool closed = shard->closed;
+            shard->mutex.unlock();
+
+            if (merged.size() < accumulators.size()) {
+                merged.resize(accumulators.size());
+            }
+            for (int i = 0; i < accumulators.size(); i++) {
+                const MetricAccumulator& accumulator = accumulators.at(i);
+                if (accumulator.count == 0) {
+                    continue;
+                }
+                MetricAccumulator& total = merged[i];
+                total.count += accumulator.count;
+                total.total += accumulator.total;
+                total.minimum = qMin(total.minimum, accumulator.minimum);
+                total.maximum = qMax(total.maximum, accumulator.maximum);
+                if (total.count == accumulator.count || accumulator.latestSequence - total.latestSequence > 0) {
+                    total.latest = accumulator.latest;
+                    total.latestSequence = accumulator.latestSequence;
+                }
+            }
+            if (closed) {
+                delete shard;
+                it = _shards.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    QList<MetricSample> samples;
+    QMutexLocker locker(&_definitionsMutex);
+    for (int i = 0; i < merged.size(); i++) {
+        const MetricAccumulator& accumulator = merged.at(i);
+        if (accumulator.count == 0) {
+            continue;
+        }
+        const Definition& definition = _definitions.at(i);
+        MetricSample sample = { definition.type, definition.key, accumulator.count, 0.0f, 0.0f, 0.0f };
+        switch (definition.type) {
+            case STAT_TYPE_COUNTER:
+                sample.value = sample.minimum = sample.maximum = accumulator.total;
+                break;
+
+            case STAT_TYPE_GAUGE:
+                sample.value = sample.minimum = sample.maximum = accumulator.latest;
+                break;
+
+            default:
+                sample.value = accumulator.total / accumulator.count;
+                sample.minimum = accumulator.minimum;
+                sample.maximum = accumulator.maximum;
+                break;
+        }
+        samples.append(sample);
+    }
+    return samples;
+}
+
+static void startDatagram(QByteArray& datagram) {
+    datagram.clear();
+    QDataStream stream(&datagram, QIODevice::WriteOnly);
+    stream << METRICS_DATAGRAM_VERSION << (quint16)0;
+}
+
+static void finishDatagram(QByteArray& datagram, quint16 sampleCount, QList<QByteArray>& datagrams) {
+    QDataStream stream(&datagram, QIODevice::ReadWrite);
+    stream.device()->seek(sizeof(METRICS_DATAGRAM_VERSION));
+    stream << sampleCount;
+    datagrams.append(datagram);
+}
+
+QList<QByteArray> MetricsRegistry::takeDatagrams() {
+    // each datagram holds the version, the sample count, and then for each sample its type, key, update count, value,
+    // and (for timers) the minimum and maximum
+    QList<QByteArray> datagrams;
+    QByteArray datagram;
+    startDatagram(datagram);
+    quint16 sampleCount = 0;
+    foreach (const MetricSample& sample, takeSamples()) {
+        QByteArray entry;
+        QDataStream stream(&entry, QIODevice::WriteOnly);
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        QByteArray key = sample.key.left(UCHAR_MAX);
+        stream << (qint8)sample.type << (quint8)key.size();
+        stream.writeRawData(key.constData(), key.size());
+        stream << sample.count << sample.value;
+        if (sample.type == STAT_TYPE_TIMER) {
+            stream << sample.minimum << sample.maximum;
+        }
+        if (datagram.size() + entry.size() > MAX_PACKET_SIZE && sampleCount > 0) {
+            finishDatagram(datagram, sampleCount, datagrams);
+            startDatagram(datagram);
+            sampleCount = 0;
+        }
+        datagram.append(entry);
+        sampleCount++;
+    }
+    if (sampleCount > 0) {
+        finishDatagram(datagram, sampleCount, datagrams);
+    }
+    return datagrams;
+}
+
+void MetricsRegistry::flush() {
+    NodeList* nodeList = NodeList::getInstance();
+    if (!(nodeList && Logging::shouldSendStats())) {
+        takeSamples();
+        return;
+    }
+    flush(nodeList->getNodeSocket(), Logging::socket());
+}
+
+void MetricsRegistry::flush(QUdpSocket& socket, const HifiSockAddr& destination) {
+    foreach (const QByteArray& datagram, takeDatagrams()) {
+        socket.writeDatagram(datagram, destination.getAddress(), destination.getPort());
+    }
+}
+
+bool MetricsRegistry::readDatagram(const QByteArray& datagram, QList<MetricSample>& samples) {
+    QDataStream stream(datagram);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint8 version;
+    quint16 sampleCount;
+    stream >> version >> sampleCount;
+    if (version != METRICS_DATAGRAM_VERSION) {
+        return false;
+    }
+    for (int i = 0; i < sampleCount; i++) {
+        MetricSample sample;
+        qint8 type;
+        quint8 keySize;
+        stream >> type >> keySize;
+        sample.type = type;
+        sample.key.resize(keySize);
+        stream.readRawData(sample.key.data(), keySize);
+        stream >> sample.count >> sample.value;
+        if (sample.type == STAT_TYPE_TIMER) {
+            stream >> sample.minimum >> sample.maximum;
+        } else {
+            sample.minimum = sample.maximum = sample.value;
+        }
+        if (stream.status() != QDataStream::Ok) {
+            return false;
+        }
+        samples.append(sample);
+    }
+    return stream.atEnd();
+}
+
+MetricsShard* MetricsRegistry::getShard() {
+    if (!_shardHolders.hasLocalData()) {
+        MetricsShard* shard = new MetricsShard();
+        QMutexLocker locker(&_shardsMutex);
+        _shards.append(shard);
+        _shardHolders.setLocalData(new MetricsShardHolder(shard));
+    }
+    return _shardHolders.localData()->shard;
+}
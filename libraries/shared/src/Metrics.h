@@ -0,0 +1,106 @@
+//
+//  Metrics.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__Metrics__
+#define __hifi__Metrics__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVector>
+
+class QUdpSocket;
+
+class HifiSockAddr;
+class MetricsShard;
+class MetricsShardHolder;
+
+/// The version written at the start of each metrics datagram.
+const quint8 METRICS_DATAGRAM_VERSION = 1;
+
+/// The interval at which assignments send their metrics.
+const int METRICS_FLUSH_INTERVAL_MSECS = 10 * 1000;
+
+/// A metric's summary over one interval, as sent in a metrics datagram.
+class MetricSample {
+public:
+    char type; ///< STAT_TYPE_COUNTER, STAT_TYPE_GAUGE or STAT_TYPE_TIMER
+    QByteArray key;
+    quint32 count; ///< the number of updates over the interval
+    float value; ///< the counter's total, the gauge's latest value, or the timer's mean
+    float minimum; ///< for timers, the smallest value recorded (otherwise equal to the value)
+    float maximum; ///< for timers, the largest value recorded (otherwise equal to the value)
+};
+
+/// Collects counters, gauges and timers (histograms of recorded values) from any thread, and sends them out together,
+/// packed into as few datagrams as possible, once per interval.  Each thread updates its own shard, so the only
+/// contention is with the flush.
+class MetricsRegistry {
+public:
+
+    static MetricsRegistry* getInstance();
+
+    /// Returns the ID of the metric with the given type and key, registering it if it's new.
+    int getMetricID(char type, const QByteArray& key);
+
+    /// Updates a metric: counters add the value, gauges take it, timers record it.
+    void update(int id, float value);
+
+    /// Collects and resets the updates since the last call.
+    QList<MetricSample> takeSamples();
+
+    /// Collects and resets the updates since the last call, packing them into datagrams no larger than MAX_PACKET_SIZE.
+    QList<QByteArray> takeDatagrams();
+
+    /// Sends the updates since the last flush to logstash, if this target sends stats (otherwise just resets them).
+    void flush();
+
+    /// Sends the updates since the last flush to the given destination.
+    void flush(QUdpSocket& socket, const HifiSockAddr& destination);
+
+    /// Reads the samples packed into a datagram.
+    /// \return whether the datagram was well formed
+    static bool readDatagram(const QByteArray& datagram, QList<MetricSample>& samples);
+
+private:
+
+    MetricsRegistry();
+
+    MetricsShard* getShard();
+
+    class Definition {
+    public:
+        char type;
+        QByteArray key;
+    };
+
+    QMutex _definitionsMutex;
+    QVector<Definition> _definitions;
+    QHash<QByteArray, int> _ids;
+
+    QThreadStorage<MetricsShardHolder*> _shardHolders;
+    QMutex _shardsMutex;
+    QList<MetricsShard*> _shards;
+    QAtomicInt _gaugeSequence;
+};
+
+/// A handle to a metric, registered once (typically as a static) and cheap to update thereafter.
+class Metric {
+public:
+
+    Metric(char type, const char* key) : _id(MetricsRegistry::getInstance()->getMetricID(type, key)) { }
+
+    void update(float value) { MetricsRegistry::getInstance()->update(_id, value); }
+
+private:
+
+    int _id;
+};
+
+#endif /* defined(__hifi__Metrics__) */
@@ -83,7 +83,8 @@ NodeList::NodeList(char newOwnerType, unsigned short int newSocketListenPort) :
 
 bool NodeList::packetVersionAndHashMatch(const QByteArray& packet) {
     PacketType checkType = packetTypeForPacket(packet);
-    if (packet[1] != versionForPacketType(checkType)
+    PacketVersion checkVersion = packet[1];
+    if ((checkVersion < minimumVersionForPacketType(checkType) || checkVersion > versionForPacketType(checkType))
         && checkType != PacketTypeStunResponse) {
         PacketType mismatchType = packetTypeForPacket(packet);
         int numPacketTypeBytes = numBytesArithmeticCodingFromBuffer(packet.data());
@@ -47,7 +47,8 @@ PacketVersion versionForPacketType(PacketType type) {
         case PacketTypeAvatarData:
             return 2;
         case PacketTypeParticleData:
-            return 1;
+        case PacketTypeParticleErase:
+            return 2;
         case PacketTypeDomainList:
         case PacketTypeDomainListRequest:
             return 1;
@@ -67,6 +68,20 @@ PacketVersion versionForPacketType(PacketType type) {
     }
 }
 
+PacketVersion minimumVersionForPacketType(PacketType type) {
+    switch (type) {
+        case PacketTypeParticleData:
+        case PacketTypeParticleErase:
+            return 1; // sent whole particles, and lists of deleted IDs
+        default:
+            return versionForPacketType(type);
+    }
+}
+
+PacketVersion versionForPacket(const QByteArray& packet) {
+    return packet[numBytesArithmeticCodingFromBuffer(packet.data())];
+}
+
 QByteArray byteArrayWithPopulatedHeader(PacketType type, const QUuid& connectionUUID) {
     QByteArray freshByteArray(MAX_PACKET_HEADER_BYTES, 0);
     freshByteArray.resize(populatePacketHeader(freshByteArray, type, connectionUUID));
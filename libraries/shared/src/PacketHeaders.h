@@ -69,6 +69,11 @@ const int MAX_PACKET_HEADER_BYTES = sizeof(PacketType) + NUM_STATIC_HEADER_BYTES
 
 PacketVersion versionForPacketType(PacketType type);
 
+/// The oldest version of the type that is still read, for types whose readers understand the layouts of older senders.
+PacketVersion minimumVersionForPacketType(PacketType type);
+
+PacketVersion versionForPacket(const QByteArray& packet);
+
 const QUuid nullUUID = QUuid();
 
 QByteArray byteArrayWithPopulatedHeader(PacketType type, const QUuid& connectionUUID = nullUUID);
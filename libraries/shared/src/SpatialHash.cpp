@@ -0,0 +1,90 @@
+//
+//  SpatialHash.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "SpatialHash.h"
+
+// each cell coordinate gets this many bits of the key. Coordinates further out than that wrap around, so that distant
+// cells can share a key, which only adds candidates that the bounding box test rejects (as long as no one sphere spans
+// that many cells)
+const int BITS_PER_CELL_COORDINATE = 21;
+const quint64 CELL_COORDINATE_MASK = (1ULL << BITS_PER_CELL_COORDINATE) - 1;
+
+SpatialHash::SpatialHash(float cellSize) :
+    _cellSize(cellSize) {
+}
+
+void SpatialHash::clear() {
+    _minimums.clear();
+    _maximums.clear();
+    _entries.clear();
+}
+
+int SpatialHash::addSphere(const glm::vec3& center, float radius) {
+    int sphere = _minimums.size();
+    glm::vec3 extent(radius, radius, radius);
+    _minimums.append(center - extent);
+    _maximums.append(center + extent);
+
+    // one entry for every cell the sphere's bounding box overlaps
+    glm::ivec3 minimumCell = getCell(center - extent);
+    glm::ivec3 maximumCell = getCell(center + extent);
+    Entry entry = { 0, sphere };
+    for (int x = minimumCell.x; x <= maximumCell.x; x++) {
+        for (int y = minimumCell.y; y <= maximumCell.y; y++) {
+            for (int z = minimumCell.z; z <= maximumCell.z; z++) {
+                entry.cell = getCellKey(glm::ivec3(x, y, z));
+                _entries.append(entry);
+            }
+        }
+    }
+    return sphere;
+}
+
+void SpatialHash::findPairs(QVector<SpatialHashPair>& pairs) {
+    pairs.clear();
+    std::sort(_entries.begin(), _entries.end());
+
+    for (int start = 0, end = 0; start < _entries.size(); start = end) {
+        quint64 cell = _entries.at(start).cell;
+        for (end = start + 1; end < _entries.size() && _entries.at(end).cell == cell; end++);
+
+        for (int i = start; i < end; i++) {
+            int first = _entries.at(i).sphere;
+            const glm::vec3& firstMinimum = _minimums.at(first);
+            const glm::vec3& firstMaximum = _maximums.at(first);
+            for (int j = i + 1; j < end; j++) {
+                int second = _entries.at(j).sphere;
+                const glm::vec3& secondMinimum = _minimums.at(second);
+                const glm::vec3& secondMaximum = _maximums.at(second);
+                if (firstMinimum.x > secondMaximum.x || secondMinimum.x > firstMaximum.x ||
+                        firstMinimum.y > secondMaximum.y || secondMinimum.y > firstMaximum.y ||
+                        firstMinimum.z > secondMaximum.z || secondMinimum.z > firstMaximum.z) {
+                    continue;
+                }
+                // spheres spanning several cells share more than one of them; only report the pair from the cell holding
+                // the minimum corner of their boxes' intersection
+                if (getCellKey(getCell(glm::max(firstMinimum, secondMinimum))) != cell) {
+                    continue;
+                }
+                SpatialHashPair pair = { first, second };
+                pairs.append(pair);
+            }
+        }
+    }
+}
+
+glm::ivec3 SpatialHash::getCell(const glm::vec3& point) const {
+    return glm::ivec3(floorf(point.x / _cellSize), floorf(point.y / _cellSize), floorf(point.z / _cellSize));
+}
+
+quint64 SpatialHash::getCellKey(const glm::ivec3& cell) {
+    return (((quint64)cell.x & CELL_COORDINATE_MASK) << (2 * BITS_PER_CELL_COORDINATE)) |
+        (((quint64)cell.y & CELL_COORDINATE_MASK) << BITS_PER_CELL_COORDINATE) | ((quint64)cell.z & CELL_COORDINATE_MASK);
+}
@@ -0,0 +1,66 @@
+//
+//  SpatialHash.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__SpatialHash__
+#define __hifi__SpatialHash__
+
+#include <glm/glm.hpp>
+
+#include <QVector>
+
+/// Two spheres whose bounding boxes overlap, by the indices they were added with. first is always less than second.
+class SpatialHashPair {
+public:
+    int first;
+    int second;
+};
+
+/// A broad phase for sphere collisions: bins spheres into the cells of a uniform grid they overlap, and then finds the
+/// pairs of spheres that could touch by looking only within each cell. Meant to be refilled every frame. Finding pairs
+/// takes roughly linear time as long as the cells are about the size of the spheres.
+class SpatialHash {
+public:
+    SpatialHash(float cellSize = 1.0f);
+
+    void setCellSize(float cellSize) { _cellSize = cellSize; }
+    float getCellSize() const { return _cellSize; }
+
+    /// Removes all of the spheres.
+    void clear();
+
+    /// Adds a sphere.
+    /// \return the index used for the sphere in pairs
+    int addSphere(const glm::vec3& center, float radius);
+
+    int getSphereCount() const { return _minimums.size(); }
+
+    /// Finds every pair of spheres whose bounding boxes overlap, each pair exactly once, in order of the cells they were
+    /// found in. Whether the spheres themselves touch is left to the caller.
+    /// \param pairs[out] the pairs found; any initial contents are lost
+    void findPairs(QVector<SpatialHashPair>& pairs);
+
+private:
+    class Entry {
+    public:
+        quint64 cell;
+        int sphere;
+
+        bool operator<(const Entry& other) const {
+            return cell < other.cell || (cell == other.cell && sphere < other.sphere);
+        }
+    };
+
+    glm::ivec3 getCell(const glm::vec3& point) const;
+    static quint64 getCellKey(const glm::ivec3& cell);
+
+    float _cellSize;
+    QVector<glm::vec3> _minimums;
+    QVector<glm::vec3> _maximums;
+    QVector<Entry> _entries;
+};
+
+#endif /* defined(__hifi__SpatialHash__) */
@@ -10,6 +10,7 @@
 #include <QtCore/QTimer>
 
 #include "Logging.h"
+#include "Metrics.h"
 #include "ThreadedAssignment.h"
 
 ThreadedAssignment::ThreadedAssignment(const QByteArray& packet) :
@@ -52,6 +53,10 @@ void ThreadedAssignment::commonInit(const QString& targetName, NodeType_t nodeTy
     QTimer* silentNodeRemovalTimer = new QTimer(this);
     connect(silentNodeRemovalTimer, SIGNAL(timeout()), nodeList, SLOT(removeSilentNodes()));
     silentNodeRemovalTimer->start(NODE_SILENCE_THRESHOLD_USECS / 1000);
+    
+    QTimer* metricsTimer = new QTimer(this);
+    connect(metricsTimer, SIGNAL(timeout()), this, SLOT(flushMetrics()));
+    metricsTimer->start(METRICS_FLUSH_INTERVAL_MSECS);
 }
 
 void ThreadedAssignment::checkInWithDomainServerOrExit() {
@@ -62,6 +67,10 @@ void ThreadedAssignment::checkInWithDomainServerOrExit() {
     }
 }
 
+void ThreadedAssignment::flushMetrics() {
+    MetricsRegistry::getInstance()->flush();
+}
+
 bool ThreadedAssignment::readAvailableDatagram(QByteArray& destinationByteArray, HifiSockAddr& senderSockAddr) {
     NodeList* nodeList = NodeList::getInstance();
     
@@ -30,6 +30,7 @@ protected:
     bool _isFinished;
 private slots:
     void checkInWithDomainServerOrExit();
+    void flushMetrics();
 signals:
     void finished();
 };
@@ -0,0 +1,189 @@
+//
+//  Tracing.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVector>
+
+#include "Tracing.h"
+
+/// The number of rings of exited threads to keep for the next dump.
+const int MAX_CLOSED_TRACE_RINGS = 16;
+
+/// One thread's recent events.
+class TraceRing {
+public:
+    int threadID;
+    QString threadName;
+    QAtomicInt written; ///< the number of events ever written, advanced by the owner after each one
+    QAtomicInt closed;
+    TraceEvent events[TRACE_RING_EVENTS];
+
+    TraceRing(int threadID, const QString& threadName) : threadID(threadID), threadName(threadName), written(0),
+        closed(0) { }
+};
+
+/// Closes a thread's ring when the thread exits, leaving its events for the next dump.
+class TraceRingHolder {
+public:
+
+    TraceRingHolder(TraceRing* ring) : ring(ring) { }
+    ~TraceRingHolder() { ring->closed.storeRelease(1); }
+
+    TraceRing* ring;
+};
+
+/// The rings of all threads that have recorded.
+class TraceRings {
+public:
+    QThreadStorage<TraceRingHolder*> holders;
+    QMutex mutex;
+    QList<TraceRing*> rings;
+    int nextThreadID;
+    quint64 enabledSince;
+
+    TraceRings() : nextThreadID(1), enabledSince(0) { }
+};
+
+static TraceRings* getTraceRings() {
+    static TraceRings* rings = new TraceRings();
+    return rings;
+}
+
+/// Removes the closed rings beyond the given number, oldest first.  Call with the mutex held.
+static void removeClosedRings(TraceRings* rings, int keep) {
+    int closedCount = 0;
+    for (int i = rings->rings.size() - 1; i >= 0; i--) {
+        TraceRing* ring = rings->rings.at(i);
+        if (ring->closed.loadAcquire() && ++closedCount > keep) {
+            delete ring;
+            rings->rings.removeAt(i);
+        }
+    }
+}
+
+static TraceRing* getRing() {
+    TraceRings* rings = getTraceRings();
+    if (!rings->holders.hasLocalData()) {
+        QMutexLocker locker(&rings->mutex);
+        removeClosedRings(rings, MAX_CLOSED_TRACE_RINGS - 1);
+        int threadID = rings->nextThreadID++;
+        QString threadName = QThread::currentThread()->objectName();
+        TraceRing* ring = new TraceRing(threadID,
+            threadName.isEmpty() ? QString("Thread %1").arg(threadID) : threadName);
+        rings->rings.append(ring);
+        rings->holders.setLocalData(new TraceRingHolder(ring));
+    }
+    return rings->holders.localData()->ring;
+}
+
+QAtomicInt Tracing::_enabled(0);
+
+void Tracing::setEnabled(bool enabled) {
+    TraceRings* rings = getTraceRings();
+    QMutexLocker locker(&rings->mutex);
+    if (enabled && !isEnabled()) {
+        removeClosedRings(rings, 0);
+        rings->enabledSince = usecTimestampNow();
+    }
+    _enabled.store(enabled ? 1 : 0);
+}
+
+void Tracing::record(const char* name, quint64 start, quint64 end) {
+    TraceRing* ring = getRing();
+    unsigned int index = (unsigned int)ring->written.load();
+    TraceEvent& event = ring->events[index & (TRACE_RING_EVENTS - 1)];
+    event.name = name;
+    event.start = start;
+    event.duration = (end > start) ? (quint32)(end - start) : 0;
+    ring->written.storeRelease((int)(index + 1));
+}
+
+/// Keeps the loads before it from moving past the loads after it.
+static inline void acquireFence() {
+#ifdef __GNUC__
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#else
+    // Qt has no standalone fence, but its ordered operations fence both sides
+    static QAtomicInt fence(0);
+    fence.fetchAndAddOrdered(0);
+#endif
+}
+
+/// Appends a string to JSON output, escaping it as necessary.
+static void appendJSONString(QByteArray& output, const char* string) {
+    output.append('"');
+    for (const char* character = string; *character; character++) {
+        if (*character == '"' || *character == '\\') {
+            output.append('\\');
+            output.append(*character);
+            
+        } else if ((unsigned char)*character < ' ') {
+            output.append("\\u00").append(QByteArray::number((unsigned char)*character, 16).rightJustified(2, '0'));
+            
+        } else {
+            output.append(*character);
+        }
+    }
+    output.append('"');
+}
+
+QByteArray Tracing::getTrace() {
+    TraceRings* rings = getTraceRings();
+    QMutexLocker locker(&rings->mutex);
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+
+    // the whole trace is one object holding an array of events: first the thread names, then the spans ("complete"
+    // events, with their start times and durations)
+    QByteArray trace("{\"traceEvents\":[");
+    bool first = true;
+    QVector<TraceEvent> events;
+    foreach (TraceRing* ring, rings->rings) {
+        QByteArray tid = QByteArray::number(ring->threadID);
+        if (!first) {
+            trace.append(',');
+        }
+        first = false;
+        trace.append("\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":").append(pid).append(",\"tid\":").append(tid);
+        trace.append(",\"args\":{\"name\":");
+        appendJSONString(trace, ring->threadName.toUtf8().constData());
+        trace.append("}}");
+
+        // copy out the events, then discard any that the owner overwrote in the meantime: after the owner has written
+        // event n, it may be partway through event n + 1, whose slot holds event n + 1 - TRACE_RING_EVENTS
+        unsigned int written = (unsigned int)ring->written.loadAcquire();
+        int count = qMin(written, (unsigned int)TRACE_RING_EVENTS);
+        events.resize(count);
+        for (int i = 0; i < count; i++) {
+            events[i] = ring->events[(written - count + i) & (TRACE_RING_EVENTS - 1)];
+        }
+        acquireFence();
+        unsigned int rewritten = (unsigned int)ring->written.load();
+        int torn = qBound(0, (int)(rewritten - written) + 1 - (TRACE_RING_EVENTS - count), count);
+
+        for (int i = torn; i < count; i++) {
+            const TraceEvent& event = events.at(i);
+            if (event.start < rings->enabledSince) {
+                continue;
+            }
+            trace.append(",\n{\"name\":");
+            appendJSONString(trace, event.name);
+            trace.append(",\"ph\":\"X\",\"ts\":").append(QByteArray::number(event.start));
+            trace.append(",\"dur\":").append(QByteArray::number(event.duration));
+            trace.append(",\"pid\":").append(pid).append(",\"tid\":").append(tid).append('}');
+        }
+    }
+    trace.append("\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    // the rings of exited threads have now been dumped
+    removeClosedRings(rings, 0);
+
+    return trace;
+}
@@ -0,0 +1,84 @@
+//
+//  Tracing.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__Tracing__
+#define __hifi__Tracing__
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+
+#include "SharedUtil.h"
+
+/// The number of events that each thread's ring holds (a power of two); once it's full, new events replace the oldest.
+const int TRACE_RING_EVENTS = 4096;
+
+/// A span of time on one thread.
+class TraceEvent {
+public:
+    const char* name; ///< a string literal, or otherwise never freed
+    quint64 start; ///< in usecs, as from usecTimestampNow()
+    quint32 duration; ///< in usecs
+};
+
+/// Records spans of time into per-thread rings while enabled, and dumps the recent ones as Chrome trace-event JSON (for
+/// chrome://tracing).  Recording takes no locks: each thread only ever writes its own ring, and the dump discards any
+/// events overwritten while it was reading.
+class Tracing {
+public:
+
+    static bool isEnabled() { return _enabled.load() != 0; }
+
+    /// Starts or stops recording.  Starting discards anything recorded before.
+    static void setEnabled(bool enabled);
+
+    /// Records a span on the current thread.  Callers check isEnabled() first, or use the macros below.
+    static void record(const char* name, quint64 start, quint64 end);
+
+    /// Returns the events still held in the rings of all threads (including those since exited), as trace-event JSON.
+    static QByteArray getTrace();
+
+private:
+
+    static QAtomicInt _enabled;
+};
+
+/// Records the span from its construction to its destruction, if tracing was enabled at the start.
+class ScopedTrace {
+public:
+
+    ScopedTrace(const char* name) :
+        _name(Tracing::isEnabled() ? name : NULL),
+        _start(_name ? usecTimestampNow() : 0) { }
+    ~ScopedTrace() {
+        if (_name) {
+            Tracing::record(_name, _start, usecTimestampNow());
+        }
+    }
+
+private:
+
+    const char* _name;
+    quint64 _start;
+};
+
+#define TRACE_CONCATENATE_INNER(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_INNER(a, b)
+
+// define NO_TRACING to compile the trace points out altogether
+#ifdef NO_TRACING
+#define TRACE_SCOPE(name)
+#define TRACE_SPAN(name, start, end)
+#else
+
+/// Traces the rest of the enclosing scope.
+#define TRACE_SCOPE(name) ScopedTrace TRACE_CONCATENATE(scopedTrace, __LINE__)(name)
+
+/// Traces a span whose times the caller has already taken.
+#define TRACE_SPAN(name, start, end) do { if (Tracing::isEnabled()) Tracing::record(name, start, end); } while (false)
+#endif
+
+#endif /* defined(__hifi__Tracing__) */
@@ -0,0 +1,350 @@
+//
+//  VoxelMesher.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  GL free generation of voxel geometry, split into chunks that are meshed in parallel.
+//
+
+#include <cmath>
+
+#include <QHash>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSet>
+#include <QThreadPool>
+#include <QtAlgorithms>
+
+#include "VoxelMesher.h"
+#include "VoxelTreeElement.h"
+
+const float VOXEL_MESH_IDENTITY_CORNERS[GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL] =
+    { 0,0,0, 1,0,0, 1,1,0, 0,1,0, 0,0,1, 1,0,1, 1,1,1, 0,1,1 };
+
+// the same faces, in the same order, as VoxelSystem's per face index buffers (top, bottom, left, right, front, back)
+static const quint32 IDENTITY_CORNER_INDICES[INDICES_PER_VOXEL] = {
+    2, 3, 7,  2, 7, 6,
+    0, 1, 5,  0, 5, 4,
+    0, 7, 3,  0, 4, 7,
+    1, 2, 6,  1, 6, 5,
+    0, 2, 1,  0, 3, 2,
+    4, 5, 6,  4, 6, 7 };
+
+/// Meshes one chunk on the global thread pool.
+class VoxelMeshTask : public QRunnable {
+public:
+
+    VoxelMeshTask(const VoxelMesher* mesher, VoxelTreeElement* root, VoxelMeshChunk* chunk, QSemaphore* finished) :
+        _mesher(mesher), _root(root), _chunk(chunk), _finished(finished) { }
+
+    virtual void run() {
+        _mesher->meshChunk(_root, *_chunk);
+        _finished->release();
+    }
+
+private:
+
+    const VoxelMesher* _mesher;
+    VoxelTreeElement* _root;
+    VoxelMeshChunk* _chunk;
+    QSemaphore* _finished;
+};
+
+VoxelMesher::VoxelMesher(const VoxelMeshParams& params) :
+    _params(params) {
+}
+
+void VoxelMesher::meshTree(VoxelTreeElement* root, QVector<VoxelMeshChunk>& chunks) const {
+    QVector<VoxelTreeElement*> chunkRoots;
+    collectChunkRoots(root, 0, chunkRoots);
+
+    chunks.clear();
+    chunks.resize(chunkRoots.size() + 1); // plus one for the spine above the chunk level
+
+    if (_params.threaded && chunkRoots.size() > 1) {
+        QSemaphore finished;
+        for (int i = 0; i < chunkRoots.size(); i++) {
+            QThreadPool::globalInstance()->start(new VoxelMeshTask(this, chunkRoots.at(i), &chunks[i], &finished));
+        }
+        finished.acquire(chunkRoots.size());
+    } else {
+        for (int i = 0; i < chunkRoots.size(); i++) {
+            meshChunk(chunkRoots.at(i), chunks[i]);
+        }
+    }
+
+    // the elements above the chunks depend on the results for their children, so they're done last
+    int nextChunk = 0;
+    meshSpine(root, 0, chunks, nextChunk);
+    if (_params.mergeFaces) {
+        mergeFaces(chunks.last());
+    }
+}
+
+bool VoxelMesher::meshSubtree(VoxelTreeElement* element, VoxelMeshChunk& chunk) const {
+    bool wasShouldRender = element->getShouldRender();
+    updateElement(element);
+
+    // let children figure out their renderness
+    if (!element->isLeaf()) {
+
+        // As we check our children, see if any of them went from shouldRender to NOT shouldRender
+        // then we probably dropped LOD and if we don't have color, we want to average our children
+        // for a new color.
+        int childrenGotHiddenCount = 0;
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            VoxelTreeElement* child = element->getChildAtIndex(i);
+            if (child && meshSubtree(child, chunk)) {
+                childrenGotHiddenCount++;
+            }
+        }
+        if (childrenGotHiddenCount > 0) {
+            element->calculateAverageFromChildren();
+        }
+    }
+    emitElement(element, chunk);
+    return wasShouldRender && !element->getShouldRender();
+}
+
+void VoxelMesher::appendCube(const glm::vec3& corner, float scale, const unsigned char* color, bool wantIndices,
+                             VoxelMeshChunk& chunk) {
+    int firstCorner = chunk.vertices.size() / 3;
+
+    chunk.vertices.resize(chunk.vertices.size() + GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL);
+    chunk.colors.resize(chunk.colors.size() + GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL);
+    float* verticesAt = chunk.vertices.end() - GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL;
+    unsigned char* colorsAt = chunk.colors.end() - GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL;
+    for (int j = 0; j < GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL; j++) {
+        verticesAt[j] = corner[j % 3] + VOXEL_MESH_IDENTITY_CORNERS[j] * scale;
+        colorsAt[j] = color[j % 3];
+    }
+
+    if (wantIndices) {
+        chunk.indices.resize(chunk.indices.size() + INDICES_PER_VOXEL);
+        quint32* indicesAt = chunk.indices.end() - INDICES_PER_VOXEL;
+        for (int j = 0; j < INDICES_PER_VOXEL; j++) {
+            indicesAt[j] = firstCorner + IDENTITY_CORNER_INDICES[j];
+        }
+    }
+}
+
+// cells deeper than this don't fit the packed keys below, so their faces are emitted without merging
+static const int MAX_MERGED_FACE_DEPTH = 19;
+static const int FACE_DIRECTIONS = 6;
+
+static quint64 cellKey(int depth, int x, int y, int z) {
+    return ((quint64)depth << 57) | ((quint64)x << 38) | ((quint64)y << 19) | (quint64)z;
+}
+
+static quint64 faceGroupKey(int direction, int depth, int plane, const unsigned char* color) {
+    return ((quint64)direction << 49) | ((quint64)depth << 44) | ((quint64)plane << 24) |
+        ((quint64)color[0] << 16) | ((quint64)color[1] << 8) | (quint64)color[2];
+}
+
+// packed so that sorting orders faces by v, then u
+static quint64 facePositionKey(int u, int v) {
+    return ((quint64)v << 32) | (quint64)u;
+}
+
+/// Appends one face on the plane at the given position along the direction's axis, spanning [u0, u1] and [v0, v1] on the
+/// other two axes. Directions are +x, -x, +y, -y, +z, -z.
+static void appendFace(int direction, float plane, float u0, float v0, float u1, float v1, const unsigned char* color,
+                       VoxelMeshChunk& chunk) {
+    const signed char MAX_NORMAL_COMPONENT = 127;
+    int axis = direction / 2;
+    bool positive = (direction % 2 == 0);
+    int uAxis = (axis + 1) % 3;
+    int vAxis = (axis + 2) % 3;
+
+    // u cross v points along the positive axis, so the corners run counter clockwise when seen from that side
+    float corners[VoxelMeshChunk::VERTICES_PER_FACE][2] = { { u0, v0 }, { u1, v0 }, { u1, v1 }, { u0, v1 } };
+    quint32 firstVertex = chunk.faceVertices.size() / 3;
+    for (int i = 0; i < VoxelMeshChunk::VERTICES_PER_FACE; i++) {
+        const float* corner = corners[positive ? i : (VoxelMeshChunk::VERTICES_PER_FACE - 1 - i)];
+        float vertex[3];
+        vertex[axis] = plane;
+        vertex[uAxis] = corner[0];
+        vertex[vAxis] = corner[1];
+        for (int j = 0; j < 3; j++) {
+            chunk.faceVertices.append(vertex[j]);
+            chunk.faceColors.append(color[j]);
+            chunk.faceNormals.append(j == axis ? (positive ? MAX_NORMAL_COMPONENT : -MAX_NORMAL_COMPONENT) : 0);
+        }
+    }
+    const quint32 QUAD_INDICES[VoxelMeshChunk::INDICES_PER_MERGED_FACE] = { 0, 1, 2, 0, 2, 3 };
+    for (int i = 0; i < VoxelMeshChunk::INDICES_PER_MERGED_FACE; i++) {
+        chunk.faceIndices.append(firstVertex + QUAD_INDICES[i]);
+    }
+}
+
+void VoxelMesher::mergeFaces(VoxelMeshChunk& chunk) {
+    // element scales are exact powers of two, so each cell sits on the integer grid of its depth
+    QVector<int> depths(chunk.cells.size());
+    QVector<int> positions(chunk.cells.size() * 3);
+    QSet<quint64> occupied;
+    occupied.reserve(chunk.cells.size());
+    for (int i = 0; i < chunk.cells.size(); i++) {
+        const VoxelMeshCell& cell = chunk.cells.at(i);
+        int exponent;
+        frexpf(cell.scale, &exponent);
+        depths[i] = 1 - exponent;
+        for (int j = 0; j < 3; j++) {
+            positions[i * 3 + j] = (int)floorf(cell.corner[j] / cell.scale + 0.5f);
+        }
+        if (depths[i] <= MAX_MERGED_FACE_DEPTH) {
+            occupied.insert(cellKey(depths[i], positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]));
+        }
+    }
+
+    // gather the exposed faces into groups that can merge with each other
+    QHash<quint64, QVector<quint64> > groups;
+    for (int i = 0; i < chunk.cells.size(); i++) {
+        const VoxelMeshCell& cell = chunk.cells.at(i);
+        if (depths[i] > MAX_MERGED_FACE_DEPTH) {
+            for (int direction = 0; direction < FACE_DIRECTIONS; direction++) {
+                int axis = direction / 2;
+                const glm::vec3& corner = cell.corner;
+                float plane = corner[axis] + ((direction % 2 == 0) ? cell.scale : 0.0f);
+                float u0 = corner[(axis + 1) % 3];
+                float v0 = corner[(axis + 2) % 3];
+                appendFace(direction, plane, u0, v0, u0 + cell.scale, v0 + cell.scale, cell.color, chunk);
+                chunk.facesBeforeMerging++;
+            }
+            continue;
+        }
+        int gridSize = 1 << depths[i];
+        const int* position = positions.constData() + i * 3;
+        for (int direction = 0; direction < FACE_DIRECTIONS; direction++) {
+            int axis = direction / 2;
+            int step = (direction % 2 == 0) ? 1 : -1;
+            int neighbor[3] = { position[0], position[1], position[2] };
+            neighbor[axis] += step;
+            if (neighbor[axis] >= 0 && neighbor[axis] < gridSize &&
+                    occupied.contains(cellKey(depths[i], neighbor[0], neighbor[1], neighbor[2]))) {
+                continue; // hidden by a neighbor of the same size
+            }
+            int plane = position[axis] + (step > 0 ? 1 : 0);
+            groups[faceGroupKey(direction, depths[i], plane, cell.color)].append(
+                facePositionKey(position[(axis + 1) % 3], position[(axis + 2) % 3]));
+            chunk.facesBeforeMerging++;
+        }
+    }
+
+    // within each group, grow each face as far as it will go along u, then along v
+    for (QHash<quint64, QVector<quint64> >::iterator group = groups.begin(); group != groups.end(); group++) {
+        QVector<quint64>& faces = group.value();
+        qSort(faces);
+        QSet<quint64> remaining;
+        remaining.reserve(faces.size());
+        foreach (quint64 face, faces) {
+            remaining.insert(face);
+        }
+
+        quint64 key = group.key();
+        int direction = (int)(key >> 49);
+        int depth = (int)((key >> 44) & 0x1F);
+        int plane = (int)((key >> 24) & 0xFFFFF);
+        unsigned char color[3] = { (unsigned char)(key >> 16), (unsigned char)(key >> 8), (unsigned char)key };
+        float scale = ldexpf(1.0f, -depth);
+
+        foreach (quint64 face, faces) {
+            if (!remaining.contains(face)) {
+                continue;
+            }
+            int u = (int)(face & 0xFFFFFFFF);
+            int v = (int)(face >> 32);
+            int width = 1;
+            while (remaining.contains(facePositionKey(u + width, v))) {
+                width++;
+            }
+            int height = 1;
+            for (bool rowIsFree = true; rowIsFree; ) {
+                for (int i = 0; i < width && rowIsFree; i++) {
+                    rowIsFree = remaining.contains(facePositionKey(u + i, v + height));
+                }
+                if (rowIsFree) {
+                    height++;
+                }
+            }
+            for (int j = 0; j < height; j++) {
+                for (int i = 0; i < width; i++) {
+                    remaining.remove(facePositionKey(u + i, v + j));
+                }
+            }
+            appendFace(direction, plane * scale, u * scale, v * scale, (u + width) * scale, (v + height) * scale,
+                       color, chunk);
+        }
+    }
+    chunk.cellsMerged += chunk.cells.size();
+    chunk.cells.clear();
+}
+
+void VoxelMesher::meshChunk(VoxelTreeElement* root, VoxelMeshChunk& chunk) const {
+    chunk.rootGotHidden = meshSubtree(root, chunk);
+    if (_params.mergeFaces) {
+        mergeFaces(chunk);
+    }
+}
+
+void VoxelMesher::collectChunkRoots(VoxelTreeElement* element, int depth, QVector<VoxelTreeElement*>& chunkRoots) const {
+    if (depth == _params.chunkLevel) {
+        chunkRoots.append(element);
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        VoxelTreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            collectChunkRoots(child, depth + 1, chunkRoots);
+        }
+    }
+}
+
+bool VoxelMesher::meshSpine(VoxelTreeElement* element, int depth, QVector<VoxelMeshChunk>& chunks, int& nextChunk) const {
+    // chunk roots are visited in the same order that collectChunkRoots() found them
+    if (depth == _params.chunkLevel) {
+        return chunks[nextChunk++].rootGotHidden;
+    }
+    bool wasShouldRender = element->getShouldRender();
+    updateElement(element);
+
+    int childrenGotHiddenCount = 0;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        VoxelTreeElement* child = element->getChildAtIndex(i);
+        if (child && meshSpine(child, depth + 1, chunks, nextChunk)) {
+            childrenGotHiddenCount++;
+        }
+    }
+    if (childrenGotHiddenCount > 0) {
+        element->calculateAverageFromChildren();
+    }
+    emitElement(element, chunks.last());
+    return wasShouldRender && !element->getShouldRender();
+}
+
+bool VoxelMesher::updateElement(VoxelTreeElement* element) const {
+    bool shouldRender = _params.viewFrustum &&
+        element->calculateShouldRender(_params.viewFrustum, _params.voxelSizeScale, _params.boundaryLevelAdjust);
+    element->setShouldRender(shouldRender);
+    return shouldRender;
+}
+
+void VoxelMesher::emitElement(VoxelTreeElement* element, VoxelMeshChunk& chunk) const {
+    chunk.elementsVisited++;
+    if (_params.mergeFaces) {
+        // merged faces span many elements, so every rendered element is collected whether or not it changed
+        if (element->getShouldRender()) {
+            VoxelMeshCell cell = { element->getCorner(), element->getScale(),
+                { element->getColor()[0], element->getColor()[1], element->getColor()[2] } };
+            chunk.cells.append(cell);
+        }
+    } else if (_params.forceDraw || element->isDirty()) {
+        VoxelMeshEntry entry = { element, VoxelMeshEntry::NOT_RENDERED };
+        if (element->getShouldRender()) {
+            entry.vertexOffset = chunk.vertices.size();
+            appendCube(element->getCorner(), element->getScale(), element->getColor(), _params.wantIndices, chunk);
+        }
+        chunk.entries.append(entry);
+    }
+    element->clearDirtyBit(); // clear the dirty bit, do this before we potentially delete things.
+}
@@ -0,0 +1,134 @@
+//
+//  VoxelMesher.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  GL free generation of voxel geometry, split into chunks that are meshed in parallel. Geometry is either one cube per
+//  rendered element, or (with VoxelMeshParams::mergeFaces) quads made by merging coplanar, same colored faces.
+//
+
+#ifndef __hifi__VoxelMesher__
+#define __hifi__VoxelMesher__
+
+#include <QVector>
+
+#include <glm/glm.hpp>
+
+#include "VoxelConstants.h"
+
+class ViewFrustum;
+class VoxelTreeElement;
+
+/// Identity corners of a unit cube, three coordinates per corner, in the order used by VoxelMeshChunk::vertices.
+extern const float VOXEL_MESH_IDENTITY_CORNERS[GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL];
+
+/// Parameters for a meshing pass.
+class VoxelMeshParams {
+public:
+    VoxelMeshParams(const ViewFrustum* viewFrustum = NULL, float voxelSizeScale = DEFAULT_OCTREE_SIZE_SCALE,
+                    int boundaryLevelAdjust = 0) :
+        viewFrustum(viewFrustum),
+        voxelSizeScale(voxelSizeScale),
+        boundaryLevelAdjust(boundaryLevelAdjust),
+        forceDraw(true),
+        wantIndices(false),
+        threaded(true),
+        mergeFaces(false),
+        chunkLevel(DEFAULT_CHUNK_LEVEL) { }
+
+    static const int DEFAULT_CHUNK_LEVEL = 2; ///< up to 64 chunks below the starting element
+
+    const ViewFrustum* viewFrustum;
+    float voxelSizeScale;
+    int boundaryLevelAdjust;
+    bool forceDraw;     ///< emit every element, not just those that are dirty
+    bool wantIndices;   ///< also emit a triangle index buffer, the VoxelSystem uses its own shared face indices instead
+    bool threaded;      ///< mesh chunks on the global thread pool
+    bool mergeFaces;    ///< emit merged faces instead of cubes, see VoxelMeshChunk::faceVertices
+    int chunkLevel;     ///< depth below the starting element at which the tree is split into chunks
+};
+
+/// An element whose geometry changed during meshing.
+class VoxelMeshEntry {
+public:
+    static const int NOT_RENDERED = -1;
+
+    VoxelTreeElement* element;
+    int vertexOffset; ///< offset of the element's first vertex coordinate in the chunk, or NOT_RENDERED
+};
+
+/// A rendered element waiting to have its faces merged.
+class VoxelMeshCell {
+public:
+    glm::vec3 corner;
+    float scale;
+    unsigned char color[3];
+};
+
+/// Packed geometry for one chunk of a voxel tree.
+class VoxelMeshChunk {
+public:
+    static const int VERTICES_PER_FACE = 4;
+    static const int COORDINATES_PER_FACE = VERTICES_PER_FACE * 3;
+    static const int INDICES_PER_MERGED_FACE = 6;
+
+    VoxelMeshChunk() : elementsVisited(0), rootGotHidden(false), cellsMerged(0), facesBeforeMerging(0) { }
+
+    QVector<VoxelMeshEntry> entries;
+    QVector<float> vertices;            ///< GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL coordinates per rendered element
+    QVector<unsigned char> colors;      ///< one RGB triplet per vertex
+    QVector<quint32> indices;           ///< chunk relative triangle indices, if VoxelMeshParams::wantIndices
+    int elementsVisited;
+    bool rootGotHidden;                 ///< whether the chunk's root went from should render to not
+
+    // merged faces, if VoxelMeshParams::mergeFaces; there are no entries in this mode
+    QVector<VoxelMeshCell> cells;       ///< rendered elements, cleared once their faces are merged
+    QVector<float> faceVertices;        ///< COORDINATES_PER_FACE coordinates per merged face, wound counter clockwise
+    QVector<unsigned char> faceColors;  ///< one RGB triplet per face vertex
+    QVector<signed char> faceNormals;   ///< one normal per face vertex
+    QVector<quint32> faceIndices;       ///< chunk relative triangle indices, INDICES_PER_MERGED_FACE per merged face
+    int cellsMerged;                    ///< rendered elements whose faces were merged
+    int facesBeforeMerging;             ///< exposed element faces that went into the merged faces
+
+    int getRenderedCount() const { return vertices.size() / GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL; }
+    int getMergedFaceCount() const { return faceVertices.size() / COORDINATES_PER_FACE; }
+};
+
+/// Generates vertex, color and index buffers for a voxel tree without touching GL. Meshing updates the elements' should
+/// render and dirty state the same way VoxelSystem always has, from the thread pool if VoxelMeshParams::threaded, so the
+/// caller must hold the tree's write lock for the whole pass, and update hooks must ignore the changes made by meshing.
+class VoxelMesher {
+public:
+    VoxelMesher(const VoxelMeshParams& params);
+
+    /// Meshes the subtree below (and including) root. The returned chunks together hold every emitted element; the last
+    /// chunk holds the elements above the chunk level.
+    void meshTree(VoxelTreeElement* root, QVector<VoxelMeshChunk>& chunks) const;
+
+    /// Meshes one subtree serially into chunk. If merging faces, the chunk's cells must then be passed to mergeFaces().
+    /// \return true if element went from should render to not
+    bool meshSubtree(VoxelTreeElement* element, VoxelMeshChunk& chunk) const;
+
+    /// Greedily merges the exposed faces of the chunk's cells into as few quads as it can, then clears the cells. Faces
+    /// are only merged with coplanar faces of the same color and size, and only faces shared by two cells of the same
+    /// size in the same chunk are dropped as hidden.
+    static void mergeFaces(VoxelMeshChunk& chunk);
+
+    /// Appends the eight corners, colors and (optionally) indices of a cube to chunk.
+    static void appendCube(const glm::vec3& corner, float scale, const unsigned char* color, bool wantIndices,
+                           VoxelMeshChunk& chunk);
+
+private:
+    friend class VoxelMeshTask;
+
+    void collectChunkRoots(VoxelTreeElement* element, int depth, QVector<VoxelTreeElement*>& chunkRoots) const;
+    bool meshSpine(VoxelTreeElement* element, int depth, QVector<VoxelMeshChunk>& chunks, int& nextChunk) const;
+    bool updateElement(VoxelTreeElement* element) const;
+    void emitElement(VoxelTreeElement* element, VoxelMeshChunk& chunk) const;
+    void meshChunk(VoxelTreeElement* root, VoxelMeshChunk& chunk) const;
+
+    VoxelMeshParams _params;
+};
+
+#endif /* defined(__hifi__VoxelMesher__) */
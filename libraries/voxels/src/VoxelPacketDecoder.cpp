@@ -0,0 +1,155 @@
+//
+//  VoxelPacketDecoder.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lock-free decoding of inbound voxel data packets into edits that can be applied to a VoxelTree in one batch.
+//
+
+#include <cstring>
+
+#include <OctalCode.h>
+#include <Octree.h>
+#include <PacketHeaders.h>
+#include <SharedUtil.h>
+
+#include "VoxelPacketDecoder.h"
+
+bool VoxelPacketDecoder::decodePacket(const QByteArray& packet, const QUuid& sourceUUID, DecodedVoxelPacket& result) {
+    if (packetTypeForPacket(packet) != PacketTypeVoxelData) {
+        return false;
+    }
+    int numBytesPacketHeader = numBytesForPacketHeader(packet);
+    if (packet.size() < (int)(numBytesPacketHeader + OCTREE_PACKET_EXTRA_HEADERS_SIZE)) {
+        result.isMalformed = true;
+        return true;
+    }
+    result.sourceUUID = sourceUUID;
+
+    const unsigned char* dataAt = reinterpret_cast<const unsigned char*>(packet.data()) + numBytesPacketHeader;
+
+    OCTREE_PACKET_FLAGS flags = (*(OCTREE_PACKET_FLAGS*)(dataAt));
+    dataAt += sizeof(OCTREE_PACKET_FLAGS);
+    result.sequence = (*(OCTREE_PACKET_SEQUENCE*)dataAt);
+    dataAt += sizeof(OCTREE_PACKET_SEQUENCE);
+    result.sentTime = (*(OCTREE_PACKET_SENT_TIME*)dataAt);
+    dataAt += sizeof(OCTREE_PACKET_SENT_TIME);
+
+    result.isColored = oneAtBit(flags, PACKET_IS_COLOR_BIT);
+    bool packetIsCompressed = oneAtBit(flags, PACKET_IS_COMPRESSED_BIT);
+
+    OCTREE_PACKET_INTERNAL_SECTION_SIZE sectionLength = 0;
+    unsigned int dataBytes = packet.size() - (numBytesPacketHeader + OCTREE_PACKET_EXTRA_HEADERS_SIZE);
+
+    OctreePacketData packetData(packetIsCompressed);
+    while (dataBytes > 0) {
+        if (packetIsCompressed) {
+            if (dataBytes > sizeof(OCTREE_PACKET_INTERNAL_SECTION_SIZE)) {
+                sectionLength = (*(OCTREE_PACKET_INTERNAL_SECTION_SIZE*)dataAt);
+                dataAt += sizeof(OCTREE_PACKET_INTERNAL_SECTION_SIZE);
+                dataBytes -= sizeof(OCTREE_PACKET_INTERNAL_SECTION_SIZE);
+            } else {
+                break; // something is wrong, stop looping
+            }
+        } else {
+            sectionLength = dataBytes;
+        }
+        if (sectionLength == 0 || sectionLength > dataBytes) {
+            result.isMalformed = true;
+            break;
+        }
+
+        packetData.loadFinalizedContent(dataAt, sectionLength);
+        decodeSection(packetData.getUncompressedData(), packetData.getUncompressedSize(),
+                      result.isColored, WANT_EXISTS_BITS, result);
+        result.sections++;
+        result.compressedBytes += sectionLength;
+        result.uncompressedBytes += packetData.getUncompressedSize();
+
+        dataBytes -= sectionLength;
+        dataAt += sectionLength;
+    }
+    return true;
+}
+
+void VoxelPacketDecoder::decodeSection(const unsigned char* bitstream, int bufferSizeBytes, bool includeColor,
+                                       bool includeExistsBits, DecodedVoxelPacket& result) {
+    const unsigned char* bitstreamAt = bitstream;
+    const unsigned char* bitstreamEnd = bitstream + bufferSizeBytes;
+
+    // as in Octree::readBitstreamToTree(), each section may pack multiple root relative octal codes
+    while (bitstreamAt < bitstreamEnd) {
+        int octalCodeBytes = bytesRequiredForCodeLength(*bitstreamAt);
+        if (bitstreamAt + octalCodeBytes > bitstreamEnd) {
+            result.isMalformed = true;
+            return;
+        }
+        VoxelElementEdit edit = { VoxelElementEdit::SelectRoot, 0, 0, 0, { 0, 0, 0 }, result.octalCodes.size() };
+        result.edits.append(edit);
+        result.octalCodes.append(reinterpret_cast<const char*>(bitstreamAt), octalCodeBytes);
+
+        bitstreamAt += octalCodeBytes;
+        bitstreamAt += decodeElement(bitstreamAt, bitstreamEnd - bitstreamAt, includeColor, includeExistsBits, result);
+    }
+}
+
+int VoxelPacketDecoder::decodeElement(const unsigned char* elementData, int bytesLeftToRead, bool includeColor,
+                                      bool includeExistsBits, DecodedVoxelPacket& result) {
+    const int BYTES_PER_COLOR = 3;
+    const unsigned char ALL_CHILDREN_ASSUMED_TO_EXIST = 0xFF;
+    const unsigned char DEFAULT_COLOR_COMPONENT = 128;
+
+    // every element we enter is left again, even if the data turns out to be truncated, so that the edits stay balanced
+    VoxelElementEdit leave = { VoxelElementEdit::LeaveElement, 0, 0, 0, { 0, 0, 0 }, 0 };
+    if (bytesLeftToRead < 1) {
+        result.isMalformed = true;
+        result.edits.append(leave);
+        return bytesLeftToRead;
+    }
+
+    unsigned char colorInPacketMask = *elementData;
+    int bytesRead = sizeof(colorInPacketMask);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (oneAtBit(colorInPacketMask, i)) {
+            if (bytesRead + BYTES_PER_COLOR > bytesLeftToRead) {
+                result.isMalformed = true;
+                result.edits.append(leave);
+                return bytesLeftToRead;
+            }
+            VoxelElementEdit edit = { VoxelElementEdit::ColorChild, (unsigned char)i, 0, 0,
+                { DEFAULT_COLOR_COMPONENT, DEFAULT_COLOR_COMPONENT, DEFAULT_COLOR_COMPONENT }, 0 };
+            if (includeColor) {
+                memcpy(edit.color, elementData + bytesRead, BYTES_PER_COLOR);
+            }
+            result.edits.append(edit);
+
+            // VoxelTreeElement::readElementDataFromBuffer() consumes the color bytes whether or not color is included
+            bytesRead += BYTES_PER_COLOR;
+        }
+    }
+
+    int maskBytes = includeExistsBits ? 2 * sizeof(unsigned char) : sizeof(unsigned char);
+    if (bytesRead + maskBytes > bytesLeftToRead) {
+        result.isMalformed = true;
+        result.edits.append(leave);
+        return bytesLeftToRead;
+    }
+    unsigned char childrenInTreeMask = includeExistsBits ? elementData[bytesRead] : ALL_CHILDREN_ASSUMED_TO_EXIST;
+    unsigned char childMask = elementData[bytesRead + (includeExistsBits ? sizeof(childrenInTreeMask) : 0)];
+    bytesRead += maskBytes;
+
+    for (int childIndex = 0; bytesLeftToRead - bytesRead > 0 && childIndex < NUMBER_OF_CHILDREN; childIndex++) {
+        if (oneAtBit(childMask, childIndex)) {
+            VoxelElementEdit edit = { VoxelElementEdit::EnterChild, (unsigned char)childIndex, 0, 0, { 0, 0, 0 }, 0 };
+            result.edits.append(edit);
+            bytesRead += decodeElement(elementData + bytesRead, bytesLeftToRead - bytesRead,
+                                       includeColor, includeExistsBits, result);
+        }
+    }
+
+    leave.existsMask = childrenInTreeMask;
+    leave.hasExistsMask = includeExistsBits;
+    result.edits.append(leave);
+    return bytesRead;
+}
@@ -0,0 +1,72 @@
+//
+//  VoxelPacketDecoder.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lock-free decoding of inbound voxel data packets into edits that can be applied to a VoxelTree in one batch.
+//
+
+#ifndef __hifi__VoxelPacketDecoder__
+#define __hifi__VoxelPacketDecoder__
+
+#include <QByteArray>
+#include <QUuid>
+#include <QVector>
+
+#include <OctreePacketData.h>
+
+/// A single pre-parsed step of a voxel data section. The steps of a section replay the same walk that
+/// Octree::readBitstreamToTree() would make, but carry no pointers into the tree so they can be produced without its lock.
+class VoxelElementEdit {
+public:
+    enum Type {
+        SelectRoot,     ///< push the element for the octal code at octalCodeOffset, creating it if needed
+        ColorChild,     ///< set the color of child childIndex of the current element, creating it if needed
+        EnterChild,     ///< push child childIndex of the current element, creating it if needed
+        LeaveElement    ///< pop the current element, first pruning the children missing from existsMask if hasExistsMask
+    };
+
+    unsigned char type;
+    unsigned char childIndex;
+    unsigned char existsMask;
+    unsigned char hasExistsMask;
+    unsigned char color[3];
+    int octalCodeOffset;
+};
+
+/// The decoded form of one PacketTypeVoxelData packet.
+class DecodedVoxelPacket {
+public:
+    DecodedVoxelPacket() : sequence(0), sentTime(0), sections(0), compressedBytes(0), uncompressedBytes(0),
+        isColored(false), isMalformed(false) { }
+
+    QUuid sourceUUID;
+    OCTREE_PACKET_SEQUENCE sequence;
+    OCTREE_PACKET_SENT_TIME sentTime;
+    QByteArray octalCodes;              ///< storage for the root octal codes referenced by SelectRoot edits
+    QVector<VoxelElementEdit> edits;
+    int sections;
+    int compressedBytes;
+    int uncompressedBytes;
+    bool isColored;
+    bool isMalformed;                   ///< a section was truncated; edits up to the truncation are still valid
+};
+
+/// Decompresses and parses voxel data packets. Touches no shared state, so many packets can be decoded at once.
+class VoxelPacketDecoder {
+public:
+    /// Decodes a full PacketTypeVoxelData packet, including its packet header.
+    /// \return false if the packet was not voxel data
+    static bool decodePacket(const QByteArray& packet, const QUuid& sourceUUID, DecodedVoxelPacket& result);
+
+    /// Decodes one uncompressed section (a sequence of root relative octal codes and their subtrees) into result.
+    static void decodeSection(const unsigned char* bitstream, int bufferSizeBytes, bool includeColor,
+                              bool includeExistsBits, DecodedVoxelPacket& result);
+
+private:
+    static int decodeElement(const unsigned char* elementData, int bytesLeftToRead, bool includeColor,
+                             bool includeExistsBits, DecodedVoxelPacket& result);
+};
+
+#endif /* defined(__hifi__VoxelPacketDecoder__) */
@@ -11,6 +11,7 @@
 #include <QtCore/QDebug>
 #include <QImage>
 #include <QRgb>
+#include <QVarLengthArray>
 
 
 #include "VoxelTree.h"
@@ -491,6 +492,78 @@ void VoxelTree::readCodeColorBufferToTreeRecursion(VoxelTreeElement* node, ReadC
     }
 }
 
+void VoxelTree::applyDecodedPacket(const DecodedVoxelPacket& packet) {
+    // mirrors Octree::readNodeData(), see VoxelPacketDecoder::decodeElement() for how the edits are produced
+    const int EXPECTED_MAXIMUM_DEPTH = 32;
+    QVarLengthArray<VoxelTreeElement*, EXPECTED_MAXIMUM_DEPTH> elementStack;
+    const unsigned char* octalCodes = reinterpret_cast<const unsigned char*>(packet.octalCodes.constData());
+
+    foreach (const VoxelElementEdit& edit, packet.edits) {
+        switch (edit.type) {
+            case VoxelElementEdit::SelectRoot: {
+                const unsigned char* octalCode = octalCodes + edit.octalCodeOffset;
+                OctreeElement* rootElement = nodeForOctalCode(_rootNode, octalCode, NULL);
+                if (*octalCode != *rootElement->getOctalCode()) {
+                    rootElement = createMissingNode(_rootNode, octalCode);
+                    if (rootElement->isDirty()) {
+                        _isDirty = true;
+                    }
+                }
+                elementStack.append(static_cast<VoxelTreeElement*>(rootElement));
+                break;
+            }
+            case VoxelElementEdit::ColorChild: {
+                VoxelTreeElement* element = elementStack.last();
+                VoxelTreeElement* child = element->getChildAtIndex(edit.childIndex);
+                if (!child) {
+                    child = element->addChildAtIndex(edit.childIndex);
+                    if (element->isDirty()) {
+                        _isDirty = true;
+                    }
+                }
+                nodeColor newColor = { edit.color[0], edit.color[1], edit.color[2], 1 };
+                child->setColor(newColor);
+                child->setSourceUUID(packet.sourceUUID);
+
+                // we may already have had this element with the same color, but not rendered it, so force it dirty
+                if (!child->isDirty() && child->getShouldRender() && !child->isRendered()) {
+                    child->setDirtyBit();
+                }
+                if (child->isDirty()) {
+                    _isDirty = true;
+                }
+                break;
+            }
+            case VoxelElementEdit::EnterChild: {
+                VoxelTreeElement* element = elementStack.last();
+                VoxelTreeElement* child = element->getChildAtIndex(edit.childIndex);
+                if (!child) {
+                    child = element->addChildAtIndex(edit.childIndex);
+                    if (element->isDirty()) {
+                        _isDirty = true;
+                    }
+                }
+                elementStack.append(child);
+                break;
+            }
+            case VoxelElementEdit::LeaveElement: {
+                VoxelTreeElement* element = elementStack.last();
+                elementStack.removeLast();
+                if (edit.hasExistsMask) {
+                    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+                        // children missing from the exists mask shouldn't be in the tree at all
+                        if (!oneAtBit(edit.existsMask, i) && element->getChildAtIndex(i)) {
+                            element->safeDeepDeleteChildAtIndex(i);
+                            _isDirty = true;
+                        }
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
 bool VoxelTree::handlesEditPacketType(PacketType packetType) const {
     // we handle these types of "edit" packets
     switch (packetType) {
@@ -13,6 +13,7 @@
 
 #include "VoxelTreeElement.h"
 #include "VoxelEditPacketSender.h"
+#include "VoxelPacketDecoder.h"
 
 class ReadCodeColorBufferToTreeArgs;
 
@@ -40,6 +41,10 @@ public:
 
     void readCodeColorBufferToTree(const unsigned char* codeColorBuffer, bool destructive = false);
 
+    /// Applies edits produced by VoxelPacketDecoder, with the same effect as readBitstreamToTree() on the original packet.
+    /// Caller must hold the write lock.
+    void applyDecodedPacket(const DecodedVoxelPacket& packet);
+
     virtual PacketType expectedDataPacketType() const { return PacketTypeVoxelData; }
     virtual bool handlesEditPacketType(PacketType packetType) const;
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
@@ -6,10 +6,17 @@
 //  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
 //
 
+#include <cfloat>
 #include <stdlib.h>
 
+#include <QDataStream>
+#include <QScriptEngine>
+
 #include <SharedUtil.h>
 
+#include <AttributeRegistry.h>
+#include <MetavoxelData.h>
+#include <MetavoxelDelta.h>
 #include <MetavoxelMessages.h>
 
 #include "MetavoxelTests.h"
@@ -34,6 +41,16 @@ static int streamedBytesReceived = 0;
 static int sharedObjectsCreated = 0;
 static int sharedObjectsDestroyed = 0;
 
+static bool testBitstreamEncoding();
+static bool testDeltaStreaming();
+static bool testDeltaBudget();
+static bool testDeltaCopies();
+static bool testGuideThroughput();
+static bool testSpannerIndex();
+static bool testEditBatching();
+static bool testCongestionControl();
+static bool testPausedServer();
+
 bool MetavoxelTests::run() {
     
     qDebug() << "Running metavoxel tests...";
@@ -63,6 +80,12 @@ bool MetavoxelTests::run() {
     qDebug() << "Sent" << datagramsSent << "datagrams, received" << datagramsReceived;
     qDebug() << "Created" << sharedObjectsCreated << "shared objects, destroyed" << sharedObjectsDestroyed;
     
+    if (testBitstreamEncoding() || testDeltaStreaming() || testDeltaBudget() || testDeltaCopies() ||
+            testGuideThroughput() || testSpannerIndex() ||
+            testEditBatching() || testCongestionControl() || testPausedServer()) {
+        return true;
+    }
+    
     qDebug() << "All tests passed!";
     
     return false;
@@ -91,6 +114,940 @@ static SharedObjectPointer createRandomSharedObject() {
     }
 }
 
+/// Writes bits a byte at a time, the way Bitstream always has; the reference for its encoding.
+class ReferenceBitWriter {
+public:
+    
+    ReferenceBitWriter() : _byte(0), _position(0) { }
+    
+    void write(const void* data, int bits, int offset);
+    void flush();
+    
+    const QByteArray& getBytes() const { return _bytes; }
+
+private:
+    
+    QByteArray _bytes;
+    quint8 _byte;
+    int _position;
+};
+
+void ReferenceBitWriter::write(const void* data, int bits, int offset) {
+    const quint8* source = (const quint8*)data;
+    while (bits > 0) {
+        int bitsToWrite = qMin(BITS_IN_BYTE - _position, qMin(BITS_IN_BYTE - offset, bits));
+        _byte |= ((*source >> offset) & ((1 << bitsToWrite) - 1)) << _position;
+        if ((_position += bitsToWrite) == BITS_IN_BYTE) {
+            flush();
+        }
+        if ((offset += bitsToWrite) == BITS_IN_BYTE) {
+            source++;
+            offset = 0;
+        }
+        bits -= bitsToWrite;
+    }
+}
+
+void ReferenceBitWriter::flush() {
+    if (_position != 0) {
+        _bytes.append((char)_byte);
+        _byte = 0;
+        _position = 0;
+    }
+}
+
+/// A value written to a bitstream: a run of bits starting at an offset into some bytes.
+class BitRun {
+public:
+    QByteArray bytes;
+    int bits;
+    int offset;
+};
+
+static bool testBitstreamEncoding() {
+    const int TRIALS = 1000;
+    const int MAX_RUNS = 64;
+    for (int trial = 0; trial < TRIALS; trial++) {
+        // a random mix of single bits, ints, short unaligned runs and long aligned ones
+        QVector<BitRun> runs(randIntInRange(1, MAX_RUNS));
+        for (int i = 0; i < runs.size(); i++) {
+            BitRun& run = runs[i];
+            switch (randIntInRange(0, 3)) {
+                case 0:
+                    run.bits = 1;
+                    run.offset = 0;
+                    break;
+                case 1:
+                    run.bits = 32;
+                    run.offset = 0;
+                    break;
+                case 2:
+                    run.bits = randIntInRange(1, 100);
+                    run.offset = randIntInRange(0, BITS_IN_BYTE - 1);
+                    break;
+                case 3:
+                default:
+                    run.bits = randIntInRange(1, 4000);
+                    run.offset = 0;
+                    break;
+            }
+            int size = (run.offset + run.bits + BITS_IN_BYTE - 1) / BITS_IN_BYTE;
+            run.bytes = createRandomBytes(size, size);
+        }
+    
+        QByteArray encoded;
+        QDataStream outStream(&encoded, QIODevice::WriteOnly);
+        Bitstream out(outStream);
+        ReferenceBitWriter reference;
+        int totalBits = 0;
+        foreach (const BitRun& run, runs) {
+            if (run.bits == 1 && run.offset == 0) {
+                out << (bool)(run.bytes.at(0) & 1);
+            } else {
+                out.write(run.bytes.constData(), run.bits, run.offset);
+            }
+            reference.write(run.bytes.constData(), run.bits, run.offset);
+            totalBits += run.bits;
+        }
+        out.flush();
+        reference.flush();
+        if (encoded != reference.getBytes()) {
+            qDebug() << "Bitstream encoding differs from byte-at-a-time encoding in trial" << trial;
+            return true;
+        }
+        
+        // follow the bits with a byte read directly from the underlying stream, as the sequencer does
+        const quint8 TRAILER = 0xA5;
+        outStream << TRAILER;
+        
+        QDataStream inStream(encoded);
+        Bitstream in(inStream);
+        foreach (const BitRun& run, runs) {
+            // read over different bytes to check that the bits outside the run are left alone
+            QByteArray bytes = createRandomBytes(run.bytes.size(), run.bytes.size());
+            QByteArray expected = bytes;
+            for (int bit = 0; bit < run.bits; bit++) {
+                int position = run.offset + bit;
+                int mask = 1 << (position % BITS_IN_BYTE);
+                expected[position / BITS_IN_BYTE] = (char)((expected.at(position / BITS_IN_BYTE) & ~mask) |
+                    (run.bytes.at(position / BITS_IN_BYTE) & mask));
+            }
+            in.read(bytes.data(), run.bits, run.offset);
+            if (bytes != expected) {
+                qDebug() << "Bitstream read back a different run of" << run.bits << "bits in trial" << trial;
+                return true;
+            }
+        }
+        in.reset();
+        quint8 trailer;
+        inStream >> trailer;
+        if (trailer != TRAILER || inStream.device()->pos() != (totalBits + BITS_IN_BYTE - 1) / BITS_IN_BYTE + 1) {
+            qDebug() << "Bitstream reset left the underlying stream in the wrong place in trial" << trial;
+            return true;
+        }
+    }
+    qDebug() << "Bitstream encoding matches byte-at-a-time encoding over" << TRIALS << "trials";
+    return false;
+}
+
+static void applyRandomBoxes(MetavoxelData& data, int count) {
+    const AttributePointer& color = AttributeRegistry::getInstance()->getColorAttribute();
+    const float MAX_BOX_SIZE = 0.1f;
+    const float GRANULARITY = 1.0f / 128.0f;
+    for (int i = 0; i < count; i++) {
+        glm::vec3 minimum(randFloat(), randFloat(), randFloat());
+        glm::vec3 size(randFloatInRange(GRANULARITY, MAX_BOX_SIZE), randFloatInRange(GRANULARITY, MAX_BOX_SIZE),
+            randFloatInRange(GRANULARITY, MAX_BOX_SIZE));
+        OwnedAttributeValue value(color, encodeInline<QRgb>(qRgb(rand(), rand(), rand())));
+        BoxSetEdit(Box(minimum, minimum + size), GRANULARITY, value).apply(data, WeakSharedObjectHash());
+    }
+}
+
+static QByteArray writeData(const MetavoxelData& data) {
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    Bitstream out(stream);
+    data.write(out);
+    out.flush();
+    return bytes;
+}
+
+static bool testDeltaStreaming() {
+    // a large tree of colored boxes, and a later version of it with a few more edits
+    const int BOX_COUNT = 500;
+    const int EDIT_COUNT = 10;
+    MetavoxelData empty, original;
+    applyRandomBoxes(original, BOX_COUNT);
+    MetavoxelData edited = original;
+    applyRandomBoxes(edited, EDIT_COUNT);
+    QByteArray expected = writeData(edited);
+    
+    const int ITERATIONS = 20;
+    const MetavoxelData* references[] = { &empty, &original };
+    const char* names[] = { "full", "incremental" };
+    for (int i = 0; i < 2; i++) {
+        const MetavoxelData& reference = *references[i];
+        MetavoxelLOD lod;
+        QByteArray delta;
+        quint64 start = usecTimestampNow();
+        for (int j = 0; j < ITERATIONS; j++) {
+            delta.clear();
+            QDataStream stream(&delta, QIODevice::WriteOnly);
+            Bitstream out(stream);
+            edited.writeDelta(reference, lod, out, lod);
+            out.flush();
+        }
+        quint64 writeTime = (usecTimestampNow() - start) / ITERATIONS;
+        
+        MetavoxelData received;
+        start = usecTimestampNow();
+        for (int j = 0; j < ITERATIONS; j++) {
+            QDataStream stream(delta);
+            Bitstream in(stream);
+            received.readDelta(reference, lod, in, lod);
+        }
+        quint64 readTime = (usecTimestampNow() - start) / ITERATIONS;
+        
+        if (writeData(received) != expected) {
+            qDebug() << "Data read from" << names[i] << "delta differs from data written";
+            return true;
+        }
+        qDebug() << "Wrote" << names[i] << "delta of" << delta.size() << "bytes in" << writeTime << "usec, read in"
+            << readTime << "usec";
+    }
+    return false;
+}
+
+/// Visits every metavoxel down to a fixed size, summing up the positions of the smallest so that tours can be compared.
+class GuideBenchmarkVisitor : public MetavoxelVisitor {
+public:
+    
+    GuideBenchmarkVisitor(float leafSize);
+    
+    virtual void prepare();
+    virtual int visit(MetavoxelInfo& info);
+    
+    int visits;
+    int leaves;
+    double checksum;
+
+private:
+    
+    float _leafSize;
+};
+
+GuideBenchmarkVisitor::GuideBenchmarkVisitor(float leafSize) :
+    MetavoxelVisitor(QVector<AttributePointer>() << AttributeRegistry::getInstance()->getColorAttribute()),
+    _leafSize(leafSize) {
+}
+
+void GuideBenchmarkVisitor::prepare() {
+    MetavoxelVisitor::prepare();
+    visits = 0;
+    leaves = 0;
+    checksum = 0.0;
+}
+
+int GuideBenchmarkVisitor::visit(MetavoxelInfo& info) {
+    visits++;
+    const float LEAF_SIZE_TOLERANCE = 1.5f;
+    if (info.size > _leafSize * LEAF_SIZE_TOLERANCE) {
+        return DEFAULT_ORDER;
+    }
+    leaves++;
+    checksum += (info.minimum.x + 2.0f * info.minimum.y + 3.0f * info.minimum.z) * info.size;
+    return STOP_RECURSION;
+}
+
+// visits every metavoxel down to the depth given as the argument, one call per metavoxel
+static const char* VISITING_GUIDE_SCRIPT =
+    "(function (args) {\n"
+    "    var depth = %1;\n"
+    "    function visit(x, y, z, size, level) {\n"
+    "        args.visitor.visit({ minimum: [x, y, z], size: size, isLeaf: level == depth });\n"
+    "        if (level == depth) {\n"
+    "            return;\n"
+    "        }\n"
+    "        var half = size / 2;\n"
+    "        for (var i = 0; i < 8; i++) {\n"
+    "            visit(x + (i & 1 ? half : 0), y + (i & 2 ? half : 0), z + (i & 4 ? half : 0), half, level + 1);\n"
+    "        }\n"
+    "    }\n"
+    "    visit(args.info.minimum[0], args.info.minimum[1], args.info.minimum[2], args.info.size, 0);\n"
+    "})";
+
+// visits the same metavoxels, but gathers them into a single block
+static const char* BLOCK_GUIDE_SCRIPT =
+    "(function (args) {\n"
+    "    var depth = %1;\n"
+    "    var block = { minimums: [], sizes: [], isLeaf: [] };\n"
+    "    function collect(x, y, z, size, level) {\n"
+    "        block.minimums.push(x, y, z);\n"
+    "        block.sizes.push(size);\n"
+    "        block.isLeaf.push(level == depth);\n"
+    "        if (level == depth) {\n"
+    "            return;\n"
+    "        }\n"
+    "        var half = size / 2;\n"
+    "        for (var i = 0; i < 8; i++) {\n"
+    "            collect(x + (i & 1 ? half : 0), y + (i & 2 ? half : 0), z + (i & 4 ? half : 0), half, level + 1);\n"
+    "        }\n"
+    "    }\n"
+    "    collect(args.info.minimum[0], args.info.minimum[1], args.info.minimum[2], args.info.size, 0);\n"
+    "    args.visitor.visitBlock(block);\n"
+    "})";
+
+static bool setScriptedGuide(MetavoxelData& data, QScriptEngine& engine, const QString& script) {
+    QScriptValue function = engine.evaluate(script);
+    if (engine.hasUncaughtException()) {
+        qDebug() << "Guide script error:" << engine.uncaughtException().toString();
+        return false;
+    }
+    ScriptedMetavoxelGuide* guide = new ScriptedMetavoxelGuide();
+    guide->setGuideFunction(function);
+    const AttributePointer& attribute = AttributeRegistry::getInstance()->getGuideAttribute();
+    GlobalSetEdit(OwnedAttributeValue(attribute, attribute->createFromVariant(QVariant::fromValue(
+        SharedObjectPointer(guide))))).apply(data, WeakSharedObjectHash());
+    return true;
+}
+
+static int writeDelta(const MetavoxelData& data, const MetavoxelData& reference, const MetavoxelLOD& referenceLOD,
+        const MetavoxelLOD& lod, QByteArray& delta) {
+    delta.clear();
+    QDataStream stream(&delta, QIODevice::WriteOnly);
+    Bitstream out(stream);
+    data.writeDelta(reference, referenceLOD, out, lod);
+    out.flush();
+    return delta.size();
+}
+
+static bool testDeltaBudget() {
+    // a viewer joins a large tree with a budget for an eighth of it, as the server sends against its congestion window
+    const int BOX_COUNT = 500;
+    MetavoxelData empty, data;
+    applyRandomBoxes(data, BOX_COUNT);
+    MetavoxelLOD lod(glm::vec3(0.5f, 0.5f, 0.5f), 0.05f);
+    QByteArray delta;
+    int fullSize = writeDelta(data, empty, MetavoxelLOD(), lod, delta);
+    int budget = fullSize / 8;
+    
+    // each delta goes from what the viewer last received, as though acknowledged at once
+    const int DELTA_COUNT = 50;
+    MetavoxelLODBudget lodBudget;
+    MetavoxelData received;
+    MetavoxelLOD receivedLOD;
+    int firstSize = 0, largestSize = 0;
+    for (int i = 0; i < DELTA_COUNT; i++) {
+        MetavoxelLOD sendLOD = lodBudget.getLOD(lod);
+        int size = writeDelta(data, received, receivedLOD, sendLOD, delta);
+        lodBudget.deltaSent(size, budget);
+        if (i == 0) {
+            firstSize = size;
+        }
+        largestSize = qMax(largestSize, size);
+        
+        QDataStream stream(delta);
+        Bitstream in(stream);
+        MetavoxelData reference = received;
+        received.readDelta(reference, receivedLOD, in, sendLOD);
+        receivedLOD = sendLOD;
+    }
+    qDebug() << "Sent" << DELTA_COUNT << "deltas against a budget of" << budget << "bytes, rather than one of" <<
+        fullSize << "bytes: the first of" << firstSize << "bytes, at most" << largestSize << "bytes, finishing at an LOD" <<
+        "scale of" << lodBudget.getScale();
+    
+    if (firstSize >= fullSize || largestSize >= fullSize) {
+        qDebug() << "Budgeted deltas weren't smaller than the full one";
+        return true;
+    }
+    QByteArray expected, actual;
+    writeDelta(data, empty, MetavoxelLOD(), receivedLOD, expected);
+    writeDelta(received, empty, MetavoxelLOD(), receivedLOD, actual);
+    if (expected != actual) {
+        qDebug() << "Data built from budgeted deltas differs from the data at the same LOD";
+        return true;
+    }
+    return false;
+}
+
+/// A session's stream, optionally primed with a persisted mapping (as left by earlier packets) so that its write mappings
+/// differ from a fresh stream's.
+class DeltaSessionStream {
+public:
+    
+    DeltaSessionStream(bool primed);
+    
+    Bitstream& getOut() { return _out; }
+    
+    /// Flushes the stream and returns everything written to it.
+    const QByteArray& getBytes();
+    
+    /// Reads back the delta written after the priming.
+    void readDelta(MetavoxelData& data, const MetavoxelData& reference, const MetavoxelLOD& lod);
+    
+private:
+    
+    bool _primed;
+    QByteArray _bytes;
+    QDataStream _stream;
+    Bitstream _out;
+};
+
+DeltaSessionStream::DeltaSessionStream(bool primed) :
+    _primed(primed),
+    _stream(&_bytes, QIODevice::WriteOnly),
+    _out(_stream) {
+    
+    if (primed) {
+        _out << AttributeRegistry::getInstance()->getColorAttribute();
+        _out.persistAndResetWriteMappings();
+    }
+}
+
+const QByteArray& DeltaSessionStream::getBytes() {
+    _out.flush();
+    return _bytes;
+}
+
+void DeltaSessionStream::readDelta(MetavoxelData& data, const MetavoxelData& reference, const MetavoxelLOD& lod) {
+    QDataStream stream(getBytes());
+    Bitstream in(stream);
+    if (_primed) {
+        AttributePointer attribute;
+        in >> attribute;
+        in.persistAndResetReadMappings();
+    }
+    data.readDelta(reference, lod, in, lod);
+}
+
+static bool testDeltaCopies() {
+    // one delta written to two sessions, as the server does, when their mappings differ and when they match
+    const int BOX_COUNT = 100;
+    MetavoxelData empty, data;
+    applyRandomBoxes(data, BOX_COUNT);
+    MetavoxelLOD lod;
+    QByteArray expected = writeData(data);
+    
+    for (int match = 0; match < 2; match++) {
+        MetavoxelDelta delta(data, empty, lod, lod);
+        DeltaSessionStream first(false), second(!match);
+        delta.write(first.getOut());
+        delta.write(second.getOut());
+        if (delta.getCopies() != match) {
+            qDebug() << "Delta was copied" << delta.getCopies() << "times, expected" << match;
+            return true;
+        }
+        
+        // the copy must be exactly what encoding directly would have written
+        if (match) {
+            DeltaSessionStream direct(false);
+            data.writeDelta(empty, lod, direct.getOut(), lod);
+            if (direct.getOut().getBitsWritten() != second.getOut().getBitsWritten() ||
+                    direct.getBytes() != second.getBytes() || !second.getOut().hasSameWriteMappings(direct.getOut())) {
+                qDebug() << "Copied delta differs from the one encoded directly";
+                return true;
+            }
+        }
+        DeltaSessionStream* sessions[] = { &first, &second };
+        for (int i = 0; i < 2; i++) {
+            MetavoxelData received;
+            sessions[i]->readDelta(received, empty, lod);
+            if (writeData(received) != expected) {
+                qDebug() << "Data read from session" << i << "differs from data written, with" <<
+                    (match ? "matching" : "differing") << "mappings";
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool testGuideThroughput() {
+    const int DEPTH = 4;
+    QScriptEngine engine;
+    MetavoxelData defaultData, visitingData, blockData;
+    if (!(setScriptedGuide(visitingData, engine, QString(VISITING_GUIDE_SCRIPT).arg(DEPTH)) &&
+            setScriptedGuide(blockData, engine, QString(BLOCK_GUIDE_SCRIPT).arg(DEPTH)))) {
+        return true;
+    }
+    MetavoxelData* datas[] = { &defaultData, &visitingData, &blockData };
+    const char* names[] = { "default guide", "scripted guide, visit per metavoxel", "scripted guide, one block" };
+    
+    const int ITERATIONS = 5;
+    GuideBenchmarkVisitor visitor(defaultData.getSize() / (1 << DEPTH));
+    int expectedVisits = 0;
+    double expectedChecksum = 0.0;
+    for (int i = 0; i < 3; i++) {
+        quint64 start = usecTimestampNow();
+        for (int j = 0; j < ITERATIONS; j++) {
+            datas[i]->guide(visitor);
+        }
+        quint64 elapsed = (usecTimestampNow() - start) / ITERATIONS;
+        
+        if (i == 0) {
+            expectedVisits = visitor.visits;
+            expectedChecksum = visitor.checksum;
+        
+        } else {
+            const double CHECKSUM_TOLERANCE = 0.001;
+            if (visitor.visits != expectedVisits || qAbs(visitor.checksum - expectedChecksum) > CHECKSUM_TOLERANCE) {
+                qDebug() << names[i] << "visited" << visitor.visits << "metavoxels (checksum" << visitor.checksum
+                    << "), expected" << expectedVisits << "(checksum" << expectedChecksum << ")";
+                return true;
+            }
+        }
+        qDebug() << "Toured" << visitor.visits << "metavoxels with" << names[i] << "in" << elapsed << "usec";
+    }
+    return false;
+}
+
+/// Collects every spanner in the cells the tour reaches.
+class SpannerGatherer : public SpannerVisitor {
+public:
+    
+    SpannerGatherer(const AttributePointer& attribute);
+    
+    virtual bool visit(Spanner* spanner);
+    
+    QSet<Spanner*> spanners;
+};
+
+SpannerGatherer::SpannerGatherer(const AttributePointer& attribute) :
+    SpannerVisitor(QVector<AttributePointer>() << attribute) {
+}
+
+bool SpannerGatherer::visit(Spanner* spanner) {
+    spanners.insert(spanner);
+    return true;
+}
+
+/// Finds the distance to the closest spanner along a ray by touring all the cells it passes through.
+class ClosestRaySpannerVisitor : public RaySpannerIntersectionVisitor {
+public:
+    
+    ClosestRaySpannerVisitor(const glm::vec3& origin, const glm::vec3& direction, const AttributePointer& attribute);
+    
+    virtual bool visitSpanner(Spanner* spanner, float distance);
+    
+    Spanner* spanner;
+    float distance;
+};
+
+ClosestRaySpannerVisitor::ClosestRaySpannerVisitor(const glm::vec3& origin, const glm::vec3& direction,
+        const AttributePointer& attribute) :
+    RaySpannerIntersectionVisitor(origin, direction, QVector<AttributePointer>() << attribute),
+    spanner(NULL),
+    distance(FLT_MAX) {
+}
+
+bool ClosestRaySpannerVisitor::visitSpanner(Spanner* spanner, float distance) {
+    if (distance < this->distance) {
+        this->spanner = spanner;
+        this->distance = distance;
+    }
+    return true;
+}
+
+/// Collects the spanners whose bounds intersect a box by touring the cells that intersect it.
+class BoxSpannerVisitor : public MetavoxelVisitor {
+public:
+    
+    BoxSpannerVisitor(const Box& bounds, const AttributePointer& attribute);
+    
+    virtual int visit(MetavoxelInfo& info);
+    
+    QSet<Spanner*> spanners;
+
+private:
+    
+    Box _bounds;
+};
+
+BoxSpannerVisitor::BoxSpannerVisitor(const Box& bounds, const AttributePointer& attribute) :
+    MetavoxelVisitor(QVector<AttributePointer>() << attribute),
+    _bounds(bounds) {
+}
+
+int BoxSpannerVisitor::visit(MetavoxelInfo& info) {
+    if (!info.getBounds().intersects(_bounds)) {
+        return STOP_RECURSION;
+    }
+    foreach (const SharedObjectPointer& object, info.inputValues.at(0).getInlineValue<SharedObjectSet>()) {
+        Spanner* spanner = static_cast<Spanner*>(object.data());
+        if (spanner->getBounds().intersects(_bounds)) {
+            spanners.insert(spanner);
+        }
+    }
+    return info.isLeaf ? STOP_RECURSION : DEFAULT_ORDER;
+}
+
+static glm::vec3 createRandomVector(float minimum, float maximum) {
+    return glm::vec3(randFloatInRange(minimum, maximum), randFloatInRange(minimum, maximum),
+        randFloatInRange(minimum, maximum));
+}
+
+/// Checks the spanner index of the data against tours of its cells.
+static bool compareSpannerIndex(MetavoxelData& data, const char* description) {
+    const AttributePointer& attribute = AttributeRegistry::getInstance()->getSpannersAttribute();
+    const SpannerIndex& index = data.getSpannerIndex(attribute);
+    SpannerGatherer gatherer(attribute);
+    data.guide(gatherer);
+    if (index.getSpannerCount() != gatherer.spanners.size()) {
+        qDebug() << "Spanner index of" << description << "holds" << index.getSpannerCount() << "spanners, expected" <<
+            gatherer.spanners.size();
+        return true;
+    }
+    foreach (Spanner* spanner, gatherer.spanners) {
+        if (!index.contains(SharedObjectPointer(spanner))) {
+            qDebug() << "Spanner index of" << description << "is missing a spanner";
+            return true;
+        }
+    }
+    
+    const int RAY_COUNT = 200;
+    quint64 indexTime = 0;
+    quint64 tourTime = 0;
+    int hits = 0;
+    for (int i = 0; i < RAY_COUNT; i++) {
+        glm::vec3 origin = createRandomVector(-1.0f, 1.0f);
+        glm::vec3 direction = glm::normalize(createRandomVector(-1.0f, 1.0f) - origin);
+        
+        quint64 start = usecTimestampNow();
+        float distance;
+        SharedObjectPointer spanner = data.findFirstRaySpannerIntersection(origin, direction, attribute, distance);
+        quint64 middle = usecTimestampNow();
+        ClosestRaySpannerVisitor visitor(origin, direction, attribute);
+        data.guide(visitor);
+        quint64 end = usecTimestampNow();
+        indexTime += middle - start;
+        tourTime += end - middle;
+        
+        const float DISTANCE_TOLERANCE = 0.0001f;
+        if ((spanner.data() != NULL) != (visitor.spanner != NULL) ||
+                (spanner && qAbs(distance - visitor.distance) > DISTANCE_TOLERANCE)) {
+            qDebug() << "Ray cast through spanner index of" << description << "found" << (spanner ? distance : -1.0f) <<
+                "expected" << (visitor.spanner ? visitor.distance : -1.0f);
+            return true;
+        }
+        if (spanner) {
+            hits++;
+        }
+    }
+    qDebug() << "Cast" << RAY_COUNT << "rays (" << hits << "hits) against" << index.getSpannerCount() << "spanners in" <<
+        description << "in" << indexTime << "usec with index," << tourTime << "usec touring the cells";
+    
+    const int BOX_COUNT = 50;
+    for (int i = 0; i < BOX_COUNT; i++) {
+        glm::vec3 minimum = createRandomVector(-0.5f, 0.4f);
+        Box bounds(minimum, minimum + createRandomVector(0.0f, 0.2f));
+        QVector<Spanner*> results;
+        data.findIntersectingSpanners(attribute, bounds, results);
+        BoxSpannerVisitor visitor(bounds, attribute);
+        data.guide(visitor);
+        if (results.size() != visitor.spanners.size() || results.toList().toSet() != visitor.spanners) {
+            qDebug() << "Box query on spanner index of" << description << "found" << results.size() << "spanners, expected" <<
+                visitor.spanners.size();
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool testSpannerIndex() {
+    const AttributePointer& attribute = AttributeRegistry::getInstance()->getSpannersAttribute();
+    const int SPANNER_COUNT = 400;
+    QVector<SharedObjectPointer> spanners;
+    for (int i = 0; i < SPANNER_COUNT; i++) {
+        Sphere* sphere = new Sphere();
+        sphere->setTranslation(createRandomVector(-0.4f, 0.4f));
+        sphere->setScale(randFloatInRange(0.005f, 0.05f));
+        spanners.append(SharedObjectPointer(sphere));
+    }
+    
+    // insert half the spanners, then build the index and maintain it through the rest of the changes
+    MetavoxelData data;
+    for (int i = 0; i < SPANNER_COUNT / 2; i++) {
+        data.insert(attribute, spanners.at(i));
+    }
+    if (compareSpannerIndex(data, "built index")) {
+        return true;
+    }
+    MetavoxelData snapshot = data;
+    for (int i = SPANNER_COUNT / 2; i < SPANNER_COUNT; i++) {
+        data.insert(attribute, spanners.at(i));
+    }
+    for (int i = 0; i < SPANNER_COUNT; i += 4) {
+        data.remove(attribute, spanners.at(i));
+    }
+    for (int i = 0; i < SPANNER_COUNT; i += 3) {
+        data.toggle(attribute, spanners.at(i));
+    }
+    if (compareSpannerIndex(data, "maintained index") || compareSpannerIndex(snapshot, "snapshot")) {
+        return true;
+    }
+    qDebug() << "Maintained spanner index has height" << data.getSpannerIndex(attribute).getHeight();
+    
+    // changing spanners some other way means rebuilding the index
+    data.clear(attribute);
+    for (int i = 0; i < SPANNER_COUNT; i += 2) {
+        data.insert(attribute, spanners.at(i));
+    }
+    return compareSpannerIndex(data, "rebuilt index");
+}
+
+/// Finds the values of a set of attributes at a point.
+class PointValueVisitor : public MetavoxelVisitor {
+public:
+    
+    PointValueVisitor(const glm::vec3& point, const QVector<AttributePointer>& attributes);
+    
+    virtual int visit(MetavoxelInfo& info);
+    
+    QVector<AttributeValue> values;
+
+private:
+    
+    glm::vec3 _point;
+};
+
+PointValueVisitor::PointValueVisitor(const glm::vec3& point, const QVector<AttributePointer>& attributes) :
+    MetavoxelVisitor(attributes),
+    _point(point) {
+}
+
+int PointValueVisitor::visit(MetavoxelInfo& info) {
+    if (!info.getBounds().contains(_point)) {
+        return STOP_RECURSION;
+    }
+    if (!info.isLeaf) {
+        return DEFAULT_ORDER;
+    }
+    values = info.inputValues.mid(0, _inputs.size());
+    return SHORT_CIRCUIT;
+}
+
+/// Creates the sort of burst a few people painting and placing spheres might send in one interval: mostly small boxes
+/// along strokes, with spanners inserted and removed (sometimes the same one twice) and the odd clear.
+static QVector<MetavoxelEditMessage> createRandomEdits(int count, const QVector<SharedObjectPointer>& spanners) {
+    const AttributePointer& color = AttributeRegistry::getInstance()->getColorAttribute();
+    const AttributePointer& normal = AttributeRegistry::getInstance()->getNormalAttribute();
+    const AttributePointer& spannersAttribute = AttributeRegistry::getInstance()->getSpannersAttribute();
+    const float GRANULARITY = 1.0f / 128.0f;
+    const float STROKE_STEP = 0.02f;
+    QVector<MetavoxelEditMessage> edits;
+    glm::vec3 stroke = createRandomVector(0.0f, 1.0f);
+    for (int i = 0; i < count; i++) {
+        float choice = randFloat();
+        MetavoxelEditMessage edit;
+        if (choice < 0.7f) {
+            if (randFloat() < 0.1f) {
+                stroke = createRandomVector(0.0f, 1.0f);
+            }
+            stroke += createRandomVector(-STROKE_STEP, STROKE_STEP);
+            float size = randFloatInRange(GRANULARITY, 0.05f);
+            OwnedAttributeValue value = (randFloat() < 0.8f) ?
+                OwnedAttributeValue(color, encodeInline<QRgb>(qRgb(rand(), rand(), rand()))) :
+                OwnedAttributeValue(normal, encodeInline<QRgb>(qRgb(rand(), rand(), rand())));
+            edit.edit = QVariant::fromValue(BoxSetEdit(Box(stroke, stroke + glm::vec3(size, size, size)), GRANULARITY,
+                value));
+            
+        } else if (choice < 0.85f) {
+            edit.edit = QVariant::fromValue(InsertSpannerEdit(spannersAttribute, spanners.at(randIntInRange(0,
+                spanners.size() - 1))));
+            
+        } else if (choice < 0.99f) {
+            edit.edit = QVariant::fromValue(RemoveSpannerEdit(spannersAttribute, spanners.at(randIntInRange(0,
+                spanners.size() - 1))->getID()));
+            
+        } else {
+            edit.edit = QVariant::fromValue(ClearSpannersEdit(spannersAttribute));
+        }
+        edits.append(edit);
+    }
+    return edits;
+}
+
+static bool testEditBatching() {
+    const AttributePointer& spannersAttribute = AttributeRegistry::getInstance()->getSpannersAttribute();
+    const int SPANNER_COUNT = 50;
+    QVector<SharedObjectPointer> spanners;
+    for (int i = 0; i < SPANNER_COUNT; i++) {
+        Sphere* sphere = new Sphere();
+        sphere->setTranslation(createRandomVector(0.1f, 0.9f));
+        sphere->setScale(randFloatInRange(0.005f, 0.05f));
+        spanners.append(SharedObjectPointer(sphere));
+    }
+    const int BOX_COUNT = 200;
+    MetavoxelData original;
+    applyRandomBoxes(original, BOX_COUNT);
+    
+    const int EDIT_COUNT = 200;
+    const int ITERATIONS = 5;
+    quint64 totalTimes[2] = { 0, 0 };
+    int totalNodes[2] = { 0, 0 };
+    int totalUpdates = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        QVector<MetavoxelEditMessage> edits = createRandomEdits(EDIT_COUNT, spanners);
+        
+        MetavoxelData sequential = original;
+        int createdCount = MetavoxelNode::getCreatedCount();
+        quint64 start = usecTimestampNow();
+        foreach (const MetavoxelEditMessage& edit, edits) {
+            edit.apply(sequential, SharedObject::getWeakHash());
+        }
+        totalTimes[0] += usecTimestampNow() - start;
+        totalNodes[0] += MetavoxelNode::getCreatedCount() - createdCount;
+        
+        MetavoxelData batched = original;
+        MetavoxelEditBatch batch;
+        foreach (const MetavoxelEditMessage& edit, edits) {
+            batch.append(edit);
+        }
+        createdCount = MetavoxelNode::getCreatedCount();
+        start = usecTimestampNow();
+        totalUpdates += batch.apply(batched, SharedObject::getWeakHash());
+        totalTimes[1] += usecTimestampNow() - start;
+        totalNodes[1] += MetavoxelNode::getCreatedCount() - createdCount;
+        
+        // the values (and spanners) everywhere should be the same, however the trees are divided up
+        const int POINT_COUNT = 500;
+        QVector<AttributePointer> attributes = QVector<AttributePointer>() <<
+            AttributeRegistry::getInstance()->getColorAttribute() <<
+            AttributeRegistry::getInstance()->getNormalAttribute() << spannersAttribute;
+        for (int j = 0; j < POINT_COUNT; j++) {
+            glm::vec3 point = createRandomVector(0.0f, 1.0f);
+            PointValueVisitor sequentialVisitor(point, attributes), batchedVisitor(point, attributes);
+            sequential.guide(sequentialVisitor);
+            batched.guide(batchedVisitor);
+            if (sequentialVisitor.values != batchedVisitor.values) {
+                qDebug() << "Batched edits produced different values at" << point.x << point.y << point.z;
+                return true;
+            }
+        }
+        SpannerGatherer sequentialGatherer(spannersAttribute), batchedGatherer(spannersAttribute);
+        sequential.guide(sequentialGatherer);
+        batched.guide(batchedGatherer);
+        if (sequentialGatherer.spanners != batchedGatherer.spanners) {
+            qDebug() << "Batched edits left" << batchedGatherer.spanners.size() << "spanners, expected" <<
+                sequentialGatherer.spanners.size();
+            return true;
+        }
+    }
+    qDebug() << "Applied" << EDIT_COUNT << "edits one at a time in" << totalTimes[0] / ITERATIONS << "usec, creating" <<
+        totalNodes[0] / ITERATIONS << "nodes";
+    qDebug() << "Applied" << EDIT_COUNT << "edits in" << totalUpdates / ITERATIONS << "batched updates in" <<
+        totalTimes[1] / ITERATIONS << "usec, creating" << totalNodes[1] / ITERATIONS << "nodes";
+    return false;
+}
+
+static quint64 simulatedTime = 0;
+
+static quint64 getSimulatedTime() {
+    return simulatedTime;
+}
+
+// the simulated link: 100KB/s, with a 40ms delay each way, room for 30KB in the bottleneck's buffer, and 1% loss
+const float LINK_BANDWIDTH = 100.0f * 1000.0f;
+const int LINK_DELAY = 40 * 1000;
+const int LINK_BUFFER_SIZE = 30 * 1000;
+const float LINK_LOSS_PROBABILITY = 0.01f;
+
+static bool testCongestionControl() {
+    // send a delta every frame, at four times what the link can carry, with and without congestion control
+    const int DELTA_SIZE = 20 * 1000;
+    const int FRAME_INTERVAL = 50 * 1000;
+    const int STEP_INTERVAL = 1000;
+    const int SIMULATION_TIME = 30 * 1000 * 1000;
+    float capacityFractions[2];
+    for (int controlled = 0; controlled < 2; controlled++) {
+        // both runs see the same losses, whatever the tests before this one drew from the generator
+        srand(0xBAAAAABE);
+        
+        QByteArray datagramHeader("testheader");
+        CongestionEndpoint sender(datagramHeader, controlled), receiver(datagramHeader, false);
+        sender.setOther(&receiver);
+        receiver.setOther(&sender);
+        
+        for (simulatedTime = STEP_INTERVAL; simulatedTime <= SIMULATION_TIME; simulatedTime += STEP_INTERVAL) {
+            if (simulatedTime % FRAME_INTERVAL == 0) {
+                sender.sendDelta(DELTA_SIZE);
+            }
+            sender.simulate();
+            receiver.simulate();
+        }
+        capacityFractions[controlled] = (float)sender.getDeltasReceived() * DELTA_SIZE /
+            (LINK_BANDWIDTH * SIMULATION_TIME / USECS_PER_SECOND);
+        const CongestionController& congestionController = sender.getSequencer().getCongestionController();
+        qDebug() << (controlled ? "With" : "Without") << "congestion control, sent" << sender.getDeltasSent() <<
+            "deltas and delivered" << sender.getDeltasReceived() << "whole (" <<
+            (int)(capacityFractions[controlled] * 100) << "percent of capacity), finishing with a window of" <<
+            congestionController.getWindow() <<
+            "bytes and a round trip time of" << congestionController.getRoundTripTime() << "usec";
+    }
+    simulatedTime = 0;
+    
+    const float MIN_CAPACITY_FRACTION = 0.5f;
+    if (capacityFractions[1] < MIN_CAPACITY_FRACTION || capacityFractions[1] <= capacityFractions[0]) {
+        qDebug() << "Congestion control delivered" << capacityFractions[1] << "of capacity, expected at least" <<
+            MIN_CAPACITY_FRACTION << "and more than the uncontrolled" << capacityFractions[0];
+        return true;
+    }
+    return false;
+}
+
+static bool testPausedServer() {
+    // a client streams reliable data to a server that sends nothing back for a while, then resumes
+    srand(0xBAAAAABE);
+    const int RELIABLE_SIZE = 100 * 1000;
+    const int CLIENT_DELTA_SIZE = 100;
+    const int FRAME_INTERVAL = 50 * 1000;
+    const int STEP_INTERVAL = 1000;
+    const int PAUSE_TIME = 6 * 1000 * 1000;
+    const int SIMULATION_TIME = 10 * 1000 * 1000;
+    QByteArray datagramHeader("testheader");
+    CongestionEndpoint client(datagramHeader, false), server(datagramHeader, false);
+    client.setOther(&server);
+    server.setOther(&client);
+    
+    ReliableChannel* output = client.getSequencer().getReliableOutputChannel();
+    output->setMessagesEnabled(false);
+    output->getBuffer().write(QByteArray(RELIABLE_SIZE, 'x'));
+    ReliableChannel* input = server.getSequencer().getReliableInputChannel();
+    input->setMessagesEnabled(false);
+    
+    server.setPaused(true);
+    int receivedWhilePaused = 0;
+    for (simulatedTime = STEP_INTERVAL; simulatedTime <= SIMULATION_TIME; simulatedTime += STEP_INTERVAL) {
+        if (simulatedTime % FRAME_INTERVAL == 0) {
+            client.sendDelta(CLIENT_DELTA_SIZE);
+        }
+        client.simulate();
+        server.simulate();
+        if (simulatedTime == PAUSE_TIME) {
+            receivedWhilePaused = input->getBuffer().size();
+            server.setPaused(false);
+        }
+    }
+    simulatedTime = 0;
+    const CongestionController& congestionController = client.getSequencer().getCongestionController();
+    qDebug() << "Server received" << receivedWhilePaused << "of" << RELIABLE_SIZE << "reliable bytes while paused," <<
+        "client finished with a window of" << congestionController.getWindow() << "bytes, a round trip time of" <<
+        congestionController.getRoundTripTime() << "usec and a timeout of" << congestionController.getTimeout() << "usec";
+    
+    // the client's reliable data must keep flowing without acknowledgements, and its timeouts must recover once
+    // they come back
+    if (receivedWhilePaused < RELIABLE_SIZE) {
+        qDebug() << "Reliable data stalled while the server was paused";
+        return true;
+    }
+    const int MAX_RECOVERED_TIMEOUT = 1000 * 1000;
+    if (congestionController.getRoundTripTime() == 0 || congestionController.getTimeout() > MAX_RECOVERED_TIMEOUT) {
+        qDebug() << "Client's timeout didn't recover after the server resumed";
+        return true;
+    }
+    return false;
+}
+
 Endpoint::Endpoint(const QByteArray& datagramHeader) :
     _sequencer(new DatagramSequencer(datagramHeader, this)),
     _highPriorityMessagesToSend(0.0f),
@@ -307,6 +1264,73 @@ void Endpoint::readReliableChannel() {
     streamedBytesReceived += bytes.size();
 }
 
+CongestionEndpoint::CongestionEndpoint(const QByteArray& datagramHeader, bool controlled) :
+    _sequencer(new DatagramSequencer(datagramHeader, this)),
+    _controlled(controlled),
+    _linkFreeTime(0),
+    _deltasSent(0),
+    _deltasReceived(0),
+    _packetReceived(false),
+    _paused(false) {
+    
+    _sequencer->setClock(getSimulatedTime);
+    _sequencer->setPacingEnabled(controlled);
+    connect(_sequencer, SIGNAL(readyToWrite(const QByteArray&)), SLOT(sendDatagram(const QByteArray&)));
+    connect(_sequencer, SIGNAL(readyToRead(Bitstream&)), SLOT(readDelta(Bitstream&)));
+}
+
+void CongestionEndpoint::sendDelta(int size) {
+    if (_controlled && _sequencer->getSendBudget() <= 0) {
+        return;
+    }
+    Bitstream& out = _sequencer->startPacket();
+    out << QByteArray(size, 'x');
+    _sequencer->endPacket();
+    _deltasSent++;
+}
+
+void CongestionEndpoint::simulate() {
+    if (_controlled) {
+        _sequencer->releasePacedDatagrams();
+    }
+    while (!_datagramsInTransit.isEmpty() && _datagramsInTransit.first().second <= simulatedTime) {
+        _other->_sequencer->receivedDatagram(_datagramsInTransit.takeFirst().first);
+    }
+    
+    // acknowledge what we received as soon as we can
+    if (_packetReceived && !_paused) {
+        Bitstream& out = _sequencer->startPacket();
+        out << QByteArray();
+        _sequencer->endPacket();
+        _packetReceived = false;
+    }
+}
+
+void CongestionEndpoint::sendDatagram(const QByteArray& datagram) {
+    if (randFloat() < LINK_LOSS_PROBABILITY) {
+        return;
+    }
+    // datagrams queue up for the bottleneck, and are dropped when its buffer is full
+    quint64 start = qMax(simulatedTime, _linkFreeTime);
+    if ((start - simulatedTime) * LINK_BANDWIDTH / USECS_PER_SECOND > LINK_BUFFER_SIZE) {
+        return;
+    }
+    _linkFreeTime = start + (quint64)(datagram.size() * USECS_PER_SECOND / LINK_BANDWIDTH);
+    
+    // have to copy the datagram; the one we're passed may be a reference to a shared buffer
+    _datagramsInTransit.append(QPair<QByteArray, quint64>(QByteArray(datagram.constData(), datagram.size()),
+        _linkFreeTime + LINK_DELAY));
+}
+
+void CongestionEndpoint::readDelta(Bitstream& in) {
+    QByteArray delta;
+    in >> delta;
+    if (!delta.isEmpty()) {
+        _other->_deltasReceived++;
+        _packetReceived = true;
+    }
+}
+
 TestSharedObjectA::TestSharedObjectA(float foo) :
         _foo(foo) {
     sharedObjectsCreated++;    
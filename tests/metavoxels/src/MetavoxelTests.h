@@ -64,6 +64,50 @@ private:
     CircularBuffer _dataStreamed;
 };
 
+/// An endpoint at one end of a simulated link of limited capacity, sending deltas of a fixed size (or acknowledging
+/// them), on a simulated clock.
+class CongestionEndpoint : public QObject {
+    Q_OBJECT
+
+public:
+    
+    CongestionEndpoint(const QByteArray& datagramHeader, bool controlled);
+    
+    void setOther(CongestionEndpoint* other) { _other = other; }
+    
+    DatagramSequencer& getSequencer() { return *_sequencer; }
+    
+    int getDeltasSent() const { return _deltasSent; }
+    int getDeltasReceived() const { return _deltasReceived; }
+    
+    /// Sets whether to stop acknowledging what we receive, as a server skipping its deltas does.
+    void setPaused(bool paused) { _paused = paused; }
+    
+    /// Sends a delta of the specified size, unless congestion controlled and the window is full.
+    void sendDelta(int size);
+    
+    /// Performs a simulation step: releases paced datagrams, delivers those that have crossed the link, and
+    /// acknowledges any packets received.
+    void simulate();
+
+private slots:
+
+    void sendDatagram(const QByteArray& datagram);
+    void readDelta(Bitstream& in);
+
+private:
+    
+    DatagramSequencer* _sequencer;
+    CongestionEndpoint* _other;
+    bool _controlled;
+    QList<QPair<QByteArray, quint64> > _datagramsInTransit;
+    quint64 _linkFreeTime;
+    int _deltasSent;
+    int _deltasReceived;
+    bool _packetReceived;
+    bool _paused;
+};
+
 /// A simple shared object.
 class TestSharedObjectA : public SharedObject {
     Q_OBJECT
@@ -0,0 +1,179 @@
+//
+//  ParticleScriptTests.cpp
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cmath>
+#include <iostream>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include <Particle.h>
+#include <ScriptEngine.h>
+#include <SharedUtil.h>
+
+#include "ParticleScriptTests.h"
+
+static const QString SPEED_UP_SCRIPT("var updates = 0;"
+    "Particle.update.connect(function() {"
+    "    updates++;"
+    "    var velocity = Particle.getVelocity();"
+    "    velocity.y += 1.0;"
+    "    Particle.setVelocity(velocity);"
+    "});");
+
+static void makeScriptedParticles(QList<Particle>& particles, int count, const QString& script) {
+    rgbColor color = { 255, 0, 0 };
+    for (int i = 0; i < count; i++) {
+        Particle particle;
+        // no gravity or damping, so that only the script changes the velocity
+        particle.init(glm::vec3(randFloat(), 0.5f, randFloat()), 0.01f, color, glm::vec3(0.0f), glm::vec3(0.0f),
+            0.0f, DEFAULT_LIFETIME, NOT_IN_HAND, script, i);
+        particles.append(particle);
+    }
+}
+
+void ParticleScriptTests::scriptsShareContexts() {
+    const int PARTICLE_COUNT = 10;
+    const int UPDATES = 3;
+    QList<Particle> particles;
+    makeScriptedParticles(particles, PARTICLE_COUNT, SPEED_UP_SCRIPT);
+    makeScriptedParticles(particles, PARTICLE_COUNT, SPEED_UP_SCRIPT + "// another script");
+
+    for (int i = 0; i < UPDATES; i++) {
+        quint64 now = usecTimestampNow();
+        for (int j = 0; j < particles.size(); j++) {
+            particles[j].update(now);
+        }
+    }
+
+    // each particle's velocity is only changed by its own updates, though the particles share two contexts
+    const float EXPECTED_SPEED = UPDATES / (float)TREE_SCALE;
+    for (int j = 0; j < particles.size(); j++) {
+        if (fabsf(particles.at(j).getVelocity().y - EXPECTED_SPEED) > EPSILON) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << j << " has speed "
+                << particles.at(j).getVelocity().y << ", expected " << EXPECTED_SPEED << std::endl;
+            break;
+        }
+    }
+    const int EXPECTED_CONTEXTS = 2;
+    if (Particle::getScriptContextCount() != EXPECTED_CONTEXTS) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << Particle::getScriptContextCount()
+            << " script contexts, expected " << EXPECTED_CONTEXTS << std::endl;
+    }
+
+    // a context goes with the last particle running its script
+    for (int j = 0; j < PARTICLE_COUNT; j++) {
+        particles.removeFirst();
+        int expectedContexts = (j == PARTICLE_COUNT - 1) ? 1 : EXPECTED_CONTEXTS;
+        if (Particle::getScriptContextCount() != expectedContexts) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << Particle::getScriptContextCount()
+                << " script contexts after " << (j + 1) << " particles died, expected " << expectedContexts
+                << std::endl;
+            break;
+        }
+    }
+    particles.clear();
+    if (Particle::getScriptContextCount() != 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << Particle::getScriptContextCount()
+            << " script contexts after all particles died, expected 0" << std::endl;
+    }
+}
+
+/// Runs two scripts on a thread that never updates a tree, then runs the second again once the particle running the
+/// first has died on another thread.
+class ReleaseContextTask : public QRunnable {
+public:
+
+    ReleaseContextTask(QList<Particle>* particles, QSemaphore* ran, QSemaphore* resume, QSemaphore* finished) :
+        _particles(particles), _ran(ran), _resume(resume), _finished(finished),
+        _contextsBefore(0), _contextsAfter(0) { }
+
+    virtual void run() {
+        (*_particles)[0].update(usecTimestampNow());
+        (*_particles)[1].update(usecTimestampNow());
+        _contextsBefore = Particle::getScriptContextCount();
+        _ran->release();
+        _resume->acquire();
+        _particles->last().update(usecTimestampNow());
+        _contextsAfter = Particle::getScriptContextCount();
+        _finished->release();
+    }
+
+    int getContextsBefore() const { return _contextsBefore; }
+    int getContextsAfter() const { return _contextsAfter; }
+
+private:
+
+    QList<Particle>* _particles;
+    QSemaphore* _ran;
+    QSemaphore* _resume;
+    QSemaphore* _finished;
+    int _contextsBefore;
+    int _contextsAfter;
+};
+
+void ParticleScriptTests::otherThreadsReleaseContexts() {
+    QList<Particle> particles;
+    makeScriptedParticles(particles, 1, SPEED_UP_SCRIPT + "// the first script");
+    makeScriptedParticles(particles, 1, SPEED_UP_SCRIPT + "// the second script");
+
+    QSemaphore ran, resume, finished;
+    ReleaseContextTask* task = new ReleaseContextTask(&particles, &ran, &resume, &finished);
+    task->setAutoDelete(false);
+    QThreadPool::globalInstance()->start(task);
+    ran.acquire();
+    particles.removeFirst();
+    resume.release();
+    finished.acquire();
+
+    // the first script's last particle died on this thread, so running the second tore down the first's context there
+    if (task->getContextsBefore() != 2 || task->getContextsAfter() != 1) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << task->getContextsBefore() << " then "
+            << task->getContextsAfter() << " script contexts on the other thread, expected 2 then 1" << std::endl;
+    }
+    delete task;
+}
+
+void ParticleScriptTests::updateThroughput() {
+    const int PARTICLE_COUNT = 100;
+    const int UPDATES = 5;
+    QList<Particle> particles;
+    makeScriptedParticles(particles, PARTICLE_COUNT, SPEED_UP_SCRIPT);
+
+    // what Particle::executeUpdateScripts() used to do: a new engine for every event
+    quint64 start = usecTimestampNow();
+    for (int i = 0; i < UPDATES; i++) {
+        for (int j = 0; j < particles.size(); j++) {
+            ScriptEngine engine(particles.at(j).getScript());
+            ParticleScriptObject particleScriptable(&particles[j]);
+            engine.registerGlobalObject("Particle", &particleScriptable);
+            engine.evaluate();
+            particleScriptable.emitUpdate();
+        }
+    }
+    quint64 newEngineElapsed = usecTimestampNow() - start;
+
+    start = usecTimestampNow();
+    for (int i = 0; i < UPDATES; i++) {
+        quint64 now = usecTimestampNow();
+        for (int j = 0; j < particles.size(); j++) {
+            particles[j].update(now);
+        }
+    }
+    quint64 reusedElapsed = usecTimestampNow() - start;
+
+    int updates = PARTICLE_COUNT * UPDATES;
+    std::cout << "scripted particle update: " << newEngineElapsed / updates << " usec with a new engine each time, "
+        << reusedElapsed / updates << " usec with reused contexts" << std::endl;
+}
+
+void ParticleScriptTests::runAllTests() {
+    scriptsShareContexts();
+    otherThreadsReleaseContexts();
+    updateThroughput();
+}
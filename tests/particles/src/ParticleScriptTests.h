@@ -0,0 +1,26 @@
+//
+//  ParticleScriptTests.h
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__ParticleScriptTests__
+#define __tests__ParticleScriptTests__
+
+namespace ParticleScriptTests {
+
+    /// Checks that particles running the same script share a context, which goes when the last of them dies.
+    void scriptsShareContexts();
+
+    /// Checks that a thread other than the tree's update thread tears down its contexts for scripts whose particles
+    /// died elsewhere.
+    void otherThreadsReleaseContexts();
+
+    /// Compares the update cost per scripted particle of a new script engine per update against reused contexts.
+    void updateThroughput();
+
+    void runAllTests();
+}
+
+#endif // __tests__ParticleScriptTests__
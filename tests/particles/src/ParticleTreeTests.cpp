@@ -0,0 +1,584 @@
+//
+//  ParticleTreeTests.cpp
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <QSet>
+#include <QUuid>
+
+#include <AABox.h>
+#include <OctreePacketData.h>
+#include <PacketHeaders.h>
+#include <ParticleTree.h>
+#include <SharedUtil.h>
+
+#include "ParticleTreeTests.h"
+
+static glm::vec3 randVector() {
+    return glm::vec3(randFloat(), randFloat(), randFloat());
+}
+
+static void storeNewParticle(ParticleTree& tree, uint32_t id) {
+    rgbColor color = { 0, 255, 0 };
+    Particle particle;
+    particle.init(randVector(), randFloatInRange(0.001f, 0.05f), color, glm::vec3(0.0f), glm::vec3(0.0f),
+        0.0f, DEFAULT_LIFETIME, NOT_IN_HAND, DEFAULT_SCRIPT, id);
+    tree.storeParticle(particle);
+}
+
+static void addPendingParticle(ParticleTree& tree, uint32_t creatorTokenID) {
+    ParticleProperties properties;
+    properties.setPosition(randVector());
+    properties.setRadius(randFloatInRange(0.001f, 0.05f));
+    properties.setGravity(glm::vec3(0.0f));
+    tree.addParticle(ParticleID(UNKNOWN_PARTICLE_ID, creatorTokenID, false), properties);
+}
+
+static void assignParticleID(ParticleTree& tree, uint32_t creatorTokenID, uint32_t particleID) {
+    QByteArray packet;
+    populatePacketHeader(packet, PacketTypeParticleAddResponse, QUuid::createUuid());
+    packet.append(reinterpret_cast<const char*>(&creatorTokenID), sizeof(creatorTokenID));
+    packet.append(reinterpret_cast<const char*>(&particleID), sizeof(particleID));
+    tree.handleAddParticleResponse(packet);
+}
+
+class CheckIndexArgs {
+public:
+    ParticleTree* tree;
+    QSet<uint32_t> ids;
+    int errors;
+};
+
+static bool checkIndexOperation(OctreeElement* element, void* extraData) {
+    CheckIndexArgs* args = static_cast<CheckIndexArgs*>(extraData);
+    const QVector<Particle>& particles = static_cast<ParticleTreeElement*>(element)->getParticles();
+    for (int i = 0; i < particles.size(); i++) {
+        uint32_t id = particles.at(i).getID();
+        if (id == UNKNOWN_PARTICLE_ID) {
+            continue;
+        }
+        args->ids.insert(id);
+        const Particle* found = args->tree->findParticleByID(id, true);
+        if (found != &particles.at(i) && args->errors++ == 0) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << id << " at level "
+                << (int)element->getLevel() << " found as " << found << ", expected " << &particles.at(i) << std::endl;
+        }
+    }
+    return true;
+}
+
+void ParticleTreeTests::indexSurvivesChurn() {
+    const int ROUNDS = 50;
+    const int STORES_PER_ROUND = 200;
+    const int ADDS_PER_ROUND = 20;
+    const int EDITS_PER_ROUND = 100;
+    const int DELETES_PER_ROUND = 40;
+    const int KILLS_PER_ROUND = 20;
+
+    ParticleTree tree;
+    QList<uint32_t> liveIDs;
+    QList<uint32_t> pendingTokens;
+    QSet<uint32_t> removedIDs;
+    uint32_t nextID = 1;
+    uint32_t nextToken = 1;
+    int errors = 0;
+
+    for (int round = 0; round < ROUNDS && errors == 0; round++) {
+        tree.lockForWrite();
+        for (int i = 0; i < STORES_PER_ROUND; i++) {
+            storeNewParticle(tree, nextID);
+            liveIDs.append(nextID++);
+        }
+        for (int i = 0; i < ADDS_PER_ROUND; i++) {
+            addPendingParticle(tree, nextToken);
+            pendingTokens.append(nextToken++);
+        }
+
+        // move some particles somewhere else entirely, possibly out of the tree, to be rehomed by the next update
+        for (int i = 0; i < EDITS_PER_ROUND && !liveIDs.isEmpty(); i++) {
+            const Particle* particle = tree.findParticleByID(liveIDs.at(randIntInRange(0, liveIDs.size() - 1)), true);
+            if (particle) {
+                Particle edited = *particle;
+                edited.setPosition(randVector() * 1.2f - glm::vec3(0.1f));
+                edited.setLastEdited(particle->getLastEdited() + 1);
+                tree.storeParticle(edited);
+            }
+        }
+        for (int i = 0; i < KILLS_PER_ROUND && !liveIDs.isEmpty(); i++) {
+            const Particle* particle = tree.findParticleByID(liveIDs.at(randIntInRange(0, liveIDs.size() - 1)), true);
+            if (particle) {
+                Particle killed = *particle;
+                killed.setShouldDie(true);
+                killed.setLastEdited(particle->getLastEdited() + 1);
+                tree.storeParticle(killed);
+            }
+        }
+        for (int i = 0; i < DELETES_PER_ROUND && !liveIDs.isEmpty(); i++) {
+            uint32_t id = liveIDs.takeAt(randIntInRange(0, liveIDs.size() - 1));
+            tree.deleteParticle(ParticleID(id));
+            removedIDs.insert(id);
+        }
+        tree.unlock();
+
+        // the server gives half of the pending particles their IDs
+        for (int i = 0; i < pendingTokens.size() / 2; i++) {
+            assignParticleID(tree, pendingTokens.takeFirst(), nextID);
+            liveIDs.append(nextID++);
+        }
+
+        tree.update();
+
+        tree.lockForRead();
+        CheckIndexArgs args;
+        args.tree = &tree;
+        args.errors = 0;
+        tree.recurseTreeWithOperation(checkIndexOperation, &args);
+        errors += args.errors;
+
+        // everything that's gone from the tree must be gone from the index
+        foreach (uint32_t id, removedIDs) {
+            if (tree.findParticleByID(id, true) && errors++ == 0) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: deleted particle " << id << " still found" << std::endl;
+            }
+        }
+        for (int i = liveIDs.size() - 1; i >= 0; i--) {
+            if (!args.ids.contains(liveIDs.at(i))) {
+                if (tree.findParticleByID(liveIDs.at(i), true) && errors++ == 0) {
+                    std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << liveIDs.at(i)
+                        << " left the tree but is still found" << std::endl;
+                }
+                removedIDs.insert(liveIDs.takeAt(i));
+            }
+        }
+        tree.unlock();
+    }
+    if (errors > 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << errors << " particle index errors" << std::endl;
+    }
+}
+
+void ParticleTreeTests::idleTreeStopsChanging() {
+    const int PARTICLE_COUNT = 100;
+    const int SETTLE_USECS = USECS_PER_SECOND;
+    const int UPDATE_INTERVAL_USECS = 10000;
+
+    // half rest on the ground under gravity, the others float without it
+    ParticleTree tree;
+    rgbColor color = { 0, 0, 255 };
+    for (int i = 0; i < PARTICLE_COUNT; i++) {
+        Particle particle;
+        bool floating = (i % 2 == 0);
+        particle.init(glm::vec3(randFloat(), floating ? randFloat() : 0.0f, randFloat()), 0.01f, color,
+            glm::vec3(0.0f), floating ? glm::vec3(0.0f) : DEFAULT_GRAVITY, DEFAULT_DAMPING, 1000.0f, NOT_IN_HAND,
+            DEFAULT_SCRIPT, i + 1);
+        tree.storeParticle(particle);
+    }
+    quint64 start = usecTimestampNow();
+    while (usecTimestampNow() - start < SETTLE_USECS) {
+        tree.update();
+        usleep(UPDATE_INTERVAL_USECS);
+    }
+
+    const int IDLE_UPDATES = 20;
+    quint64 settled = usecTimestampNow();
+    tree.clearDirtyBit();
+    for (int i = 0; i < IDLE_UPDATES; i++) {
+        tree.update();
+        usleep(UPDATE_INTERVAL_USECS);
+    }
+    if (tree.getRoot()->hasChangedSince(settled) || tree.isDirty()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: tree of settled particles changed" << std::endl;
+    }
+    const Particle* sleeper = tree.findParticleByID(1);
+    if (!sleeper || !sleeper->isSleeping()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: settled particle isn't asleep" << std::endl;
+        return;
+    }
+
+    // kicking one particle wakes it up and changes its element, and the path to it
+    Particle kicked = *sleeper;
+    kicked.setVelocity(glm::vec3(0.0f, 1.0f, 0.0f) / (float)TREE_SCALE);
+    kicked.setLastEdited(sleeper->getLastEdited() + 1);
+    tree.storeParticle(kicked);
+    quint64 kickedAt = usecTimestampNow();
+    usleep(UPDATE_INTERVAL_USECS);
+    tree.update();
+    if (!tree.getRoot()->hasChangedSince(kickedAt)) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: kicked particle didn't change the tree" << std::endl;
+    }
+    sleeper = tree.findParticleByID(1);
+    if (!sleeper || sleeper->isSleeping()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: kicked particle didn't wake up" << std::endl;
+    }
+}
+
+static void storeMovingParticles(ParticleTree& tree, int count, float maxSpeed, const QString& script = DEFAULT_SCRIPT) {
+    static uint32_t nextID = 1;
+    rgbColor color = { 255, 255, 0 };
+    for (int i = 0; i < count; i++) {
+        Particle particle;
+        glm::vec3 velocity = (randVector() - glm::vec3(0.5f)) * (2.0f * maxSpeed);
+        particle.init(randVector(), 0.001f, color, velocity, glm::vec3(0.0f), DEFAULT_DAMPING, 1000.0f, NOT_IN_HAND,
+            script, nextID++);
+        tree.storeParticle(particle);
+    }
+}
+
+static bool collectParticlesOperation(OctreeElement* element, void* extraData) {
+    QVector<Particle>* particles = static_cast<QVector<Particle>*>(extraData);
+    *particles += static_cast<ParticleTreeElement*>(element)->getParticles();
+    return true;
+}
+
+void ParticleTreeTests::parallelUpdateMatchesSerial() {
+    const int PARTICLE_COUNT = 5000;
+    const int SCRIPTED_PARTICLE_COUNT = 50;
+    const float MAX_SPEED = 20.0f; // fast enough that some particles change elements or leave the tree
+    ParticleTree tree;
+    storeMovingParticles(tree, PARTICLE_COUNT, MAX_SPEED);
+    storeMovingParticles(tree, SCRIPTED_PARTICLE_COUNT, MAX_SPEED, "Particle.update.connect(function() { });");
+
+    QVector<Particle> before;
+    tree.recurseTreeWithOperation(collectParticlesOperation, &before);
+    usleep(1000);
+    tree.update();
+
+    // every particle is simulated with the same time, which we can read back from any of them
+    QVector<Particle> after;
+    tree.recurseTreeWithOperation(collectParticlesOperation, &after);
+    if (after.isEmpty()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: every particle left the tree" << std::endl;
+        return;
+    }
+    quint64 now = after.first().getLastUpdated();
+
+    AABox treeBounds = tree.getRoot()->getAABox();
+    int mismatches = 0;
+    int left = 0;
+    for (int i = 0; i < before.size(); i++) {
+        Particle expected = before.at(i);
+        expected.update(now);
+        const Particle* particle = tree.findParticleByID(expected.getID());
+        if (expected.getShouldDie() || !treeBounds.contains(expected.getPosition())) {
+            left++;
+            if (particle && mismatches++ == 0) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << expected.getID()
+                    << " should have left the tree" << std::endl;
+            }
+        } else if (!particle || particle->getLastUpdated() != now || particle->getPosition() != expected.getPosition() ||
+                particle->getVelocity() != expected.getVelocity()) {
+            if (mismatches++ == 0) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << expected.getID()
+                    << (particle ? " simulated differently" : " is missing") << std::endl;
+            }
+        }
+    }
+    if (mismatches > 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << mismatches << " of " << before.size()
+            << " particles differ from simulating them one at a time (" << left << " left the tree)" << std::endl;
+    }
+}
+
+void ParticleTreeTests::updateThroughput() {
+    const int PARTICLE_COUNT = 100000;
+    const float MAX_SPEED = 0.01f;
+    const int UPDATES = 10;
+    ParticleTree tree;
+    storeMovingParticles(tree, PARTICLE_COUNT, MAX_SPEED);
+
+    for (int parallel = 0; parallel < 2; parallel++) {
+        tree.setDeterministicUpdates(!parallel);
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < UPDATES; i++) {
+            tree.update();
+        }
+        quint64 elapsed = (usecTimestampNow() - start) / UPDATES;
+        std::cout << "updated " << PARTICLE_COUNT << " particles in " << elapsed << " usec "
+            << (parallel ? "in parallel" : "on one thread") << std::endl;
+    }
+}
+
+static bool collectElementsOperation(OctreeElement* element, void* extraData) {
+    static_cast<QVector<ParticleTreeElement*>*>(extraData)->append(static_cast<ParticleTreeElement*>(element));
+    return true;
+}
+
+void ParticleTreeTests::encodeThroughput() {
+    const int PARTICLE_COUNT = 100000;
+    const int ITERATIONS = 5;
+    ParticleTree tree;
+    storeMovingParticles(tree, PARTICLE_COUNT, 0.0f);
+    QVector<ParticleTreeElement*> elements;
+    tree.recurseTreeWithOperation(collectElementsOperation, &elements);
+
+    int packets = 0;
+    quint64 start = usecTimestampNow();
+    for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+        OctreePacketData packetData;
+        packets = 0;
+        foreach (ParticleTreeElement* element, elements) {
+            LevelDetails level = packetData.startLevel();
+            if (element->appendElementData(&packetData)) {
+                packetData.endLevel(level);
+                continue;
+            }
+            // start a new packet
+            packetData.discardLevel(level);
+            packetData.reset();
+            packets++;
+            level = packetData.startLevel();
+            if (element->appendElementData(&packetData)) {
+                packetData.endLevel(level);
+            } else {
+                packetData.discardLevel(level);
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: element with " << element->getParticles().size()
+                    << " particles didn't fit in an empty packet" << std::endl;
+            }
+        }
+        if (packetData.hasContent()) {
+            packets++;
+        }
+    }
+    quint64 elapsed = (usecTimestampNow() - start) / ITERATIONS;
+    std::cout << "encoded " << PARTICLE_COUNT << " particles in " << elements.size() << " elements into " << packets
+        << " packets in " << elapsed << " usec" << std::endl;
+}
+
+static ParticleTreeElement* findElementWithParticle(ParticleTree& tree, uint32_t id) {
+    QVector<ParticleTreeElement*> elements;
+    tree.recurseTreeWithOperation(collectElementsOperation, &elements);
+    foreach (ParticleTreeElement* element, elements) {
+        foreach (const Particle& particle, element->getParticles()) {
+            if (particle.getID() == id) {
+                return element;
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool sendElement(ParticleTreeElement* from, ParticleTreeElement* to, quint64 sinceTime, int packetVersion,
+                        int& bytesSent) {
+    OctreePacketData packetData;
+    if (!from->appendElementDelta(&packetData, sinceTime, packetVersion)) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: element didn't fit in an empty packet" << std::endl;
+        return false;
+    }
+    bytesSent = packetData.getUncompressedSize();
+    ReadBitstreamToTreeParams args(WANT_COLOR, WANT_EXISTS_BITS, NULL, QUuid(), SharedNodePointer(), false,
+        packetVersion == LATEST_PACKET_VERSION ? versionForPacketType(PacketTypeParticleData) : packetVersion);
+    int bytesRead = to->readElementDataFromBuffer(packetData.getUncompressedData(), bytesSent, args);
+    if (bytesRead != bytesSent) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: read " << bytesRead << " of " << bytesSent << " bytes"
+            << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool particlesMatch(const Particle* received, const Particle& sent, bool exact) {
+    const float POSITION_TOLERANCE = 0.002f / TREE_SCALE;
+    const float VELOCITY_TOLERANCE = 0.02f / TREE_SCALE;
+    if (!received) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << sent.getID() << " wasn't received" << std::endl;
+        return false;
+    }
+    float positionError = glm::length(received->getPosition() - sent.getPosition());
+    float velocityError = glm::length(received->getVelocity() - sent.getVelocity());
+    if ((exact ? positionError != 0.0f : positionError > POSITION_TOLERANCE) ||
+            (exact ? velocityError != 0.0f : velocityError > VELOCITY_TOLERANCE) ||
+            memcmp(received->getColor(), sent.getColor(), sizeof(rgbColor)) != 0 ||
+            received->getRadius() != sent.getRadius() || received->getScript() != sent.getScript() ||
+            received->getModelURL() != sent.getModelURL()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particle " << sent.getID() << " received off by "
+            << positionError * TREE_SCALE << " meters and " << velocityError * TREE_SCALE << " meters/second, or with "
+            << "different properties" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ParticleTreeTests::deltaRoundTrip() {
+    const uint32_t PARTICLE_ID = 1;
+    const uint32_t PLACEHOLDER_ID = 2;
+    rgbColor color = { 255, 0, 0 };
+    Particle particle;
+    particle.init(glm::vec3(0.3f, 0.4f, 0.5f), 0.01f, color, glm::vec3(1.5f, 0.0f, -2.25f) / (float)TREE_SCALE,
+        glm::vec3(0.0f), DEFAULT_DAMPING, DEFAULT_LIFETIME, NOT_IN_HAND, DEFAULT_SCRIPT, PARTICLE_ID);
+    particle.setModelURL("http://example.com/model.fst");
+
+    // the viewers already have the element, with another particle in it, but have never heard of ours
+    const int PACKET_VERSIONS[] = { FULL_PARTICLE_DATA_VERSION, LATEST_PACKET_VERSION };
+    for (unsigned int i = 0; i < sizeof(PACKET_VERSIONS) / sizeof(PACKET_VERSIONS[0]); i++) {
+        int packetVersion = PACKET_VERSIONS[i];
+        bool full = (packetVersion == FULL_PARTICLE_DATA_VERSION);
+        ParticleTree serverTree;
+        ParticleTree clientTree;
+        serverTree.storeParticle(particle);
+        Particle placeholder = particle;
+        placeholder.setID(PLACEHOLDER_ID);
+        clientTree.storeParticle(placeholder);
+        ParticleTreeElement* serverElement = findElementWithParticle(serverTree, PARTICLE_ID);
+        ParticleTreeElement* clientElement = findElementWithParticle(clientTree, PLACEHOLDER_ID);
+        if (!serverElement || !clientElement || serverElement->getAABox().getCorner() != clientElement->getAABox().getCorner()) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: particles weren't stored in matching elements" << std::endl;
+            return;
+        }
+
+        int fullBytes = 0;
+        if (!sendElement(serverElement, clientElement, 0, packetVersion, fullBytes) ||
+                !particlesMatch(clientTree.findParticleByID(PARTICLE_ID), particle, full)) {
+            return;
+        }
+        if (full) {
+            continue;
+        }
+
+        // recolor the particle, which is all that should be sent to a viewer that's seen it
+        quint64 sentAt = usecTimestampNow();
+        usleep(1000);
+        Particle recolored = *serverTree.findParticleByID(PARTICLE_ID);
+        rgbColor newColor = { 0, 0, 255 };
+        recolored.setColor(newColor);
+        recolored.setLastEdited(usecTimestampNow());
+        serverTree.storeParticle(recolored);
+
+        int deltaBytes = 0;
+        if (!sendElement(serverElement, clientElement, sentAt, packetVersion, deltaBytes) ||
+                !particlesMatch(clientTree.findParticleByID(PARTICLE_ID), recolored, false)) {
+            return;
+        }
+        if (deltaBytes >= fullBytes) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: recoloring took " << deltaBytes << " bytes, sending "
+                << "the whole element took " << fullBytes << std::endl;
+        }
+
+        // nothing has changed since the recoloring, so nothing should be sent but the (zero) particle count
+        int idleBytes = 0;
+        if (sendElement(serverElement, clientElement, usecTimestampNow(), packetVersion, idleBytes) &&
+                idleBytes != (int)sizeof(uint16_t)) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: an unchanged element took " << idleBytes << " bytes"
+                << std::endl;
+        }
+    }
+}
+
+void ParticleTreeTests::erasedRangesRoundTrip() {
+    // runs of consecutive IDs, lone IDs, and gaps too wide for a single byte
+    QVector<uint32_t> ids;
+    uint32_t id = 0;
+    for (int i = 0; i < 2000; i++) {
+        id += 1 + (randIntInRange(0, 3) == 0 ? randIntInRange(1, 100000) : 0);
+        int runLength = randIntInRange(1, 20);
+        for (int j = 0; j < runLength; j++) {
+            ids.append(id++);
+        }
+    }
+
+    // a small buffer, so the IDs are split over several packets
+    const int MAX_LENGTH = 100;
+    unsigned char buffer[MAX_LENGTH];
+    QVector<uint32_t> unpacked;
+    int nextID = 0;
+    int packets = 0;
+    while (nextID < ids.size()) {
+        int previousID = nextID;
+        int length = ParticleTree::packParticleIDRanges(ids, nextID, buffer, MAX_LENGTH);
+        if (nextID == previousID) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: no IDs fit in a packet" << std::endl;
+            return;
+        }
+        packets++;
+        if (ParticleTree::unpackParticleIDRanges(buffer, length, unpacked) != length) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't unpack packet " << packets << std::endl;
+            return;
+        }
+        // a cut short packet must be rejected rather than read past its end
+        QVector<uint32_t> truncated;
+        if (length > (int)sizeof(uint16_t) && ParticleTree::unpackParticleIDRanges(buffer, length - 1, truncated) != 0) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: unpacked a truncated packet" << std::endl;
+        }
+    }
+    if (unpacked != ids) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: unpacked " << unpacked.size() << " IDs from " << packets
+            << " packets, packed " << ids.size() << std::endl;
+    }
+}
+
+void ParticleTreeTests::extrapolationFollowsServer() {
+    const quint64 SIMULATED_USECS = 4 * USECS_PER_SECOND;
+    const quint64 CLIENT_FRAME_USECS = USECS_PER_SECOND / 60;
+    rgbColor color = { 0, 255, 255 };
+
+    // thrown up from near the ground, so that it bounces: something the client and server won't time the same
+    Particle server;
+    server.init(glm::vec3(0.5f, 1.0f / TREE_SCALE, 0.5f), 0.001f, color, glm::vec3(3.0f, 5.0f, -2.0f) / (float)TREE_SCALE,
+        DEFAULT_GRAVITY, DEFAULT_DAMPING, 1000.0f, NOT_IN_HAND, DEFAULT_SCRIPT, 1);
+    Particle client;
+    AABox box(glm::vec3(0.0f), 1.0f);
+    ReadBitstreamToTreeParams args;
+
+    quint64 start = server.getLastUpdated();
+    quint64 serverTime = start;
+    quint64 clientTime = start;
+    quint64 lastSent = 0;
+    int serverUpdates = 0;
+    int motionSends = 0;
+    float maxError = 0.0f;
+    while (serverTime < start + SIMULATED_USECS) {
+        serverTime += randIntInRange(2000, 20000);
+        server.update(serverTime);
+        serverUpdates++;
+
+        // the client draws frames at its own rate in between hearing from the server
+        while (clientTime + CLIENT_FRAME_USECS < serverTime) {
+            clientTime += CLIENT_FRAME_USECS;
+            client.update(clientTime, true);
+        }
+        uint8_t delta = server.getDeltaSince(lastSent, serverTime);
+        if (delta) {
+            OctreePacketData packetData;
+            server.appendParticleDelta(&packetData, delta, box);
+            Particle received = client;
+            if (received.readParticleDeltaFromBuffer(packetData.getUncompressedData(), packetData.getUncompressedSize(),
+                    box, args) == 0) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't read a particle delta" << std::endl;
+                return;
+            }
+            client.copyChangedProperties(received);
+            lastSent = serverTime;
+            if (delta & PARTICLE_DELTA_MOTION) {
+                motionSends++;
+            }
+        }
+        clientTime = serverTime;
+        client.update(clientTime, true);
+        maxError = std::max(maxError, glm::distance(client.getPosition(), server.getPosition()));
+    }
+    if (maxError > DEFAULT_MOTION_TOLERANCE * 1.001f) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: client strayed " << maxError * TREE_SCALE << " meters from the "
+            << "server, tolerance is " << DEFAULT_MOTION_TOLERANCE * TREE_SCALE << std::endl;
+    }
+    const int MAX_SENDS_PER_UPDATE = 4;
+    if (motionSends * MAX_SENDS_PER_UPDATE > serverUpdates) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: motion sent " << motionSends << " times in " << serverUpdates
+            << " updates" << std::endl;
+    }
+}
+
+void ParticleTreeTests::runAllTests() {
+    indexSurvivesChurn();
+    idleTreeStopsChanging();
+    parallelUpdateMatchesSerial();
+    updateThroughput();
+    encodeThroughput();
+    deltaRoundTrip();
+    erasedRangesRoundTrip();
+    extrapolationFollowsServer();
+}
@@ -0,0 +1,43 @@
+//
+//  ParticleTreeTests.h
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__ParticleTreeTests__
+#define __tests__ParticleTreeTests__
+
+namespace ParticleTreeTests {
+
+    /// Stores, edits, moves, kills and deletes particles at random, checking after each round that every particle in
+    /// the tree is found by its ID and that removed particles are not.
+    void indexSurvivesChurn();
+
+    /// Checks that a tree of settled particles stops being stamped as changed, and that an edit wakes it back up.
+    void idleTreeStopsChanging();
+
+    /// Checks that a parallel update leaves every particle where simulating it on its own would.
+    void parallelUpdateMatchesSerial();
+
+    /// Compares the time to update 100k particles on one thread and in parallel.
+    void updateThroughput();
+
+    /// Times encoding the elements of a tree of 100k particles into packets.
+    void encodeThroughput();
+
+    /// Sends an element to a viewer in full and as deltas, checking that the particles arrive within the quantization
+    /// tolerance and that deltas are smaller.
+    void deltaRoundTrip();
+
+    /// Packs sorted particle IDs as ranges over several packets and checks that they unpack to the same IDs.
+    void erasedRangesRoundTrip();
+
+    /// Simulates a bouncing particle on a server and extrapolates it on a client that's only sent what the server thinks
+    /// it needs, checking that the client stays within the motion tolerance of the server, and is seldom sent its motion.
+    void extrapolationFollowsServer();
+
+    void runAllTests();
+}
+
+#endif // __tests__ParticleTreeTests__
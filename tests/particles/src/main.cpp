@@ -0,0 +1,13 @@
+//
+//  main.cpp
+//  particle-tests
+//
+
+#include "ParticleScriptTests.h"
+#include "ParticleTreeTests.h"
+
+int main(int argc, char** argv) {
+    ParticleScriptTests::runAllTests();
+    ParticleTreeTests::runAllTests();
+    return 0;
+}
@@ -0,0 +1,135 @@
+//
+//  SpatialHashTests.cpp
+//  physics-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <iostream>
+
+#include <GeometryUtil.h>
+#include <SharedUtil.h>
+#include <SpatialHash.h>
+
+#include "SpatialHashTests.h"
+
+static bool operator<(const SpatialHashPair& a, const SpatialHashPair& b) {
+    return a.first < b.first || (a.first == b.first && a.second < b.second);
+}
+
+static bool operator==(const SpatialHashPair& a, const SpatialHashPair& b) {
+    return a.first == b.first && a.second == b.second;
+}
+
+static void makeSpheres(int count, float minRadius, float maxRadius, QVector<glm::vec3>& centers, QVector<float>& radii) {
+    for (int i = 0; i < count; i++) {
+        centers.append(glm::vec3(randFloat(), randFloat(), randFloat()));
+        radii.append(randFloatInRange(minRadius, maxRadius));
+    }
+}
+
+static bool boxesOverlap(const glm::vec3& firstCenter, float firstRadius, const glm::vec3& secondCenter, float secondRadius) {
+    glm::vec3 distance = glm::abs(firstCenter - secondCenter);
+    float radius = firstRadius + secondRadius;
+    return distance.x <= radius && distance.y <= radius && distance.z <= radius;
+}
+
+void SpatialHashTests::pairsMatchBruteForce() {
+    const int SPHERE_COUNT = 2000;
+    QVector<glm::vec3> centers;
+    QVector<float> radii;
+    makeSpheres(SPHERE_COUNT, 0.001f, 0.02f, centers, radii);
+
+    // a few big spheres spanning many cells, and some outside the unit cube
+    const int BIG_SPHERE_COUNT = 5;
+    for (int i = 0; i < BIG_SPHERE_COUNT; i++) {
+        radii[i] = randFloatInRange(0.1f, 0.3f);
+    }
+    const int OUTSIDE_SPHERE_COUNT = 100;
+    for (int i = 0; i < OUTSIDE_SPHERE_COUNT; i++) {
+        centers[BIG_SPHERE_COUNT + i] -= glm::vec3(1.0f, 0.5f, 2.0f);
+    }
+
+    QVector<SpatialHashPair> expected;
+    for (int i = 0; i < SPHERE_COUNT; i++) {
+        for (int j = i + 1; j < SPHERE_COUNT; j++) {
+            if (boxesOverlap(centers.at(i), radii.at(i), centers.at(j), radii.at(j))) {
+                SpatialHashPair pair = { i, j };
+                expected.append(pair);
+            }
+        }
+    }
+
+    const float CELL_SIZES[] = { 0.005f, 0.02f, 0.1f, 1.0f };
+    for (unsigned int i = 0; i < sizeof(CELL_SIZES) / sizeof(CELL_SIZES[0]); i++) {
+        SpatialHash spatialHash(CELL_SIZES[i]);
+        for (int j = 0; j < SPHERE_COUNT; j++) {
+            spatialHash.addSphere(centers.at(j), radii.at(j));
+        }
+        QVector<SpatialHashPair> pairs;
+        spatialHash.findPairs(pairs);
+        std::sort(pairs.begin(), pairs.end());
+        if (pairs != expected) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: found " << pairs.size() << " pairs with cell size "
+                << CELL_SIZES[i] << ", expected " << expected.size() << std::endl;
+        }
+    }
+}
+
+void SpatialHashTests::pairsThroughput() {
+    const int SPHERE_COUNT = 10000;
+    const float RADIUS = 0.005f;
+    QVector<glm::vec3> centers;
+    QVector<float> radii;
+    makeSpheres(SPHERE_COUNT, 0.5f * RADIUS, 1.5f * RADIUS, centers, radii);
+
+    glm::vec3 penetration;
+    int touching = 0;
+    quint64 start = usecTimestampNow();
+    for (int i = 0; i < SPHERE_COUNT; i++) {
+        for (int j = i + 1; j < SPHERE_COUNT; j++) {
+            if (findSphereSpherePenetration(centers.at(i), radii.at(i), centers.at(j), radii.at(j), penetration)) {
+                touching++;
+            }
+        }
+    }
+    quint64 bruteForceElapsed = usecTimestampNow() - start;
+
+    const int ITERATIONS = 10;
+    int hashedTouching = 0;
+    int candidates = 0;
+    SpatialHash spatialHash(2.0f * RADIUS);
+    QVector<SpatialHashPair> pairs;
+    start = usecTimestampNow();
+    for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+        // rebuilt every time, as it would be every frame
+        spatialHash.clear();
+        for (int i = 0; i < SPHERE_COUNT; i++) {
+            spatialHash.addSphere(centers.at(i), radii.at(i));
+        }
+        spatialHash.findPairs(pairs);
+        candidates = pairs.size();
+        hashedTouching = 0;
+        foreach (const SpatialHashPair& pair, pairs) {
+            if (findSphereSpherePenetration(centers.at(pair.first), radii.at(pair.first), centers.at(pair.second),
+                    radii.at(pair.second), penetration)) {
+                hashedTouching++;
+            }
+        }
+    }
+    quint64 hashedElapsed = (usecTimestampNow() - start) / ITERATIONS;
+
+    if (hashedTouching != touching) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: spatial hash found " << hashedTouching
+            << " touching pairs, expected " << touching << std::endl;
+    }
+    std::cout << SPHERE_COUNT << " spheres, " << touching << " touching pairs: " << bruteForceElapsed
+        << " usec testing every pair, " << hashedElapsed << " usec with the spatial hash (" << candidates
+        << " candidates)" << std::endl;
+}
+
+void SpatialHashTests::runAllTests() {
+    pairsMatchBruteForce();
+    pairsThroughput();
+}
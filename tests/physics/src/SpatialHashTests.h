@@ -0,0 +1,22 @@
+//
+//  SpatialHashTests.h
+//  physics-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__SpatialHashTests__
+#define __tests__SpatialHashTests__
+
+namespace SpatialHashTests {
+
+    /// Checks that the spatial hash finds the same pairs as testing every pair, each exactly once, at several cell sizes.
+    void pairsMatchBruteForce();
+
+    /// Times finding the touching pairs among 10k spheres by testing every pair and with the spatial hash.
+    void pairsThroughput();
+
+    void runAllTests();
+}
+
+#endif // __tests__SpatialHashTests__
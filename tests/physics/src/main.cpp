@@ -4,8 +4,10 @@
 //
 
 #include "ShapeColliderTests.h"
+#include "SpatialHashTests.h"
 
 int main(int argc, char** argv) {
     ShapeColliderTests::runAllTests();
+    SpatialHashTests::runAllTests();
     return 0;
 }
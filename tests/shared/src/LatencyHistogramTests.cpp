@@ -0,0 +1,129 @@
+//
+//  LatencyHistogramTests.cpp
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <QtCore/QVector>
+
+#include <LatencyHistogram.h>
+#include <SharedUtil.h>
+
+#include "LatencyHistogramTests.h"
+
+const int VALUE_COUNT = 100000;
+
+enum Distribution { UNIFORM, LONG_TAILED, BIMODAL, DISTRIBUTION_COUNT };
+
+static const char* DISTRIBUTION_NAMES[] = { "uniform", "long tailed", "bimodal" };
+
+static int createRandomValue(Distribution distribution) {
+    switch (distribution) {
+        case UNIFORM:
+            return randIntInRange(0, 999);
+
+        case LONG_TAILED:
+            // spread over eight orders of magnitude, like lock waits
+            return (int)exp(randFloatInRange(0.0f, 18.0f));
+
+        default:
+            // mostly quick, with a cluster of stalls
+            return (randFloat() < 0.95f) ? randIntInRange(0, 50) : randIntInRange(100000, 1100000);
+    }
+}
+
+static bool isWithinPrecision(int actual, int expected) {
+    // exact below 128; otherwise no less than the value, and no more than 1/64 above it
+    const int EXACT_LIMIT = 128;
+    const int RELATIVE_PRECISION = 64;
+    return (expected < EXACT_LIMIT) ? (actual == expected) :
+        (actual >= expected && actual - expected <= expected / RELATIVE_PRECISION);
+}
+
+void LatencyHistogramTests::percentilesMatchSort() {
+    const float PERCENTILES[] = { 0.0f, 50.0f, 90.0f, 99.0f, 99.9f, 100.0f };
+    const int PERCENTILE_COUNT = sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+    for (int distribution = 0; distribution < DISTRIBUTION_COUNT; distribution++) {
+        LatencyHistogram histogram;
+        QVector<int> values;
+        double total = 0.0;
+        for (int i = 0; i < VALUE_COUNT; i++) {
+            int value = createRandomValue((Distribution)distribution);
+            values.append(value);
+            histogram.record(value);
+            total += value;
+        }
+        std::sort(values.begin(), values.end());
+
+        for (int i = 0; i < PERCENTILE_COUNT; i++) {
+            int rank = std::max(1, (int)ceil(PERCENTILES[i] * VALUE_COUNT / 100.0f));
+            int expected = values.at(rank - 1);
+            int actual = histogram.getPercentile(PERCENTILES[i]);
+            if (!isWithinPrecision(actual, expected)) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << DISTRIBUTION_NAMES[distribution] << " p"
+                    << PERCENTILES[i] << " is " << actual << ", expected " << expected << std::endl;
+            }
+        }
+        if (histogram.getCount() != VALUE_COUNT || histogram.getMinimum() != values.first() ||
+                histogram.getMaximum() != values.last()) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << DISTRIBUTION_NAMES[distribution]
+                << " count/min/max " << histogram.getCount() << "/" << histogram.getMinimum() << "/"
+                << histogram.getMaximum() << ", expected " << VALUE_COUNT << "/" << values.first() << "/"
+                << values.last() << std::endl;
+        }
+        const float MEAN_PRECISION = 1.0f / 64.0f;
+        float mean = total / VALUE_COUNT;
+        if (fabsf(histogram.getMean() - mean) > mean * MEAN_PRECISION) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << DISTRIBUTION_NAMES[distribution] << " mean "
+                << histogram.getMean() << ", expected " << mean << std::endl;
+        }
+        std::cout << DISTRIBUTION_NAMES[distribution] << ": p50 " << histogram.getPercentile(50.0f) << " p99 "
+            << histogram.getPercentile(99.0f) << " p99.9 " << histogram.getPercentile(99.9f) << " max "
+            << histogram.getMaximum() << " (sorted: " << values.at(VALUE_COUNT / 2 - 1) << " "
+            << values.at(VALUE_COUNT * 99 / 100 - 1) << " " << values.at(VALUE_COUNT * 999 / 1000 - 1) << " "
+            << values.last() << ")" << std::endl;
+    }
+}
+
+void LatencyHistogramTests::mergedMatchesWhole() {
+    const int PART_COUNT = 4;
+    LatencyHistogram whole;
+    LatencyHistogram parts[PART_COUNT];
+    for (int i = 0; i < VALUE_COUNT; i++) {
+        int value = createRandomValue(LONG_TAILED);
+        whole.record(value);
+        parts[i % PART_COUNT].record(value);
+    }
+    LatencyHistogram merged;
+    for (int i = 0; i < PART_COUNT; i++) {
+        merged.merge(parts[i]);
+    }
+    const float PERCENTILES[] = { 50.0f, 99.0f, 99.9f, 100.0f };
+    for (unsigned int i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++) {
+        if (merged.getPercentile(PERCENTILES[i]) != whole.getPercentile(PERCENTILES[i])) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: merged p" << PERCENTILES[i] << " is "
+                << merged.getPercentile(PERCENTILES[i]) << ", expected " << whole.getPercentile(PERCENTILES[i])
+                << std::endl;
+        }
+    }
+    if (merged.getCount() != whole.getCount() || merged.getMinimum() != whole.getMinimum() ||
+            merged.getMaximum() != whole.getMaximum()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: merged count/min/max differ" << std::endl;
+    }
+
+    merged.reset();
+    if (merged.getCount() != 0 || merged.getPercentile(50.0f) != 0 || merged.getMaximum() != 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: reset histogram isn't empty" << std::endl;
+    }
+}
+
+void LatencyHistogramTests::runAllTests() {
+    percentilesMatchSort();
+    mergedMatchesWhole();
+}
@@ -0,0 +1,22 @@
+//
+//  LatencyHistogramTests.h
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__LatencyHistogramTests__
+#define __tests__LatencyHistogramTests__
+
+namespace LatencyHistogramTests {
+
+    /// Checks the histogram's percentiles and mean against those of the sorted values, for several distributions.
+    void percentilesMatchSort();
+
+    /// Checks that histograms recorded separately and merged report the same as one that recorded everything.
+    void mergedMatchesWhole();
+
+    void runAllTests();
+}
+
+#endif // __tests__LatencyHistogramTests__
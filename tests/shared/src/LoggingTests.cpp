@@ -0,0 +1,188 @@
+//
+//  LoggingTests.cpp
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <iostream>
+
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+
+#include <LogRing.h>
+#include <Logging.h>
+#include <SharedUtil.h>
+
+#include "LoggingTests.h"
+
+#ifdef _WIN32
+const char NULL_DEVICE[] = "NUL";
+#else
+const char NULL_DEVICE[] = "/dev/null";
+#endif
+
+static void logMessage(const QString& message) {
+    Logging::verboseMessageHandler(QtDebugMsg, QMessageLogContext(), message);
+}
+
+/// Logs a numbered series of messages from a pool thread.
+class LoggingTask : public QRunnable {
+public:
+
+    LoggingTask(int thread, int messageCount, QSemaphore* finished) :
+        _thread(thread), _messageCount(messageCount), _finished(finished) { }
+
+    virtual void run() {
+        for (int i = 0; i < _messageCount; i++) {
+            logMessage(QString("thread %1 message %2").arg(_thread).arg(i));
+        }
+        _finished->release();
+    }
+
+private:
+
+    int _thread;
+    int _messageCount;
+    QSemaphore* _finished;
+};
+
+void LoggingTests::messagesArriveInOrder() {
+    FILE* output = tmpfile();
+    if (!output) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't create a temporary file" << std::endl;
+        return;
+    }
+    Logging::setOutput(output);
+
+    const int THREAD_COUNT = 4;
+    const int MESSAGE_COUNT = 2000;
+    QSemaphore finished;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        QThreadPool::globalInstance()->start(new LoggingTask(i, MESSAGE_COUNT, &finished));
+    }
+    finished.acquire(THREAD_COUNT);
+
+    QString longMessage;
+    const int LONG_MESSAGE_LENGTH = LOG_RECORD_CHARACTERS * 5 / 2;
+    for (int i = 0; i < LONG_MESSAGE_LENGTH; i++) {
+        longMessage.append(QChar('a' + i % 26));
+    }
+    logMessage(longMessage);
+
+    Logging::setOutput(stdout);
+
+    rewind(output);
+    QVector<int> lastMessages(THREAD_COUNT, -1);
+    int received = 0;
+    int dropped = 0;
+    bool foundLongMessage = false;
+    char line[LONG_MESSAGE_LENGTH * 2];
+    while (fgets(line, sizeof(line), output)) {
+        QString lineString = QString::fromLocal8Bit(line).trimmed();
+        if (lineString.endsWith(longMessage)) {
+            foundLongMessage = true;
+            continue;
+        }
+        QStringList words = lineString.split(' ');
+        if (words.size() >= 4 && words.at(words.size() - 4) == "thread") {
+            int thread = words.at(words.size() - 3).toInt();
+            int message = words.last().toInt();
+            if (thread < 0 || thread >= THREAD_COUNT || message <= lastMessages.at(thread)) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: out of order: " << line << std::endl;
+                break;
+            }
+            lastMessages[thread] = message;
+            received++;
+
+        } else if (lineString.endsWith("log messages dropped")) {
+            dropped += words.at(words.size() - 4).toInt();
+        }
+    }
+    fclose(output);
+
+    if (received + dropped != THREAD_COUNT * MESSAGE_COUNT) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: logged " << THREAD_COUNT * MESSAGE_COUNT << " messages, "
+            "but " << received << " were written and " << dropped << " dropped" << std::endl;
+    }
+    if (!foundLongMessage) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: long message didn't come out whole" << std::endl;
+    }
+}
+
+void LoggingTests::idleWriterWakes() {
+    FILE* output = tmpfile();
+    if (!output) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't create a temporary file" << std::endl;
+        return;
+    }
+    Logging::setOutput(output);
+
+    // give the writer time to go idle, then check that a single message, too few to wake it by filling the ring, still
+    // comes out without a flush
+    const unsigned long IDLE_MSECS = 100;
+    QThread::msleep(IDLE_MSECS);
+    logMessage("one message to an idle writer");
+
+    const int MAX_WAIT_MSECS = 1000;
+    const int POLL_MSECS = 5;
+    bool written = false;
+    for (int waited = 0; !written && waited < MAX_WAIT_MSECS; waited += POLL_MSECS) {
+        QThread::msleep(POLL_MSECS);
+        fseek(output, 0, SEEK_END);
+        written = ftell(output) > 0;
+    }
+    Logging::setOutput(stdout);
+    fclose(output);
+
+    if (!written) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: message to an idle writer wasn't written within "
+            << MAX_WAIT_MSECS << " msecs" << std::endl;
+    }
+}
+
+void LoggingTests::callThroughput() {
+    FILE* output = fopen(NULL_DEVICE, "w");
+    if (!output) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't open " << NULL_DEVICE << std::endl;
+        return;
+    }
+    Logging::setOutput(output);
+
+    // log in bursts that fit in a ring, letting the writer catch up in between (outside the timing)
+    const int BURSTS = 200;
+    const int BURST_MESSAGES = LOG_RING_RECORDS / 4;
+    const char* names[] = { "written on the caller", "handed off" };
+    for (int asynchronous = 0; asynchronous < 2; asynchronous++) {
+        quint64 elapsed = 0;
+        for (int i = 0; i < BURSTS; i++) {
+            quint64 start = usecTimestampNow();
+            for (int j = 0; j < BURST_MESSAGES; j++) {
+                QString message = QString("burst %1 message %2 of an ordinary length log line").arg(i).arg(j);
+                if (asynchronous) {
+                    Logging::verboseMessageHandler(QtDebugMsg, QMessageLogContext(), message);
+                } else {
+                    Logging::synchronousMessageHandler(QtDebugMsg, QMessageLogContext(), message);
+                }
+            }
+            elapsed += usecTimestampNow() - start;
+            Logging::flush();
+        }
+        std::cout << "logged " << BURSTS * BURST_MESSAGES << " messages " << names[asynchronous] << " at "
+            << (double)elapsed / (BURSTS * BURST_MESSAGES) << " usec per call" << std::endl;
+    }
+
+    Logging::setOutput(stdout);
+    fclose(output);
+}
+
+void LoggingTests::runAllTests() {
+    messagesArriveInOrder();
+    idleWriterWakes();
+    callThroughput();
+}
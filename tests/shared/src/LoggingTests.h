@@ -0,0 +1,26 @@
+//
+//  LoggingTests.h
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__LoggingTests__
+#define __tests__LoggingTests__
+
+namespace LoggingTests {
+
+    /// Checks that messages logged from several threads at once are all written (or counted as dropped), each thread's
+    /// in order, and that messages longer than a record come out whole.
+    void messagesArriveInOrder();
+
+    /// Checks that the writer, sleeping with nothing queued, wakes for the next message.
+    void idleWriterWakes();
+
+    /// Times a log call on the emitting thread, with the message written there and handed off to the writer.
+    void callThroughput();
+
+    void runAllTests();
+}
+
+#endif // __tests__LoggingTests__
@@ -0,0 +1,158 @@
+//
+//  MetricsTests.cpp
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cmath>
+#include <iostream>
+
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+#include <QtNetwork/QUdpSocket>
+
+#include <HifiSockAddr.h>
+#include <Logging.h>
+#include <Metrics.h>
+#include <SharedUtil.h>
+
+#include "MetricsTests.h"
+
+static Metric testCounter(STAT_TYPE_COUNTER, "test-counter");
+static Metric testGauge(STAT_TYPE_GAUGE, "test-gauge");
+static Metric testTimer(STAT_TYPE_TIMER, "test-timer");
+
+/// Updates the test metrics from a pool thread.
+class MetricsTask : public QRunnable {
+public:
+
+    MetricsTask(int updateCount, QSemaphore* finished) : _updateCount(updateCount), _finished(finished) { }
+
+    virtual void run() {
+        for (int i = 0; i < _updateCount; i++) {
+            testCounter.update(1.0f);
+            testGauge.update(i);
+            testTimer.update(i);
+        }
+        _finished->release();
+    }
+
+private:
+
+    int _updateCount;
+    QSemaphore* _finished;
+};
+
+static QList<MetricSample> flushToLoopback(int& datagramCount) {
+    QUdpSocket receiver;
+    receiver.bind(QHostAddress::LocalHost, 0);
+    QUdpSocket sender;
+    MetricsRegistry::getInstance()->flush(sender, HifiSockAddr(QHostAddress::LocalHost, receiver.localPort()));
+
+    QList<MetricSample> samples;
+    datagramCount = 0;
+    const int RECEIVE_TIMEOUT_MSECS = 1000;
+    while (receiver.hasPendingDatagrams() || receiver.waitForReadyRead(RECEIVE_TIMEOUT_MSECS)) {
+        QByteArray datagram(receiver.pendingDatagramSize(), 0);
+        receiver.readDatagram(datagram.data(), datagram.size());
+        if (datagram.size() > MAX_PACKET_SIZE) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: datagram of " << datagram.size()
+                << " bytes is larger than a packet" << std::endl;
+        }
+        if (!MetricsRegistry::readDatagram(datagram, samples)) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: malformed metrics datagram" << std::endl;
+        }
+        datagramCount++;
+    }
+    return samples;
+}
+
+static const MetricSample* findSample(const QList<MetricSample>& samples, const char* key) {
+    foreach (const MetricSample& sample, samples) {
+        if (sample.key == key) {
+            return &sample;
+        }
+    }
+    return NULL;
+}
+
+void MetricsTests::flushedDatagramsMatchUpdates() {
+    MetricsRegistry::getInstance()->takeSamples();
+
+    const int THREAD_COUNT = 4;
+    const int UPDATE_COUNT = 1000;
+    QSemaphore finished;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        QThreadPool::globalInstance()->start(new MetricsTask(UPDATE_COUNT, &finished));
+    }
+    finished.acquire(THREAD_COUNT);
+    const float LAST_GAUGE_VALUE = -1.0f;
+    testGauge.update(LAST_GAUGE_VALUE);
+    Logging::stashValue(STAT_TYPE_TIMER, "test-stashed-timer", 2.5f);
+
+    int datagramCount;
+    QList<MetricSample> samples = flushToLoopback(datagramCount);
+    if (datagramCount != 1) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: expected one datagram, received " << datagramCount
+            << std::endl;
+    }
+
+    const MetricSample* counter = findSample(samples, "test-counter");
+    if (!counter || counter->count != THREAD_COUNT * UPDATE_COUNT || counter->value != THREAD_COUNT * UPDATE_COUNT) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: counter total "
+            << (counter ? counter->value : 0.0f) << ", expected " << THREAD_COUNT * UPDATE_COUNT << std::endl;
+    }
+
+    const MetricSample* gauge = findSample(samples, "test-gauge");
+    if (!gauge || gauge->value != LAST_GAUGE_VALUE) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: gauge " << (gauge ? gauge->value : 0.0f)
+            << ", expected " << LAST_GAUGE_VALUE << std::endl;
+    }
+
+    const MetricSample* timer = findSample(samples, "test-timer");
+    const float EXPECTED_MEAN = (UPDATE_COUNT - 1) / 2.0f;
+    const float MEAN_TOLERANCE = 0.01f;
+    if (!timer || timer->count != THREAD_COUNT * UPDATE_COUNT || fabsf(timer->value - EXPECTED_MEAN) > MEAN_TOLERANCE ||
+            timer->minimum != 0.0f || timer->maximum != UPDATE_COUNT - 1) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: timer mean/min/max "
+            << (timer ? timer->value : 0.0f) << "/" << (timer ? timer->minimum : 0.0f) << "/"
+            << (timer ? timer->maximum : 0.0f) << ", expected " << EXPECTED_MEAN << "/0/" << UPDATE_COUNT - 1 << std::endl;
+    }
+
+    const MetricSample* stashed = findSample(samples, "test-stashed-timer");
+    if (!stashed || stashed->type != STAT_TYPE_TIMER || stashed->count != 1 || stashed->value != 2.5f) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: stashed value didn't come through" << std::endl;
+    }
+
+    // the flush resets the metrics, so another sends nothing
+    samples = flushToLoopback(datagramCount);
+    if (datagramCount != 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: second flush sent " << datagramCount << " datagrams"
+            << std::endl;
+    }
+}
+
+void MetricsTests::datagramsFitInPackets() {
+    MetricsRegistry::getInstance()->takeSamples();
+
+    const int METRIC_COUNT = 500;
+    MetricsRegistry* registry = MetricsRegistry::getInstance();
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        registry->update(registry->getMetricID(STAT_TYPE_TIMER, QString("test-many-%1").arg(i).toLatin1()), i);
+    }
+
+    int datagramCount;
+    QList<MetricSample> samples = flushToLoopback(datagramCount);
+    if (samples.size() != METRIC_COUNT) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: received " << samples.size() << " of " << METRIC_COUNT
+            << " metrics" << std::endl;
+    }
+    std::cout << "flushed " << samples.size() << " metrics in " << datagramCount << " datagrams" << std::endl;
+}
+
+void MetricsTests::runAllTests() {
+    flushedDatagramsMatchUpdates();
+    datagramsFitInPackets();
+}
@@ -0,0 +1,23 @@
+//
+//  MetricsTests.h
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__MetricsTests__
+#define __tests__MetricsTests__
+
+namespace MetricsTests {
+
+    /// Updates counters, gauges and timers from several threads, flushes them to a socket on the loopback interface,
+    /// and checks that the datagrams received hold the expected totals.
+    void flushedDatagramsMatchUpdates();
+
+    /// Checks that a flush with many metrics splits them over datagrams that each fit in a packet.
+    void datagramsFitInPackets();
+
+    void runAllTests();
+}
+
+#endif // __tests__MetricsTests__
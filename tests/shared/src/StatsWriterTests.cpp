@@ -0,0 +1,100 @@
+//
+//  StatsWriterTests.cpp
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <iostream>
+#include <limits>
+
+#include <StatsWriter.h>
+
+#include "StatsWriterTests.h"
+
+static void compareOutput(const char* file, int line, const QByteArray& output, const char* expected) {
+    if (output != expected) {
+        std::cout << file << ":" << line << " ERROR: wrote\n" << output.constData() << "expected\n" << expected
+            << std::endl;
+    }
+}
+
+void StatsWriterTests::writesExpositionFormat() {
+    QByteArray output;
+    StatsWriter writer(output, "hifi_");
+    writer.writeCounter("packets_sent", (quint64)42, "Packets sent.");
+    writer.writeGauge("load", 0.5, "Fraction of the frame spent working.");
+    writer.writeFamily("latency_usecs", "summary", "Time to reply.");
+    writer.writeSample("latency_usecs", 1500.0, "quantile", "0.5");
+    writer.writeSample("latency_usecs", 12345.0, "quantile", "0.99");
+    writer.writeSample("latency_usecs_count", (quint64)7);
+    compareOutput(__FILE__, __LINE__, output,
+        "# HELP hifi_packets_sent Packets sent.\n"
+        "# TYPE hifi_packets_sent counter\n"
+        "hifi_packets_sent 42\n"
+        "# HELP hifi_load Fraction of the frame spent working.\n"
+        "# TYPE hifi_load gauge\n"
+        "hifi_load 0.5\n"
+        "# HELP hifi_latency_usecs Time to reply.\n"
+        "# TYPE hifi_latency_usecs summary\n"
+        "hifi_latency_usecs{quantile=\"0.5\"} 1500\n"
+        "hifi_latency_usecs{quantile=\"0.99\"} 12345\n"
+        "hifi_latency_usecs_count 7\n");
+
+    // values that aren't finite have their own spellings
+    output.clear();
+    writer.setPrefix(QByteArray());
+    writer.writeSample("nan", std::numeric_limits<double>::quiet_NaN());
+    writer.writeSample("high", std::numeric_limits<double>::infinity());
+    writer.writeSample("low", -std::numeric_limits<double>::infinity());
+    compareOutput(__FILE__, __LINE__, output,
+        "nan NaN\n"
+        "high +Inf\n"
+        "low -Inf\n");
+}
+
+void StatsWriterTests::escapesLabelValues() {
+    QByteArray output;
+    StatsWriter writer(output);
+    writer.writeSample("requests", (quint64)3, "path", QString("C:\\a \"quoted\"\nname"));
+    writer.writeSample("requests", (quint64)1, "path", QString::fromUtf8("/caf\xc3\xa9"));
+    compareOutput(__FILE__, __LINE__, output,
+        "requests{path=\"C:\\\\a \\\"quoted\\\"\\nname\"} 3\n"
+        "requests{path=\"/caf\xc3\xa9\"} 1\n");
+}
+
+/// Notes its own destruction.
+class TestStatsProvider : public StatsProvider {
+public:
+
+    TestStatsProvider(bool& destroyed) : _destroyed(destroyed) { }
+    virtual ~TestStatsProvider() { _destroyed = true; }
+
+    virtual void writeStats(StatsWriter& writer) { writer.writeCounter("provided", (quint64)1, "Provided."); }
+
+private:
+
+    bool& _destroyed;
+};
+
+void StatsWriterTests::deletesProvidersThroughBase() {
+    bool destroyed = false;
+    StatsProvider* provider = new TestStatsProvider(destroyed);
+    QByteArray output;
+    StatsWriter writer(output);
+    provider->writeStats(writer);
+    delete provider;
+    if (!destroyed) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: provider wasn't destroyed through its base" << std::endl;
+    }
+    compareOutput(__FILE__, __LINE__, output,
+        "# HELP provided Provided.\n"
+        "# TYPE provided counter\n"
+        "provided 1\n");
+}
+
+void StatsWriterTests::runAllTests() {
+    writesExpositionFormat();
+    escapesLabelValues();
+    deletesProvidersThroughBase();
+}
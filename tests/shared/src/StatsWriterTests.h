@@ -0,0 +1,26 @@
+//
+//  StatsWriterTests.h
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__StatsWriterTests__
+#define __tests__StatsWriterTests__
+
+namespace StatsWriterTests {
+
+    /// Checks the HELP, TYPE and sample lines written for counters, gauges and labelled samples, including values that
+    /// aren't finite.
+    void writesExpositionFormat();
+
+    /// Checks that backslashes, quotes and newlines in label values are escaped.
+    void escapesLabelValues();
+
+    /// Checks that providers are destroyed properly through a StatsProvider pointer.
+    void deletesProvidersThroughBase();
+
+    void runAllTests();
+}
+
+#endif // __tests__StatsWriterTests__
@@ -0,0 +1,156 @@
+//
+//  TracingTests.cpp
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <iostream>
+
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+
+#include <SharedUtil.h>
+#include <Tracing.h>
+
+#include "TracingTests.h"
+
+/// Traces a series of nested scopes from a pool thread.
+class TracingTask : public QRunnable {
+public:
+
+    TracingTask(int frameCount, QSemaphore* finished) : _frameCount(frameCount), _finished(finished) { }
+
+    virtual void run() {
+        for (int i = 0; i < _frameCount; i++) {
+            TRACE_SCOPE("test frame");
+            {
+                TRACE_SCOPE("test phase");
+                usleep(1);
+            }
+        }
+        _finished->release();
+    }
+
+private:
+
+    int _frameCount;
+    QSemaphore* _finished;
+};
+
+/// Returns the spans in a dump with the given name, after checking that it parses.
+static QList<QJsonObject> getSpans(const QByteArray& trace, const QString& name,
+        QHash<int, QString>* threadNames = NULL) {
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(trace, &error);
+    if (error.error != QJsonParseError::NoError) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: trace doesn't parse: "
+            << error.errorString().toLocal8Bit().constData() << std::endl;
+    }
+    QList<QJsonObject> spans;
+    foreach (const QJsonValue& value, document.object().value("traceEvents").toArray()) {
+        QJsonObject event = value.toObject();
+        if (event.value("ph").toString() == "M") {
+            if (threadNames) {
+                threadNames->insert((int)event.value("tid").toDouble(),
+                    event.value("args").toObject().value("name").toString());
+            }
+        } else if (event.value("name").toString() == name) {
+            spans.append(event);
+        }
+    }
+    return spans;
+}
+
+void TracingTests::dumpHoldsNestedSpans() {
+    Tracing::setEnabled(true);
+
+    const int THREAD_COUNT = 4;
+    const int FRAME_COUNT = 100;
+    QSemaphore finished;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        QThreadPool::globalInstance()->start(new TracingTask(FRAME_COUNT, &finished));
+    }
+    finished.acquire(THREAD_COUNT);
+    Tracing::setEnabled(false);
+
+    QByteArray trace = Tracing::getTrace();
+    QHash<int, QString> threadNames;
+    QList<QJsonObject> frames = getSpans(trace, "test frame", &threadNames);
+    QList<QJsonObject> phases = getSpans(trace, "test phase");
+    if (frames.size() != THREAD_COUNT * FRAME_COUNT || phases.size() != THREAD_COUNT * FRAME_COUNT) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: dumped " << frames.size() << " frames and "
+            << phases.size() << " phases, expected " << THREAD_COUNT * FRAME_COUNT << " of each" << std::endl;
+        return;
+    }
+
+    // each thread records the inner span first, so it comes just before the frame that holds it
+    for (int i = 0; i < frames.size(); i++) {
+        const QJsonObject& frame = frames.at(i);
+        const QJsonObject& phase = phases.at(i);
+        double frameStart = frame.value("ts").toDouble();
+        double phaseStart = phase.value("ts").toDouble();
+        if (frame.value("tid") != phase.value("tid") || phaseStart < frameStart || phaseStart +
+                phase.value("dur").toDouble() > frameStart + frame.value("dur").toDouble()) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: phase " << i << " isn't within its frame" << std::endl;
+            return;
+        }
+        if (threadNames.value((int)frame.value("tid").toDouble()).isEmpty()) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: frame " << i << " is on an unnamed thread"
+                << std::endl;
+            return;
+        }
+    }
+}
+
+void TracingTests::ringKeepsNewestEvents() {
+    Tracing::setEnabled(true);
+    quint64 base = usecTimestampNow();
+    const int EVENT_COUNT = TRACE_RING_EVENTS * 5 / 2;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        TRACE_SPAN("test ring", base + i, base + i + 1);
+    }
+    Tracing::setEnabled(false);
+    {
+        TRACE_SCOPE("test disabled");
+    }
+
+    QByteArray trace = Tracing::getTrace();
+    QList<QJsonObject> spans = getSpans(trace, "test ring");
+    if (spans.size() != TRACE_RING_EVENTS ||
+            spans.first().value("ts").toDouble() != base + EVENT_COUNT - TRACE_RING_EVENTS ||
+            spans.last().value("ts").toDouble() != base + EVENT_COUNT - 1) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: dumped " << spans.size() << " of the last "
+            << TRACE_RING_EVENTS << " events" << std::endl;
+    }
+    if (!getSpans(trace, "test disabled").isEmpty()) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: traced while disabled" << std::endl;
+    }
+}
+
+void TracingTests::scopeOverhead() {
+    const int SCOPE_COUNT = 1000000;
+    const char* names[] = { "disabled", "enabled" };
+    for (int enabled = 0; enabled < 2; enabled++) {
+        Tracing::setEnabled(enabled);
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < SCOPE_COUNT; i++) {
+            TRACE_SCOPE("test overhead");
+        }
+        quint64 elapsed = usecTimestampNow() - start;
+        std::cout << "traced " << SCOPE_COUNT << " scopes " << names[enabled] << " at "
+            << (double)elapsed * 1000.0 / SCOPE_COUNT << " nsec per scope" << std::endl;
+    }
+    Tracing::setEnabled(false);
+}
+
+void TracingTests::runAllTests() {
+    dumpHoldsNestedSpans();
+    ringKeepsNewestEvents();
+    scopeOverhead();
+}
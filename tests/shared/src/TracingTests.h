@@ -0,0 +1,26 @@
+//
+//  TracingTests.h
+//  shared-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__TracingTests__
+#define __tests__TracingTests__
+
+namespace TracingTests {
+
+    /// Traces nested scopes on several threads and checks that the dump parses as trace-event JSON with every span,
+    /// each inner one within its outer one, on named threads.
+    void dumpHoldsNestedSpans();
+
+    /// Checks that a full ring keeps its newest events, and that nothing is recorded while tracing is disabled.
+    void ringKeepsNewestEvents();
+
+    /// Reports the cost of a scoped trace, enabled and disabled.
+    void scopeOverhead();
+
+    void runAllTests();
+}
+
+#endif // __tests__TracingTests__
@@ -0,0 +1,19 @@
+//
+//  main.cpp
+//  shared-tests
+//
+
+#include "LatencyHistogramTests.h"
+#include "LoggingTests.h"
+#include "MetricsTests.h"
+#include "StatsWriterTests.h"
+#include "TracingTests.h"
+
+int main(int argc, char** argv) {
+    LatencyHistogramTests::runAllTests();
+    LoggingTests::runAllTests();
+    MetricsTests::runAllTests();
+    StatsWriterTests::runAllTests();
+    TracingTests::runAllTests();
+    return 0;
+}
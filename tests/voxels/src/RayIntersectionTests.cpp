@@ -0,0 +1,222 @@
+//
+//  RayIntersectionTests.cpp
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cmath>
+#include <iostream>
+
+#include <SharedUtil.h>
+#include <VoxelTree.h>
+
+#include "RayIntersectionTests.h"
+
+static void populateHills(VoxelTree& tree, int voxelsPerSide) {
+    float scale = 1.0f / voxelsPerSide;
+    for (int i = 0; i < voxelsPerSide; i++) {
+        for (int j = 0; j < voxelsPerSide; j++) {
+            int height = (int)((0.25f + 0.125f * sinf(i * 0.1f) * cosf(j * 0.07f)) * voxelsPerSide);
+            tree.createVoxel(i * scale, height * scale, j * scale, scale, 100, (unsigned char)height, 100);
+        }
+    }
+    // some floating blocks for the rays to hit first
+    for (int i = 0; i < 16; i++) {
+        tree.createVoxel(randFloatInRange(0.0f, 0.9f), randFloatInRange(0.5f, 0.9f), randFloatInRange(0.0f, 0.9f),
+            1.0f / 16, 200, 50, 50);
+    }
+}
+
+// the search that findRayIntersection() used to do: every leaf the ray crosses, keeping the nearest
+class ExhaustiveRayArgs {
+public:
+    glm::vec3 origin;
+    glm::vec3 direction;
+    OctreeElement* element;
+    float distance;
+    bool found;
+};
+
+static bool exhaustiveRayOperation(OctreeElement* element, void* extraData) {
+    ExhaustiveRayArgs* args = static_cast<ExhaustiveRayArgs*>(extraData);
+    float distance;
+    BoxFace face;
+    if (!element->getAABox().findRayIntersection(args->origin, args->direction, distance, face)) {
+        return false;
+    }
+    if (!element->isLeaf()) {
+        return true;
+    }
+    distance *= TREE_SCALE;
+    if (element->hasContent() && (!args->found || distance < args->distance)) {
+        args->element = element;
+        args->distance = distance;
+        args->found = true;
+    }
+    return false;
+}
+
+static void makeRandomRays(QVector<OctreeRayIntersection>& rays, int count) {
+    // mostly from above the tree looking down, like mouse picks, and a few from within it in any direction
+    const float FROM_WITHIN_PROBABILITY = 0.1f;
+    for (int i = 0; i < count; i++) {
+        glm::vec3 origin, direction;
+        if (randFloat() < FROM_WITHIN_PROBABILITY) {
+            origin = glm::vec3(randFloat(), randFloat(), randFloat());
+            direction = glm::vec3(randFloatInRange(-1.0f, 1.0f), randFloatInRange(-1.0f, 1.0f),
+                randFloatInRange(-1.0f, 1.0f));
+        } else {
+            origin = glm::vec3(randFloatInRange(-0.5f, 1.5f), randFloatInRange(1.0f, 1.5f), randFloatInRange(-0.5f, 1.5f));
+            glm::vec3 target(randFloat(), 0.0f, randFloat());
+            direction = target - origin;
+        }
+        if (glm::length(direction) < EPSILON) {
+            direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        }
+        rays.append(OctreeRayIntersection(origin * (float)TREE_SCALE, glm::normalize(direction)));
+    }
+    // and some straight down, with zero components in the direction
+    for (int i = 0; i < count / 10 && i < rays.size(); i++) {
+        rays[i].direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    }
+}
+
+static bool sameHit(bool intersects, OctreeElement* element, float distance, bool expectedIntersects,
+                    OctreeElement* expectedElement, float expectedDistance) {
+    const float DISTANCE_TOLERANCE = 0.0001f;
+    if (intersects != expectedIntersects) {
+        return false;
+    }
+    // ties between leaves the ray enters at the same distance may go either way
+    return !intersects || element == expectedElement ||
+        fabsf(distance - expectedDistance) <= DISTANCE_TOLERANCE * glm::max(expectedDistance, 1.0f);
+}
+
+void RayIntersectionTests::castsMatchExhaustiveSearch(const char* persistFile) {
+    const int RAY_COUNT = 10000;
+    VoxelTree tree;
+    if (persistFile) {
+        if (!tree.readFromSVOFile(persistFile)) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't read " << persistFile << std::endl;
+            return;
+        }
+    } else {
+        populateHills(tree, 256);
+    }
+    QVector<OctreeRayIntersection> rays;
+    makeRandomRays(rays, RAY_COUNT);
+
+    QVector<ExhaustiveRayArgs> expected;
+    quint64 start = usecTimestampNow();
+    foreach (const OctreeRayIntersection& ray, rays) {
+        ExhaustiveRayArgs args = { ray.origin / (float)TREE_SCALE, ray.direction, NULL, 0.0f, false };
+        tree.recurseTreeWithOperation(exhaustiveRayOperation, &args);
+        expected.append(args);
+    }
+    quint64 exhaustiveElapsed = usecTimestampNow() - start;
+
+    int hits = 0;
+    int mismatches = 0;
+    start = usecTimestampNow();
+    for (int i = 0; i < rays.size(); i++) {
+        OctreeElement* element = NULL;
+        float distance = 0.0f;
+        BoxFace face;
+        bool intersects = tree.findRayIntersection(rays.at(i).origin, rays.at(i).direction, element, distance, face,
+            Octree::NoLock);
+        hits += intersects ? 1 : 0;
+        if (!sameHit(intersects, element, distance, expected.at(i).found, expected.at(i).element,
+                expected.at(i).distance) && mismatches++ == 0) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: ordered cast " << i << " hit " << intersects
+                << " at " << distance << ", expected " << expected.at(i).found << " at " << expected.at(i).distance
+                << std::endl;
+        }
+    }
+    quint64 orderedElapsed = usecTimestampNow() - start;
+
+    start = usecTimestampNow();
+    int batchedHits = tree.findRayIntersections(rays, Octree::NoLock);
+    quint64 batchedElapsed = usecTimestampNow() - start;
+    for (int i = 0; i < rays.size(); i++) {
+        const OctreeRayIntersection& ray = rays.at(i);
+        if (!sameHit(ray.intersects, ray.element, ray.distance, expected.at(i).found, expected.at(i).element,
+                expected.at(i).distance) && mismatches++ == 0) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: batched cast " << i << " hit " << ray.intersects
+                << " at " << ray.distance << ", expected " << expected.at(i).found << " at " << expected.at(i).distance
+                << std::endl;
+        }
+    }
+    if (mismatches > 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << mismatches << " casts differ from the exhaustive search"
+            << std::endl;
+    }
+
+    std::cout << rays.size() << " rays, " << hits << " hits (" << batchedHits << " batched): exhaustive "
+        << exhaustiveElapsed << " usec, ordered " << orderedElapsed << " usec, batched " << batchedElapsed << " usec"
+        << std::endl;
+}
+
+// rays that tie: straight down and diagonally along the edges between voxels, and from points on the faces between them
+static void makeTiedRays(QVector<OctreeRayIntersection>& rays, int voxelsPerSide, int count) {
+    float scale = 1.0f / voxelsPerSide;
+    for (int i = 0; i < count; i++) {
+        glm::vec3 edge(randIntInRange(1, voxelsPerSide - 1) * scale, 0.0f,
+            randIntInRange(1, voxelsPerSide - 1) * scale);
+        switch (i % 3) {
+            case 0:
+                rays.append(OctreeRayIntersection(glm::vec3(edge.x, 1.0f, edge.z) * (float)TREE_SCALE,
+                    glm::vec3(0.0f, -1.0f, 0.0f)));
+                break;
+            case 1:
+                rays.append(OctreeRayIntersection(glm::vec3(edge.x, 0.75f, edge.z) * (float)TREE_SCALE,
+                    glm::normalize(glm::vec3(randFloat() < 0.5f ? -1.0f : 1.0f, -1.0f, 0.0f))));
+                break;
+            default:
+                rays.append(OctreeRayIntersection(glm::vec3(edge.x, randFloatInRange(0.1f, 0.5f), randFloat()) *
+                    (float)TREE_SCALE, glm::normalize(glm::vec3(randFloatInRange(-1.0f, 1.0f), -1.0f,
+                        randFloatInRange(-1.0f, 1.0f)))));
+                break;
+        }
+    }
+}
+
+void RayIntersectionTests::batchedCastsMatchSingleCasts() {
+    const int VOXELS_PER_SIDE = 64;
+    const int RAY_COUNT = 3000;
+    VoxelTree tree;
+    populateHills(tree, VOXELS_PER_SIDE);
+    QVector<OctreeRayIntersection> rays;
+    makeRandomRays(rays, RAY_COUNT);
+    makeTiedRays(rays, VOXELS_PER_SIDE, RAY_COUNT);
+
+    int hits = tree.findRayIntersections(rays, Octree::NoLock);
+    int singleHits = 0;
+    int mismatches = 0;
+    for (int i = 0; i < rays.size(); i++) {
+        const OctreeRayIntersection& ray = rays.at(i);
+        OctreeElement* element = NULL;
+        float distance = 0.0f;
+        BoxFace face = MIN_X_FACE;
+        bool intersects = tree.findRayIntersection(ray.origin, ray.direction, element, distance, face, Octree::NoLock);
+        singleHits += intersects ? 1 : 0;
+
+        // the same leaf, not just one at the same distance
+        if ((intersects != ray.intersects || (intersects && (element != ray.element || distance != ray.distance ||
+                face != ray.face))) && mismatches++ == 0) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: batched cast " << i << " hit " << ray.intersects
+                << " at " << ray.distance << " face " << ray.face << ", single cast hit " << intersects << " at "
+                << distance << " face " << face << std::endl;
+        }
+    }
+    if (mismatches > 0 || hits != singleHits) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << mismatches << " of " << rays.size()
+            << " batched casts differ from single casts (" << hits << " hits batched, " << singleHits << " single)"
+            << std::endl;
+    }
+}
+
+void RayIntersectionTests::runAllTests(const char* persistFile) {
+    castsMatchExhaustiveSearch(persistFile);
+    batchedCastsMatchSingleCasts();
+}
@@ -0,0 +1,26 @@
+//
+//  RayIntersectionTests.h
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__RayIntersectionTests__
+#define __tests__RayIntersectionTests__
+
+#include <cstddef>
+
+namespace RayIntersectionTests {
+
+    /// Checks the ordered and batched ray casts against an exhaustive search of the tree, and times all three over
+    /// random rays into a persisted world if one is given.
+    void castsMatchExhaustiveSearch(const char* persistFile = NULL);
+
+    /// Checks that batched casts hit exactly the leaves that single casts do, including rays that graze the edges between
+    /// voxels or start on the faces between them, where several leaves are hit at the same distance.
+    void batchedCastsMatchSingleCasts();
+
+    void runAllTests(const char* persistFile = NULL);
+}
+
+#endif // __tests__RayIntersectionTests__
@@ -0,0 +1,216 @@
+//
+//  ViewFrustumTests.cpp
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <climits>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <OctreeElementBag.h>
+#include <OctreePacketData.h>
+#include <SharedUtil.h>
+#include <ViewFrustum.h>
+#include <VoxelTree.h>
+
+#include "ViewFrustumTests.h"
+
+const float NO_KEYHOLE = -1.0f;
+
+static void populateHills(VoxelTree& tree, int voxelsPerSide) {
+    float scale = 1.0f / voxelsPerSide;
+    for (int i = 0; i < voxelsPerSide; i++) {
+        for (int j = 0; j < voxelsPerSide; j++) {
+            int height = (int)((0.5f + 0.25f * sinf(i * 0.3f) * cosf(j * 0.2f)) * voxelsPerSide);
+            unsigned char shade = (unsigned char)(50 + (height * 200) / voxelsPerSide);
+            tree.createVoxel(i * scale, height * scale, j * scale, scale, shade, shade, shade);
+        }
+    }
+}
+
+static void setupViewFrustum(ViewFrustum& viewFrustum, const glm::vec3& position, const glm::vec3& eulerAngles,
+                             float keyholeRadius) {
+    viewFrustum.setPosition(position * (float)TREE_SCALE);
+    viewFrustum.setOrientation(glm::quat(glm::radians(eulerAngles)));
+    viewFrustum.setKeyholeRadius(keyholeRadius);
+    viewFrustum.calculate();
+}
+
+static int compareChildren(OctreeElement* element, const ViewFrustum& viewFrustum, int& mismatches) {
+    int compared = 0;
+    ViewFrustum::ChildLocations locations;
+    element->childrenInFrustum(viewFrustum, locations);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        if (!child) {
+            continue;
+        }
+        compared++;
+        const float DISTANCE_TOLERANCE = 0.0001f;
+        float distance = child->distanceToCamera(viewFrustum);
+        float furthestDistance = child->furthestDistanceToCamera(viewFrustum);
+        if (locations.getLocation(i) != child->inFrustum(viewFrustum) ||
+                fabsf(locations.distances[i] - distance) > DISTANCE_TOLERANCE * distance ||
+                fabsf(locations.furthestDistances[i] - furthestDistance) > DISTANCE_TOLERANCE * furthestDistance) {
+            if (mismatches++ == 0) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: child " << i << " at level " << child->getLevel()
+                    << " batched location " << locations.getLocation(i) << " expected " << child->inFrustum(viewFrustum)
+                    << ", distance " << locations.distances[i] << " expected " << distance
+                    << ", furthest distance " << locations.furthestDistances[i] << " expected " << furthestDistance
+                    << std::endl;
+            }
+        }
+        compared += compareChildren(child, viewFrustum, mismatches);
+    }
+    return compared;
+}
+
+void ViewFrustumTests::childrenMatchSingleTests() {
+    const int VOXELS_PER_SIDE = 64;
+    VoxelTree tree;
+    populateHills(tree, VOXELS_PER_SIDE);
+
+    // inside the tree looking along each axis, above it looking down, and outside it looking in
+    const int VIEW_COUNT = 5;
+    const glm::vec3 POSITIONS[VIEW_COUNT] = { glm::vec3(0.5f, 0.6f, 0.5f), glm::vec3(0.5f, 0.6f, 0.5f),
+        glm::vec3(0.3f, 2.0f, 0.4f), glm::vec3(-0.5f, 0.5f, -0.5f), glm::vec3(0.01f, 0.51f, 0.99f) };
+    const glm::vec3 ANGLES[VIEW_COUNT] = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 90.0f, 0.0f),
+        glm::vec3(-80.0f, 10.0f, 0.0f), glm::vec3(-10.0f, -135.0f, 5.0f), glm::vec3(20.0f, 200.0f, 0.0f) };
+    const float KEYHOLE_RADII[] = { NO_KEYHOLE, DEFAULT_KEYHOLE_RADIUS, 0.1f * TREE_SCALE };
+
+    int compared = 0;
+    int mismatches = 0;
+    for (int view = 0; view < VIEW_COUNT; view++) {
+        for (unsigned int keyhole = 0; keyhole < sizeof(KEYHOLE_RADII) / sizeof(KEYHOLE_RADII[0]); keyhole++) {
+            ViewFrustum viewFrustum;
+            setupViewFrustum(viewFrustum, POSITIONS[view], ANGLES[view], KEYHOLE_RADII[keyhole]);
+            compared += compareChildren(tree.getRoot(), viewFrustum, mismatches);
+        }
+    }
+    if (mismatches > 0) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << mismatches << " of " << compared
+            << " children differ from the single tests" << std::endl;
+    }
+}
+
+static void testChildrenOneByOne(OctreeElement* element, const ViewFrustum& viewFrustum, int& inView) {
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            if (child->inFrustum(viewFrustum) != ViewFrustum::OUTSIDE) {
+                inView++;
+            }
+            child->distanceToCamera(viewFrustum);
+            child->furthestDistanceToCamera(viewFrustum);
+            testChildrenOneByOne(child, viewFrustum, inView);
+        }
+    }
+}
+
+static void testChildrenBatched(OctreeElement* element, const ViewFrustum& viewFrustum, int& inView) {
+    ViewFrustum::ChildLocations locations;
+    element->childrenInFrustum(viewFrustum, locations);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            if (locations.getLocation(i) != ViewFrustum::OUTSIDE) {
+                inView++;
+            }
+            testChildrenBatched(child, viewFrustum, inView);
+        }
+    }
+}
+
+void ViewFrustumTests::childrenThroughput() {
+    const int VOXELS_PER_SIDE = 256;
+    const int ITERATIONS = 5;
+    VoxelTree tree;
+    populateHills(tree, VOXELS_PER_SIDE);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum, glm::vec3(0.5f, 0.8f, 0.5f), glm::vec3(-30.0f, 45.0f, 0.0f), DEFAULT_KEYHOLE_RADIUS);
+
+    for (int batched = 0; batched < 2; batched++) {
+        int inView = 0;
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < ITERATIONS; i++) {
+            inView = 0;
+            if (batched) {
+                testChildrenBatched(tree.getRoot(), viewFrustum, inView);
+            } else {
+                testChildrenOneByOne(tree.getRoot(), viewFrustum, inView);
+            }
+        }
+        quint64 elapsed = (usecTimestampNow() - start) / ITERATIONS;
+        std::cout << "culled tree (" << inView << " in view) in " << elapsed << " usec "
+            << (batched ? "batched" : "one child at a time") << std::endl;
+    }
+}
+
+void ViewFrustumTests::encodeThroughput() {
+    const int VOXELS_PER_SIDE = 256;
+    const int ITERATIONS = 3;
+    VoxelTree tree;
+    populateHills(tree, VOXELS_PER_SIDE);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum, glm::vec3(0.5f, 0.8f, 0.5f), glm::vec3(-30.0f, 45.0f, 0.0f), DEFAULT_KEYHOLE_RADIUS);
+
+    // the baseline tests the children one at a time, as encoding did before the batched test
+    int baselinePackets = 0;
+    for (int batched = 0; batched < 2; batched++) {
+        viewFrustum.setBatchChildTests(batched);
+        int packets = 0;
+        quint64 start = usecTimestampNow();
+        for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+            OctreeElementBag bag;
+            bag.insert(tree.getRoot());
+            OctreePacketData packetData;
+            EncodeBitstreamParams params(INT_MAX, &viewFrustum);
+            bool packetHasData = false;
+            packets = 0;
+            while (!bag.isEmpty()) {
+                OctreeElement* element = bag.extract();
+                params.stopReason = EncodeBitstreamParams::UNKNOWN;
+                int bytesWritten = tree.encodeTreeBitstream(element, &packetData, bag, params);
+                if (bytesWritten > 0) {
+                    packetHasData = true;
+                } else if (params.stopReason == EncodeBitstreamParams::DIDNT_FIT) {
+                    if (!packetHasData) {
+                        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: element didn't fit in an empty packet"
+                            << std::endl;
+                        bag.remove(element);
+                        continue;
+                    }
+                    packetData.reset();
+                    packetHasData = false;
+                    packets++;
+                }
+            }
+            if (packetHasData) {
+                packets++;
+            }
+        }
+        quint64 elapsed = (usecTimestampNow() - start) / ITERATIONS;
+        std::cout << "encoded " << packets << " packets in " << elapsed << " usec ("
+            << (packets ? elapsed / packets : 0) << " usec/packet) "
+            << (batched ? "batched" : "one child at a time") << std::endl;
+
+        if (!batched) {
+            baselinePackets = packets;
+        } else if (packets != baselinePackets) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: batched encoding wrote " << packets
+                << " packets, one child at a time wrote " << baselinePackets << std::endl;
+        }
+    }
+}
+
+void ViewFrustumTests::runAllTests() {
+    childrenMatchSingleTests();
+    childrenThroughput();
+    encodeThroughput();
+}
@@ -0,0 +1,21 @@
+//
+//  ViewFrustumTests.h
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__ViewFrustumTests__
+#define __tests__ViewFrustumTests__
+
+namespace ViewFrustumTests {
+
+    /// Checks that ViewFrustum::childrenInFrustum() agrees with testing each child on its own, for several views.
+    void childrenMatchSingleTests();
+    void childrenThroughput();
+    void encodeThroughput();
+
+    void runAllTests();
+}
+
+#endif // __tests__ViewFrustumTests__
@@ -0,0 +1,412 @@
+//
+//  VoxelMesherTests.cpp
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <SharedUtil.h>
+#include <ViewFrustum.h>
+#include <VoxelMesher.h>
+#include <VoxelTree.h>
+
+#include "VoxelMesherTests.h"
+
+// large enough that every leaf is inside its render boundary
+const float RENDER_ALL_LEAVES_SIZE_SCALE = FLT_MAX;
+
+static void populateFloor(VoxelTree& tree, int voxelsPerSide, float y) {
+    float scale = 1.0f / voxelsPerSide;
+    for (int i = 0; i < voxelsPerSide; i++) {
+        for (int j = 0; j < voxelsPerSide; j++) {
+            // blocks of eight voxels share a color, like the patches in a persisted world
+            unsigned char shade = ((i / 8 + j / 8) % 2) ? 200 : 100;
+            tree.createVoxel(i * scale, y, j * scale, scale, shade, shade, shade);
+        }
+    }
+}
+
+static void setupViewFrustum(ViewFrustum& viewFrustum) {
+    viewFrustum.setPosition(glm::vec3(0.5f, 2.0f, 0.5f) * (float)TREE_SCALE);
+    viewFrustum.calculate();
+}
+
+static int countRendered(const QVector<VoxelMeshChunk>& chunks, double& coordinateSum) {
+    int rendered = 0;
+    coordinateSum = 0.0;
+    foreach (const VoxelMeshChunk& chunk, chunks) {
+        foreach (const VoxelMeshEntry& entry, chunk.entries) {
+            if (entry.vertexOffset != VoxelMeshEntry::NOT_RENDERED) {
+                rendered++;
+                for (int i = 0; i < GLOBAL_NORMALS_VERTEX_POINTS_PER_VOXEL; i++) {
+                    coordinateSum += chunk.vertices.at(entry.vertexOffset + i);
+                }
+            }
+        }
+    }
+    return rendered;
+}
+
+void VoxelMesherTests::rendersEveryLeaf() {
+    const int VOXELS_PER_SIDE = 32;
+    VoxelTree tree;
+    populateFloor(tree, VOXELS_PER_SIDE, 0.0f);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+
+    QVector<VoxelMeshChunk> chunks;
+    VoxelMesher(params).meshTree(tree.getRoot(), chunks);
+
+    double coordinateSum;
+    int rendered = countRendered(chunks, coordinateSum);
+    if (rendered != VOXELS_PER_SIDE * VOXELS_PER_SIDE) {
+        std::cout << __FILE__ << ":" << __LINE__
+            << " ERROR: rendered " << rendered << " voxels but we expected " << VOXELS_PER_SIDE * VOXELS_PER_SIDE
+            << std::endl;
+    }
+}
+
+void VoxelMesherTests::threadedMatchesSerial() {
+    VoxelTree tree;
+    populateFloor(tree, 64, 0.0f);
+    populateFloor(tree, 16, 0.5f);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+
+    params.threaded = false;
+    QVector<VoxelMeshChunk> serialChunks;
+    VoxelMesher(params).meshTree(tree.getRoot(), serialChunks);
+
+    params.threaded = true;
+    QVector<VoxelMeshChunk> threadedChunks;
+    VoxelMesher(params).meshTree(tree.getRoot(), threadedChunks);
+
+    double serialSum, threadedSum;
+    int serialRendered = countRendered(serialChunks, serialSum);
+    int threadedRendered = countRendered(threadedChunks, threadedSum);
+    if (serialRendered != threadedRendered || serialSum != threadedSum) {
+        std::cout << __FILE__ << ":" << __LINE__
+            << " ERROR: threaded meshing rendered " << threadedRendered << " voxels (coordinate sum " << threadedSum
+            << ") but serial meshing rendered " << serialRendered << " (coordinate sum " << serialSum << ")"
+            << std::endl;
+    }
+}
+
+/// Builds a second floor above the first one voxel at a time, deleting and recreating a voxel of the first as it goes.
+class FloorEditTask : public QRunnable {
+public:
+
+    FloorEditTask(VoxelTree* tree, int voxelsPerSide, QSemaphore* finished) :
+        _tree(tree), _voxelsPerSide(voxelsPerSide), _finished(finished) { }
+
+    virtual void run() {
+        // createVoxel() and deleteVoxelAt() take the tree's write lock themselves
+        float scale = 1.0f / _voxelsPerSide;
+        for (int i = 0; i < _voxelsPerSide; i++) {
+            for (int j = 0; j < _voxelsPerSide; j++) {
+                _tree->createVoxel(i * scale, 0.5f, j * scale, scale, 50, 100, 150);
+                _tree->deleteVoxelAt(j * scale, 0.0f, i * scale, scale);
+                _tree->createVoxel(j * scale, 0.0f, i * scale, scale, 100, 100, 100);
+            }
+        }
+        _finished->release();
+    }
+
+private:
+
+    VoxelTree* _tree;
+    int _voxelsPerSide;
+    QSemaphore* _finished;
+};
+
+void VoxelMesherTests::meshesWhileEditing() {
+    const int VOXELS_PER_SIDE = 32;
+    VoxelTree tree;
+    populateFloor(tree, VOXELS_PER_SIDE, 0.0f);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+
+    QSemaphore finished;
+    QThreadPool::globalInstance()->start(new FloorEditTask(&tree, VOXELS_PER_SIDE, &finished));
+
+    // like the VoxelSystem, hold the write lock for the whole meshing pass so that the edits land between passes
+    int passes = 0;
+    for (bool editing = true; editing; passes++) {
+        editing = !finished.tryAcquire();
+        tree.lockForWrite();
+        params.threaded = true;
+        QVector<VoxelMeshChunk> threadedChunks;
+        VoxelMesher(params).meshTree(tree.getRoot(), threadedChunks);
+
+        params.threaded = false;
+        QVector<VoxelMeshChunk> serialChunks;
+        VoxelMesher(params).meshTree(tree.getRoot(), serialChunks);
+        tree.unlock();
+
+        double serialSum, threadedSum;
+        int serialRendered = countRendered(serialChunks, serialSum);
+        int threadedRendered = countRendered(threadedChunks, threadedSum);
+        if (serialRendered != threadedRendered || serialSum != threadedSum) {
+            std::cout << __FILE__ << ":" << __LINE__
+                << " ERROR: pass " << passes << " meshed " << threadedRendered << " voxels (coordinate sum "
+                << threadedSum << ") threaded but " << serialRendered << " (coordinate sum " << serialSum
+                << ") serially on the same tree" << std::endl;
+            return;
+        }
+        if (!editing && threadedRendered != 2 * VOXELS_PER_SIDE * VOXELS_PER_SIDE) {
+            std::cout << __FILE__ << ":" << __LINE__
+                << " ERROR: rendered " << threadedRendered << " voxels once the edits were done but we expected "
+                << 2 * VOXELS_PER_SIDE * VOXELS_PER_SIDE << std::endl;
+        }
+    }
+}
+
+/// Redraws as the VoxelSystem does for a local voxels overlay: takes the write lock and meshes the whole tree.  Gives
+/// up rather than deadlocking if the calling thread still holds the lock.
+static bool redrawTree(VoxelTree& tree, const VoxelMeshParams& params) {
+    const int MAX_WAIT_MSECS = 1000;
+    const int RETRY_MSECS = 10;
+    for (int waited = 0; !tree.tryLockForWrite(); waited += RETRY_MSECS) {
+        if (waited >= MAX_WAIT_MSECS) {
+            return false;
+        }
+        QThread::msleep(RETRY_MSECS);
+    }
+    QVector<VoxelMeshChunk> chunks;
+    VoxelMesher(params).meshTree(tree.getRoot(), chunks);
+    tree.unlock();
+    return true;
+}
+
+void VoxelMesherTests::overlayRedrawsWithoutDeadlock() {
+    const int VOXELS_PER_SIDE = 16;
+    VoxelTree tree;
+    populateFloor(tree, VOXELS_PER_SIDE, 0.0f);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+
+    // the overlay's update: redraw whenever the count changes, once at first, again after an edit, not when unchanged
+    unsigned long voxelCount = 0;
+    const bool EXPECTED_REDRAWS[] = { true, false, true, false };
+    for (int update = 0; update < 4; update++) {
+        if (update == 2) {
+            populateFloor(tree, VOXELS_PER_SIDE, 0.5f);
+        }
+        bool redrew = false;
+        if (tree.elementsCountChanged(voxelCount)) {
+            if (!redrawTree(tree, params)) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: update " << update
+                    << " couldn't take the write lock to redraw after checking the count" << std::endl;
+                return;
+            }
+            redrew = true;
+        }
+        if (redrew != EXPECTED_REDRAWS[update]) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: update " << update
+                << (redrew ? " redrew" : " didn't redraw") << " with " << voxelCount << " elements" << std::endl;
+        }
+    }
+}
+
+void VoxelMesherTests::indicesStayInChunk() {
+    VoxelTree tree;
+    populateFloor(tree, 32, 0.25f);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+    params.wantIndices = true;
+
+    QVector<VoxelMeshChunk> chunks;
+    VoxelMesher(params).meshTree(tree.getRoot(), chunks);
+
+    foreach (const VoxelMeshChunk& chunk, chunks) {
+        int expectedIndices = chunk.getRenderedCount() * INDICES_PER_VOXEL;
+        if (chunk.indices.size() != expectedIndices) {
+            std::cout << __FILE__ << ":" << __LINE__
+                << " ERROR: chunk has " << chunk.indices.size() << " indices but we expected " << expectedIndices
+                << std::endl;
+        }
+        quint32 vertexCount = chunk.vertices.size() / 3;
+        foreach (quint32 index, chunk.indices) {
+            if (index >= vertexCount) {
+                std::cout << __FILE__ << ":" << __LINE__
+                    << " ERROR: index " << index << " is past the chunk's " << vertexCount << " vertices" << std::endl;
+                break;
+            }
+        }
+    }
+}
+
+void VoxelMesherTests::meshingThroughput() {
+    const int VOXELS_PER_SIDE = 256;
+    const int ITERATIONS = 5;
+    VoxelTree tree;
+    populateFloor(tree, VOXELS_PER_SIDE, 0.0f);
+    populateFloor(tree, VOXELS_PER_SIDE, 0.5f);
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+
+    for (int threaded = 0; threaded < 2; threaded++) {
+        params.threaded = threaded;
+        quint64 start = usecTimestampNow();
+        int rendered = 0;
+        for (int i = 0; i < ITERATIONS; i++) {
+            QVector<VoxelMeshChunk> chunks;
+            VoxelMesher(params).meshTree(tree.getRoot(), chunks);
+            double coordinateSum;
+            rendered = countRendered(chunks, coordinateSum);
+        }
+        quint64 elapsed = (usecTimestampNow() - start) / ITERATIONS;
+        std::cout << "meshed " << rendered << " voxels in " << elapsed << " usec "
+            << (threaded ? "threaded" : "serial") << " ("
+            << (elapsed ? (rendered * USECS_PER_SECOND / elapsed) : 0) << " voxels/sec)" << std::endl;
+    }
+}
+
+void VoxelMesherTests::mergedFacesCoverFloor() {
+    const int VOXELS_PER_SIDE = 32;
+    VoxelTree tree;
+    float scale = 1.0f / VOXELS_PER_SIDE;
+    for (int i = 0; i < VOXELS_PER_SIDE; i++) {
+        for (int j = 0; j < VOXELS_PER_SIDE; j++) {
+            tree.createVoxel(i * scale, 0.25f, j * scale, scale, 100, 150, 200);
+        }
+    }
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+    params.mergeFaces = true;
+
+    QVector<VoxelMeshChunk> chunks;
+    VoxelMesher(params).meshTree(tree.getRoot(), chunks);
+
+    // the top and bottom of the floor must be covered exactly once, however the faces were merged
+    float upArea = 0.0f, downArea = 0.0f;
+    int cellsMerged = 0, mergedFaces = 0, facesBeforeMerging = 0;
+    foreach (const VoxelMeshChunk& chunk, chunks) {
+        cellsMerged += chunk.cellsMerged;
+        mergedFaces += chunk.getMergedFaceCount();
+        facesBeforeMerging += chunk.facesBeforeMerging;
+        for (int i = 0; i < chunk.getMergedFaceCount(); i++) {
+            const float* vertices = chunk.faceVertices.constData() + i * VoxelMeshChunk::COORDINATES_PER_FACE;
+            glm::vec3 first(vertices[0], vertices[1], vertices[2]);
+            glm::vec3 second(vertices[3], vertices[4], vertices[5]);
+            glm::vec3 fourth(vertices[9], vertices[10], vertices[11]);
+            glm::vec3 normal = glm::cross(second - first, fourth - first);
+            if (normal.y > 0.0f) {
+                upArea += normal.y;
+            } else if (normal.y < 0.0f) {
+                downArea -= normal.y;
+            }
+            signed char normalY = chunk.faceNormals.at(i * VoxelMeshChunk::COORDINATES_PER_FACE + 1);
+            if ((normal.y > 0.0f && normalY <= 0) || (normal.y < 0.0f && normalY >= 0)) {
+                std::cout << __FILE__ << ":" << __LINE__
+                    << " ERROR: merged face is wound against its normal" << std::endl;
+            }
+        }
+        quint32 vertexCount = chunk.faceVertices.size() / 3;
+        foreach (quint32 index, chunk.faceIndices) {
+            if (index >= vertexCount) {
+                std::cout << __FILE__ << ":" << __LINE__
+                    << " ERROR: index " << index << " is past the chunk's " << vertexCount << " vertices" << std::endl;
+                break;
+            }
+        }
+    }
+
+    const float AREA_EPSILON = 0.0001f;
+    if (fabsf(upArea - 1.0f) > AREA_EPSILON || fabsf(downArea - 1.0f) > AREA_EPSILON) {
+        std::cout << __FILE__ << ":" << __LINE__
+            << " ERROR: merged faces cover " << upArea << " facing up and " << downArea
+            << " facing down but we expected 1" << std::endl;
+    }
+    if (cellsMerged != VOXELS_PER_SIDE * VOXELS_PER_SIDE) {
+        std::cout << __FILE__ << ":" << __LINE__
+            << " ERROR: merged " << cellsMerged << " voxels but we expected " << VOXELS_PER_SIDE * VOXELS_PER_SIDE
+            << std::endl;
+    }
+    if (mergedFaces >= facesBeforeMerging) {
+        std::cout << __FILE__ << ":" << __LINE__
+            << " ERROR: " << facesBeforeMerging << " faces were merged into " << mergedFaces << std::endl;
+    }
+}
+
+void VoxelMesherTests::mergedFacesVersusCubes(const char* persistFile) {
+    const int ITERATIONS = 5;
+    VoxelTree tree;
+    if (persistFile) {
+        if (!tree.readFromSVOFile(persistFile)) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: couldn't read " << persistFile << std::endl;
+            return;
+        }
+    } else {
+        populateFloor(tree, 256, 0.0f);
+        populateFloor(tree, 64, 0.5f);
+    }
+
+    ViewFrustum viewFrustum;
+    setupViewFrustum(viewFrustum);
+    VoxelMeshParams params(&viewFrustum, RENDER_ALL_LEAVES_SIZE_SCALE);
+
+    for (int mergeFaces = 0; mergeFaces < 2; mergeFaces++) {
+        params.mergeFaces = mergeFaces;
+        quint64 start = usecTimestampNow();
+        QVector<VoxelMeshChunk> chunks;
+        for (int i = 0; i < ITERATIONS; i++) {
+            VoxelMesher(params).meshTree(tree.getRoot(), chunks);
+        }
+        quint64 elapsed = (usecTimestampNow() - start) / ITERATIONS;
+
+        int voxels = 0, vertices = 0, indices = 0, bytes = 0;
+        foreach (const VoxelMeshChunk& chunk, chunks) {
+            if (mergeFaces) {
+                voxels += chunk.cellsMerged;
+                vertices += chunk.faceVertices.size() / 3;
+                indices += chunk.faceIndices.size();
+                bytes += chunk.faceVertices.size() * sizeof(float) + chunk.faceColors.size() +
+                    chunk.faceNormals.size() + chunk.faceIndices.size() * sizeof(quint32);
+            } else {
+                // as drawn by the VoxelSystem: eight corners per voxel, plus its six per face index buffers
+                voxels += chunk.getRenderedCount();
+                vertices += chunk.vertices.size() / 3;
+                indices += chunk.getRenderedCount() * INDICES_PER_VOXEL;
+                bytes += chunk.vertices.size() * sizeof(float) + chunk.colors.size() +
+                    chunk.getRenderedCount() * INDICES_PER_VOXEL * sizeof(quint32);
+            }
+        }
+        std::cout << (mergeFaces ? "merged faces: " : "cubes: ") << voxels << " voxels, " << vertices << " vertices, "
+            << indices / 3 << " triangles, " << bytes / 1024 << " KB, meshed in " << elapsed << " usec" << std::endl;
+    }
+}
+
+void VoxelMesherTests::runAllTests(const char* persistFile) {
+    rendersEveryLeaf();
+    threadedMatchesSerial();
+    meshesWhileEditing();
+    overlayRedrawsWithoutDeadlock();
+    indicesStayInChunk();
+    meshingThroughput();
+    mergedFacesCoverFloor();
+    mergedFacesVersusCubes(persistFile);
+}
@@ -0,0 +1,35 @@
+//
+//  VoxelMesherTests.h
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__VoxelMesherTests__
+#define __tests__VoxelMesherTests__
+
+#include <cstddef>
+
+namespace VoxelMesherTests {
+
+    void rendersEveryLeaf();
+    void threadedMatchesSerial();
+
+    /// Meshes a tree over and over while another thread edits it.
+    void meshesWhileEditing();
+
+    /// Checks a local voxels overlay's update path: the count check must leave the tree unlocked for the redraw, which
+    /// takes the write lock.
+    void overlayRedrawsWithoutDeadlock();
+
+    void indicesStayInChunk();
+    void meshingThroughput();
+    void mergedFacesCoverFloor();
+
+    /// Compares the size and meshing time of merged faces against cubes, for a persisted world if one is given.
+    void mergedFacesVersusCubes(const char* persistFile = NULL);
+
+    void runAllTests(const char* persistFile = NULL);
+}
+
+#endif // __tests__VoxelMesherTests__
@@ -0,0 +1,153 @@
+//
+//  VoxelPacketDecoderTests.cpp
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include <OctreeElementBag.h>
+#include <OctreePacketData.h>
+#include <PacketHeaders.h>
+#include <SharedUtil.h>
+#include <VoxelPacketDecoder.h>
+#include <VoxelTree.h>
+
+#include "VoxelPacketDecoderTests.h"
+
+static void populateRandomVoxels(VoxelTree& tree, int count) {
+    for (int i = 0; i < count; i++) {
+        // a mix of sizes, so that some voxels land inside others' subtrees
+        float scale = 1.0f / (1 << randIntInRange(2, 7));
+        tree.createVoxel(randIntInRange(0, 1.0f / scale - 1) * scale, randIntInRange(0, 1.0f / scale - 1) * scale,
+            randIntInRange(0, 1.0f / scale - 1) * scale, scale, randIntInRange(0, 255), randIntInRange(0, 255),
+            randIntInRange(0, 255));
+    }
+}
+
+/// Returns the number of differences between the two subtrees, printing the first.
+static int compareElements(VoxelTreeElement* first, VoxelTreeElement* second, int differences = 0) {
+    bool sameColor = first->isColored() == second->isColored() &&
+        (!first->isColored() || memcmp(first->getColor(), second->getColor(), 3) == 0);
+    if (!sameColor) {
+        if (differences++ == 0) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: element colors differ at ";
+            printOctalCode(first->getOctalCode());
+        }
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        VoxelTreeElement* firstChild = first->getChildAtIndex(i);
+        VoxelTreeElement* secondChild = second->getChildAtIndex(i);
+        if (firstChild && secondChild) {
+            differences = compareElements(firstChild, secondChild, differences);
+
+        } else if (firstChild || secondChild) {
+            if (differences++ == 0) {
+                std::cout << __FILE__ << ":" << __LINE__ << " ERROR: child " << i << " exists in only one tree at ";
+                printOctalCode(first->getOctalCode());
+            }
+        }
+    }
+    return differences;
+}
+
+static void compareTrees(VoxelTree& readTree, VoxelTree& decodedTree, const char* description) {
+    int differences = compareElements(readTree.getRoot(), decodedTree.getRoot());
+    unsigned long readCount = readTree.getOctreeElementsCount();
+    unsigned long decodedCount = decodedTree.getOctreeElementsCount();
+    if (differences != 0 || readCount != decodedCount) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: " << description << ": " << differences
+            << " differences; read " << readCount << " elements, decoded " << decodedCount << std::endl;
+    }
+}
+
+void VoxelPacketDecoderTests::sectionsMatchReadBitstream() {
+    const int SOURCE_VOXELS = 2000;
+    VoxelTree source;
+    populateRandomVoxels(source, SOURCE_VOXELS);
+
+    VoxelTree readTree, decodedTree;
+    OctreeElementBag bag;
+    bag.insert(source.getRoot());
+    OctreePacketData packetData;
+    while (!bag.isEmpty()) {
+        packetData.reset();
+        EncodeBitstreamParams params(INT_MAX, IGNORE_VIEW_FRUSTUM, WANT_COLOR, NO_EXISTS_BITS);
+        source.encodeTreeBitstream(bag.extract(), &packetData, bag, params);
+
+        ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+        readTree.readBitstreamToTree(packetData.getUncompressedData(), packetData.getUncompressedSize(), args);
+
+        DecodedVoxelPacket decoded;
+        VoxelPacketDecoder::decodeSection(packetData.getUncompressedData(), packetData.getUncompressedSize(),
+            WANT_COLOR, NO_EXISTS_BITS, decoded);
+        if (decoded.isMalformed) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: well formed section decoded as malformed" << std::endl;
+        }
+        decodedTree.applyDecodedPacket(decoded);
+    }
+    compareTrees(readTree, decodedTree, "uncompressed sections");
+}
+
+void VoxelPacketDecoderTests::packetsMatchReadBitstream() {
+    const int SOURCE_VOXELS = 2000;
+    const int STALE_VOXELS = 500;
+    VoxelTree source;
+    populateRandomVoxels(source, SOURCE_VOXELS);
+
+    // both destinations start with the same voxels that the source doesn't have, which the exists bits should prune
+    VoxelTree readTree, decodedTree;
+    unsigned int seed = rand();
+    srand(seed);
+    populateRandomVoxels(readTree, STALE_VOXELS);
+    srand(seed);
+    populateRandomVoxels(decodedTree, STALE_VOXELS);
+
+    QUuid sourceUUID = QUuid::createUuid();
+    OCTREE_PACKET_SEQUENCE sequence = 0;
+    OctreeElementBag bag;
+    bag.insert(source.getRoot());
+    OctreePacketData packetData(true);
+    int packets = 0;
+    while (!bag.isEmpty()) {
+        packetData.reset();
+        EncodeBitstreamParams params(INT_MAX, IGNORE_VIEW_FRUSTUM, WANT_COLOR, WANT_EXISTS_BITS);
+        source.encodeTreeBitstream(bag.extract(), &packetData, bag, params);
+
+        // lay the packet out as OctreeQueryNode does: flags, sequence, sent time, then the sized, compressed section
+        QByteArray packet = byteArrayWithPopulatedHeader(PacketTypeVoxelData, sourceUUID);
+        OCTREE_PACKET_FLAGS flags = 0;
+        setAtBit(flags, PACKET_IS_COLOR_BIT);
+        setAtBit(flags, PACKET_IS_COMPRESSED_BIT);
+        OCTREE_PACKET_SENT_TIME sentTime = usecTimestampNow();
+        OCTREE_PACKET_INTERNAL_SECTION_SIZE sectionSize = packetData.getFinalizedSize();
+        packet.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+        packet.append(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+        packet.append(reinterpret_cast<const char*>(&sentTime), sizeof(sentTime));
+        packet.append(reinterpret_cast<const char*>(&sectionSize), sizeof(sectionSize));
+        packet.append(reinterpret_cast<const char*>(packetData.getFinalizedData()), sectionSize);
+        sequence++;
+
+        ReadBitstreamToTreeParams args(WANT_COLOR, WANT_EXISTS_BITS, NULL, sourceUUID);
+        readTree.readBitstreamToTree(packetData.getUncompressedData(), packetData.getUncompressedSize(), args);
+
+        DecodedVoxelPacket decoded;
+        if (!VoxelPacketDecoder::decodePacket(packet, sourceUUID, decoded) || decoded.isMalformed ||
+                decoded.sections != 1 || !decoded.isColored) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: packet " << packets << " decoded with "
+                << decoded.sections << " sections, malformed:" << debug::valueOf(decoded.isMalformed) << std::endl;
+        }
+        decodedTree.applyDecodedPacket(decoded);
+        packets++;
+    }
+    compareTrees(readTree, decodedTree, "compressed packets");
+    std::cout << "decoded " << packets << " packets to the same tree as readBitstreamToTree()" << std::endl;
+}
+
+void VoxelPacketDecoderTests::runAllTests() {
+    sectionsMatchReadBitstream();
+    packetsMatchReadBitstream();
+}
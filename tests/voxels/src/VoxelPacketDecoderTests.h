@@ -0,0 +1,23 @@
+//
+//  VoxelPacketDecoderTests.h
+//  voxel-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __tests__VoxelPacketDecoderTests__
+#define __tests__VoxelPacketDecoderTests__
+
+namespace VoxelPacketDecoderTests {
+
+    /// Reads the same sections into one tree with Octree::readBitstreamToTree() and into another by decoding and
+    /// applying them, and compares the trees.
+    void sectionsMatchReadBitstream();
+
+    /// Does the same for whole compressed packets, including the pruning of elements missing from the exists bits.
+    void packetsMatchReadBitstream();
+
+    void runAllTests();
+}
+
+#endif // __tests__VoxelPacketDecoderTests__
@@ -0,0 +1,19 @@
+//
+//  main.cpp
+//  voxel-tests
+//
+
+#include "RayIntersectionTests.h"
+#include "ViewFrustumTests.h"
+#include "VoxelPacketDecoderTests.h"
+#include "VoxelMesherTests.h"
+
+int main(int argc, char** argv) {
+    // an optional persisted world (.svo) to measure merged faces and ray casts against
+    const char* persistFile = argc > 1 ? argv[1] : NULL;
+    VoxelMesherTests::runAllTests(persistFile);
+    ViewFrustumTests::runAllTests();
+    RayIntersectionTests::runAllTests(persistFile);
+    VoxelPacketDecoderTests::runAllTests();
+    return 0;
+}